@@ -0,0 +1,355 @@
+#include "AccelerationStructures.h"
+
+//Standard includes
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+
+namespace dae
+{
+	namespace AccelerationStructures
+	{
+		namespace
+		{
+			//Grid
+			constexpr float cellsPerTriangle{ 2.f };
+			constexpr int maxResolution{ 512 };
+			//Axes shorter than this part of the longest one are treated as flat
+			constexpr float flatExtent{ 1e-3f };
+
+			//Kd-tree, a triangle test costs a few node steps here (pbrt's 80 only made the trees slower, see BVHAnalyzer)
+			constexpr float traversalCost{ 1.f };
+			constexpr float intersectionCost{ 4.f };
+			constexpr float emptyBonus{ .5f };
+			constexpr uint32_t maxLeafSize{ 1 };
+			constexpr uint32_t maxBadRefines{ 3 };
+
+			//Choose
+			constexpr uint32_t minNrTriangles{ 1024 };
+			constexpr float axisAlignedCos{ .999f };
+			constexpr float minAxisAlignedArea{ .9f };
+			constexpr float maxDensityVariation{ 1.f };
+
+			uint32_t GetNrTriangles(const TriangleMesh& mesh)
+			{
+				return static_cast<uint32_t>(mesh.indices.size() / 3);
+			}
+
+			AABB GetTriangleBounds(const TriangleMesh& mesh, uint32_t triangleIdx)
+			{
+				const int* pIndices{ &mesh.indices[triangleIdx * 3] };
+				const Vector3 v0{ mesh.GetTransformedPosition(pIndices[0]) };
+				const Vector3 v1{ mesh.GetTransformedPosition(pIndices[1]) };
+				const Vector3 v2{ mesh.GetTransformedPosition(pIndices[2]) };
+				return AABB{ Vector3::Min(v0, Vector3::Min(v1, v2)), Vector3::Max(v0, Vector3::Max(v1, v2)) };
+			}
+
+			AABB GetTriangleBounds(const TriangleMesh& mesh, std::vector<AABB>& triangleBounds)
+			{
+				AABB meshBounds{};
+				triangleBounds.resize(GetNrTriangles(mesh));
+				for (uint32_t i = 0; i < triangleBounds.size(); ++i)
+				{
+					triangleBounds[i] = GetTriangleBounds(mesh, i);
+					meshBounds = meshBounds.Union(triangleBounds[i]);
+				}
+				return meshBounds;
+			}
+
+#pragma region Grid
+			//Cubic cells of the same volume on every axis the bounds aren't flat along
+			void GetResolution(const AABB& bounds, float nrCells, int resolution[3])
+			{
+				const Vector3 extent{ bounds.max - bounds.min };
+				const float maxExtent{ std::max(extent.x, std::max(extent.y, extent.z)) };
+
+				float volume{ 1.f };
+				int nrAxes{ 0 };
+				for (int a = 0; a < 3; ++a)
+				{
+					resolution[a] = 1;
+					if (extent[a] > flatExtent * maxExtent)
+					{
+						volume *= extent[a];
+						++nrAxes;
+					}
+				}
+				if (nrAxes == 0)
+					return;
+
+				const float cellSide{ std::pow(volume / std::max(nrCells, 1.f), 1.f / nrAxes) };
+				for (int a = 0; a < 3; ++a)
+				{
+					if (extent[a] > flatExtent * maxExtent)
+						resolution[a] = std::clamp(static_cast<int>(std::ceil(extent[a] / cellSide)), 1, maxResolution);
+				}
+			}
+
+			int GetCell(const UniformGrid& grid, int axis, float position)
+			{
+				const int cell{ static_cast<int>((position - grid.minAABB[axis]) * grid.reciprocalCellSize[axis]) };
+				return std::clamp(cell, 0, grid.resolution[axis] - 1);
+			}
+
+			template<typename Function>
+			void ForEachCell(const UniformGrid& grid, const AABB& bounds, const Function& function)
+			{
+				const int minX{ GetCell(grid, 0, bounds.min.x) }, maxX{ GetCell(grid, 0, bounds.max.x) };
+				const int minY{ GetCell(grid, 1, bounds.min.y) }, maxY{ GetCell(grid, 1, bounds.max.y) };
+				const int minZ{ GetCell(grid, 2, bounds.min.z) }, maxZ{ GetCell(grid, 2, bounds.max.z) };
+				for (int z = minZ; z <= maxZ; ++z)
+				{
+					for (int y = minY; y <= maxY; ++y)
+					{
+						for (int x = minX; x <= maxX; ++x)
+							function(static_cast<uint32_t>(x + grid.resolution[0] * (y + grid.resolution[1] * z)));
+					}
+				}
+			}
+#pragma endregion
+
+#pragma region KdTree
+			struct BoundEdge
+			{
+				float t;
+				uint32_t triangleIdx;
+				bool isEnd;
+
+				//Starts before ends at the same position, so a flat triangle on a split is still below it
+				bool operator<(const BoundEdge& other) const
+				{
+					return t == other.t ? isEnd < other.isEnd : t < other.t;
+				}
+			};
+
+			struct KdBuilder
+			{
+				const std::vector<AABB>& triangleBounds;
+				KdTree& tree;
+				uint32_t maxDepth;
+				std::vector<BoundEdge> edges[3]{};	//Reused by every node, a node is done with them before its children are built
+
+				void MakeLeaf(uint32_t nodeIdx, const std::vector<uint32_t>& triangles)
+				{
+					tree.nodes[nodeIdx] = KdNode{ 0.f, KdNode::leafAxis, static_cast<uint32_t>(tree.triangles.size()), static_cast<uint32_t>(triangles.size()) };
+					tree.triangles.insert(tree.triangles.end(), triangles.begin(), triangles.end());
+				}
+
+				void Build(uint32_t nodeIdx, const AABB& nodeBounds, const std::vector<uint32_t>& triangles, uint32_t depth, uint32_t badRefines)
+				{
+					const uint32_t nrTriangles{ static_cast<uint32_t>(triangles.size()) };
+					const float totalArea{ nodeBounds.Area() };
+					if (nrTriangles <= maxLeafSize || depth == maxDepth || totalArea <= 0.f)
+					{
+						MakeLeaf(nodeIdx, triangles);
+						return;
+					}
+
+					//The longest axis first, the others only when it has no split inside the node
+					const Vector3 extent{ nodeBounds.max - nodeBounds.min };
+					int axis{ extent.x > extent.y && extent.x > extent.z ? 0 : extent.y > extent.z ? 1 : 2 };
+					const float leafCost{ intersectionCost * nrTriangles };
+					float bestCost{ INFINITY };
+					int bestAxis{ -1 };
+					uint32_t bestOffset{};
+					for (int retries = 0; retries < 3 && bestAxis == -1; ++retries, axis = (axis + 1) % 3)
+					{
+						std::vector<BoundEdge>& axisEdges{ edges[axis] };
+						axisEdges.resize(2 * nrTriangles);
+						for (uint32_t i = 0; i < nrTriangles; ++i)
+						{
+							const AABB& bounds{ triangleBounds[triangles[i]] };
+							axisEdges[2 * i] = BoundEdge{ bounds.min[axis], triangles[i], false };
+							axisEdges[2 * i + 1] = BoundEdge{ bounds.max[axis], triangles[i], true };
+						}
+						std::sort(axisEdges.begin(), axisEdges.end());
+
+						const int axis1{ (axis + 1) % 3 };
+						const int axis2{ (axis + 2) % 3 };
+						const float sideArea{ extent[axis1] * extent[axis2] };
+						const float perimeter{ extent[axis1] + extent[axis2] };
+						uint32_t nrBelow{ 0 };
+						uint32_t nrAbove{ nrTriangles };
+						for (uint32_t i = 0; i < 2 * nrTriangles; ++i)
+						{
+							if (axisEdges[i].isEnd)
+								--nrAbove;
+
+							const float t{ axisEdges[i].t };
+							if (t > nodeBounds.min[axis] && t < nodeBounds.max[axis])
+							{
+								const float belowArea{ sideArea + (t - nodeBounds.min[axis]) * perimeter };
+								const float aboveArea{ sideArea + (nodeBounds.max[axis] - t) * perimeter };
+								const float bonus{ nrBelow == 0 || nrAbove == 0 ? emptyBonus : 0.f };
+								const float cost{ traversalCost + intersectionCost * (1.f - bonus) * (belowArea * nrBelow + aboveArea * nrAbove) / totalArea };
+								if (cost < bestCost)
+								{
+									bestCost = cost;
+									bestAxis = axis;
+									bestOffset = i;
+								}
+							}
+
+							if (!axisEdges[i].isEnd)
+								++nrBelow;
+						}
+					}
+
+					if (bestCost > leafCost)
+						++badRefines;
+					if ((bestCost > 4.f * leafCost && nrTriangles < 16) || bestAxis == -1 || badRefines == maxBadRefines)
+					{
+						MakeLeaf(nodeIdx, triangles);
+						return;
+					}
+
+					//Triangles starting before the split go below it, the ones ending after it above, straddling ones both
+					const std::vector<BoundEdge>& splitEdges{ edges[bestAxis] };
+					std::vector<uint32_t> below{};
+					std::vector<uint32_t> above{};
+					for (uint32_t i = 0; i < bestOffset; ++i)
+					{
+						if (!splitEdges[i].isEnd)
+							below.push_back(splitEdges[i].triangleIdx);
+					}
+					for (uint32_t i = bestOffset + 1; i < 2 * nrTriangles; ++i)
+					{
+						if (splitEdges[i].isEnd)
+							above.push_back(splitEdges[i].triangleIdx);
+					}
+
+					const float splitPos{ splitEdges[bestOffset].t };
+					const uint32_t childIdx{ static_cast<uint32_t>(tree.nodes.size()) };
+					tree.nodes.resize(childIdx + 2);
+					tree.nodes[nodeIdx] = KdNode{ splitPos, static_cast<uint32_t>(bestAxis), childIdx, 0 };
+
+					AABB belowBounds{ nodeBounds };
+					AABB aboveBounds{ nodeBounds };
+					belowBounds.max[bestAxis] = splitPos;
+					aboveBounds.min[bestAxis] = splitPos;
+					Build(childIdx, belowBounds, below, depth + 1, badRefines);
+					Build(childIdx + 1, aboveBounds, above, depth + 1, badRefines);
+				}
+			};
+#pragma endregion
+		}
+
+		void BuildGrid(TriangleMesh& mesh)
+		{
+			PROFILE_ZONE("AccelerationStructures::BuildGrid");
+			UniformGrid& grid{ mesh.grid };
+			std::vector<AABB> triangleBounds{};
+			const AABB meshBounds{ GetTriangleBounds(mesh, triangleBounds) };
+			const uint32_t nrTriangles{ static_cast<uint32_t>(triangleBounds.size()) };
+
+			grid.minAABB = nrTriangles > 0 ? meshBounds.min : Vector3::Zero;
+			grid.maxAABB = nrTriangles > 0 ? meshBounds.max : Vector3::Zero;
+			GetResolution(AABB{ grid.minAABB, grid.maxAABB }, cellsPerTriangle * nrTriangles, grid.resolution);
+			for (int a = 0; a < 3; ++a)
+			{
+				grid.cellSize[a] = (grid.maxAABB[a] - grid.minAABB[a]) / grid.resolution[a];
+				grid.reciprocalCellSize[a] = grid.cellSize[a] > 0.f ? 1.f / grid.cellSize[a] : 0.f;
+			}
+
+			//Counting sort of the triangles into the cells
+			const uint32_t nrCells{ static_cast<uint32_t>(grid.resolution[0] * grid.resolution[1] * grid.resolution[2]) };
+			grid.cellStarts.assign(nrCells + 1, 0);
+			for (uint32_t i = 0; i < nrTriangles; ++i)
+				ForEachCell(grid, triangleBounds[i], [&](uint32_t cellIdx) { ++grid.cellStarts[cellIdx + 1]; });
+			for (uint32_t cellIdx = 0; cellIdx < nrCells; ++cellIdx)
+				grid.cellStarts[cellIdx + 1] += grid.cellStarts[cellIdx];
+
+			grid.triangles.resize(grid.cellStarts.back());
+			std::vector<uint32_t> nextSlots(grid.cellStarts.begin(), grid.cellStarts.end() - 1);
+			for (uint32_t i = 0; i < nrTriangles; ++i)
+				ForEachCell(grid, triangleBounds[i], [&](uint32_t cellIdx) { grid.triangles[nextSlots[cellIdx]++] = i; });
+		}
+
+		void BuildKdTree(TriangleMesh& mesh)
+		{
+			PROFILE_ZONE("AccelerationStructures::BuildKdTree");
+			KdTree& tree{ mesh.kdTree };
+			std::vector<AABB> triangleBounds{};
+			const AABB meshBounds{ GetTriangleBounds(mesh, triangleBounds) };
+			const uint32_t nrTriangles{ static_cast<uint32_t>(triangleBounds.size()) };
+
+			tree.minAABB = nrTriangles > 0 ? meshBounds.min : Vector3::Zero;
+			tree.maxAABB = nrTriangles > 0 ? meshBounds.max : Vector3::Zero;
+			tree.nodes.assign(1, KdNode{});
+			tree.triangles.clear();
+
+			std::vector<uint32_t> triangles(nrTriangles);
+			for (uint32_t i = 0; i < nrTriangles; ++i)
+				triangles[i] = i;
+
+			//pbrt's depth limit, a few more levels for every doubling of the triangles
+			const uint32_t maxDepth{ std::min(KdTree::maxDepth, static_cast<uint32_t>(std::lround(8.f + 1.3f * std::log2(std::max(nrTriangles, 1u))))) };
+			KdBuilder builder{ triangleBounds, tree, maxDepth };
+			builder.Build(0, AABB{ tree.minAABB, tree.maxAABB }, triangles, 0, 0);
+		}
+
+		AccelerationStructure Choose(const TriangleMesh& mesh)
+		{
+			const uint32_t nrTriangles{ GetNrTriangles(mesh) };
+			if (nrTriangles < minNrTriangles)
+				return AccelerationStructure::BVH;
+
+			//Even density: the occupied cells of a grid with a cell per triangle hold about as many triangles each
+			std::vector<AABB> triangleBounds{};
+			const AABB meshBounds{ GetTriangleBounds(mesh, triangleBounds) };
+			UniformGrid grid{};
+			grid.minAABB = meshBounds.min;
+			GetResolution(meshBounds, static_cast<float>(nrTriangles), grid.resolution);
+			for (int a = 0; a < 3; ++a)
+			{
+				const float cellSize{ (meshBounds.max[a] - meshBounds.min[a]) / grid.resolution[a] };
+				grid.reciprocalCellSize[a] = cellSize > 0.f ? 1.f / cellSize : 0.f;
+			}
+
+			std::vector<uint32_t> cellCounts(static_cast<size_t>(grid.resolution[0]) * grid.resolution[1] * grid.resolution[2]);
+			for (const AABB& bounds : triangleBounds)
+			{
+				const Vector3 center{ (bounds.min + bounds.max) * .5f };
+				++cellCounts[GetCell(grid, 0, center.x) + grid.resolution[0] * (GetCell(grid, 1, center.y) + grid.resolution[1] * GetCell(grid, 2, center.z))];
+			}
+
+			double sum{ 0. };
+			double sumOfSquares{ 0. };
+			uint32_t nrOccupied{ 0 };
+			for (uint32_t count : cellCounts)
+			{
+				if (count == 0)
+					continue;
+				sum += count;
+				sumOfSquares += static_cast<double>(count) * count;
+				++nrOccupied;
+			}
+			const double mean{ sum / nrOccupied };
+			const double deviation{ std::sqrt(std::max(sumOfSquares / nrOccupied - mean * mean, 0.)) };
+			if (deviation <= maxDensityVariation * mean)
+				return AccelerationStructure::Grid;
+
+			//Voxel like: most of the surface faces along an axis
+			double totalArea{ 0. };
+			double alignedArea{ 0. };
+			for (uint32_t i = 0; i < nrTriangles; ++i)
+			{
+				const int* pIndices{ &mesh.indices[i * 3] };
+				const Vector3 v0{ mesh.GetTransformedPosition(pIndices[0]) };
+				const Vector3 cross{ Vector3::Cross(mesh.GetTransformedPosition(pIndices[1]) - v0, mesh.GetTransformedPosition(pIndices[2]) - v0) };
+				const float area{ cross.Magnitude() };
+				if (area <= 0.f)
+					continue;
+
+				totalArea += area;
+				const float maxCos{ std::max(std::abs(cross.x), std::max(std::abs(cross.y), std::abs(cross.z))) / area };
+				if (maxCos >= axisAlignedCos)
+					alignedArea += area;
+			}
+			return alignedArea >= minAxisAlignedArea * totalArea ? AccelerationStructure::KdTree : AccelerationStructure::BVH;
+		}
+	}
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+
+namespace dae
+{
+	struct TriangleMesh;
+	enum class AccelerationStructure : uint32_t;
+
+	//Alternatives to the BVH that HitTest_TriangleMesh can traverse instead (TriangleMesh::accelerationStructure)
+	//Both are built over the transformed triangles, TriangleMesh::UpdateAccelerationStructure calls them
+	namespace AccelerationStructures
+	{
+		/**
+		 * \brief Builds TriangleMesh::grid with about cellsPerTriangle cells for every triangle, cubic where the mesh has volume
+		 * Axes the mesh is flat along get a single cell, so a heightfield becomes a 2D grid.
+		 */
+		void BuildGrid(TriangleMesh& mesh);
+
+		/**
+		 * \brief Builds TriangleMesh::kdTree with the SAH, sweeping the sorted triangle bounds of every axis (pbrt's KdTreeAccel)
+		 * Triangles straddling a split are listed on both sides, slower to build than the BVH and it allocates.
+		 */
+		void BuildKdTree(TriangleMesh& mesh);
+
+		/**
+		 * \brief Picks the structure that should traverse fastest for the shape of the mesh
+		 * An even triangle density gets the grid, otherwise mostly axis aligned triangles get the kd-tree (its splits fall between them),
+		 * everything else (and small meshes) the BVH.
+		 */
+		AccelerationStructure Choose(const TriangleMesh& mesh);
+	}
+}
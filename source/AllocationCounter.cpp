@@ -0,0 +1,57 @@
+#include "AllocationCounter.h"
+
+#ifdef COUNT_HEAP_ALLOCATIONS
+//Standard includes
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+	std::atomic<uint64_t> g_NrAllocations{ 0 };
+	thread_local int g_IgnoreDepth{ 0 };
+}
+
+//The array and nothrow versions call these two, aligned allocations aren't counted
+void* operator new(size_t size)
+{
+	if (g_IgnoreDepth == 0)
+		g_NrAllocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (void* pMemory{ std::malloc(size != 0 ? size : 1) })
+		return pMemory;
+	throw std::bad_alloc{};
+}
+
+void operator delete(void* pMemory) noexcept
+{
+	std::free(pMemory);
+}
+
+//Sized deallocation (C++14) would otherwise go to the default one, which doesn't have to end up in the delete above
+void operator delete(void* pMemory, size_t) noexcept
+{
+	std::free(pMemory);
+}
+
+namespace dae
+{
+	namespace AllocationCounter
+	{
+		uint64_t GetCount()
+		{
+			return g_NrAllocations.load(std::memory_order_relaxed);
+		}
+
+		ScopedIgnore::ScopedIgnore()
+		{
+			++g_IgnoreDepth;
+		}
+
+		ScopedIgnore::~ScopedIgnore()
+		{
+			--g_IgnoreDepth;
+		}
+	}
+}
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+
+//Replaces the global operator new with one that counts, Renderer::Render aborts when a frame still allocates after warming up
+//Works in Release too, only meant for checking the hot path (PARALLEL_FOR, ASYNC creates futures every frame)
+//Scenes with an OutOfCoreMesh page in by design and will trip it
+//#define COUNT_HEAP_ALLOCATIONS
+
+namespace dae
+{
+	namespace AllocationCounter
+	{
+#ifdef COUNT_HEAP_ALLOCATIONS
+		//Allocations on all threads since the start, except the ones made under a ScopedIgnore
+		uint64_t GetCount();
+
+		//Allocations of this thread aren't counted while it lives (screenshots, the image writer, ...)
+		class ScopedIgnore final
+		{
+		public:
+			ScopedIgnore();
+			~ScopedIgnore();
+
+			ScopedIgnore(const ScopedIgnore&) = delete;
+			ScopedIgnore(ScopedIgnore&&) noexcept = delete;
+			ScopedIgnore& operator=(const ScopedIgnore&) = delete;
+			ScopedIgnore& operator=(ScopedIgnore&&) noexcept = delete;
+		};
+#else
+		inline uint64_t GetCount() { return 0; }
+
+		//User provided constructor and destructor, so a local of it isn't an unused variable
+		class ScopedIgnore final
+		{
+		public:
+			ScopedIgnore() {}
+			~ScopedIgnore() {}
+
+			ScopedIgnore(const ScopedIgnore&) = delete;
+			ScopedIgnore(ScopedIgnore&&) noexcept = delete;
+			ScopedIgnore& operator=(const ScopedIgnore&) = delete;
+			ScopedIgnore& operator=(ScopedIgnore&&) noexcept = delete;
+		};
+#endif
+	}
+}
@@ -0,0 +1,486 @@
+//Quality report of the BVH of an OBJ, built by every builder with every combination of the given settings,
+//followed by the grid and kd-tree against the fastest BVH of the sweep
+//Separate executable (BVHAnalyzer.vcxproj) without SDL, so it also builds on Linux:
+//	g++ -std=c++20 -O2 -pthread BVHAnalyzer.cpp AccelerationStructures.cpp LinearBVH.cpp SpatialSplitBVH.cpp TreeletOptimizer.cpp MeshOptimizer.cpp Vector2.cpp Vector3.cpp Vector4.cpp Matrix.cpp ScratchArena.cpp OBJParser.cpp MappedFile.cpp Profiler.cpp AllocationCounter.cpp -o BVHAnalyzer
+//Usage: BVHAnalyzer mesh.obj [--bins n,n,...] [--leaf n,n,...] [--rays n] [--seed n]
+
+//Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+#include "MeshOptimizer.h"
+#include "TreeletOptimizer.h"
+#include "Utils.h"
+
+using namespace dae;
+
+namespace
+{
+	struct Settings
+	{
+		std::string filename{};
+		std::vector<uint32_t> binCounts{ 4, 8, 10, 16, 32 };
+		std::vector<uint32_t> leafSizes{ 1, 2, 4, 8 };
+		uint32_t nrRays{ 100000 };	//Same rays for every build, see MeshOptimizer::GenerateTestRays
+		uint32_t seed{ 1 };
+	};
+
+	//Every builder a TriangleMesh can use, add new ones here to get them in the report
+	struct Builder
+	{
+		const char* pName;
+		std::function<void(TriangleMesh&)> build;
+	};
+
+	std::vector<Builder> GetBuilders()
+	{
+		return {
+			{ "BinnedSAH", [](TriangleMesh& mesh) { mesh.BuildBVH(); } },
+			{ "Linear", [](TriangleMesh& mesh) { mesh.bvhSettings.builder = BVHBuilder::Linear; mesh.BuildBVH(); } },
+			{ "Linear+SAH3", [](TriangleMesh& mesh) { mesh.bvhSettings.builder = BVHBuilder::Linear; mesh.bvhSettings.sahLevels = 3; mesh.BuildBVH(); } },
+			{ "SpatialSAH", [](TriangleMesh& mesh) { mesh.bvhSettings.builder = BVHBuilder::SpatialSAH; mesh.BuildBVH(); } },
+			{ "SAH+Treelet", [](TriangleMesh& mesh) { mesh.bvhSettings.treeletSize = 7; mesh.BuildBVH(); TreeletOptimizer::Optimize(mesh); } },
+			{ "Linear+Tree", [](TriangleMesh& mesh) { mesh.bvhSettings.builder = BVHBuilder::Linear; mesh.bvhSettings.treeletSize = 7; mesh.BuildBVH(); TreeletOptimizer::Optimize(mesh); } }
+		};
+	}
+
+	//Costs of the SAH estimate, relative to one slab test
+	constexpr float traversalCost{ 1.f };
+	constexpr float intersectionCost{ 1.f };
+
+	constexpr uint32_t nrLeafSizeBuckets{ 7 };	//1, 2, 3-4, 5-8, 9-16, 17-32, 33+
+	const char* const leafSizeBucketNames[nrLeafSizeBuckets]{ "1", "2", "3-4", "5-8", "9-16", "17-32", "33+" };
+
+	struct Report
+	{
+		double buildMs{};
+		float sahCost{};
+		uint32_t nrNodes{};
+		uint32_t nrLeaves{};
+		uint32_t maxDepth{};
+		float averageLeafDepth{};
+		std::vector<uint32_t> leavesPerDepth{};
+		uint32_t leavesPerSize[nrLeafSizeBuckets]{};
+		float averageLeafSize{};
+		float averageSiblingOverlap{};	//Surface area of the overlap of both children, relative to their parent
+		size_t usedBytes{};
+		size_t reservedBytes{};
+		uint32_t nrDuplicates{};	//Extra triangle references of spatial splits
+		float nodesPerRay{};
+		float trianglesPerRay{};
+		double nsPerRay{};
+		float hitRate{};
+	};
+
+#pragma region Tree statistics
+	float SurfaceArea(const Vector3& minAABB, const Vector3& maxAABB)
+	{
+		const Vector3 extent{ maxAABB - minAABB };
+		if (extent.x < 0.f || extent.y < 0.f || extent.z < 0.f)
+			return 0.f;
+		return 2.f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+	}
+
+	uint32_t GetLeafSizeBucket(uint32_t nrPrimitives)
+	{
+		uint32_t bucket{ 0 };
+		for (uint32_t size{ 1 }; size < nrPrimitives && bucket < nrLeafSizeBuckets - 1; size *= 2)
+			++bucket;
+		return bucket;
+	}
+
+	void AnalyzeTree(const TriangleMesh& mesh, Report& report)
+	{
+		const BVHNode& root{ mesh.bvhNodes[mesh.rootNodeIdx] };
+		const float rootArea{ SurfaceArea(root.minAABB, root.maxAABB) };
+
+		uint64_t totalLeafDepth{ 0 };
+		uint64_t totalLeafSize{ 0 };
+		float totalOverlap{ 0.f };
+		uint32_t nrInternalNodes{ 0 };
+
+		struct Entry
+		{
+			uint32_t nodeIdx;
+			uint32_t depth;
+		};
+		std::vector<Entry> stack{ { mesh.rootNodeIdx, 0 } };
+		while (!stack.empty())
+		{
+			const Entry entry{ stack.back() };
+			stack.pop_back();
+
+			const BVHNode& node{ mesh.bvhNodes[entry.nodeIdx] };
+			const float relativeArea{ rootArea > 0.f ? SurfaceArea(node.minAABB, node.maxAABB) / rootArea : 1.f };
+			++report.nrNodes;
+			report.maxDepth = std::max(report.maxDepth, entry.depth);
+
+			if (node.nrPrimitives != 0)
+			{
+				report.sahCost += relativeArea * intersectionCost * node.nrPrimitives;
+				++report.nrLeaves;
+				totalLeafDepth += entry.depth;
+				totalLeafSize += node.nrPrimitives;
+				++report.leavesPerSize[GetLeafSizeBucket(node.nrPrimitives)];
+
+				if (report.leavesPerDepth.size() <= entry.depth)
+					report.leavesPerDepth.resize(entry.depth + 1);
+				++report.leavesPerDepth[entry.depth];
+				continue;
+			}
+
+			report.sahCost += relativeArea * traversalCost;
+			++nrInternalNodes;
+
+			const BVHNode& left{ mesh.bvhNodes[node.leftFirst] };
+			const BVHNode& right{ mesh.bvhNodes[node.leftFirst + 1] };
+			const float parentArea{ SurfaceArea(node.minAABB, node.maxAABB) };
+			if (parentArea > 0.f)
+			{
+				const Vector3 overlapMin{ Vector3::Max(left.minAABB, right.minAABB) };
+				const Vector3 overlapMax{ Vector3::Min(left.maxAABB, right.maxAABB) };
+				totalOverlap += SurfaceArea(overlapMin, overlapMax) / parentArea;
+			}
+
+			stack.push_back({ node.leftFirst, entry.depth + 1 });
+			stack.push_back({ node.leftFirst + 1, entry.depth + 1 });
+		}
+
+		report.averageLeafDepth = report.nrLeaves > 0 ? static_cast<float>(totalLeafDepth) / report.nrLeaves : 0.f;
+		report.averageLeafSize = report.nrLeaves > 0 ? static_cast<float>(totalLeafSize) / report.nrLeaves : 0.f;
+		report.averageSiblingOverlap = nrInternalNodes > 0 ? totalOverlap / nrInternalNodes : 0.f;
+		report.usedBytes = mesh.nodesUsed * sizeof(BVHNode) + mesh.bvhReferences.size() * sizeof(uint32_t);
+		report.reservedBytes = mesh.bvhNodes.capacity() * sizeof(BVHNode) + mesh.bvhReferences.capacity() * sizeof(uint32_t);
+		report.nrDuplicates = mesh.bvhReferences.empty() ? 0 : static_cast<uint32_t>(mesh.bvhReferences.size()) - mesh.trCount;
+	}
+#pragma endregion
+
+#pragma region Traversal
+	//Same order and culling as GeometryUtils::IntersectBVH, but counts instead of collecting the leaves
+	void CountTraversal(const Ray& ray, const TriangleMesh& mesh, uint32_t nodeIdx, uint64_t& nrNodes, uint64_t& nrTriangles)
+	{
+		++nrNodes;
+		const BVHNode& node{ mesh.bvhNodes[nodeIdx] };
+		if (!GeometryUtils::SlabTest(node.minAABB, node.maxAABB, ray))
+			return;
+
+		if (node.nrPrimitives != 0)
+		{
+			nrTriangles += node.nrPrimitives;
+			return;
+		}
+
+		CountTraversal(ray, mesh, node.leftFirst, nrNodes, nrTriangles);
+		CountTraversal(ray, mesh, node.leftFirst + 1, nrNodes, nrTriangles);
+	}
+
+	//Closest hits through HitTest_TriangleMesh, whatever structure the mesh uses
+	void MeasureHitTests(const TriangleMesh& mesh, const std::vector<Ray>& rays, Report& report)
+	{
+		//Best of a few runs, the first one also warms the caches
+		constexpr int nrTrials{ 3 };
+		double bestSeconds{ std::numeric_limits<double>::max() };
+		uint32_t nrHits{ 0 };
+		for (int trial{ 0 }; trial < nrTrials; ++trial)
+		{
+			nrHits = 0;
+			const auto startTime{ std::chrono::steady_clock::now() };
+			for (const Ray& ray : rays)
+			{
+				HitRecord hitRecord{};
+				if (GeometryUtils::HitTest_TriangleMesh(mesh, ray, hitRecord))
+					++nrHits;
+			}
+			bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count());
+		}
+
+		report.nsPerRay = bestSeconds * 1e9 / rays.size();
+		report.hitRate = static_cast<float>(nrHits) / rays.size();
+	}
+
+	void MeasureTraversal(const TriangleMesh& mesh, const std::vector<Ray>& rays, Report& report)
+	{
+		uint64_t nrNodes{ 0 };
+		uint64_t nrTriangles{ 0 };
+		for (const Ray& ray : rays)
+			CountTraversal(ray, mesh, mesh.rootNodeIdx, nrNodes, nrTriangles);
+
+		report.nodesPerRay = static_cast<float>(nrNodes) / rays.size();
+		report.trianglesPerRay = static_cast<float>(nrTriangles) / rays.size();
+		MeasureHitTests(mesh, rays, report);
+	}
+#pragma endregion
+
+#pragma region Acceleration structures
+	const char* GetName(AccelerationStructure accelerationStructure)
+	{
+		switch (accelerationStructure)
+		{
+		case AccelerationStructure::Grid:
+			return "Grid";
+		case AccelerationStructure::KdTree:
+			return "KdTree";
+		case AccelerationStructure::Automatic:
+			return "Automatic";
+		default:
+			return "BVH";
+		}
+	}
+
+	//Builder and settings of the sweep with the lowest ns/ray, what the grid and kd-tree have to beat
+	struct FastestBVH
+	{
+		const Builder* pBuilder{};
+		BVHBuildSettings bvhSettings{};
+		double nsPerRay{ std::numeric_limits<double>::max() };
+	};
+
+	//Every structure HitTest_TriangleMesh can traverse, built from scratch, the BVH like the fastest one of the sweep
+	void CompareAccelerationStructures(const TriangleMesh& mesh, const std::vector<Ray>& rays, const FastestBVH& fastestBVH)
+	{
+		std::cout << "\nAcceleration structures (BVH: " << fastestBVH.pBuilder->pName << ", " << fastestBVH.bvhSettings.binCount << " bins, leaf " << fastestBVH.bvhSettings.leafSize
+			<< "), Automatic picks " << GetName(AccelerationStructures::Choose(mesh)) << "\n\n";
+		std::cout << std::left
+			<< std::setw(12) << "structure"
+			<< std::right
+			<< std::setw(10) << "build ms"
+			<< std::setw(12) << "cells/nodes"
+			<< std::setw(10) << "refs"
+			<< std::setw(9) << "KB"
+			<< std::setw(9) << "hit %"
+			<< std::setw(9) << "ns/ray" << '\n';
+
+		for (AccelerationStructure accelerationStructure : { AccelerationStructure::BVH, AccelerationStructure::Grid, AccelerationStructure::KdTree })
+		{
+			TriangleMesh buildMesh{ mesh };
+			buildMesh.bvhSettings.binCount = fastestBVH.bvhSettings.binCount;
+			buildMesh.bvhSettings.leafSize = fastestBVH.bvhSettings.leafSize;
+
+			Report report{};
+			const auto startTime{ std::chrono::steady_clock::now() };
+			size_t nrElements{};
+			size_t nrReferences{};
+			size_t usedBytes{};
+			if (accelerationStructure == AccelerationStructure::Grid)
+			{
+				AccelerationStructures::BuildGrid(buildMesh);
+				nrElements = buildMesh.grid.cellStarts.size() - 1;
+				nrReferences = buildMesh.grid.triangles.size();
+				usedBytes = (buildMesh.grid.cellStarts.size() + nrReferences) * sizeof(uint32_t);
+			}
+			else if (accelerationStructure == AccelerationStructure::KdTree)
+			{
+				AccelerationStructures::BuildKdTree(buildMesh);
+				nrElements = buildMesh.kdTree.nodes.size();
+				nrReferences = buildMesh.kdTree.triangles.size();
+				usedBytes = nrElements * sizeof(KdNode) + nrReferences * sizeof(uint32_t);
+			}
+			else
+			{
+				buildMesh.bvhNodes = {};
+				buildMesh.InitBVH();
+				fastestBVH.pBuilder->build(buildMesh);
+				nrElements = buildMesh.nodesUsed;
+				nrReferences = buildMesh.bvhReferences.empty() ? buildMesh.trCount : buildMesh.bvhReferences.size();
+				usedBytes = buildMesh.nodesUsed * sizeof(BVHNode);
+			}
+			report.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+			//Same transform as the build, so this only selects the structure
+			buildMesh.accelerationStructure = accelerationStructure;
+			buildMesh.accelerationTransform = buildMesh.rotationTransform * buildMesh.translationTransform * buildMesh.scaleTransform;
+			MeasureHitTests(buildMesh, rays, report);
+
+			std::cout << std::left << std::fixed
+				<< std::setw(12) << GetName(accelerationStructure)
+				<< std::right
+				<< std::setw(10) << std::setprecision(2) << report.buildMs
+				<< std::setw(12) << nrElements
+				<< std::setw(10) << nrReferences
+				<< std::setw(9) << usedBytes / 1024
+				<< std::setw(9) << std::setprecision(1) << report.hitRate * 100.f
+				<< std::setw(9) << std::setprecision(1) << report.nsPerRay << '\n';
+		}
+	}
+#pragma endregion
+
+#pragma region Output
+	void PrintHeader()
+	{
+		std::cout << std::left
+			<< std::setw(12) << "builder"
+			<< std::right
+			<< std::setw(6) << "bins"
+			<< std::setw(6) << "leaf"
+			<< std::setw(10) << "build ms"
+			<< std::setw(10) << "SAH"
+			<< std::setw(9) << "nodes"
+			<< std::setw(7) << "depth"
+			<< std::setw(8) << "avg"
+			<< std::setw(8) << "tris"
+			<< std::setw(9) << "overlap"
+			<< std::setw(9) << "KB"
+			<< std::setw(10) << "nodes/ray"
+			<< std::setw(9) << "tris/ray"
+			<< std::setw(9) << "ns/ray" << '\n';
+	}
+
+	void PrintReport(const char* pBuilder, const BVHBuildSettings& bvhSettings, const Report& report)
+	{
+		std::cout << std::left << std::fixed
+			<< std::setw(12) << pBuilder
+			<< std::right
+			<< std::setw(6) << bvhSettings.binCount
+			<< std::setw(6) << bvhSettings.leafSize
+			<< std::setw(10) << std::setprecision(2) << report.buildMs
+			<< std::setw(10) << std::setprecision(2) << report.sahCost
+			<< std::setw(9) << report.nrNodes
+			<< std::setw(7) << report.maxDepth
+			<< std::setw(8) << std::setprecision(1) << report.averageLeafDepth
+			<< std::setw(8) << std::setprecision(2) << report.averageLeafSize
+			<< std::setw(9) << std::setprecision(3) << report.averageSiblingOverlap
+			<< std::setw(9) << report.usedBytes / 1024
+			<< std::setw(10) << std::setprecision(1) << report.nodesPerRay
+			<< std::setw(9) << std::setprecision(1) << report.trianglesPerRay
+			<< std::setw(9) << std::setprecision(1) << report.nsPerRay << '\n';
+	}
+
+	void PrintHistograms(const Report& report)
+	{
+		std::cout << "    leaves per depth:";
+		for (size_t depth{ 0 }; depth < report.leavesPerDepth.size(); ++depth)
+		{
+			if (report.leavesPerDepth[depth] != 0)
+				std::cout << ' ' << depth << ':' << report.leavesPerDepth[depth];
+		}
+
+		std::cout << "\n    leaves per size: ";
+		for (uint32_t bucket{ 0 }; bucket < nrLeafSizeBuckets; ++bucket)
+			std::cout << ' ' << leafSizeBucketNames[bucket] << ':' << report.leavesPerSize[bucket];
+
+		std::cout << "\n    " << report.nrLeaves << " leaves, " << report.nrDuplicates << " duplicated triangles, " << report.reservedBytes / 1024 << " KB reserved, "
+			<< std::setprecision(1) << report.hitRate * 100.f << "% of the rays hit\n";
+	}
+#pragma endregion
+
+	bool ParseList(const char* pText, std::vector<uint32_t>& values)
+	{
+		values.clear();
+		std::stringstream stream{ pText };
+		std::string value{};
+		while (std::getline(stream, value, ','))
+		{
+			const uint32_t number{ static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10)) };
+			if (number == 0)
+				return false;
+			values.push_back(number);
+		}
+		return !values.empty();
+	}
+
+	bool ParseCommandLine(int argc, char* args[], Settings& settings)
+	{
+		bool isValid{ true };
+		for (int i = 1; i < argc && isValid; ++i)
+		{
+			const bool hasValue{ i + 1 < argc };
+			if (std::strcmp(args[i], "--bins") == 0 && hasValue)
+				isValid = ParseList(args[++i], settings.binCounts);
+			else if (std::strcmp(args[i], "--leaf") == 0 && hasValue)
+				isValid = ParseList(args[++i], settings.leafSizes);
+			else if (std::strcmp(args[i], "--rays") == 0 && hasValue)
+				settings.nrRays = std::max(static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10)), 1u);
+			else if (std::strcmp(args[i], "--seed") == 0 && hasValue)
+				settings.seed = static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10));
+			else if (args[i][0] != '-' && settings.filename.empty())
+				settings.filename = args[i];
+			else
+				isValid = false;
+		}
+
+		if (!isValid || settings.filename.empty())
+		{
+			std::cout << "Usage: BVHAnalyzer mesh.obj [--bins n,n,...] [--leaf n,n,...] [--rays n] [--seed n]\n";
+			return false;
+		}
+		return true;
+	}
+
+	//Loaded the way MeshCache does on a cache miss, so the analyzed tree is the one the renderer gets
+	bool LoadMesh(const std::string& filename, TriangleMesh& mesh)
+	{
+		if (!Utils::ParseOBJ(filename, mesh.positions, mesh.normals, mesh.indices, mesh.texcoords))
+			return false;
+
+		MeshOptimizer::PrintStats(MeshOptimizer::Optimize(mesh));
+		mesh.CalculateCentroids();
+		mesh.shouldUseBVH = true;
+		mesh.UpdateTransforms();
+		return mesh.trCount > 0;
+	}
+}
+
+int main(int argc, char* args[])
+{
+	Settings settings{};
+	if (!ParseCommandLine(argc, args, settings))
+		return 1;
+
+	TriangleMesh mesh{};
+	if (!LoadMesh(settings.filename, mesh))
+	{
+		std::cout << "Can't load " << settings.filename << '\n';
+		return 1;
+	}
+
+	//Aimed at the mesh bounds, which every builder agrees on
+	const std::vector<Ray> rays{ MeshOptimizer::GenerateTestRays(mesh, settings.nrRays, settings.seed) };
+	std::cout << settings.filename << ": " << mesh.trCount << " triangles, " << rays.size() << " rays, seed " << settings.seed << "\n\n";
+	PrintHeader();
+
+	const std::vector<Builder> builders{ GetBuilders() };
+	FastestBVH fastestBVH{};
+	for (const Builder& builder : builders)
+	{
+		for (uint32_t binCount : settings.binCounts)
+		{
+			for (uint32_t leafSize : settings.leafSizes)
+			{
+				TriangleMesh buildMesh{ mesh };
+				buildMesh.bvhSettings.binCount = std::clamp(binCount, 2u, BVHBuildSettings::maxBinCount);
+				buildMesh.bvhSettings.leafSize = leafSize;
+				buildMesh.bvhNodes = {};
+				buildMesh.InitBVH();
+
+				Report report{};
+				const auto startTime{ std::chrono::steady_clock::now() };
+				builder.build(buildMesh);
+				report.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+				buildMesh.UpdateTransforms();
+
+				AnalyzeTree(buildMesh, report);
+				MeasureTraversal(buildMesh, rays, report);
+				PrintReport(builder.pName, buildMesh.bvhSettings, report);
+				PrintHistograms(report);
+
+				if (report.nsPerRay < fastestBVH.nsPerRay)
+					fastestBVH = FastestBVH{ &builder, buildMesh.bvhSettings, report.nsPerRay };
+			}
+		}
+	}
+
+	CompareAccelerationStructures(mesh, rays, fastestBVH);
+	return 0;
+}
@@ -0,0 +1,406 @@
+#include "Benchmark.h"
+
+//External includes
+#include "SDL.h"
+#include "SDL_surface.h"
+
+//Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <ppl.h>
+#include <thread>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+#include "Numa.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Timer.h"
+#include "TraversalStats.h"
+
+namespace dae
+{
+	namespace Benchmark
+	{
+		namespace
+		{
+			using Clock = std::chrono::steady_clock;
+
+			struct NumaResult
+			{
+				uint32_t nrNodes{};
+				bool isAvailable{ false };	//The system has this many nodes
+				uint32_t nrWorkers{};
+				double meanFrameMs{};
+			};
+
+			struct ShadowSortingResult
+			{
+				bool isMeasured{ false };
+				double meanFrameMs{};
+				TraversalStats::Totals traversalTotals{};	//Only with TRAVERSAL_STATS
+			};
+
+			//NUMA scaling is measured at these node counts
+			constexpr uint32_t numaNodeCounts[]{ 1, 2, 4 };
+
+			struct SceneResult
+			{
+				std::string name{};
+				double initializeMs{};
+				double bvhBuildMs{};
+				uint32_t nrMeshes{};
+				uint64_t nrTriangles{};
+				uint64_t nrPrimaryRaysPerFrame{};
+				uint64_t nrShadowRaysPerFrame{};
+				std::vector<double> frameMs{};	//Sorted
+				TraversalStats::Totals traversalTotals{};	//Of the timed frames, only with TRAVERSAL_STATS
+				std::vector<NumaResult> numaResults{};
+				ShadowSortingResult shadowSorting{};
+			};
+
+			template<typename T>
+			SceneEntry MakeEntry(const char* pName)
+			{
+				return { pName, [] { return std::unique_ptr<Scene>{ std::make_unique<T>() }; } };
+			}
+
+			double ToMilliseconds(Clock::duration duration)
+			{
+				return std::chrono::duration<double, std::milli>(duration).count();
+			}
+
+			//Nearest rank
+			double Percentile(const std::vector<double>& sorted, double percentile)
+			{
+				if (sorted.empty())
+					return 0.0;
+				const size_t rank{ static_cast<size_t>(std::ceil(percentile / 100.0 * sorted.size())) };
+				return sorted[std::clamp(rank, size_t(1), sorted.size()) - 1];
+			}
+
+			//Scenes load their meshes from the BVH cache, so the builder is timed on copies of the loaded meshes
+			double MeasureBVHBuild(const Scene& scene, uint64_t& nrTriangles)
+			{
+				double buildMs{ 0.0 };
+				for (const TriangleMesh& mesh : scene.GetTriangleMeshGeometries())
+				{
+					nrTriangles += mesh.trCount;
+					if (!mesh.shouldUseBVH || mesh.isCompact || mesh.trCount == 0)
+						continue;
+
+					TriangleMesh copy{ mesh };
+					copy.bvhNodes = {};
+
+					const auto start{ Clock::now() };
+					copy.InitBVH();
+					copy.BuildBVH();
+					buildMs += ToMilliseconds(Clock::now() - start);
+				}
+				return buildMs;
+			}
+
+			//Every processor of the first nrNodes nodes renders, --threads doesn't apply
+			NumaResult MeasureNuma(Scene& scene, const Settings& settings, Renderer& renderer, uint32_t nrNodes)
+			{
+				NumaResult result{};
+				result.nrNodes = nrNodes;
+				result.isAvailable = nrNodes <= Numa::GetNodes().size();
+				if (!result.isAvailable)
+					return result;
+
+				renderer.SetNuma(Numa::Settings{ nrNodes, true, settings.isReplicated });
+				result.nrWorkers = renderer.GetNrNumaWorkers();
+
+				for (uint32_t i = 0; i < settings.nrWarmupFrames; ++i)
+					renderer.Render(&scene);
+
+				const auto start{ Clock::now() };
+				for (uint32_t i = 0; i < settings.nrFrames; ++i)
+					renderer.Render(&scene);
+				result.meanFrameMs = ToMilliseconds(Clock::now() - start) / settings.nrFrames;
+
+				renderer.SetNuma(Numa::Settings{});
+				scene.PrepareReplicas(0);
+				return result;
+			}
+
+			//The same frames again with the shadow rays of every tile sorted, the image doesn't change
+			ShadowSortingResult MeasureShadowSorting(Scene& scene, const Settings& settings, Renderer& renderer)
+			{
+				ShadowSortingResult result{};
+				result.isMeasured = true;
+				renderer.SetShadowRaySorting(true);
+
+				for (uint32_t i = 0; i < settings.nrWarmupFrames; ++i)
+					renderer.Render(&scene);
+
+				TraversalStats::ExchangeTotals();
+				const auto start{ Clock::now() };
+				for (uint32_t i = 0; i < settings.nrFrames; ++i)
+					renderer.Render(&scene);
+				result.meanFrameMs = ToMilliseconds(Clock::now() - start) / settings.nrFrames;
+				result.traversalTotals = TraversalStats::ExchangeTotals();
+
+				renderer.SetShadowRaySorting(false);
+				return result;
+			}
+
+			SceneResult RunScene(const SceneEntry& entry, const Settings& settings, Renderer& renderer)
+			{
+				SceneResult result{};
+				result.name = entry.pName;
+				std::cout << "Benchmarking " << entry.pName << std::endl;
+
+				Timer timer{};
+				timer.SetFixedTime(settings.animationTime);
+
+				const auto initializeStart{ Clock::now() };
+				std::unique_ptr<Scene> pScene{ entry.create() };
+				pScene->Initialize();
+				result.initializeMs = ToMilliseconds(Clock::now() - initializeStart);
+
+				result.nrMeshes = static_cast<uint32_t>(pScene->GetTriangleMeshGeometries().size());
+				result.bvhBuildMs = MeasureBVHBuild(*pScene, result.nrTriangles);
+
+				//The same animation time every frame, so every frame traces the same rays
+				pScene->Update(&timer);
+
+				for (uint32_t i = 0; i < settings.nrWarmupFrames; ++i)
+					renderer.Render(pScene.get());
+
+				result.frameMs.reserve(settings.nrFrames);
+				TraversalStats::ExchangeTotals();
+				for (uint32_t i = 0; i < settings.nrFrames; ++i)
+				{
+					const auto frameStart{ Clock::now() };
+					renderer.Render(pScene.get());
+					result.frameMs.push_back(ToMilliseconds(Clock::now() - frameStart));
+				}
+				std::sort(result.frameMs.begin(), result.frameMs.end());
+				result.traversalTotals = TraversalStats::ExchangeTotals();
+
+				result.nrPrimaryRaysPerFrame = renderer.GetNrPrimaryRays();
+				result.nrShadowRaysPerFrame = renderer.GetNrShadowRays();
+
+				if (settings.isNumaScaling)
+				{
+					for (uint32_t nrNodes : numaNodeCounts)
+						result.numaResults.push_back(MeasureNuma(*pScene, settings, renderer, nrNodes));
+				}
+
+				if (settings.isShadowSorting)
+					result.shadowSorting = MeasureShadowSorting(*pScene, settings, renderer);
+				return result;
+			}
+
+			void WriteScene(std::ofstream& file, const SceneResult& result)
+			{
+				const double totalSeconds{ std::accumulate(result.frameMs.begin(), result.frameMs.end(), 0.0) / 1000.0 };
+				const double nrFrames{ static_cast<double>(result.frameMs.size()) };
+				const double primaryMrays{ totalSeconds > 0.0 ? result.nrPrimaryRaysPerFrame * nrFrames / totalSeconds / 1e6 : 0.0 };
+				const double shadowMrays{ totalSeconds > 0.0 ? result.nrShadowRaysPerFrame * nrFrames / totalSeconds / 1e6 : 0.0 };
+
+				file << "\t\t{\n"
+					<< "\t\t\t\"name\": \"" << result.name << "\",\n"
+					<< "\t\t\t\"meshes\": " << result.nrMeshes << ",\n"
+					<< "\t\t\t\"triangles\": " << result.nrTriangles << ",\n"
+					<< "\t\t\t\"initializeMs\": " << result.initializeMs << ",\n"
+					<< "\t\t\t\"bvhBuildMs\": " << result.bvhBuildMs << ",\n"
+					<< "\t\t\t\"primaryRaysPerFrame\": " << result.nrPrimaryRaysPerFrame << ",\n"
+					<< "\t\t\t\"shadowRaysPerFrame\": " << result.nrShadowRaysPerFrame << ",\n"
+					<< "\t\t\t\"primaryMraysPerSecond\": " << primaryMrays << ",\n"
+					<< "\t\t\t\"shadowMraysPerSecond\": " << shadowMrays << ",\n"
+					<< "\t\t\t\"totalMraysPerSecond\": " << primaryMrays + shadowMrays << ",\n";
+
+				if (TraversalStats::isEnabled)
+				{
+					const double nrRays{ static_cast<double>(std::max(result.traversalTotals.values[TraversalStats::PrimaryRays], uint64_t{ 1 })) };
+					file << "\t\t\t\"perPrimaryRay\": { ";
+					for (uint32_t i = TraversalStats::NodesVisited; i < TraversalStats::NrCounters; ++i)
+					{
+						file << (i != TraversalStats::NodesVisited ? ", " : "")
+							<< '"' << TraversalStats::GetName(static_cast<TraversalStats::Counter>(i)) << "\": " << result.traversalTotals.values[i] / nrRays;
+					}
+					file << " },\n";
+				}
+
+				if (!result.numaResults.empty())
+				{
+					//Speedup over the single node run
+					const double singleNodeMs{ result.numaResults.front().meanFrameMs };
+					file << "\t\t\t\"numaScaling\": [";
+					for (size_t i = 0; i < result.numaResults.size(); ++i)
+					{
+						const NumaResult& numa{ result.numaResults[i] };
+						file << (i != 0 ? ", " : " ") << "{ \"nodes\": " << numa.nrNodes << ", ";
+						if (numa.isAvailable)
+						{
+							file << "\"workers\": " << numa.nrWorkers << ", \"frameMsMean\": " << numa.meanFrameMs
+								<< ", \"speedup\": " << (numa.meanFrameMs > 0.0 ? singleNodeMs / numa.meanFrameMs : 0.0) << " }";
+						}
+						else
+						{
+							file << "\"available\": false }";
+						}
+					}
+					file << " ],\n";
+				}
+
+				if (result.shadowSorting.isMeasured)
+				{
+					//Speedup and fewer cache misses than the frames above, which traced every shadow ray right after its view ray
+					const ShadowSortingResult& sorting{ result.shadowSorting };
+					const double unsortedMs{ nrFrames > 0.0 ? totalSeconds * 1000.0 / nrFrames : 0.0 };
+					file << "\t\t\t\"shadowSorting\": { \"frameMsMean\": " << sorting.meanFrameMs
+						<< ", \"speedup\": " << (sorting.meanFrameMs > 0.0 ? unsortedMs / sorting.meanFrameMs : 0.0);
+					if (TraversalStats::isEnabled)
+					{
+						const double unsortedMisses{ result.traversalTotals.values[TraversalStats::CacheMisses] / std::max(nrFrames, 1.0) };
+						const double sortedMisses{ sorting.traversalTotals.values[TraversalStats::CacheMisses] / std::max(nrFrames, 1.0) };
+						file << ", \"cacheMissesPerFrame\": " << unsortedMisses
+							<< ", \"sortedCacheMissesPerFrame\": " << sortedMisses
+							<< ", \"cacheMissReduction\": " << (unsortedMisses > 0.0 ? 1.0 - sortedMisses / unsortedMisses : 0.0);
+					}
+					file << " },\n";
+				}
+
+				file << "\t\t\t\"frameMs\": { "
+					<< "\"min\": " << (result.frameMs.empty() ? 0.0 : result.frameMs.front()) << ", "
+					<< "\"mean\": " << (nrFrames > 0.0 ? totalSeconds * 1000.0 / nrFrames : 0.0) << ", "
+					<< "\"p50\": " << Percentile(result.frameMs, 50.0) << ", "
+					<< "\"p95\": " << Percentile(result.frameMs, 95.0) << ", "
+					<< "\"p99\": " << Percentile(result.frameMs, 99.0) << ", "
+					<< "\"max\": " << (result.frameMs.empty() ? 0.0 : result.frameMs.back()) << " }\n"
+					<< "\t\t}";
+			}
+		}
+
+		//Add new scenes here
+		std::vector<SceneEntry> GetScenes()
+		{
+			return {
+				MakeEntry<Scene_W1>("Scene_W1"),
+				MakeEntry<Scene_W2>("Scene_W2"),
+				MakeEntry<Scene_W3_TestScene>("Scene_W3_TestScene"),
+				MakeEntry<Scene_W3>("Scene_W3"),
+				MakeEntry<Scene_W4_TestScene>("Scene_W4_TestScene"),
+				MakeEntry<Scene_W4_ReferenceScene>("Scene_W4_ReferenceScene"),
+				MakeEntry<Scene_W4_BunnyScene>("Scene_W4_BunnyScene"),
+				MakeEntry<Scene_W4_OutOfCoreBunnyScene>("Scene_W4_OutOfCoreBunnyScene")
+			};
+		}
+
+		uint32_t SetThreadCount(uint32_t nrThreads)
+		{
+			if (nrThreads == 0)
+				nrThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+			concurrency::Scheduler::SetDefaultSchedulerPolicy(concurrency::SchedulerPolicy(2,
+				concurrency::MinConcurrency, nrThreads,
+				concurrency::MaxConcurrency, nrThreads));
+			return nrThreads;
+		}
+
+		bool ParseCommandLine(int argc, char* args[], Settings& settings)
+		{
+			bool isBenchmark{ false };
+			for (int i = 1; i < argc; ++i)
+			{
+				const auto readNumber = [&](uint32_t& value) {
+					if (i + 1 < argc)
+						value = static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10));
+				};
+
+				if (std::strcmp(args[i], "--benchmark") == 0)
+				{
+					isBenchmark = true;
+					if (i + 1 < argc && std::strncmp(args[i + 1], "--", 2) != 0)
+						settings.outputFilename = args[++i];
+				}
+				else if (std::strcmp(args[i], "--threads") == 0)
+					readNumber(settings.nrThreads);
+				else if (std::strcmp(args[i], "--numa") == 0)
+					settings.isNumaScaling = true;
+				else if (std::strcmp(args[i], "--replicate") == 0)
+					settings.isReplicated = true;
+				else if (std::strcmp(args[i], "--sortShadows") == 0)
+					settings.isShadowSorting = true;
+				else if (std::strcmp(args[i], "--frames") == 0)
+					readNumber(settings.nrFrames);
+				else if (std::strcmp(args[i], "--resolution") == 0)
+				{
+					readNumber(settings.width);
+					readNumber(settings.height);
+				}
+			}
+
+			settings.width = std::max(settings.width, 4u);
+			settings.height = std::max(settings.height, 4u);
+			settings.nrFrames = std::max(settings.nrFrames, 1u);
+			return isBenchmark;
+		}
+
+		bool Run(const Settings& settings)
+		{
+			const uint32_t nrThreads{ SetThreadCount(settings.nrThreads) };
+
+			SDL_Surface* pBuffer{ SDL_CreateRGBSurfaceWithFormat(0, settings.width, settings.height, 32, SDL_PIXELFORMAT_ARGB8888) };
+			if (!pBuffer)
+			{
+				std::cout << "Can't create a " << settings.width << "x" << settings.height << " buffer: " << SDL_GetError() << std::endl;
+				return false;
+			}
+
+			std::vector<SceneResult> results{};
+			{
+				Renderer renderer{ pBuffer };
+				renderer.SetPipelining(false);
+
+				for (const SceneEntry& entry : GetScenes())
+					results.push_back(RunScene(entry, settings, renderer));
+			}
+			SDL_FreeSurface(pBuffer);
+
+			std::ofstream file(settings.outputFilename, std::ios::trunc);
+			if (!file)
+			{
+				std::cout << "Can't write " << settings.outputFilename << std::endl;
+				return false;
+			}
+
+#if defined(_DEBUG)
+			constexpr const char* pConfiguration{ "Debug" };
+#else
+			constexpr const char* pConfiguration{ "Release" };
+#endif
+			file << "{\n"
+				<< "\t\"configuration\": \"" << pConfiguration << "\",\n"
+				<< "\t\"width\": " << settings.width << ",\n"
+				<< "\t\"height\": " << settings.height << ",\n"
+				<< "\t\"threads\": " << nrThreads << ",\n"
+				<< "\t\"warmupFrames\": " << settings.nrWarmupFrames << ",\n"
+				<< "\t\"frames\": " << settings.nrFrames << ",\n"
+				<< "\t\"animationTime\": " << settings.animationTime << ",\n"
+				<< "\t\"numaNodes\": " << Numa::GetNodes().size() << ",\n"
+				<< "\t\"scenes\": [\n";
+			for (size_t i = 0; i < results.size(); ++i)
+			{
+				WriteScene(file, results[i]);
+				file << (i + 1 < results.size() ? ",\n" : "\n");
+			}
+			file << "\t]\n}\n";
+
+			std::cout << "Benchmark written to " << settings.outputFilename << std::endl;
+			return file.good();
+		}
+	}
+}
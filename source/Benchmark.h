@@ -0,0 +1,60 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	class Scene;
+
+	namespace Benchmark
+	{
+		struct SceneEntry
+		{
+			const char* pName;
+			std::function<std::unique_ptr<Scene>()> create;
+		};
+
+		//Every compiled in scene, also the ones the regression test renders
+		std::vector<SceneEntry> GetScenes();
+
+		/**
+		 * \brief Makes every parallel_for after this use exactly nrThreads, has to be called before anything creates the default scheduler
+		 * \param nrThreads 0 uses every hardware thread
+		 * \return Number of threads used
+		 */
+		uint32_t SetThreadCount(uint32_t nrThreads);
+
+		//Everything that changes the numbers is fixed, so two runs (or two builds) are comparable
+		struct Settings
+		{
+			uint32_t width{ 640 };
+			uint32_t height{ 480 };
+			uint32_t nrThreads{ 0 };		//0 uses every hardware thread
+			uint32_t nrWarmupFrames{ 2 };
+			uint32_t nrFrames{ 16 };
+			float animationTime{ 1.f };		//Timer::GetTotal seen by Scene::Update
+			std::string outputFilename{ "benchmark.json" };
+			bool isNumaScaling{ false };	//Also times every scene on the workers of 1, 2 and 4 NUMA nodes
+			bool isReplicated{ false };		//With per node copies of the meshes, see Numa::Settings
+			bool isShadowSorting{ false };	//Also times every scene with sorted shadow rays, see Renderer::ToggleShadowRaySorting
+		};
+
+		/**
+		 * \brief Reads --benchmark [output.json] [--threads n] [--frames n] [--resolution w h] [--numa [--replicate]] [--sortShadows] from the command line
+		 * \return false if --benchmark isn't there
+		 */
+		bool ParseCommandLine(int argc, char* args[], Settings& settings);
+
+		/**
+		 * \brief Renders every Scene_W* scene headless, sequential (not pipelined) and with the camera where the scene puts it
+		 * Writes primary and shadow Mrays/s, frame time percentiles and BVH build times per scene as JSON
+		 * \return false if the output couldn't be written
+		 */
+		bool Run(const Settings& settings);
+	}
+}
@@ -1,19 +1,29 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 
+#include "AccelerationStructures.h"
+#include "LinearBVH.h"
 #include "Math.h"
+#include "Profiler.h"
+#include "SpatialSplitBVH.h"
 #include "vector"
 
 
 namespace dae
 {
+	//Type of the material in the upper bits, index in the pool of that type in the lower ones (see MaterialTable)
+	//0 is the scene's default material
+	using MaterialHandle = uint32_t;
+
 #pragma region GEOMETRY
 	struct Sphere
 	{
 		Vector3 origin{};
 		float radius{};
 
-		unsigned char materialIndex{ 0 };
+		MaterialHandle materialHandle{ 0 };
 	};
 
 	struct Plane
@@ -21,7 +31,7 @@ namespace dae
 		Vector3 origin{};
 		Vector3 normal{};
 
-		unsigned char materialIndex{ 0 };
+		MaterialHandle materialHandle{ 0 };
 	};
 
 	enum class TriangleCullMode
@@ -57,7 +67,7 @@ namespace dae
 		Vector3 centroid{};
 
 		TriangleCullMode cullMode{};
-		unsigned char materialIndex{};
+		MaterialHandle materialHandle{};
 	};
 
 	//Implemented using https://jacco.ompf2.com/2022/04/13/how-to-build-a-bvh-part-1-basics/
@@ -82,11 +92,30 @@ namespace dae
 			max = Vector3::Max(max, pos);
 		}
 
-		float Area()
+		//Half the surface area, 0 for empty boxes (min above max) instead of a product of infinities
+		float Area() const
 		{
+			if (IsEmpty())
+				return 0.f;
+
 			Vector3 size = max - min;
 			return size.x * size.y + size.y * size.z + size.z * size.x;
 		}
+
+		AABB Union(const AABB& other) const
+		{
+			return AABB{ Vector3::Min(min, other.min), Vector3::Max(max, other.max) };
+		}
+
+		AABB Intersection(const AABB& other) const
+		{
+			return AABB{ Vector3::Max(min, other.min), Vector3::Min(max, other.max) };
+		}
+
+		bool IsEmpty() const
+		{
+			return min.x > max.x || min.y > max.y || min.z > max.z;
+		}
 	};
 
 	struct Bin
@@ -95,6 +124,158 @@ namespace dae
 		uint32_t nrPrimitives = 0;
 	};
 
+	enum class BVHBuilder : uint32_t
+	{
+		BinnedSAH,	//Recursive, best trees (TriangleMesh::Subdivide)
+		Linear,		//Morton codes, fast enough to rebuild every frame (LinearBVH::Build)
+		SpatialSAH	//Binned SAH that also splits triangles over both children, for long thin triangles (SpatialSplitBVH::Build)
+	};
+
+	//Parameters of the BVH builders (TriangleMesh::BuildBVH), part of the mesh cache key
+	struct BVHBuildSettings
+	{
+		static constexpr uint32_t maxBinCount{ 64 };
+
+		BVHBuilder builder{ BVHBuilder::BinnedSAH };
+		uint32_t binCount{ 10 };	//Per axis, the planes between them are the split candidates
+		uint32_t leafSize{ 1 };		//Nodes with this many triangles or fewer aren't split
+		uint32_t sahLevels{ 0 };	//Linear builder only, levels at the top that are split with the binned SAH (at most 8)
+		float spatialSplitBudget{ .3f };	//Spatial builder only, references it may add for split triangles, relative to the number of triangles
+		uint32_t treeletSize{ 0 };	//Leaves per treelet of the optimization after the build (TreeletOptimizer, run by MeshCache), 0 skips it
+	};
+
+	enum class AccelerationStructure : uint32_t
+	{
+		BVH,		//TriangleMesh::bvhNodes, the only one that can be refit
+		Grid,		//Uniform grid traversed with a 3D-DDA, for meshes with an even triangle density (terrain)
+		KdTree,		//SAH kd-tree, for meshes of mostly axis aligned triangles (voxels)
+		Automatic	//AccelerationStructures::Choose picks one of the others when the mesh is first transformed
+	};
+
+	//Built over the transformed triangles (AccelerationStructures::BuildGrid), cells are x first, then y, then z
+	struct UniformGrid
+	{
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+		Vector3 cellSize{};
+		Vector3 reciprocalCellSize{};
+		int resolution[3]{};
+		std::vector<uint32_t> cellStarts{};	//The triangles of cell i are triangles[cellStarts[i]] up to triangles[cellStarts[i + 1]]
+		std::vector<uint32_t> triangles{};	//A triangle is listed in every cell its AABB overlaps
+	};
+
+	//Children of an inner node are leftFirst and leftFirst + 1, like BVHNode
+	struct KdNode
+	{
+		static constexpr uint32_t leafAxis{ 3 };
+
+		float splitPos;
+		uint32_t axis;		//leafAxis for a leaf
+		uint32_t leftFirst;	//Inner node: left child, leaf: first entry of its triangles in KdTree::triangles
+		uint32_t nrPrimitives;
+	};
+
+	//Built over the transformed triangles (AccelerationStructures::BuildKdTree), the root is node 0
+	struct KdTree
+	{
+		static constexpr uint32_t maxDepth{ 48 };
+
+		Vector3 minAABB{};
+		Vector3 maxAABB{};
+		std::vector<KdNode> nodes{};
+		std::vector<uint32_t> triangles{};	//A triangle is listed in every leaf its AABB overlaps
+	};
+
+	//16 bits per axis, relative to the AABB it was quantized against
+	struct QuantizedPosition
+	{
+		uint16_t x, y, z;
+	};
+
+	struct QuantizationRange
+	{
+		Vector3 min{};
+		Vector3 scale{};		//Size of one step per axis
+		Vector3 inverseScale{};
+
+		static QuantizationRange FromAABB(const Vector3& minAABB, const Vector3& maxAABB)
+		{
+			constexpr float maxValue{ 65535.f };
+			const Vector3 extent{ maxAABB - minAABB };
+
+			QuantizationRange range{};
+			range.min = minAABB;
+			for (int a = 0; a < 3; ++a)
+			{
+				range.scale[a] = extent[a] / maxValue;
+				range.inverseScale[a] = extent[a] > 0.f ? maxValue / extent[a] : 0.f;
+			}
+			return range;
+		}
+
+		QuantizedPosition Encode(const Vector3& position) const
+		{
+			auto encode = [](float value)
+			{
+				return static_cast<uint16_t>(std::clamp(value + .5f, 0.f, 65535.f));
+			};
+			return QuantizedPosition{
+				encode((position.x - min.x) * inverseScale.x),
+				encode((position.y - min.y) * inverseScale.y),
+				encode((position.z - min.z) * inverseScale.z) };
+		}
+
+		//BVH bounds are refit from this same decode, so every decoded vertex is inside its node
+		Vector3 Decode(const QuantizedPosition& position) const
+		{
+			return Vector3{ min.x + position.x * scale.x, min.y + position.y * scale.y, min.z + position.z * scale.z };
+		}
+
+		Vector3 GetMax() const
+		{
+			return Decode(QuantizedPosition{ 65535, 65535, 65535 });
+		}
+	};
+
+	//Unit vector in 32 bits: projected on an octahedron, unfolded onto a square and stored as 2 x 16 bit snorm
+	namespace OctahedralNormal
+	{
+		inline uint32_t Encode(const Vector3& normal)
+		{
+			const float length{ std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z) };
+			if (!(length > 0.f))
+				return 0;
+
+			float u{ normal.x / length };
+			float v{ normal.y / length };
+			if (normal.z < 0.f)
+			{
+				const float foldedU{ (1.f - std::abs(v)) * (u >= 0.f ? 1.f : -1.f) };
+				v = (1.f - std::abs(u)) * (v >= 0.f ? 1.f : -1.f);
+				u = foldedU;
+			}
+
+			auto encode = [](float value)
+			{
+				return static_cast<uint16_t>(static_cast<int16_t>(std::round(std::clamp(value, -1.f, 1.f) * 32767.f)));
+			};
+			return static_cast<uint32_t>(encode(u)) | static_cast<uint32_t>(encode(v)) << 16;
+		}
+
+		inline Vector3 Decode(uint32_t encoded)
+		{
+			const float u{ static_cast<int16_t>(encoded & 0xFFFF) / 32767.f };
+			const float v{ static_cast<int16_t>(encoded >> 16) / 32767.f };
+
+			Vector3 normal{ u, v, 1.f - std::abs(u) - std::abs(v) };
+			const float fold{ std::max(-normal.z, 0.f) };
+			normal.x += normal.x >= 0.f ? -fold : fold;
+			normal.y += normal.y >= 0.f ? -fold : fold;
+			normal.Normalize();
+			return normal;
+		}
+	}
+
 	struct TriangleMesh
 	{
 		TriangleMesh() = default;
@@ -126,7 +307,8 @@ namespace dae
 		std::vector<Vector3> normals{};
 		std::vector<Vector3> centroids{};
 		std::vector<int> indices{};
-		unsigned char materialIndex{};
+		std::vector<Vector2> texcoords{};	//Per vertex like positions, empty when the mesh isn't textured
+		MaterialHandle materialHandle{};
 		uint32_t trCount{};
 
 		TriangleCullMode cullMode{TriangleCullMode::BackFaceCulling};
@@ -148,8 +330,34 @@ namespace dae
 		std::vector<BVHNode> bvhNodes{};
 		uint32_t rootNodeIdx{};
 		uint32_t nodesUsed{};
+		//Triangle of every leaf slot when spatial splits duplicated triangles, empty when leaves index the triangles directly
+		std::vector<uint32_t> bvhReferences{};
+		//World transform the node bounds were fitted with, spatial split bounds are tighter than a refit so they are kept while it holds
+		Matrix bvhTransform{};
 
 		bool shouldUseBVH = false;
+		BVHBuildSettings bvhSettings{};
+		//What HitTest_TriangleMesh traverses when shouldUseBVH is set, the BVH is built either way
+		//A grid or kd-tree is rebuilt whenever the transform changes, only use them for static meshes
+		AccelerationStructure accelerationStructure{ AccelerationStructure::BVH };
+		UniformGrid grid{};
+		KdTree kdTree{};
+		//World transform the grid or kd-tree was built with
+		Matrix accelerationTransform{};
+		//UpdateTransforms rebuilds the BVH instead of refitting it, for meshes that deform (use the linear builder)
+		bool shouldRebuildBVH = false;
+
+		//Incremented by every UpdateTransforms, copies of the mesh (Scene::UpdateReplica) are refreshed when it changed
+		uint32_t transformVersion{ 0 };
+
+		//Compact storage (see Compact), replaces positions, normals and their transformed copies, centroids are dropped
+		bool isCompact = false;
+		QuantizationRange positionRange{};
+		QuantizationRange transformedPositionRange{};
+		std::vector<QuantizedPosition> quantizedPositions{};
+		std::vector<QuantizedPosition> transformedQuantizedPositions{};
+		std::vector<uint32_t> octahedralNormals{};
+		std::vector<uint32_t> transformedOctahedralNormals{};
 
 		void Translate(const Vector3& translation)
 		{
@@ -221,41 +429,190 @@ namespace dae
 			}
 		}
 
+		Vector3 GetTransformedPosition(int index) const
+		{
+			return isCompact ? transformedPositionRange.Decode(transformedQuantizedPositions[index]) : transformedPositions[index];
+		}
+
+		Vector3 GetTransformedNormal(uint32_t triangleIdx) const
+		{
+			return isCompact ? OctahedralNormal::Decode(transformedOctahedralNormals[triangleIdx]) : transformedNormals[triangleIdx];
+		}
+
+		//Triangle in slot leftFirst + i of a leaf
+		uint32_t GetLeafTriangle(uint32_t slot) const
+		{
+			return bvhReferences.empty() ? slot : bvhReferences[slot];
+		}
+
+		/**
+		 * \brief Switches to the compact storage: 6 byte positions quantized against the AABB and 4 byte octahedral normals
+		 * Call it once the BVH is built, a compact mesh can be transformed and refit but not rebuilt
+		 */
+		void Compact()
+		{
+			if (isCompact)
+				return;
+
+			Vector3 objectMinAABB{ INFINITY,INFINITY,INFINITY };
+			Vector3 objectMaxAABB{ -INFINITY,-INFINITY,-INFINITY };
+			for (const Vector3& position : positions)
+			{
+				objectMinAABB = Vector3::Min(position, objectMinAABB);
+				objectMaxAABB = Vector3::Max(position, objectMaxAABB);
+			}
+
+			positionRange = QuantizationRange::FromAABB(objectMinAABB, objectMaxAABB);
+			quantizedPositions.resize(positions.size());
+			for (size_t i = 0; i < positions.size(); ++i)
+			{
+				quantizedPositions[i] = positionRange.Encode(positions[i]);
+			}
+
+			octahedralNormals.resize(normals.size());
+			for (size_t i = 0; i < normals.size(); ++i)
+			{
+				octahedralNormals[i] = OctahedralNormal::Encode(normals[i]);
+			}
+
+			//Swapping with empty vectors actually gives the memory back
+			std::vector<Vector3>{}.swap(positions);
+			std::vector<Vector3>{}.swap(normals);
+			std::vector<Vector3>{}.swap(centroids);
+			std::vector<Vector3>{}.swap(transformedPositions);
+			std::vector<Vector3>{}.swap(transformedNormals);
+			std::vector<Vector3>{}.swap(transformedCentroids);
+
+			isCompact = true;
+			if (!shouldUseBVH)
+			{
+				minAABB = positionRange.min;
+				maxAABB = positionRange.GetMax();
+			}
+			UpdateTransforms();
+		}
+
+		//Bytes of every per vertex, per triangle and per node array
+		size_t GetMemoryUsage() const
+		{
+			return (positions.capacity() + normals.capacity() + centroids.capacity()
+				+ transformedPositions.capacity() + transformedNormals.capacity() + transformedCentroids.capacity()) * sizeof(Vector3)
+				+ (quantizedPositions.capacity() + transformedQuantizedPositions.capacity()) * sizeof(QuantizedPosition)
+				+ (octahedralNormals.capacity() + transformedOctahedralNormals.capacity()) * sizeof(uint32_t)
+				+ texcoords.capacity() * sizeof(Vector2)
+				+ indices.capacity() * sizeof(int)
+				+ bvhNodes.capacity() * sizeof(BVHNode)
+				+ bvhReferences.capacity() * sizeof(uint32_t)
+				+ (grid.cellStarts.capacity() + grid.triangles.capacity() + kdTree.triangles.capacity()) * sizeof(uint32_t)
+				+ kdTree.nodes.capacity() * sizeof(KdNode);
+		}
+
+		void UpdateCompactTransforms(const Matrix& transformMatrix)
+		{
+			//Two passes, the transformed positions are quantized against their own AABB
+			Vector3 tMinAABB{ INFINITY,INFINITY,INFINITY };
+			Vector3 tMaxAABB{ -INFINITY,-INFINITY,-INFINITY };
+			for (const QuantizedPosition& position : quantizedPositions)
+			{
+				const Vector3 transformedPosition{ transformMatrix.TransformPoint(positionRange.Decode(position)) };
+				tMinAABB = Vector3::Min(transformedPosition, tMinAABB);
+				tMaxAABB = Vector3::Max(transformedPosition, tMaxAABB);
+			}
+
+			transformedPositionRange = QuantizationRange::FromAABB(tMinAABB, tMaxAABB);
+			transformedQuantizedPositions.resize(quantizedPositions.size());
+			for (size_t i = 0; i < quantizedPositions.size(); ++i)
+			{
+				transformedQuantizedPositions[i] = transformedPositionRange.Encode(transformMatrix.TransformPoint(positionRange.Decode(quantizedPositions[i])));
+			}
+
+			transformedOctahedralNormals.resize(octahedralNormals.size());
+			for (size_t i = 0; i < octahedralNormals.size(); ++i)
+			{
+				const Vector3 normal{ OctahedralNormal::Decode(octahedralNormals[i]) };
+				transformedOctahedralNormals[i] = OctahedralNormal::Encode(transformMatrix.TransformVector(normal).Normalized());
+			}
+
+			if (!shouldUseBVH)
+			{
+				transformedMinAABB = transformedPositionRange.min;
+				transformedMaxAABB = transformedPositionRange.GetMax();
+			}
+			else
+			{
+				RefitBVH();
+				UpdateAccelerationStructure(transformMatrix);
+			}
+		}
+
 		void UpdateTransforms()
-		{		
-			transformedNormals.clear();
-			transformedPositions.clear();
-			transformedCentroids.clear();
-			transformedNormals.reserve(normals.size());
-			transformedCentroids.reserve(centroids.size());
-			transformedPositions.reserve(positions.size());
+		{
+			PROFILE_ZONE("TriangleMesh::UpdateTransforms");
+			++transformVersion;
+			if (isCompact)
+			{
+				UpdateCompactTransforms(rotationTransform * translationTransform * scaleTransform);
+				return;
+			}
+
+			//Same sizes every update, so after the first one this doesn't allocate
+			transformedPositions.resize(positions.size());
+			transformedCentroids.resize(centroids.size());
+			transformedNormals.resize(normals.size());
 
 			auto transformMatrix = rotationTransform * translationTransform * scaleTransform;
 
 			for (size_t i = 0; i < positions.size(); i++)
 			{
-				transformedPositions.emplace_back(transformMatrix.TransformPoint(positions[i]));
-				
+				transformedPositions[i] = transformMatrix.TransformPoint(positions[i]);
 			}
 
 			for (size_t i = 0; i < centroids.size(); i++)
 			{
-				transformedCentroids.emplace_back(transformMatrix.TransformPoint(centroids[i]));
+				transformedCentroids[i] = transformMatrix.TransformPoint(centroids[i]);
 			}
 
 			for (size_t i = 0; i < normals.size(); i++)
 			{
-				transformedNormals.emplace_back(transformMatrix.TransformVector(normals[i]).Normalized());
+				transformedNormals[i] = transformMatrix.TransformVector(normals[i]).Normalized();
 			}
 			
 			if (!shouldUseBVH)
 			{
 				UpdateTransformedAABB(transformMatrix);
 			}
-			else
+			else if (shouldRebuildBVH)
+			{
+				BuildBVH();
+			}
+			else if (bvhReferences.empty() || std::memcmp(&transformMatrix, &bvhTransform, sizeof(Matrix)) != 0)
 			{
 				RefitBVH();
+				bvhTransform = transformMatrix;
 			}
+
+			if (shouldUseBVH)
+				UpdateAccelerationStructure(transformMatrix);
+		}
+
+		//Grids and kd-trees can't be refit, they are built again for a new transform
+		void UpdateAccelerationStructure(const Matrix& transformMatrix)
+		{
+			if (accelerationStructure == AccelerationStructure::BVH)
+				return;
+
+			if (accelerationStructure == AccelerationStructure::Automatic)
+				accelerationStructure = AccelerationStructures::Choose(*this);
+
+			const bool isBuilt{ accelerationStructure == AccelerationStructure::Grid ? !grid.cellStarts.empty() : !kdTree.nodes.empty() };
+			if (isBuilt && std::memcmp(&transformMatrix, &accelerationTransform, sizeof(Matrix)) == 0)
+				return;
+
+			accelerationTransform = transformMatrix;
+			if (accelerationStructure == AccelerationStructure::Grid)
+				AccelerationStructures::BuildGrid(*this);
+			else if (accelerationStructure == AccelerationStructure::KdTree)
+				AccelerationStructures::BuildKdTree(*this);
 		}
 
 		void UpdateAABB(uint32_t nodeIdx)
@@ -263,7 +620,12 @@ namespace dae
 			//Single AABB
 			if (!shouldUseBVH)
 			{
-				if (positions.size() > 0)
+				if (isCompact)
+				{
+					minAABB = positionRange.min;
+					maxAABB = positionRange.GetMax();
+				}
+				else if (positions.size() > 0)
 				{
 					minAABB = Vector3{INFINITY,INFINITY,INFINITY};
 					maxAABB = Vector3{ -INFINITY,-INFINITY,-INFINITY };
@@ -280,17 +642,21 @@ namespace dae
 			//BVH
 			BVHNode& node = bvhNodes[nodeIdx];
 
-			uint32_t start{node.leftFirst *3};
-			uint32_t end{ start + node.nrPrimitives*3};
+			uint32_t start{ node.leftFirst };
+			uint32_t end{ start + node.nrPrimitives };
 
 			node.minAABB = Vector3{INFINITY,INFINITY,INFINITY};
 			node.maxAABB = Vector3{ -INFINITY,-INFINITY,-INFINITY };
 
-			for (uint32_t i = start; i < end ; ++i)
+			for (uint32_t slot = start; slot < end; ++slot)
 			{
-				node.minAABB = Vector3::Min(transformedPositions[indices[i]], node.minAABB);
-				node.maxAABB = Vector3::Max(transformedPositions[indices[i]], node.maxAABB);
-			
+				const int* pIndices{ &indices[GetLeafTriangle(slot) * 3] };
+				for (int i = 0; i < 3; ++i)
+				{
+					const Vector3 position{ GetTransformedPosition(pIndices[i]) };
+					node.minAABB = Vector3::Min(position, node.minAABB);
+					node.maxAABB = Vector3::Max(position, node.maxAABB);
+				}
 			}
 		}
 
@@ -354,6 +720,20 @@ namespace dae
 
 		void BuildBVH()
 		{
+			bvhTransform = rotationTransform * translationTransform * scaleTransform;
+			if (bvhSettings.builder == BVHBuilder::SpatialSAH)
+			{
+				SpatialSplitBVH::Build(*this);
+				return;
+			}
+
+			bvhReferences.clear();
+			if (bvhSettings.builder == BVHBuilder::Linear)
+			{
+				LinearBVH::Build(*this);
+				return;
+			}
+
 			rootNodeIdx = 0;
 			nodesUsed = 1;
 
@@ -367,6 +747,8 @@ namespace dae
 		void Subdivide(uint32_t nodeIdx)
 		{
 			BVHNode& node = bvhNodes[nodeIdx];
+			if (node.nrPrimitives <= bvhSettings.leafSize)
+				return;
 			
 			//Split axis using SAH !!!EXPENSIVE TO CALCULATE BUT PERFORMANT
 			int axis{};
@@ -386,7 +768,7 @@ namespace dae
 			
 			int leftCount = left - node.leftFirst; //amountTriangles leftside
 			
-			if (leftCount == 0 || leftCount == node.nrPrimitives)
+			if (leftCount == 0 || static_cast<uint32_t>(leftCount) == node.nrPrimitives)
 				return; // Either nothing on the left side, or everything on the left side
 
 			//Create child nodes
@@ -443,7 +825,8 @@ namespace dae
 
 		float FindBestSplitPlane(BVHNode& node, int& axis, float& splitPos)
 		{
-			const uint32_t binCount = 10;
+			constexpr uint32_t maxBinCount = BVHBuildSettings::maxBinCount;
+			const uint32_t binCount = std::clamp(bvhSettings.binCount, 2u, maxBinCount);
 			float bestCost = INFINITY;
 
 			
@@ -463,7 +846,7 @@ namespace dae
 					continue;
 
 		//Populate the bins
-				Bin bin[binCount];
+				Bin bin[maxBinCount];
 				float scale = binCount / (maxBound - minBound);//Used in idxFormula, prevents repeated division which is costly
 
 				for (uint32_t i = 0; i < node.nrPrimitives; ++i)
@@ -480,8 +863,8 @@ namespace dae
 				}
 
 		//Gather data for the planes between the bins (possible split location)
-				float leftArea[binCount - 1], rightArea[binCount - 1];
-				int leftCount[binCount - 1], rightCount[binCount - 1]; //nr primitives each side depending on split plane
+				float leftArea[maxBinCount - 1], rightArea[maxBinCount - 1];
+				int leftCount[maxBinCount - 1], rightCount[maxBinCount - 1]; //nr primitives each side depending on split plane
 
 				AABB leftBox, rightBox;
 				int leftSum = 0, rightSum = 0;
@@ -531,6 +914,7 @@ namespace dae
 		
 		void RefitBVH()
 		{
+			PROFILE_ZONE("TriangleMesh::RefitBVH");
 			for (int i = nodesUsed - 1; i >= 0; i--)
 			{
 				BVHNode& node = bvhNodes[i];
@@ -584,7 +968,13 @@ namespace dae
 		float t = FLT_MAX;
 
 		bool didHit{ false };
-		unsigned char materialIndex{ 0 };
+		MaterialHandle materialHandle{ 0 };
+
+		//Texturing, only triangles fill in the barycentrics and only textured meshes the rest
+		Vector2 barycentrics{};	//Weights of v1 and v2, v0 gets the remainder
+		Vector2 uv{};
+		float uvScale{ 0.f };	//sqrt(uv area / world area) of the triangle, texture space per world unit
+		float footprint{ 0.f };	//World space width of the ray cone at the hit, set by the renderer
 	};
 
 #pragma endregion
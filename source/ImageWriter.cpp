@@ -0,0 +1,422 @@
+#include "ImageWriter.h"
+
+//Standard includes
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+//Project includes
+#include "AllocationCounter.h"
+#include "Profiler.h"
+
+namespace dae
+{
+	namespace
+	{
+#pragma region Helpers
+		void UnpackRGB8(const uint32_t* pPixels, size_t numPixels, const ToneMapping::PixelFormat& format, std::vector<uint8_t>& rgb)
+		{
+			rgb.resize(numPixels * 3);
+			for (size_t i = 0; i < numPixels; ++i)
+			{
+				rgb[i * 3] = static_cast<uint8_t>(pPixels[i] >> format.rShift);
+				rgb[i * 3 + 1] = static_cast<uint8_t>(pPixels[i] >> format.gShift);
+				rgb[i * 3 + 2] = static_cast<uint8_t>(pPixels[i] >> format.bShift);
+			}
+		}
+
+		void WriteU32BE(std::ofstream& file, uint32_t value)
+		{
+			const char bytes[4]{ static_cast<char>(value >> 24), static_cast<char>(value >> 16), static_cast<char>(value >> 8), static_cast<char>(value) };
+			file.write(bytes, 4);
+		}
+
+		template<typename T>
+		void WriteLE(std::vector<char>& buffer, T value)
+		{
+			//x64 is little endian, which is what OpenEXR expects
+			const char* pBytes{ reinterpret_cast<const char*>(&value) };
+			buffer.insert(buffer.end(), pBytes, pBytes + sizeof(T));
+		}
+
+		void WriteString(std::vector<char>& buffer, const char* pString)
+		{
+			buffer.insert(buffer.end(), pString, pString + strlen(pString) + 1);
+		}
+
+		uint32_t Crc32(const uint8_t* pData, size_t size, uint32_t crc = 0)
+		{
+			static uint32_t table[256]{};
+			static const bool isTableInitialized = [] {
+				for (uint32_t n = 0; n < 256; ++n)
+				{
+					uint32_t c{ n };
+					for (int k = 0; k < 8; ++k)
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					table[n] = c;
+				}
+				return true;
+			}();
+			(void)isTableInitialized;
+
+			crc = ~crc;
+			for (size_t i = 0; i < size; ++i)
+				crc = table[(crc ^ pData[i]) & 0xFF] ^ (crc >> 8);
+			return ~crc;
+		}
+#pragma endregion
+
+#pragma region Encoders
+		bool WritePPM(const std::string& fileName, int width, int height, const std::vector<uint8_t>& rgb)
+		{
+			std::ofstream file(fileName, std::ios::binary);
+			if (!file)
+				return false;
+
+			file << "P6\n" << width << ' ' << height << "\n255\n";
+			file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+			return file.good();
+		}
+
+		void WritePNGChunk(std::ofstream& file, const char* pType, const std::vector<uint8_t>& data)
+		{
+			WriteU32BE(file, static_cast<uint32_t>(data.size()));
+			file.write(pType, 4);
+			file.write(reinterpret_cast<const char*>(data.data()), data.size());
+
+			uint32_t crc{ Crc32(reinterpret_cast<const uint8_t*>(pType), 4) };
+			crc = Crc32(data.data(), data.size(), crc);
+			WriteU32BE(file, crc);
+		}
+
+		//Speed over size: the zlib stream only uses stored blocks, so there is no compression cost on the writer thread
+		bool WritePNG(const std::string& fileName, int width, int height, const std::vector<uint8_t>& rgb)
+		{
+			std::ofstream file(fileName, std::ios::binary);
+			if (!file)
+				return false;
+
+			const uint8_t signature[8]{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+			file.write(reinterpret_cast<const char*>(signature), 8);
+
+			std::vector<uint8_t> header(13);
+			for (int i = 0; i < 4; ++i)
+			{
+				header[i] = static_cast<uint8_t>(width >> (24 - i * 8));
+				header[4 + i] = static_cast<uint8_t>(height >> (24 - i * 8));
+			}
+			header[8] = 8;	//bit depth
+			header[9] = 2;	//color type RGB
+			WritePNGChunk(file, "IHDR", header);
+
+			//Raw scanlines, each prefixed with filter type 0
+			const size_t rowSize{ static_cast<size_t>(width) * 3 };
+			std::vector<uint8_t> raw{};
+			raw.reserve((rowSize + 1) * height);
+			for (int y = 0; y < height; ++y)
+			{
+				raw.push_back(0);
+				raw.insert(raw.end(), rgb.begin() + y * rowSize, rgb.begin() + (y + 1) * rowSize);
+			}
+
+			constexpr size_t maxBlockSize{ 65535 };
+			std::vector<uint8_t> zlib{};
+			zlib.reserve(raw.size() + raw.size() / maxBlockSize * 5 + 16);
+			zlib.push_back(0x78);
+			zlib.push_back(0x01);
+
+			uint32_t adlerA{ 1 }, adlerB{ 0 };
+			for (size_t offset = 0; offset < raw.size(); offset += maxBlockSize)
+			{
+				const uint16_t blockSize{ static_cast<uint16_t>(std::min(maxBlockSize, raw.size() - offset)) };
+				const bool isLastBlock{ offset + blockSize == raw.size() };
+				zlib.push_back(isLastBlock ? 1 : 0);
+				zlib.push_back(static_cast<uint8_t>(blockSize));
+				zlib.push_back(static_cast<uint8_t>(blockSize >> 8));
+				zlib.push_back(static_cast<uint8_t>(~blockSize));
+				zlib.push_back(static_cast<uint8_t>(~blockSize >> 8));
+				zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+
+				for (size_t i = offset; i < offset + blockSize; ++i)
+				{
+					adlerA = (adlerA + raw[i]) % 65521;
+					adlerB = (adlerB + adlerA) % 65521;
+				}
+			}
+
+			const uint32_t adler{ (adlerB << 16) | adlerA };
+			for (int i = 0; i < 4; ++i)
+				zlib.push_back(static_cast<uint8_t>(adler >> (24 - i * 8)));
+
+			WritePNGChunk(file, "IDAT", zlib);
+			WritePNGChunk(file, "IEND", {});
+			return file.good();
+		}
+
+		//Single part, scanline, uncompressed OpenEXR with FLOAT B, G, R channels
+		bool WriteEXR(const std::string& fileName, int width, int height, const std::vector<float>& radiance)
+		{
+			std::ofstream file(fileName, std::ios::binary);
+			if (!file)
+				return false;
+
+			std::vector<char> header{};
+			WriteLE<uint32_t>(header, 20000630); //magic
+			WriteLE<uint32_t>(header, 2); //version, scanline
+
+			//Channels are stored alphabetically
+			const char* channelNames[3]{ "B", "G", "R" };
+			WriteString(header, "channels");
+			WriteString(header, "chlist");
+			WriteLE<uint32_t>(header, 3 * (2 + 16) + 1);
+			for (const char* pName : channelNames)
+			{
+				WriteString(header, pName);
+				WriteLE<int32_t>(header, 2); //FLOAT
+				WriteLE<uint32_t>(header, 0); //pLinear + reserved
+				WriteLE<int32_t>(header, 1); //xSampling
+				WriteLE<int32_t>(header, 1); //ySampling
+			}
+			header.push_back(0);
+
+			WriteString(header, "compression");
+			WriteString(header, "compression");
+			WriteLE<uint32_t>(header, 1);
+			header.push_back(0); //NO_COMPRESSION
+
+			for (const char* pWindow : { "dataWindow", "displayWindow" })
+			{
+				WriteString(header, pWindow);
+				WriteString(header, "box2i");
+				WriteLE<uint32_t>(header, 16);
+				WriteLE<int32_t>(header, 0);
+				WriteLE<int32_t>(header, 0);
+				WriteLE<int32_t>(header, width - 1);
+				WriteLE<int32_t>(header, height - 1);
+			}
+
+			WriteString(header, "lineOrder");
+			WriteString(header, "lineOrder");
+			WriteLE<uint32_t>(header, 1);
+			header.push_back(0); //INCREASING_Y
+
+			WriteString(header, "pixelAspectRatio");
+			WriteString(header, "float");
+			WriteLE<uint32_t>(header, 4);
+			WriteLE<float>(header, 1.f);
+
+			WriteString(header, "screenWindowCenter");
+			WriteString(header, "v2f");
+			WriteLE<uint32_t>(header, 8);
+			WriteLE<float>(header, 0.f);
+			WriteLE<float>(header, 0.f);
+
+			WriteString(header, "screenWindowWidth");
+			WriteString(header, "float");
+			WriteLE<uint32_t>(header, 4);
+			WriteLE<float>(header, 1.f);
+
+			header.push_back(0); //end of header
+
+			//Line offset table
+			const uint32_t lineDataSize{ static_cast<uint32_t>(width * 3 * sizeof(float)) };
+			const uint64_t firstLineOffset{ header.size() + static_cast<uint64_t>(height) * sizeof(uint64_t) };
+			for (int y = 0; y < height; ++y)
+			{
+				WriteLE<uint64_t>(header, firstLineOffset + static_cast<uint64_t>(y) * (8 + lineDataSize));
+			}
+			file.write(header.data(), header.size());
+
+			const size_t numPixels{ static_cast<size_t>(width) * height };
+			const float* pPlanes[3]{ radiance.data() + numPixels * 2, radiance.data() + numPixels, radiance.data() }; //B, G, R
+			for (int y = 0; y < height; ++y)
+			{
+				file.write(reinterpret_cast<const char*>(&y), sizeof(int32_t));
+				file.write(reinterpret_cast<const char*>(&lineDataSize), sizeof(uint32_t));
+				for (const float* pPlane : pPlanes)
+				{
+					file.write(reinterpret_cast<const char*>(pPlane + static_cast<size_t>(y) * width), width * sizeof(float));
+				}
+			}
+			return file.good();
+		}
+#pragma endregion
+
+		//One past the highest <baseName>_<sequence>.<any extension> already on disk, so a new run doesn't overwrite the last one's frames
+		uint32_t FindNextSequence(const std::string& baseName)
+		{
+			const std::filesystem::path basePath{ baseName };
+			const std::filesystem::path directory{ basePath.has_parent_path() ? basePath.parent_path() : std::filesystem::path{ "." } };
+			const std::string prefix{ basePath.filename().string() + "_" };
+
+			uint32_t nextSequence{ 0 };
+			std::error_code error{};
+			for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(directory, error))
+			{
+				const std::string stem{ entry.path().stem().string() };
+				if (stem.size() <= prefix.size() || stem.compare(0, prefix.size(), prefix) != 0)
+					continue;
+
+				const std::string digits{ stem.substr(prefix.size()) };
+				if (digits.size() > 9 || !std::all_of(digits.begin(), digits.end(), [](char c) { return c >= '0' && c <= '9'; }))
+					continue;
+
+				nextSequence = std::max(nextSequence, static_cast<uint32_t>(std::stoul(digits)) + 1);
+			}
+			return nextSequence;
+		}
+	}
+
+	ImageWriter::ImageWriter(const std::string& baseName, uint32_t maxQueuedFrames) :
+		m_BaseName(baseName),
+		m_MaxQueuedFrames(std::max(maxQueuedFrames, 1u)),
+		m_NextSequence(FindNextSequence(baseName))
+	{
+		m_Thread = std::thread(&ImageWriter::Run, this);
+	}
+
+	ImageWriter::~ImageWriter()
+	{
+		//Finish writing everything that was queued
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_QueueChanged.notify_all();
+		m_Thread.join();
+	}
+
+	uint32_t ImageWriter::Enqueue(int width, int height, const uint32_t* pPixels, const ToneMapping::PixelFormat& format,
+		const float* pRed, const float* pGreen, const float* pBlue)
+	{
+		std::unique_ptr<Frame> pFrame{};
+		{
+			//Backpressure: wait while the queue is full
+			std::unique_lock<std::mutex> lock{ m_Mutex };
+			m_QueueChanged.wait(lock, [this] { return m_Queue.size() < m_MaxQueuedFrames; });
+
+			if (!m_FreeFrames.empty())
+			{
+				pFrame = std::move(m_FreeFrames.back());
+				m_FreeFrames.pop_back();
+			}
+		}
+
+		if (!pFrame)
+			pFrame = std::make_unique<Frame>();
+
+		const size_t numPixels{ static_cast<size_t>(width) * height };
+		pFrame->width = width;
+		pFrame->height = height;
+		pFrame->format = m_Format;
+		pFrame->pixelFormat = format;
+
+		//Only copy what the encoder needs
+		if (m_Format == ImageFormat::EXR)
+		{
+			pFrame->radiance.resize(numPixels * 3);
+			std::memcpy(pFrame->radiance.data(), pRed, numPixels * sizeof(float));
+			std::memcpy(pFrame->radiance.data() + numPixels, pGreen, numPixels * sizeof(float));
+			std::memcpy(pFrame->radiance.data() + numPixels * 2, pBlue, numPixels * sizeof(float));
+		}
+		else
+		{
+			pFrame->pixels.assign(pPixels, pPixels + numPixels);
+		}
+
+		uint32_t sequence{};
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			sequence = m_NextSequence++;
+			pFrame->sequence = sequence;
+			m_Queue.push_back(std::move(pFrame));
+		}
+		m_QueueChanged.notify_all();
+		return sequence;
+	}
+
+	void ImageWriter::Flush()
+	{
+		std::unique_lock<std::mutex> lock{ m_Mutex };
+		m_QueueChanged.wait(lock, [this] { return m_Queue.empty() && !m_IsWriting; });
+	}
+
+	void ImageWriter::CycleFormat()
+	{
+		m_Format = (m_Format == ImageFormat::EXR) ? ImageFormat::PPM : static_cast<ImageFormat>(static_cast<int>(m_Format) + 1);
+		std::cout << "Image format: " << GetExtension(m_Format) << std::endl;
+	}
+
+	const char* ImageWriter::GetExtension(ImageFormat format)
+	{
+		switch (format)
+		{
+		case ImageFormat::PPM:
+			return "ppm";
+		case ImageFormat::PNG:
+			return "png";
+		case ImageFormat::EXR:
+			return "exr";
+		}
+		return "bin";
+	}
+
+	void ImageWriter::Run()
+	{
+		//Encoding allocates, but never on the render path
+		AllocationCounter::ScopedIgnore ignoreAllocations{};
+		Profiler::SetThreadName("ImageWriter");
+
+		while (true)
+		{
+			std::unique_ptr<Frame> pFrame{};
+			{
+				std::unique_lock<std::mutex> lock{ m_Mutex };
+				m_QueueChanged.wait(lock, [this] { return !m_Queue.empty() || m_IsStopping; });
+
+				if (m_Queue.empty())
+					return; //Stopping and nothing left to write
+
+				pFrame = std::move(m_Queue.front());
+				m_Queue.pop_front();
+				m_IsWriting = true;
+			}
+			m_QueueChanged.notify_all();
+
+			bool isWritten{};
+			{
+				PROFILE_ZONE("ImageWriter::Write");
+				isWritten = Write(*pFrame);
+			}
+			if (!isWritten)
+				std::cout << "Something went wrong. Frame " << pFrame->sequence << " not saved!" << std::endl;
+
+			{
+				std::lock_guard<std::mutex> lock{ m_Mutex };
+				m_IsWriting = false;
+				m_FreeFrames.push_back(std::move(pFrame));
+			}
+			m_QueueChanged.notify_all();
+		}
+	}
+
+	bool ImageWriter::Write(const Frame& frame) const
+	{
+		char fileName[512]{};
+		snprintf(fileName, sizeof(fileName), "%s_%05u.%s", m_BaseName.c_str(), frame.sequence, GetExtension(frame.format));
+
+		if (frame.format == ImageFormat::EXR)
+			return WriteEXR(fileName, frame.width, frame.height, frame.radiance);
+
+		std::vector<uint8_t> rgb{};
+		UnpackRGB8(frame.pixels.data(), frame.pixels.size(), frame.pixelFormat, rgb);
+
+		if (frame.format == ImageFormat::PPM)
+			return WritePPM(fileName, frame.width, frame.height, rgb);
+
+		return WritePNG(fileName, frame.width, frame.height, rgb);
+	}
+}
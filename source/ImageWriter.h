@@ -0,0 +1,85 @@
+#pragma once
+
+//Standard includes
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Project includes
+#include "ToneMapping.h"
+
+namespace dae
+{
+	enum class ImageFormat
+	{
+		PPM,	//8-bit, binary P6
+		PNG,	//8-bit, stored (uncompressed) deflate blocks
+		EXR		//32-bit float HDR radiance, uncompressed scanlines
+	};
+
+	//Encodes and writes frames on a background thread
+	//Frames are copied into pooled buffers, Enqueue only blocks when maxQueuedFrames are still waiting to be written
+	class ImageWriter final
+	{
+	public:
+		ImageWriter(const std::string& baseName, uint32_t maxQueuedFrames = 4);
+		~ImageWriter();
+
+		ImageWriter(const ImageWriter&) = delete;
+		ImageWriter(ImageWriter&&) noexcept = delete;
+		ImageWriter& operator=(const ImageWriter&) = delete;
+		ImageWriter& operator=(ImageWriter&&) noexcept = delete;
+
+		/**
+		 * \brief Copies the frame and queues it for writing as <baseName>_<sequence>.<extension>
+		 * Sequences continue after the highest one already on disk, a second run doesn't overwrite the first one's files
+		 * \param pPixels Packed 32-bit pixels (used for PPM and PNG)
+		 * \param format Bit layout of pPixels
+		 * \param pRed, pGreen, pBlue Planar linear radiance (used for EXR)
+		 * \return Sequence number of the queued frame
+		 */
+		uint32_t Enqueue(int width, int height, const uint32_t* pPixels, const ToneMapping::PixelFormat& format,
+			const float* pRed, const float* pGreen, const float* pBlue);
+
+		//Blocks until every queued frame is written
+		void Flush();
+
+		void CycleFormat();
+		ImageFormat GetFormat() const { return m_Format; }
+
+		static const char* GetExtension(ImageFormat format);
+
+	private:
+		struct Frame
+		{
+			int width{};
+			int height{};
+			uint32_t sequence{};
+			ImageFormat format{};
+			ToneMapping::PixelFormat pixelFormat{};
+			std::vector<uint32_t> pixels{};
+			std::vector<float> radiance{}; //planar R, G, B
+		};
+
+		std::string m_BaseName{};
+		uint32_t m_MaxQueuedFrames{};
+		uint32_t m_NextSequence{ 0 };
+		ImageFormat m_Format{ ImageFormat::PNG };
+
+		std::thread m_Thread{};
+		std::mutex m_Mutex{};
+		std::condition_variable m_QueueChanged{};
+		std::deque<std::unique_ptr<Frame>> m_Queue{};
+		std::vector<std::unique_ptr<Frame>> m_FreeFrames{};
+		bool m_IsWriting{ false };
+		bool m_IsStopping{ false };
+
+		void Run();
+		bool Write(const Frame& frame) const;
+	};
+}
@@ -0,0 +1,304 @@
+#include "Json.h"
+
+//Standard includes
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+namespace dae
+{
+	namespace Json
+	{
+		namespace
+		{
+			//Scene files are small, nesting deeper than this is a broken file
+			constexpr int maxDepth{ 64 };
+
+			class Parser final
+			{
+			public:
+				Parser(const std::string& text) :
+					m_pCurrent(text.data()),
+					m_pEnd(text.data() + text.size())
+				{
+				}
+
+				bool ParseDocument(Value& root, std::string& error)
+				{
+					bool isParsed{ ParseValue(root, 0) };
+					if (isParsed && !IsAtEnd())
+						isParsed = Fail("Unexpected characters after the document");
+					if (!isParsed)
+						error = "Line " + std::to_string(m_Line) + ": " + m_Error;
+					return isParsed;
+				}
+
+			private:
+				const char* m_pCurrent;
+				const char* m_pEnd;
+				int m_Line{ 1 };
+				std::string m_Error{};
+
+				bool Fail(const std::string& error)
+				{
+					if (m_Error.empty())
+						m_Error = error;
+					return false;
+				}
+
+				void SkipWhitespace()
+				{
+					while (m_pCurrent < m_pEnd)
+					{
+						const char c{ *m_pCurrent };
+						if (c == '\n')
+						{
+							++m_Line;
+							++m_pCurrent;
+						}
+						else if (c == ' ' || c == '\t' || c == '\r')
+						{
+							++m_pCurrent;
+						}
+						else if (c == '/' && m_pCurrent + 1 < m_pEnd && m_pCurrent[1] == '/')
+						{
+							while (m_pCurrent < m_pEnd && *m_pCurrent != '\n')
+								++m_pCurrent;
+						}
+						else if (c == '/' && m_pCurrent + 1 < m_pEnd && m_pCurrent[1] == '*')
+						{
+							m_pCurrent += 2;
+							while (m_pCurrent + 1 < m_pEnd && !(m_pCurrent[0] == '*' && m_pCurrent[1] == '/'))
+							{
+								if (*m_pCurrent == '\n')
+									++m_Line;
+								++m_pCurrent;
+							}
+							m_pCurrent = std::min(m_pCurrent + 2, m_pEnd);
+						}
+						else
+						{
+							return;
+						}
+					}
+				}
+
+				bool IsAtEnd()
+				{
+					SkipWhitespace();
+					return m_pCurrent == m_pEnd;
+				}
+
+				bool Peek(char c)
+				{
+					SkipWhitespace();
+					return m_pCurrent < m_pEnd && *m_pCurrent == c;
+				}
+
+				bool Consume(char c)
+				{
+					if (!Peek(c))
+						return false;
+					++m_pCurrent;
+					return true;
+				}
+
+				bool ConsumeWord(const char* pWord)
+				{
+					const char* p{ m_pCurrent };
+					for (; *pWord != '\0'; ++pWord, ++p)
+					{
+						if (p >= m_pEnd || *p != *pWord)
+							return false;
+					}
+					m_pCurrent = p;
+					return true;
+				}
+
+				bool ParseValue(Value& value, int depth)
+				{
+					if (depth > maxDepth)
+						return Fail("Nesting too deep");
+
+					SkipWhitespace();
+					if (m_pCurrent >= m_pEnd)
+						return Fail("Unexpected end of file");
+
+					switch (*m_pCurrent)
+					{
+					case '{':
+						return ParseObject(value, depth);
+					case '[':
+						return ParseArray(value, depth);
+					case '"':
+						value.type = Type::String;
+						return ParseString(value.string);
+					case 't':
+					case 'f':
+						value.type = Type::Bool;
+						value.boolean = *m_pCurrent == 't';
+						return ConsumeWord(value.boolean ? "true" : "false") || Fail("Expected true or false");
+					case 'n':
+						value.type = Type::Null;
+						return ConsumeWord("null") || Fail("Expected null");
+					default:
+						return ParseNumber(value);
+					}
+				}
+
+				bool ParseNumber(Value& value)
+				{
+					//strtod needs a terminated string, numbers are short
+					char buffer[64]{};
+					size_t length{ 0 };
+					while (m_pCurrent + length < m_pEnd && length < sizeof(buffer) - 1)
+					{
+						const char c{ m_pCurrent[length] };
+						if (!((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E'))
+							break;
+						buffer[length++] = c;
+					}
+
+					char* pNumberEnd{ nullptr };
+					value.type = Type::Number;
+					value.number = std::strtod(buffer, &pNumberEnd);
+					if (length == 0 || pNumberEnd != buffer + length)
+						return Fail("Expected a value");
+
+					m_pCurrent += length;
+					return true;
+				}
+
+				bool ParseString(std::string& string)
+				{
+					++m_pCurrent;	//Opening quote
+					while (m_pCurrent < m_pEnd && *m_pCurrent != '"')
+					{
+						char c{ *m_pCurrent++ };
+						if (c == '\n')
+							return Fail("Unterminated string");
+
+						if (c == '\\' && m_pCurrent < m_pEnd)
+						{
+							c = *m_pCurrent++;
+							switch (c)
+							{
+							case 'n': c = '\n'; break;
+							case 't': c = '\t'; break;
+							case 'r': c = '\r'; break;
+							case 'b': c = '\b'; break;
+							case 'f': c = '\f'; break;
+							case 'u':
+								//Only used for paths and names, anything outside ASCII becomes '?'
+								if (m_pEnd - m_pCurrent < 4)
+									return Fail("Invalid \\u escape");
+							{
+								const long codePoint{ std::strtol(std::string(m_pCurrent, 4).c_str(), nullptr, 16) };
+								c = codePoint > 0 && codePoint < 128 ? static_cast<char>(codePoint) : '?';
+								m_pCurrent += 4;
+							}
+								break;
+							default: break;	//Quote, backslash and slash are themselves
+							}
+						}
+						string.push_back(c);
+					}
+
+					if (m_pCurrent >= m_pEnd)
+						return Fail("Unterminated string");
+					++m_pCurrent;	//Closing quote
+					return true;
+				}
+
+				bool ParseArray(Value& value, int depth)
+				{
+					++m_pCurrent;
+					value.type = Type::Array;
+					while (!Consume(']'))
+					{
+						value.array.emplace_back();
+						if (!ParseValue(value.array.back(), depth + 1))
+							return false;
+						if (!Consume(',') && !Peek(']'))
+							return Fail("Expected , or ]");
+					}
+					return true;
+				}
+
+				bool ParseObject(Value& value, int depth)
+				{
+					++m_pCurrent;
+					value.type = Type::Object;
+					while (!Consume('}'))
+					{
+						if (!Peek('"'))
+							return Fail("Expected a key");
+
+						std::string key{};
+						if (!ParseString(key))
+							return false;
+						if (!Consume(':'))
+							return Fail("Expected : after \"" + key + "\"");
+
+						value.object.emplace_back(std::move(key), Value{});
+						if (!ParseValue(value.object.back().second, depth + 1))
+							return false;
+						if (!Consume(',') && !Peek('}'))
+							return Fail("Expected , or }");
+					}
+					return true;
+				}
+			};
+		}
+
+		const Value* Value::Find(const std::string& key) const
+		{
+			for (const auto& [name, member] : object)
+			{
+				if (name == key)
+					return &member;
+			}
+			return nullptr;
+		}
+
+		bool Value::GetBool(const std::string& key, bool defaultValue) const
+		{
+			const Value* pValue{ Find(key) };
+			return pValue && pValue->type == Type::Bool ? pValue->boolean : defaultValue;
+		}
+
+		float Value::GetFloat(const std::string& key, float defaultValue) const
+		{
+			const Value* pValue{ Find(key) };
+			return pValue && pValue->type == Type::Number ? static_cast<float>(pValue->number) : defaultValue;
+		}
+
+		std::string Value::GetString(const std::string& key, const std::string& defaultValue) const
+		{
+			const Value* pValue{ Find(key) };
+			return pValue && pValue->type == Type::String ? pValue->string : defaultValue;
+		}
+
+		bool Parse(const std::string& text, Value& root, std::string& error)
+		{
+			root = Value{};
+			Parser parser{ text };
+			return parser.ParseDocument(root, error);
+		}
+
+		bool ParseFile(const std::string& filename, Value& root, std::string& error)
+		{
+			std::ifstream file(filename, std::ios::binary);
+			if (!file)
+			{
+				error = "Can't open " + filename;
+				return false;
+			}
+
+			std::stringstream stream{};
+			stream << file.rdbuf();
+			return Parse(stream.str(), root, error);
+		}
+	}
+}
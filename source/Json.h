@@ -0,0 +1,49 @@
+#pragma once
+
+//Standard includes
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace dae
+{
+	namespace Json
+	{
+		enum class Type
+		{
+			Null,
+			Bool,
+			Number,
+			String,
+			Array,
+			Object
+		};
+
+		struct Value
+		{
+			Type type{ Type::Null };
+			bool boolean{};
+			double number{};
+			std::string string{};
+			std::vector<Value> array{};
+			std::vector<std::pair<std::string, Value>> object{};	//In file order
+
+			bool IsNull() const { return type == Type::Null; }
+
+			//nullptr when this isn't an object or doesn't have the key
+			const Value* Find(const std::string& key) const;
+
+			//Value of a member, defaultValue when it is missing or of another type
+			bool GetBool(const std::string& key, bool defaultValue) const;
+			float GetFloat(const std::string& key, float defaultValue) const;
+			std::string GetString(const std::string& key, const std::string& defaultValue) const;
+		};
+
+		/**
+		 * \brief Parses a JSON document, // and / * * / comments and trailing commas are allowed
+		 * \param error Line and reason when parsing fails
+		 */
+		bool Parse(const std::string& text, Value& root, std::string& error);
+		bool ParseFile(const std::string& filename, Value& root, std::string& error);
+	}
+}
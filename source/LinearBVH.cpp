@@ -0,0 +1,333 @@
+#include "LinearBVH.h"
+
+//Standard includes
+#include <algorithm>
+#include <bit>
+#include <numeric>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+#include "ParallelFor.h"
+
+namespace dae
+{
+	namespace LinearBVH
+	{
+		namespace
+		{
+			//Fixed, so the sorted order and the tree don't depend on the number of threads
+			constexpr uint32_t chunkSize{ 16384 };
+			constexpr uint32_t radixBits{ 8 };
+			constexpr uint32_t radixSize{ 1u << radixBits };
+			constexpr uint32_t mortonBits{ 30 };
+			//The SAH levels leave at most this many ranges, one radix pass sorts the triangles back into them
+			constexpr uint32_t maxSahLevels{ radixBits };
+
+			struct Scratch
+			{
+				std::vector<AABB> chunkBounds{};
+				std::vector<uint32_t> histograms{};		//radixSize per chunk
+				std::vector<uint32_t> codes{};
+				std::vector<uint32_t> sortedCodes{};
+				std::vector<uint32_t> triangles{};		//Triangle that was at this position before sorting
+				std::vector<uint32_t> sortedTriangles{};
+				std::vector<uint32_t> ranges{};			//Per triangle, the SAH leaf it is in
+				std::vector<Vector3> vectors{};
+				std::vector<int> indices{};
+				std::vector<uint32_t> frontier{};		//Nodes of the level being split
+				std::vector<uint32_t> splits{};			//Per frontier node, first triangle of the right child or 0 when it stays a leaf
+				std::vector<uint32_t> childIndices{};
+			};
+
+			//Meshes are built on the thread that updates them, the vectors keep their capacity for the next build
+			thread_local Scratch t_Scratch{};
+
+			uint32_t GetNrChunks(uint32_t count)
+			{
+				return (count + chunkSize - 1) / chunkSize;
+			}
+
+			template<typename Function>
+			void ForEachChunk(uint32_t count, const Function& function)
+			{
+				ParallelFor(GetNrChunks(count), [&](uint32_t chunk) {
+					function(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+				});
+			}
+
+			//Spreads the lower 10 bits so there are 2 zero bits between each of them
+			uint32_t ExpandBits(uint32_t value)
+			{
+				value = (value * 0x00010001u) & 0xFF0000FFu;
+				value = (value * 0x00000101u) & 0x0F00F00Fu;
+				value = (value * 0x00000011u) & 0xC30C30C3u;
+				value = (value * 0x00000005u) & 0x49249249u;
+				return value;
+			}
+
+			//Stable counting sort of codes and triangles on one digit, chunks are counted and scattered in parallel
+			template<typename Digit>
+			void RadixPass(Scratch& scratch, uint32_t count, const Digit& digit)
+			{
+				const uint32_t nrChunks{ GetNrChunks(count) };
+				scratch.histograms.assign(size_t{ nrChunks } * radixSize, 0);
+				ForEachChunk(count, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+					uint32_t* pHistogram{ &scratch.histograms[chunk * radixSize] };
+					for (uint32_t i = begin; i < end; ++i)
+						++pHistogram[digit(scratch.codes[i], scratch.triangles[i])];
+				});
+
+				//Nothing moves when every key has the same digit
+				for (uint32_t d = 0; d < radixSize; ++d)
+				{
+					uint32_t total{ 0 };
+					for (uint32_t chunk = 0; chunk < nrChunks; ++chunk)
+						total += scratch.histograms[chunk * radixSize + d];
+					if (total == count)
+						return;
+					if (total != 0)
+						break;
+				}
+
+				//Exclusive prefix sum, per digit over the chunks so equal keys keep their order
+				uint32_t offset{ 0 };
+				for (uint32_t d = 0; d < radixSize; ++d)
+				{
+					for (uint32_t chunk = 0; chunk < nrChunks; ++chunk)
+					{
+						uint32_t& bucket{ scratch.histograms[chunk * radixSize + d] };
+						const uint32_t bucketCount{ bucket };
+						bucket = offset;
+						offset += bucketCount;
+					}
+				}
+
+				ForEachChunk(count, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+					uint32_t* pOffsets{ &scratch.histograms[chunk * radixSize] };
+					for (uint32_t i = begin; i < end; ++i)
+					{
+						const uint32_t destination{ pOffsets[digit(scratch.codes[i], scratch.triangles[i])]++ };
+						scratch.sortedCodes[destination] = scratch.codes[i];
+						scratch.sortedTriangles[destination] = scratch.triangles[i];
+					}
+				});
+				scratch.codes.swap(scratch.sortedCodes);
+				scratch.triangles.swap(scratch.sortedTriangles);
+			}
+
+			//Puts the per triangle values in sorted order, arrays the mesh doesn't have (compact or not transformed yet) are skipped
+			template<typename T>
+			void Reorder(const Scratch& scratch, uint32_t count, uint32_t stride, std::vector<T>& values, std::vector<T>& reordered)
+			{
+				if (values.size() != size_t{ count } * stride)
+					return;
+
+				reordered.resize(values.size());
+				ForEachChunk(count, [&](uint32_t, uint32_t begin, uint32_t end) {
+					for (uint32_t i = begin; i < end; ++i)
+						std::copy_n(values.begin() + size_t{ scratch.triangles[i] } * stride, stride, reordered.begin() + size_t{ i } * stride);
+				});
+				//Copied back instead of swapped, so every mesh keeps its own buffer and rebuilds don't allocate
+				std::copy(reordered.begin(), reordered.end(), values.begin());
+			}
+
+			//Karras 2012: the children split where the highest bit that differs between the first and last code of the range flips
+			uint32_t FindMortonSplit(const std::vector<uint32_t>& codes, uint32_t first, uint32_t last)
+			{
+				const uint32_t firstCode{ codes[first] };
+				const uint32_t lastCode{ codes[last] };
+				if (firstCode == lastCode)
+					return (first + last + 1) / 2;
+
+				//Binary search for the last code that has more leading bits in common with the first one
+				const int commonPrefix{ std::countl_zero(firstCode ^ lastCode) };
+				uint32_t split{ first };
+				uint32_t step{ last - first };
+				do
+				{
+					step = (step + 1) / 2;
+					const uint32_t newSplit{ split + step };
+					if (newSplit < last && std::countl_zero(firstCode ^ codes[newSplit]) > commonPrefix)
+						split = newSplit;
+				} while (step > 1);
+
+				return split + 1;
+			}
+
+			/**
+			 * Splits every node of the frontier in parallel, then makes the children of this level the next frontier
+			 * Children are allocated in frontier order, so they always come after their parent (RefitBVH relies on that)
+			 * findSplit(node) returns the first triangle of the right child, or 0 to keep the node a leaf
+			 */
+			template<typename FindSplit>
+			void SplitLevel(TriangleMesh& mesh, Scratch& scratch, const FindSplit& findSplit)
+			{
+				const uint32_t nrNodes{ static_cast<uint32_t>(scratch.frontier.size()) };
+				scratch.splits.resize(nrNodes);
+				scratch.childIndices.resize(nrNodes);
+
+				ParallelFor(nrNodes, [&](uint32_t k) {
+					scratch.splits[k] = findSplit(mesh.bvhNodes[scratch.frontier[k]]);
+				});
+
+				const uint32_t firstChildIdx{ mesh.nodesUsed };
+				for (uint32_t k = 0; k < nrNodes; ++k)
+				{
+					scratch.childIndices[k] = mesh.nodesUsed;
+					if (scratch.splits[k] != 0)
+						mesh.nodesUsed += 2;
+				}
+
+				ParallelFor(nrNodes, [&](uint32_t k) {
+					const uint32_t split{ scratch.splits[k] };
+					if (split == 0)
+						return;
+
+					BVHNode& node{ mesh.bvhNodes[scratch.frontier[k]] };
+					const uint32_t leftChildIdx{ scratch.childIndices[k] };
+					mesh.bvhNodes[leftChildIdx].leftFirst = node.leftFirst;
+					mesh.bvhNodes[leftChildIdx].nrPrimitives = split - node.leftFirst;
+					mesh.bvhNodes[leftChildIdx + 1].leftFirst = split;
+					mesh.bvhNodes[leftChildIdx + 1].nrPrimitives = node.leftFirst + node.nrPrimitives - split;
+
+					node.nrPrimitives = 0; //Is not leaf
+					node.leftFirst = leftChildIdx;
+				});
+
+				scratch.frontier.resize(mesh.nodesUsed - firstChildIdx);
+				std::iota(scratch.frontier.begin(), scratch.frontier.end(), firstChildIdx);
+			}
+		}
+
+		uint32_t MortonCode(float x, float y, float z)
+		{
+			constexpr float maxValue{ (1u << (mortonBits / 3)) - 1.f };
+			const uint32_t xx{ static_cast<uint32_t>(std::clamp(x * maxValue, 0.f, maxValue)) };
+			const uint32_t yy{ static_cast<uint32_t>(std::clamp(y * maxValue, 0.f, maxValue)) };
+			const uint32_t zz{ static_cast<uint32_t>(std::clamp(z * maxValue, 0.f, maxValue)) };
+			return ExpandBits(xx) << 2 | ExpandBits(yy) << 1 | ExpandBits(zz);
+		}
+
+		void Build(TriangleMesh& mesh)
+		{
+			PROFILE_ZONE("LinearBVH::Build");
+			assert(!mesh.isCompact && "Compact meshes have no centroids, build before compacting");
+
+			Scratch& scratch{ t_Scratch };
+			const uint32_t count{ mesh.trCount };
+			const uint32_t leafSize{ std::max(mesh.bvhSettings.leafSize, 1u) };
+
+			mesh.rootNodeIdx = 0;
+			mesh.nodesUsed = 1;
+			mesh.bvhNodes[mesh.rootNodeIdx].leftFirst = 0;
+			mesh.bvhNodes[mesh.rootNodeIdx].nrPrimitives = count; //IsLeaf
+			scratch.frontier.assign(1, mesh.rootNodeIdx);
+
+		//Top levels with the binned SAH, where a bad split costs the most
+			const uint32_t sahLevels{ std::min(mesh.bvhSettings.sahLevels, maxSahLevels) };
+			for (uint32_t level = 0; level < sahLevels && !scratch.frontier.empty(); ++level)
+			{
+				SplitLevel(mesh, scratch, [&mesh, leafSize](BVHNode& node) -> uint32_t {
+					if (node.nrPrimitives <= leafSize)
+						return 0;
+
+					int axis{};
+					float splitPos{};
+					mesh.FindBestSplitPlane(node, axis, splitPos);
+
+					int left = node.leftFirst;
+					mesh.SortPrimitives(left, node.leftFirst + node.nrPrimitives - 1, axis, splitPos);
+					const uint32_t leftCount{ static_cast<uint32_t>(left) - node.leftFirst };
+					return leftCount != 0 && leftCount != node.nrPrimitives ? static_cast<uint32_t>(left) : 0;
+				});
+			}
+
+			//Every leaf so far is a range the Morton codes are sorted within, in order of their triangles
+			scratch.frontier.clear();
+			for (uint32_t nodeIdx = 0; nodeIdx < mesh.nodesUsed; ++nodeIdx)
+			{
+				if (mesh.bvhNodes[nodeIdx].nrPrimitives != 0)
+					scratch.frontier.push_back(nodeIdx);
+			}
+			std::sort(scratch.frontier.begin(), scratch.frontier.end(), [&mesh](uint32_t a, uint32_t b) {
+				return mesh.bvhNodes[a].leftFirst < mesh.bvhNodes[b].leftFirst;
+			});
+
+			const uint32_t nrRanges{ static_cast<uint32_t>(scratch.frontier.size()) };
+			scratch.ranges.resize(count);
+			ParallelFor(nrRanges, [&](uint32_t rangeIdx) {
+				const BVHNode& node{ mesh.bvhNodes[scratch.frontier[rangeIdx]] };
+				std::fill_n(scratch.ranges.begin() + node.leftFirst, node.nrPrimitives, rangeIdx);
+			});
+
+		//Morton codes of the centroids, relative to their bounds
+			const std::vector<Vector3>& centroids{ mesh.transformedCentroids };
+			scratch.chunkBounds.resize(GetNrChunks(count));
+			ForEachChunk(count, [&](uint32_t chunk, uint32_t begin, uint32_t end) {
+				AABB bounds{};
+				for (uint32_t i = begin; i < end; ++i)
+					bounds.Grow(centroids[i]);
+				scratch.chunkBounds[chunk] = bounds;
+			});
+
+			AABB bounds{};
+			for (const AABB& chunkBounds : scratch.chunkBounds)
+			{
+				bounds.Grow(chunkBounds.min);
+				bounds.Grow(chunkBounds.max);
+			}
+
+			Vector3 inverseExtent{};
+			for (int a = 0; a < 3; ++a)
+			{
+				const float extent{ bounds.max[a] - bounds.min[a] };
+				inverseExtent[a] = extent > 0.f ? 1.f / extent : 0.f;
+			}
+
+			scratch.codes.resize(count);
+			scratch.sortedCodes.resize(count);
+			scratch.triangles.resize(count);
+			scratch.sortedTriangles.resize(count);
+			ForEachChunk(count, [&](uint32_t, uint32_t begin, uint32_t end) {
+				for (uint32_t i = begin; i < end; ++i)
+				{
+					const Vector3& centroid{ centroids[i] };
+					scratch.codes[i] = MortonCode(
+						(centroid.x - bounds.min.x) * inverseExtent.x,
+						(centroid.y - bounds.min.y) * inverseExtent.y,
+						(centroid.z - bounds.min.z) * inverseExtent.z);
+					scratch.triangles[i] = i;
+				}
+			});
+
+		//Sort on the codes, least significant digit first, then on the range so every range keeps its triangles
+			for (uint32_t shift = 0; shift < mortonBits; shift += radixBits)
+			{
+				RadixPass(scratch, count, [shift](uint32_t code, uint32_t) { return code >> shift & (radixSize - 1); });
+			}
+			if (nrRanges > 1)
+			{
+				RadixPass(scratch, count, [&scratch](uint32_t, uint32_t triangle) { return scratch.ranges[triangle]; });
+			}
+
+			Reorder(scratch, count, 3, mesh.indices, scratch.indices);
+			Reorder(scratch, count, 1, mesh.normals, scratch.vectors);
+			Reorder(scratch, count, 1, mesh.transformedNormals, scratch.vectors);
+			Reorder(scratch, count, 1, mesh.centroids, scratch.vectors);
+			Reorder(scratch, count, 1, mesh.transformedCentroids, scratch.vectors);
+
+		//Split the ranges level by level at the highest differing bit of their codes
+			while (!scratch.frontier.empty())
+			{
+				SplitLevel(mesh, scratch, [&scratch, leafSize](const BVHNode& node) -> uint32_t {
+					if (node.nrPrimitives <= leafSize)
+						return 0;
+					return FindMortonSplit(scratch.codes, node.leftFirst, node.leftFirst + node.nrPrimitives - 1);
+				});
+			}
+
+			mesh.RefitBVH();
+		}
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+
+namespace dae
+{
+	struct TriangleMesh;
+
+	//Linear BVH (Lauterbach et al. 2009, splits found like Karras 2012), fast enough to rebuild deforming meshes every frame
+	//Selected with BVHBuildSettings::builder, TriangleMesh::BuildBVH calls it
+	namespace LinearBVH
+	{
+		/**
+		 * \brief Builds the BVH of the mesh from the 30-bit Morton codes of its transformedCentroids
+		 * The codes are radix sorted and the tree is emitted level by level, both in parallel.
+		 * The first BVHBuildSettings::sahLevels levels are split with the binned SAH instead, the Morton order only applies below them.
+		 * Triangles are reordered like the SAH builder does, nodes use the same layout. Scratch memory is kept per thread,
+		 * so rebuilding the same mesh every frame doesn't allocate.
+		 */
+		void Build(TriangleMesh& mesh);
+
+		//10 bits per axis interleaved, the coordinates are in [0, 1]
+		uint32_t MortonCode(float x, float y, float z);
+	}
+}
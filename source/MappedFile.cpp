@@ -0,0 +1,91 @@
+#include "MappedFile.h"
+
+//External includes
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace dae
+{
+#if defined(_WIN32)
+	MappedFile::MappedFile(const std::string& fileName)
+	{
+		m_FileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (m_FileHandle == INVALID_HANDLE_VALUE)
+		{
+			m_FileHandle = nullptr;
+			return;
+		}
+
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(m_FileHandle, &size))
+			return;
+
+		m_Size = static_cast<size_t>(size.QuadPart);
+		if (m_Size == 0)
+		{
+			//Empty files can't be mapped
+			m_IsOpen = true;
+			return;
+		}
+
+		m_MappingHandle = CreateFileMappingA(m_FileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_MappingHandle)
+			return;
+
+		m_pData = static_cast<const char*>(MapViewOfFile(m_MappingHandle, FILE_MAP_READ, 0, 0, 0));
+		m_IsOpen = m_pData != nullptr;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (m_pData)
+			UnmapViewOfFile(m_pData);
+		if (m_MappingHandle)
+			CloseHandle(m_MappingHandle);
+		if (m_FileHandle)
+			CloseHandle(m_FileHandle);
+	}
+#else
+	MappedFile::MappedFile(const std::string& fileName)
+	{
+		m_FileDescriptor = open(fileName.c_str(), O_RDONLY);
+		if (m_FileDescriptor < 0)
+			return;
+
+		struct stat fileStat {};
+		if (fstat(m_FileDescriptor, &fileStat) != 0)
+			return;
+
+		m_Size = static_cast<size_t>(fileStat.st_size);
+		if (m_Size == 0)
+		{
+			//Empty files can't be mapped
+			m_IsOpen = true;
+			return;
+		}
+
+		void* pData{ mmap(nullptr, m_Size, PROT_READ, MAP_PRIVATE, m_FileDescriptor, 0) };
+		if (pData == MAP_FAILED)
+			return;
+
+		m_pData = static_cast<const char*>(pData);
+		m_IsOpen = true;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		if (m_pData)
+			munmap(const_cast<char*>(m_pData), m_Size);
+		if (m_FileDescriptor >= 0)
+			close(m_FileDescriptor);
+	}
+#endif
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+//Standard includes
+#include <cstddef>
+#include <string>
+
+namespace dae
+{
+	//Read-only memory mapping of a whole file
+	class MappedFile final
+	{
+	public:
+		MappedFile(const std::string& fileName);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile(MappedFile&&) noexcept = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile& operator=(MappedFile&&) noexcept = delete;
+
+		//False if the file could not be opened or mapped (an empty file is open, but has no data)
+		bool IsOpen() const { return m_IsOpen; }
+		const char* GetData() const { return m_pData; }
+		size_t GetSize() const { return m_Size; }
+
+	private:
+#if defined(_WIN32)
+		void* m_FileHandle{};
+		void* m_MappingHandle{};
+#else
+		int m_FileDescriptor{ -1 };
+#endif
+		const char* m_pData{};
+		size_t m_Size{};
+		bool m_IsOpen{ false };
+	};
+}
@@ -2,43 +2,28 @@
 #include "Math.h"
 #include "DataTypes.h"
 #include "BRDFs.h"
+#include "Texture.h"
+
+#include <cassert>
+#include <vector>
 
 namespace dae
 {
 #pragma region Material BASE
-	class Material
-	{
-	public:
-		Material() = default;
-		virtual ~Material() = default;
-
-		Material(const Material&) = delete;
-		Material(Material&&) noexcept = delete;
-		Material& operator=(const Material&) = delete;
-		Material& operator=(Material&&) noexcept = delete;
-
-		/**
-		 * \brief Function used to calculate the correct color for the specific material and its parameters
-		 * \param hitRecord current hitrecord
-		 * \param l light direction
-		 * \param v view direction
-		 * \return color
-		 */
-		virtual ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) = 0;
-	};
+	//Materials are plain values with a non-virtual Shade, a MaterialTable stores them in one pool per type
 #pragma endregion
 
 #pragma region Material SOLID COLOR
 	//SOLID COLOR
 	//===========
-	class Material_SolidColor final : public Material
+	class Material_SolidColor final
 	{
 	public:
 		Material_SolidColor(const ColorRGB& color): m_Color(color)
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) override
+		ColorRGB Shade(const HitRecord& hitRecord, const Vector3& l, const Vector3& v) const
 		{
 			return m_Color;
 		}
@@ -51,38 +36,42 @@ namespace dae
 #pragma region Material LAMBERT
 	//LAMBERT
 	//=======
-	class Material_Lambert final : public Material
+	class Material_Lambert final
 	{
 	public:
-		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance) :
-			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance){}
+		//pDiffuseTexture (owned by the scene) is multiplied with the diffuse color
+		Material_Lambert(const ColorRGB& diffuseColor, float diffuseReflectance, const Texture* pDiffuseTexture = nullptr) :
+			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(diffuseReflectance), m_pDiffuseTexture(pDiffuseTexture){}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const
 		{
-			return BRDF::Lambert(m_DiffuseReflectance,m_DiffuseColor);
+			const ColorRGB diffuseColor{ m_pDiffuseTexture ? m_pDiffuseTexture->Sample(hitRecord) * m_DiffuseColor : m_DiffuseColor };
+			return BRDF::Lambert(m_DiffuseReflectance,diffuseColor);
 		}
 
 	private:
 		ColorRGB m_DiffuseColor{colors::White};
 		float m_DiffuseReflectance{1.f}; //kd
+		const Texture* m_pDiffuseTexture{};
 	};
 #pragma endregion
 
 #pragma region Material LAMBERT PHONG
 	//LAMBERT-PHONG
 	//=============
-	class Material_LambertPhong final : public Material
+	class Material_LambertPhong final
 	{
 	public:
-		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent):
+		Material_LambertPhong(const ColorRGB& diffuseColor, float kd, float ks, float phongExponent, const Texture* pDiffuseTexture = nullptr):
 			m_DiffuseColor(diffuseColor), m_DiffuseReflectance(kd), m_SpecularReflectance(ks),
-			m_PhongExponent(phongExponent)
+			m_PhongExponent(phongExponent), m_pDiffuseTexture(pDiffuseTexture)
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const
 		{
-			return BRDF::Lambert(m_DiffuseReflectance,m_DiffuseColor)
+			const ColorRGB diffuseColor{ m_pDiffuseTexture ? m_pDiffuseTexture->Sample(hitRecord) * m_DiffuseColor : m_DiffuseColor };
+			return BRDF::Lambert(m_DiffuseReflectance,diffuseColor)
 				+ BRDF::Phong(m_SpecularReflectance,m_PhongExponent,l,-v,hitRecord.normal);
 		}
 
@@ -91,22 +80,25 @@ namespace dae
 		float m_DiffuseReflectance{0.5f}; //kd
 		float m_SpecularReflectance{0.5f}; //ks
 		float m_PhongExponent{1.f}; //Phong Exponent
+		const Texture* m_pDiffuseTexture{};
 	};
 #pragma endregion
 
 #pragma region Material COOK TORRENCE
 	//COOK TORRENCE
-	class Material_CookTorrence final : public Material
+	class Material_CookTorrence final
 	{
 	public:
-		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness):
-			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness)
+		//pAlbedoTexture (owned by the scene) is multiplied with the albedo
+		Material_CookTorrence(const ColorRGB& albedo, float metalness, float roughness, const Texture* pAlbedoTexture = nullptr):
+			m_Albedo(albedo), m_Metalness(metalness), m_Roughness(roughness), m_pAlbedoTexture(pAlbedoTexture)
 		{
 		}
 
-		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) override
+		ColorRGB Shade(const HitRecord& hitRecord = {}, const Vector3& l = {}, const Vector3& v = {}) const
 		{
-			ColorRGB f0{ (m_Metalness == 0.0f) ? ColorRGB{0.04f,0.04f,0.04f} : m_Albedo };
+			const ColorRGB albedo{ m_pAlbedoTexture ? m_pAlbedoTexture->Sample(hitRecord) * m_Albedo : m_Albedo };
+			ColorRGB f0{ (m_Metalness == 0.0f) ? ColorRGB{0.04f,0.04f,0.04f} : albedo };
 			Vector3 h{ (v + l) / (v + l).Magnitude() };
 			h.Normalize();
 			ColorRGB F{ BRDF::FresnelFunction_Schlick(h,v,f0) };
@@ -116,7 +108,7 @@ namespace dae
 			ColorRGB specular{ D * F * G };
 			specular /= specularDenom;
 			ColorRGB kd{ (m_Metalness == 1.0f) ? ColorRGB{0.f,0.f,0.f} : (ColorRGB{1.f,1.f,1.f} - F) };
-			ColorRGB diffuse{ BRDF::Lambert(kd,m_Albedo) };
+			ColorRGB diffuse{ BRDF::Lambert(kd,albedo) };
 			return diffuse + specular;
 		}
 
@@ -124,6 +116,74 @@ namespace dae
 		ColorRGB m_Albedo{0.955f, 0.637f, 0.538f}; //Copper
 		float m_Metalness{1.0f};
 		float m_Roughness{0.1f}; // [1.0 > 0.0] >> [ROUGH > SMOOTH]
+		const Texture* m_pAlbedoTexture{};
+	};
+#pragma endregion
+
+#pragma region Material TABLE
+	enum class MaterialType : uint32_t
+	{
+		SolidColor,
+		Lambert,
+		LambertPhong,
+		CookTorrence
+	};
+
+	//One contiguous pool per material type, shading switches on the type instead of calling through a vtable
+	class MaterialTable final
+	{
+	public:
+		static constexpr uint32_t indexBits{ 24 };
+		static constexpr uint32_t indexMask{ (1u << indexBits) - 1 };
+
+		static MaterialType GetType(MaterialHandle handle) { return static_cast<MaterialType>(handle >> indexBits); }
+		static uint32_t GetIndex(MaterialHandle handle) { return handle & indexMask; }
+
+		MaterialHandle Add(const Material_SolidColor& material) { return Add(m_SolidColors, material, MaterialType::SolidColor); }
+		MaterialHandle Add(const Material_Lambert& material) { return Add(m_Lamberts, material, MaterialType::Lambert); }
+		MaterialHandle Add(const Material_LambertPhong& material) { return Add(m_LambertPhongs, material, MaterialType::LambertPhong); }
+		MaterialHandle Add(const Material_CookTorrence& material) { return Add(m_CookTorrences, material, MaterialType::CookTorrence); }
+
+		size_t GetCount() const { return m_SolidColors.size() + m_Lamberts.size() + m_LambertPhongs.size() + m_CookTorrences.size(); }
+
+		/**
+		 * \brief Function used to calculate the correct color for the specific material and its parameters
+		 * \param handle material returned by Add
+		 * \param hitRecord current hitrecord
+		 * \param l light direction
+		 * \param v view direction
+		 * \return color
+		 */
+		ColorRGB Shade(MaterialHandle handle, const HitRecord& hitRecord, const Vector3& l, const Vector3& v) const
+		{
+			const uint32_t index{ GetIndex(handle) };
+			switch (GetType(handle))
+			{
+			case MaterialType::SolidColor:
+				return m_SolidColors[index].Shade(hitRecord, l, v);
+			case MaterialType::Lambert:
+				return m_Lamberts[index].Shade(hitRecord, l, v);
+			case MaterialType::LambertPhong:
+				return m_LambertPhongs[index].Shade(hitRecord, l, v);
+			case MaterialType::CookTorrence:
+				return m_CookTorrences[index].Shade(hitRecord, l, v);
+			}
+			return colors::Black;
+		}
+
+	private:
+		std::vector<Material_SolidColor> m_SolidColors{};
+		std::vector<Material_Lambert> m_Lamberts{};
+		std::vector<Material_LambertPhong> m_LambertPhongs{};
+		std::vector<Material_CookTorrence> m_CookTorrences{};
+
+		template<typename T>
+		static MaterialHandle Add(std::vector<T>& pool, const T& material, MaterialType type)
+		{
+			assert(pool.size() <= indexMask && "Material pool is full");
+			pool.push_back(material);
+			return (static_cast<uint32_t>(type) << indexBits) | static_cast<uint32_t>(pool.size() - 1);
+		}
 	};
 #pragma endregion
 }
@@ -0,0 +1,304 @@
+#include "MeshCache.h"
+
+//Standard includes
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "TreeletOptimizer.h"
+#include "Utils.h"
+
+//Also builds the BVH of the unoptimized mesh on a cache miss and prints the traversal speedup of the optimized one
+//#define REPORT_MESH_OPTIMIZATION
+
+namespace dae
+{
+	namespace MeshCache
+	{
+		namespace
+		{
+			//Every section starts on a cache line
+			constexpr uint64_t sectionAlignment{ 64 };
+			constexpr char magic[8]{ 'D', 'A', 'E', 'M', 'E', 'S', 'H', '\0' };
+
+			struct Header
+			{
+				char magic[8]{};
+				uint32_t version{};
+				uint32_t headerSize{};
+
+				uint64_t sourceHash{};
+				uint64_t buildHash{};
+
+				uint32_t nrPositions{};
+				uint32_t nrIndices{};
+				uint32_t nrTriangles{};
+				uint32_t nrNodes{};
+				uint32_t rootNodeIdx{};
+				uint32_t nrTexcoords{};	//0 or nrPositions
+				uint32_t nrReferences{};	//0 unless spatial splits duplicated triangles (TriangleMesh::bvhReferences)
+
+				uint64_t positionsOffset{};
+				uint64_t indicesOffset{};
+				uint64_t normalsOffset{};
+				uint64_t centroidsOffset{};
+				uint64_t nodesOffset{};
+				uint64_t texcoordsOffset{};
+				uint64_t referencesOffset{};
+				uint64_t fileSize{};
+			};
+
+			uint64_t AlignUp(uint64_t offset)
+			{
+				return (offset + sectionAlignment - 1) & ~(sectionAlignment - 1);
+			}
+
+			//The BVH is built in transformed space, a different transform (or builder setting) gives a different tree
+			uint64_t HashBuild(const TriangleMesh& mesh)
+			{
+				uint64_t hash{ Hash(&version, sizeof(version)) };
+				hash = Hash(&mesh.rotationTransform, sizeof(Matrix), hash);
+				hash = Hash(&mesh.translationTransform, sizeof(Matrix), hash);
+				hash = Hash(&mesh.scaleTransform, sizeof(Matrix), hash);
+				hash = Hash(&mesh.bvhSettings, sizeof(BVHBuildSettings), hash);
+				return hash;
+			}
+
+			template<typename T>
+			bool IsSectionValid(const Header& header, uint64_t offset, uint64_t count)
+			{
+				return offset % sectionAlignment == 0 && offset + count * sizeof(T) <= header.fileSize;
+			}
+
+			template<typename T>
+			void AssignSection(const char* pFile, uint64_t offset, uint64_t count, std::vector<T>& destination)
+			{
+				const T* pBegin{ reinterpret_cast<const T*>(pFile + offset) };
+				destination.assign(pBegin, pBegin + count);
+			}
+
+			bool TryLoadCache(const std::string& cacheFilename, uint64_t sourceHash, uint64_t buildHash, TriangleMesh& mesh)
+			{
+				const MappedFile file{ cacheFilename };
+				if (!file.IsOpen() || file.GetSize() < sizeof(Header))
+					return false;
+
+				const char* pFile{ file.GetData() };
+				Header header{};
+				std::memcpy(&header, pFile, sizeof(Header));
+
+				if (std::memcmp(header.magic, magic, sizeof(magic)) != 0
+					|| header.version != version
+					|| header.headerSize != sizeof(Header)
+					|| header.fileSize != file.GetSize()
+					|| header.sourceHash != sourceHash
+					|| header.buildHash != buildHash
+					|| header.nrIndices != header.nrTriangles * 3
+					|| (header.nrTexcoords != 0 && header.nrTexcoords != header.nrPositions))
+					return false;
+
+				if (!IsSectionValid<Vector3>(header, header.positionsOffset, header.nrPositions)
+					|| !IsSectionValid<int>(header, header.indicesOffset, header.nrIndices)
+					|| !IsSectionValid<Vector3>(header, header.normalsOffset, header.nrTriangles)
+					|| !IsSectionValid<Vector3>(header, header.centroidsOffset, header.nrTriangles)
+					|| !IsSectionValid<BVHNode>(header, header.nodesOffset, header.nrNodes)
+					|| !IsSectionValid<Vector2>(header, header.texcoordsOffset, header.nrTexcoords)
+					|| !IsSectionValid<uint32_t>(header, header.referencesOffset, header.nrReferences))
+					return false;
+
+				//The mesh owns its arrays (the BVH is refit and the transformed copies are rebuilt from these),
+				//so every section is one sequential copy out of the mapping
+				AssignSection(pFile, header.positionsOffset, header.nrPositions, mesh.positions);
+				AssignSection(pFile, header.indicesOffset, header.nrIndices, mesh.indices);
+				AssignSection(pFile, header.normalsOffset, header.nrTriangles, mesh.normals);
+				AssignSection(pFile, header.centroidsOffset, header.nrTriangles, mesh.centroids);
+				AssignSection(pFile, header.nodesOffset, header.nrNodes, mesh.bvhNodes);
+				AssignSection(pFile, header.texcoordsOffset, header.nrTexcoords, mesh.texcoords);
+				AssignSection(pFile, header.referencesOffset, header.nrReferences, mesh.bvhReferences);
+
+				mesh.trCount = header.nrTriangles;
+				mesh.nodesUsed = header.nrNodes;
+				mesh.rootNodeIdx = header.rootNodeIdx;
+				//Part of the build hash, the cached bounds fit this transform
+				mesh.bvhTransform = mesh.rotationTransform * mesh.translationTransform * mesh.scaleTransform;
+				return true;
+			}
+
+			template<typename T>
+			void WriteSection(std::ofstream& file, uint64_t offset, const T* pData, uint64_t count)
+			{
+				static const char zeros[sectionAlignment]{};
+				const uint64_t position{ static_cast<uint64_t>(file.tellp()) };
+				file.write(zeros, offset - position);
+				file.write(reinterpret_cast<const char*>(pData), count * sizeof(T));
+			}
+
+			void WriteCache(const std::string& cacheFilename, uint64_t sourceHash, uint64_t buildHash, const TriangleMesh& mesh)
+			{
+				Header header{};
+				std::memcpy(header.magic, magic, sizeof(magic));
+				header.version = version;
+				header.headerSize = sizeof(Header);
+				header.sourceHash = sourceHash;
+				header.buildHash = buildHash;
+				header.nrPositions = static_cast<uint32_t>(mesh.positions.size());
+				header.nrIndices = static_cast<uint32_t>(mesh.indices.size());
+				header.nrTriangles = mesh.trCount;
+				header.nrNodes = mesh.nodesUsed;
+				header.rootNodeIdx = mesh.rootNodeIdx;
+				header.nrTexcoords = static_cast<uint32_t>(mesh.texcoords.size());
+				header.nrReferences = static_cast<uint32_t>(mesh.bvhReferences.size());
+
+				header.positionsOffset = AlignUp(sizeof(Header));
+				header.indicesOffset = AlignUp(header.positionsOffset + header.nrPositions * sizeof(Vector3));
+				header.normalsOffset = AlignUp(header.indicesOffset + header.nrIndices * sizeof(int));
+				header.centroidsOffset = AlignUp(header.normalsOffset + header.nrTriangles * sizeof(Vector3));
+				header.nodesOffset = AlignUp(header.centroidsOffset + header.nrTriangles * sizeof(Vector3));
+				header.texcoordsOffset = AlignUp(header.nodesOffset + header.nrNodes * sizeof(BVHNode));
+				header.referencesOffset = AlignUp(header.texcoordsOffset + header.nrTexcoords * sizeof(Vector2));
+				header.fileSize = header.referencesOffset + header.nrReferences * sizeof(uint32_t);
+
+				//Written under a temporary name so a crash never leaves a half written cache behind
+				const std::string tempFilename{ cacheFilename + ".tmp" };
+				{
+					std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+					if (!file)
+						return;
+
+					file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+					WriteSection(file, header.positionsOffset, mesh.positions.data(), header.nrPositions);
+					WriteSection(file, header.indicesOffset, mesh.indices.data(), header.nrIndices);
+					WriteSection(file, header.normalsOffset, mesh.normals.data(), header.nrTriangles);
+					WriteSection(file, header.centroidsOffset, mesh.centroids.data(), header.nrTriangles);
+					WriteSection(file, header.nodesOffset, mesh.bvhNodes.data(), header.nrNodes);
+					WriteSection(file, header.texcoordsOffset, mesh.texcoords.data(), header.nrTexcoords);
+					WriteSection(file, header.referencesOffset, mesh.bvhReferences.data(), header.nrReferences);
+
+					if (!file.good())
+						return;
+				}
+
+				std::remove(cacheFilename.c_str());
+				if (std::rename(tempFilename.c_str(), cacheFilename.c_str()) != 0)
+					std::remove(tempFilename.c_str());
+			}
+		}
+
+		uint64_t Hash(const void* pData, size_t size, uint64_t seed)
+		{
+			//FNV-1a style mixing on 64-bit words
+			constexpr uint64_t prime{ 0x100000001b3ull };
+			const unsigned char* pBytes{ static_cast<const unsigned char*>(pData) };
+			uint64_t hash{ seed };
+
+			size_t i{ 0 };
+			for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+			{
+				uint64_t word{};
+				std::memcpy(&word, pBytes + i, sizeof(uint64_t));
+				hash = (hash ^ word) * prime;
+				hash ^= hash >> 29;
+			}
+			for (; i < size; ++i)
+			{
+				hash = (hash ^ pBytes[i]) * prime;
+			}
+			return hash;
+		}
+
+		bool HashFile(const std::string& filename, uint64_t& hash)
+		{
+			const MappedFile file{ filename };
+			if (!file.IsOpen())
+				return false;
+			hash = Hash(file.GetData(), file.GetSize());
+			return true;
+		}
+
+		std::string GetCacheFilename(const std::string& filename, uint64_t buildHash, const std::string& extension)
+		{
+			char hex[17]{};
+			std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(buildHash));
+			return filename + '.' + hex + extension;
+		}
+
+		bool LoadOBJ(const std::string& filename, TriangleMesh& mesh)
+		{
+			const auto startTime{ std::chrono::steady_clock::now() };
+
+			uint64_t sourceHash{};
+			if (!HashFile(filename, sourceHash))
+				return false;
+
+			const uint64_t buildHash{ HashBuild(mesh) };
+			const std::string cacheFilename{ GetCacheFilename(filename, buildHash, ".bvhcache") };
+
+			bool isCached{ false };
+			if (mesh.shouldUseBVH && TryLoadCache(cacheFilename, sourceHash, buildHash, mesh))
+			{
+				isCached = true;
+				mesh.UpdateTransforms();
+			}
+			else
+			{
+				mesh.positions.clear();
+				mesh.normals.clear();
+				mesh.indices.clear();
+				mesh.centroids.clear();
+
+				if (!Utils::ParseOBJ(filename, mesh.positions, mesh.normals, mesh.indices, mesh.texcoords))
+					return false;
+
+#ifdef REPORT_MESH_OPTIMIZATION
+				TriangleMesh unoptimizedMesh{ mesh };
+#endif
+				MeshOptimizer::PrintStats(MeshOptimizer::Optimize(mesh));
+
+				mesh.CalculateCentroids();
+				if (!mesh.shouldUseBVH)
+					mesh.UpdateAABB(-1);
+				mesh.UpdateTransforms();
+
+				if (mesh.shouldUseBVH)
+				{
+					mesh.InitBVH();
+					mesh.BuildBVH();
+					if (mesh.bvhSettings.treeletSize > 0)
+						TreeletOptimizer::PrintStats(TreeletOptimizer::Optimize(mesh));
+					MeshOptimizer::ReorderVertices(mesh);
+					WriteCache(cacheFilename, sourceHash, buildHash, mesh);
+				}
+
+#ifdef REPORT_MESH_OPTIMIZATION
+				//ParseOBJ leaves NaN normals on degenerate triangles, those never report a hit
+				unoptimizedMesh.CalculateCentroids();
+				if (!unoptimizedMesh.shouldUseBVH)
+					unoptimizedMesh.UpdateAABB(-1);
+				unoptimizedMesh.UpdateTransforms();
+				if (unoptimizedMesh.shouldUseBVH)
+				{
+					unoptimizedMesh.InitBVH();
+					unoptimizedMesh.BuildBVH();
+				}
+
+				constexpr uint32_t nrRays{ 20000 };
+				const double unoptimizedTime{ MeshOptimizer::MeasureTraversal(unoptimizedMesh, nrRays) };
+				const double optimizedTime{ MeshOptimizer::MeasureTraversal(mesh, nrRays) };
+				std::cout << "Traversal: " << unoptimizedTime * 1000.0 << "ms -> " << optimizedTime * 1000.0 << "ms for "
+					<< nrRays << " rays (" << unoptimizedTime / optimizedTime << "x)" << std::endl;
+#endif
+			}
+
+			const auto duration{ std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime) };
+			std::cout << "Loaded " << filename << (isCached ? " from cache" : "") << " in " << duration.count() << "ms" << std::endl;
+			return true;
+		}
+	}
+}
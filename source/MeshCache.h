@@ -0,0 +1,36 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string>
+
+namespace dae
+{
+	struct TriangleMesh;
+
+	namespace MeshCache
+	{
+		//Bump whenever the file layout, the BVH builder or the OBJ parser output changes
+		constexpr uint32_t version{ 5 };
+
+		/**
+		 * \brief Loads an OBJ with its BVH into the mesh, from <filename>.<build hash>.bvhcache when that cache matches the source
+		 * The cache is keyed on a hash of the OBJ bytes and of the mesh transform and BVH settings the BVH is built with,
+		 * the build hash is part of the file name so meshes that share an OBJ but not a transform each keep their own cache,
+		 * on a miss the OBJ is parsed and optimized (MeshOptimizer), the BVH built (and its treelets optimized, see BVHBuildSettings::treeletSize)
+		 * and a new cache written next to the OBJ.
+		 * Set shouldUseBVH and the transforms of the mesh before calling this.
+		 * \return false if the OBJ could not be read
+		 */
+		bool LoadOBJ(const std::string& filename, TriangleMesh& mesh);
+
+		//<filename>.<16 hex digits of buildHash><extension>, one file per way the OBJ is built
+		std::string GetCacheFilename(const std::string& filename, uint64_t buildHash, const std::string& extension);
+
+		//64-bit hash of a block of memory (8 bytes per step)
+		uint64_t Hash(const void* pData, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+
+		//Hash of every byte of the file, false if it can't be opened
+		bool HashFile(const std::string& filename, uint64_t& hash);
+	}
+}
@@ -0,0 +1,368 @@
+#include "MeshOptimizer.h"
+
+//Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+#include "LinearBVH.h"
+#include "Utils.h"
+
+namespace dae
+{
+	namespace MeshOptimizer
+	{
+		namespace
+		{
+			constexpr uint32_t invalidIndex{ UINT32_MAX };
+			//Cell coordinates are packed in 21 bits per axis
+			constexpr float maxCellsPerAxis{ static_cast<float>(1 << 20) };
+
+			uint64_t MeshBytes(uint64_t nrVertices, uint64_t nrTriangles)
+			{
+				//Per vertex: position + transformed position
+				//Per triangle: 3 indices, normal, centroid, their transformed copies and ~2 BVH nodes
+				return nrVertices * 2 * sizeof(Vector3)
+					+ nrTriangles * (3 * sizeof(int) + 4 * sizeof(Vector3) + 2 * sizeof(BVHNode));
+			}
+
+			bool IsFinite(const Vector3& v)
+			{
+				return std::isfinite(v.x) && std::isfinite(v.y) && std::isfinite(v.z);
+			}
+
+#pragma region Welding
+			struct WeldGrid
+			{
+				Vector3 minAABB{};
+				float inverseCellSize{};
+				std::unordered_map<uint64_t, uint32_t> firstInCell{};	//Cell -> first welded vertex in it
+				std::vector<uint32_t> nextInCell{};					//Welded vertex -> next one in the same cell
+
+				int64_t Cell(float value, float minValue) const
+				{
+					return static_cast<int64_t>(std::floor((value - minValue) * inverseCellSize));
+				}
+
+				static uint64_t Key(int64_t x, int64_t y, int64_t z)
+				{
+					constexpr uint64_t mask{ (1ull << 21) - 1 };
+					return (static_cast<uint64_t>(x) & mask) << 42 | (static_cast<uint64_t>(y) & mask) << 21 | (static_cast<uint64_t>(z) & mask);
+				}
+			};
+
+			//Maps every vertex to the first earlier vertex within epsilon (with the same texcoord), returns the welded positions
+			std::vector<Vector3> WeldVertices(const std::vector<Vector3>& positions, const std::vector<Vector2>& texcoords, float weldEpsilon,
+				std::vector<uint32_t>& remap, std::vector<Vector2>& weldedTexcoords)
+			{
+				const bool hasTexcoords{ texcoords.size() == positions.size() };
+
+				Vector3 minAABB{ INFINITY, INFINITY, INFINITY };
+				Vector3 maxAABB{ -INFINITY, -INFINITY, -INFINITY };
+				for (const Vector3& position : positions)
+				{
+					if (!IsFinite(position))
+						continue;
+					minAABB = Vector3::Min(minAABB, position);
+					maxAABB = Vector3::Max(maxAABB, position);
+				}
+
+				const Vector3 extent{ maxAABB - minAABB };
+				const float epsilon{ weldEpsilon * extent.Magnitude() };
+				const float maxExtent{ std::max({ extent.x, extent.y, extent.z, FLT_MIN }) };
+
+				//Cells at least epsilon wide, so every candidate is in one of the 27 surrounding cells
+				WeldGrid grid{};
+				grid.minAABB = minAABB;
+				grid.inverseCellSize = 1.f / std::max(epsilon, maxExtent / maxCellsPerAxis);
+				grid.firstInCell.reserve(positions.size());
+				grid.nextInCell.reserve(positions.size());
+
+				std::vector<Vector3> weldedPositions{};
+				weldedPositions.reserve(positions.size());
+				remap.assign(positions.size(), invalidIndex);
+				weldedTexcoords.clear();
+				if (hasTexcoords)
+					weldedTexcoords.reserve(positions.size());
+
+				const float epsilonSquared{ epsilon * epsilon };
+				for (size_t i = 0; i < positions.size(); ++i)
+				{
+					const Vector3& position{ positions[i] };
+					if (!IsFinite(position))
+					{
+						//Only used by degenerate triangles, which get removed
+						remap[i] = static_cast<uint32_t>(weldedPositions.size());
+						weldedPositions.push_back(position);
+						if (hasTexcoords)
+							weldedTexcoords.push_back(texcoords[i]);
+						grid.nextInCell.push_back(invalidIndex);
+						continue;
+					}
+
+					const int64_t cellX{ grid.Cell(position.x, minAABB.x) };
+					const int64_t cellY{ grid.Cell(position.y, minAABB.y) };
+					const int64_t cellZ{ grid.Cell(position.z, minAABB.z) };
+
+					for (int64_t x = cellX - 1; x <= cellX + 1 && remap[i] == invalidIndex; ++x)
+					{
+						for (int64_t y = cellY - 1; y <= cellY + 1 && remap[i] == invalidIndex; ++y)
+						{
+							for (int64_t z = cellZ - 1; z <= cellZ + 1 && remap[i] == invalidIndex; ++z)
+							{
+								const auto cell{ grid.firstInCell.find(WeldGrid::Key(x, y, z)) };
+								if (cell == grid.firstInCell.end())
+									continue;
+
+								for (uint32_t candidate = cell->second; candidate != invalidIndex; candidate = grid.nextInCell[candidate])
+								{
+									//Seams keep their vertices, one per side
+									if ((weldedPositions[candidate] - position).SqrMagnitude() <= epsilonSquared
+										&& (!hasTexcoords || weldedTexcoords[candidate] == texcoords[i]))
+									{
+										remap[i] = candidate;
+										break;
+									}
+								}
+							}
+						}
+					}
+
+					if (remap[i] != invalidIndex)
+						continue;
+
+					const uint32_t weldedIdx{ static_cast<uint32_t>(weldedPositions.size()) };
+					remap[i] = weldedIdx;
+					weldedPositions.push_back(position);
+					if (hasTexcoords)
+						weldedTexcoords.push_back(texcoords[i]);
+
+					const auto [cell, isInserted] { grid.firstInCell.try_emplace(WeldGrid::Key(cellX, cellY, cellZ), weldedIdx) };
+					grid.nextInCell.push_back(isInserted ? invalidIndex : cell->second);
+					cell->second = weldedIdx;
+				}
+
+				return weldedPositions;
+			}
+#pragma endregion
+		}
+
+		Stats Optimize(TriangleMesh& mesh, float weldEpsilon)
+		{
+			Stats stats{};
+			stats.nrVerticesBefore = static_cast<uint32_t>(mesh.positions.size());
+			stats.nrTrianglesBefore = static_cast<uint32_t>(mesh.indices.size() / 3);
+			stats.bytesBefore = MeshBytes(stats.nrVerticesBefore, stats.nrTrianglesBefore);
+
+			std::vector<uint32_t> remap{};
+			std::vector<Vector2> texcoords{};
+			std::vector<Vector3> positions{ WeldVertices(mesh.positions, mesh.texcoords, weldEpsilon, remap, texcoords) };
+
+			//Drop triangles that collapsed while welding or have no area (their normal would be NaN)
+			std::vector<int> indices{};
+			std::vector<Vector3> normals{};
+			indices.reserve(mesh.indices.size());
+			normals.reserve(stats.nrTrianglesBefore);
+
+			for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+			{
+				const bool isInRange{ std::all_of(mesh.indices.begin() + i, mesh.indices.begin() + i + 3,
+					[&remap](int index) { return index >= 0 && static_cast<size_t>(index) < remap.size(); }) };
+				if (!isInRange)
+				{
+					++stats.nrDegenerateTriangles;
+					continue;
+				}
+
+				const int i0{ static_cast<int>(remap[mesh.indices[i]]) };
+				const int i1{ static_cast<int>(remap[mesh.indices[i + 1]]) };
+				const int i2{ static_cast<int>(remap[mesh.indices[i + 2]]) };
+
+				const Vector3 normal{ Vector3::Cross(positions[i1] - positions[i0], positions[i2] - positions[i0]) };
+				const float lengthSquared{ normal.SqrMagnitude() };
+				if (i0 == i1 || i1 == i2 || i2 == i0 || !(lengthSquared > 0.f) || !std::isfinite(lengthSquared))
+				{
+					++stats.nrDegenerateTriangles;
+					continue;
+				}
+
+				indices.push_back(i0);
+				indices.push_back(i1);
+				indices.push_back(i2);
+				normals.push_back(normal / std::sqrt(lengthSquared));
+			}
+
+			//Triangles along a Morton curve, so the BVH builder starts from (and its leaves end up with) nearby triangles
+			const uint32_t nrTriangles{ static_cast<uint32_t>(normals.size()) };
+			Vector3 minAABB{ INFINITY, INFINITY, INFINITY };
+			Vector3 maxAABB{ -INFINITY, -INFINITY, -INFINITY };
+			for (const int index : indices)
+			{
+				minAABB = Vector3::Min(minAABB, positions[index]);
+				maxAABB = Vector3::Max(maxAABB, positions[index]);
+			}
+
+			const Vector3 extent{ maxAABB - minAABB };
+			const Vector3 inverseExtent{
+				extent.x > 0.f ? 1.f / extent.x : 0.f,
+				extent.y > 0.f ? 1.f / extent.y : 0.f,
+				extent.z > 0.f ? 1.f / extent.z : 0.f };
+
+			std::vector<uint32_t> mortonCodes(nrTriangles);
+			for (uint32_t t = 0; t < nrTriangles; ++t)
+			{
+				const Vector3 centroid{ (positions[indices[t * 3]] + positions[indices[t * 3 + 1]] + positions[indices[t * 3 + 2]]) / 3.f };
+				//Same codes as the linear BVH builder, so both sort triangles in the same order
+				mortonCodes[t] = LinearBVH::MortonCode(
+					(centroid.x - minAABB.x) * inverseExtent.x,
+					(centroid.y - minAABB.y) * inverseExtent.y,
+					(centroid.z - minAABB.z) * inverseExtent.z);
+			}
+
+			std::vector<uint32_t> order(nrTriangles);
+			std::iota(order.begin(), order.end(), 0);
+			std::stable_sort(order.begin(), order.end(), [&mortonCodes](uint32_t a, uint32_t b) { return mortonCodes[a] < mortonCodes[b]; });
+
+			mesh.indices.resize(indices.size());
+			mesh.normals.resize(nrTriangles);
+			for (uint32_t t = 0; t < nrTriangles; ++t)
+			{
+				mesh.indices[t * 3] = indices[order[t] * 3];
+				mesh.indices[t * 3 + 1] = indices[order[t] * 3 + 1];
+				mesh.indices[t * 3 + 2] = indices[order[t] * 3 + 2];
+				mesh.normals[t] = normals[order[t]];
+			}
+
+			mesh.positions = std::move(positions);
+			mesh.texcoords = std::move(texcoords);
+			mesh.centroids.clear();
+			mesh.trCount = nrTriangles;
+
+			//Also drops vertices that were only used by degenerate triangles
+			ReorderVertices(mesh);
+
+			stats.nrVerticesAfter = static_cast<uint32_t>(mesh.positions.size());
+			stats.nrTrianglesAfter = nrTriangles;
+			stats.bytesAfter = MeshBytes(stats.nrVerticesAfter, stats.nrTrianglesAfter);
+			return stats;
+		}
+
+		void ReorderVertices(TriangleMesh& mesh)
+		{
+			std::vector<uint32_t> remap(mesh.positions.size(), invalidIndex);
+			std::vector<Vector3> positions{};
+			positions.reserve(mesh.positions.size());
+
+			const bool hasTransformedPositions{ mesh.transformedPositions.size() == mesh.positions.size() };
+			std::vector<Vector3> transformedPositions{};
+			if (hasTransformedPositions)
+				transformedPositions.reserve(mesh.transformedPositions.size());
+
+			const bool hasTexcoords{ mesh.texcoords.size() == mesh.positions.size() };
+			std::vector<Vector2> texcoords{};
+			if (hasTexcoords)
+				texcoords.reserve(mesh.texcoords.size());
+
+			for (int& index : mesh.indices)
+			{
+				if (remap[index] == invalidIndex)
+				{
+					remap[index] = static_cast<uint32_t>(positions.size());
+					positions.push_back(mesh.positions[index]);
+					if (hasTransformedPositions)
+						transformedPositions.push_back(mesh.transformedPositions[index]);
+					if (hasTexcoords)
+						texcoords.push_back(mesh.texcoords[index]);
+				}
+				index = static_cast<int>(remap[index]);
+			}
+
+			mesh.positions = std::move(positions);
+			if (hasTransformedPositions)
+				mesh.transformedPositions = std::move(transformedPositions);
+			if (hasTexcoords)
+				mesh.texcoords = std::move(texcoords);
+		}
+
+		std::vector<Ray> GenerateTestRays(const TriangleMesh& mesh, uint32_t nrRays, uint32_t seed)
+		{
+			Vector3 minAABB{ mesh.transformedMinAABB };
+			Vector3 maxAABB{ mesh.transformedMaxAABB };
+			if (mesh.shouldUseBVH && mesh.nodesUsed > 0)
+			{
+				minAABB = mesh.bvhNodes[mesh.rootNodeIdx].minAABB;
+				maxAABB = mesh.bvhNodes[mesh.rootNodeIdx].maxAABB;
+			}
+			else if (mesh.shouldUseBVH)
+			{
+				//No tree yet, so the bounds of the transformed vertices
+				minAABB = Vector3{ INFINITY, INFINITY, INFINITY };
+				maxAABB = Vector3{ -INFINITY, -INFINITY, -INFINITY };
+				for (const Vector3& position : mesh.transformedPositions)
+				{
+					minAABB = Vector3::Min(position, minAABB);
+					maxAABB = Vector3::Max(position, maxAABB);
+				}
+			}
+
+			const Vector3 center{ (minAABB + maxAABB) / 2.f };
+			const float radius{ (maxAABB - minAABB).Magnitude() };
+
+			//Rays from a sphere around the mesh towards random points inside its bounds
+			std::mt19937 generator{ seed };
+			std::uniform_real_distribution<float> distribution{ -1.f, 1.f };
+			std::vector<Ray> rays(nrRays);
+			for (Ray& ray : rays)
+			{
+				Vector3 direction{ distribution(generator), distribution(generator), distribution(generator) };
+				if (direction.Normalize() == 0.f)
+					direction = Vector3::UnitZ;
+
+				const Vector3 target{
+					center.x + distribution(generator) * (maxAABB.x - minAABB.x) / 2.f,
+					center.y + distribution(generator) * (maxAABB.y - minAABB.y) / 2.f,
+					center.z + distribution(generator) * (maxAABB.z - minAABB.z) / 2.f };
+
+				ray.origin = center + direction * radius;
+				ray.direction = (target - ray.origin).Normalized();
+				ray.reciprocalDir = Vector3{ 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+			}
+			return rays;
+		}
+
+		double MeasureTraversal(const TriangleMesh& mesh, uint32_t nrRays, uint32_t seed)
+		{
+			const std::vector<Ray> rays{ GenerateTestRays(mesh, nrRays, seed) };
+
+			uint32_t nrHits{ 0 };
+			const auto startTime{ std::chrono::steady_clock::now() };
+			for (const Ray& ray : rays)
+			{
+				HitRecord hitRecord{};
+				if (GeometryUtils::HitTest_TriangleMesh(mesh, ray, hitRecord))
+					++nrHits;
+			}
+			const auto duration{ std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime) };
+
+			//Keeps the loop from being optimized away
+			volatile uint32_t sink{ nrHits };
+			(void)sink;
+			return duration.count();
+		}
+
+		void PrintStats(const Stats& stats)
+		{
+			std::cout << "Optimized mesh: " << stats.nrVerticesBefore << " -> " << stats.nrVerticesAfter << " vertices, "
+				<< stats.nrTrianglesBefore << " -> " << stats.nrTrianglesAfter << " triangles ("
+				<< stats.nrDegenerateTriangles << " degenerate), "
+				<< (static_cast<int64_t>(stats.bytesBefore) - static_cast<int64_t>(stats.bytesAfter)) / 1024 << " KB saved" << std::endl;
+		}
+	}
+}
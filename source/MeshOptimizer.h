@@ -0,0 +1,45 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <vector>
+
+namespace dae
+{
+	struct TriangleMesh;
+	struct Ray;
+
+	namespace MeshOptimizer
+	{
+		struct Stats
+		{
+			uint32_t nrVerticesBefore{};
+			uint32_t nrVerticesAfter{};
+			uint32_t nrTrianglesBefore{};
+			uint32_t nrTrianglesAfter{};
+			uint32_t nrDegenerateTriangles{};
+
+			//Everything the mesh keeps per vertex and per triangle (transformed copies and BVH nodes included)
+			uint64_t bytesBefore{};
+			uint64_t bytesAfter{};
+		};
+
+		/**
+		 * \brief Welds vertices, removes degenerate triangles and reorders both for locality
+		 * Call it right after parsing, before CalculateCentroids and the BVH build. Normals are recalculated.
+		 * \param weldEpsilon Vertices closer than this fraction of the bounding box diagonal become one vertex
+		 */
+		Stats Optimize(TriangleMesh& mesh, float weldEpsilon = 1e-6f);
+
+		//Renumbers vertices in the order the triangles first use them, call it after BuildBVH so vertices follow the leaves
+		void ReorderVertices(TriangleMesh& mesh);
+
+		//Rays from a sphere around the transformed mesh towards random points in its bounds (same rays for the same seed and bounds)
+		std::vector<Ray> GenerateTestRays(const TriangleMesh& mesh, uint32_t nrRays, uint32_t seed = 1);
+
+		//Seconds it takes to trace the nrRays closest hit rays of GenerateTestRays
+		double MeasureTraversal(const TriangleMesh& mesh, uint32_t nrRays, uint32_t seed = 1);
+
+		void PrintStats(const Stats& stats);
+	}
+}
@@ -0,0 +1,548 @@
+//Micro benchmarks of the intersection and BRDF kernels, each one in isolation on randomized rays and primitives
+//Separate executable (MicroBenchmark.vcxproj) without SDL, so it also builds on Linux:
+//	g++ -std=c++20 -O2 -pthread MicroBenchmark.cpp AccelerationStructures.cpp LinearBVH.cpp SpatialSplitBVH.cpp Vector2.cpp Vector3.cpp Vector4.cpp Matrix.cpp ScratchArena.cpp OBJParser.cpp MappedFile.cpp Profiler.cpp AllocationCounter.cpp -o MicroBenchmark
+//Usage: MicroBenchmark [--count n] [--triangles n] [--hitrate p]... [--seed n] [--kernel name]
+
+//Standard includes
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+//Project includes
+#include "BRDFs.h"
+#include "DataTypes.h"
+#include "Math.h"
+#include "Utils.h"
+
+using namespace dae;
+
+namespace
+{
+	struct Settings
+	{
+		uint32_t count{ 4096 };				//Rays (and primitives) per set
+		uint32_t nrMeshTriangles{ 16384 };	//Triangle soup IntersectBVH and HitTest_TriangleMesh run on
+		std::vector<float> hitRates{};		//Fraction of the rays aimed at their primitive, empty runs 0, .5 and 1
+		uint32_t seed{ 1 };
+		std::string kernelFilter{};			//Only kernels whose name contains this
+	};
+
+	//Results are summed in here, so the optimizer can't drop the kernels
+	volatile float g_Sink{};
+
+	bool IsSelected(const Settings& settings, const char* pKernel)
+	{
+		return settings.kernelFilter.empty() || std::string(pKernel).find(settings.kernelFilter) != std::string::npos;
+	}
+
+#pragma region Random sets
+	class RandomGenerator final
+	{
+	public:
+		explicit RandomGenerator(uint32_t seed) :
+			m_Engine(seed)
+		{
+		}
+
+		float Range(float min, float max)
+		{
+			return std::uniform_real_distribution<float>{ min, max }(m_Engine);
+		}
+
+		bool Chance(float probability)
+		{
+			return Range(0.f, 1.f) < probability;
+		}
+
+		Vector3 InCube(float halfSize)
+		{
+			return { Range(-halfSize, halfSize), Range(-halfSize, halfSize), Range(-halfSize, halfSize) };
+		}
+
+		Vector3 UnitVector()
+		{
+			Vector3 direction{};
+			do
+			{
+				direction = InCube(1.f);
+			} while (direction.SqrMagnitude() < .0001f || direction.SqrMagnitude() > 1.f);
+			return direction.Normalized();
+		}
+
+		//Unit vector perpendicular to axis
+		Vector3 Perpendicular(const Vector3& axis)
+		{
+			Vector3 perpendicular{};
+			do
+			{
+				perpendicular = Vector3::Cross(axis, UnitVector());
+			} while (perpendicular.SqrMagnitude() < .0001f);
+			return perpendicular.Normalized();
+		}
+
+		Vector3 InHemisphere(const Vector3& normal)
+		{
+			const Vector3 direction{ UnitVector() };
+			return Vector3::Dot(direction, normal) < 0.f ? -direction : direction;
+		}
+
+	private:
+		std::mt19937 m_Engine;
+	};
+
+	Ray MakeRay(const Vector3& origin, const Vector3& target)
+	{
+		Ray ray{};
+		ray.origin = origin;
+		ray.direction = (target - origin).Normalized();
+		ray.reciprocalDir = { 1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z };
+		return ray;
+	}
+
+	//A point the ray from origin passes at more than radius from center
+	//Offset perpendicular to origin -> center, the closest approach of that ray is distance * offset / sqrt(distance^2 + offset^2)
+	Vector3 MissTarget(RandomGenerator& random, const Vector3& origin, const Vector3& center, float radius)
+	{
+		const Vector3 toCenter{ center - origin };
+		const float distance{ toCenter.Magnitude() };
+		const float minOffset{ radius * distance / std::sqrt(std::max(distance * distance - radius * radius, FLT_EPSILON)) };
+		return center + random.Perpendicular(toCenter / distance) * minOffset * random.Range(1.1f, 3.f);
+	}
+
+	//Triangle soup in a cube, small triangles so most rays pass through several leaves
+	TriangleMesh MakeTriangleSoup(RandomGenerator& random, uint32_t nrTriangles, float halfSize)
+	{
+		TriangleMesh mesh{};
+		mesh.positions.reserve(nrTriangles * 3);
+		mesh.indices.reserve(nrTriangles * 3);
+		for (uint32_t i = 0; i < nrTriangles; ++i)
+		{
+			const Vector3 center{ random.InCube(halfSize) };
+			for (int corner = 0; corner < 3; ++corner)
+			{
+				mesh.indices.push_back(static_cast<int>(mesh.positions.size()));
+				mesh.positions.push_back(center + random.InCube(halfSize * .02f));
+			}
+		}
+
+		mesh.trCount = nrTriangles;
+		mesh.cullMode = TriangleCullMode::NoCulling;
+		mesh.shouldUseBVH = true;
+		mesh.CalculateNormals();
+		mesh.CalculateCentroids();
+		mesh.UpdateTransforms();
+		mesh.InitBVH();
+		mesh.BuildBVH();
+		mesh.UpdateTransforms();
+		return mesh;
+	}
+#pragma endregion
+
+#pragma region Measuring
+	using Clock = std::chrono::steady_clock;
+
+	struct Measurement
+	{
+		double nsPerTest{};
+		float measuredHitRate{};	//Negative when the kernel doesn't hit or miss
+	};
+
+	/**
+	 * \brief Runs kernel(i) for every i in [0, count), repeated until a trial takes long enough to time
+	 * \param kernel Returns whether test i hit, its result has to end up in the sink
+	 * \return Best trial (the others were disturbed by something else), ns per single test
+	 */
+	template<typename Kernel>
+	Measurement Measure(uint32_t count, Kernel&& kernel)
+	{
+		constexpr int nrTrials{ 5 };
+		constexpr double minTrialSeconds{ .02 };
+
+		uint32_t nrHits{ 0 };
+		for (uint32_t i = 0; i < count; ++i)
+			nrHits += kernel(i) ? 1 : 0;
+
+		//Grow the repetitions until a trial is long enough for the clock
+		uint32_t nrRepetitions{ 1 };
+		double bestSeconds{};
+		for (;;)
+		{
+			const auto start{ Clock::now() };
+			for (uint32_t repetition = 0; repetition < nrRepetitions; ++repetition)
+				for (uint32_t i = 0; i < count; ++i)
+					kernel(i);
+			bestSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+			if (bestSeconds >= minTrialSeconds)
+				break;
+			nrRepetitions *= 2;
+		}
+
+		for (int trial = 1; trial < nrTrials; ++trial)
+		{
+			const auto start{ Clock::now() };
+			for (uint32_t repetition = 0; repetition < nrRepetitions; ++repetition)
+				for (uint32_t i = 0; i < count; ++i)
+					kernel(i);
+			bestSeconds = std::min(bestSeconds, std::chrono::duration<double>(Clock::now() - start).count());
+		}
+
+		return { bestSeconds * 1e9 / (static_cast<double>(nrRepetitions) * count), static_cast<float>(nrHits) / count };
+	}
+
+	void PrintHeader()
+	{
+		std::cout << std::left
+			<< std::setw(24) << "kernel"
+			<< std::setw(26) << "mode"
+			<< std::right
+			<< std::setw(8) << "target"
+			<< std::setw(8) << "hits"
+			<< std::setw(12) << "ns/test"
+			<< std::setw(12) << "Mtests/s" << '\n';
+	}
+
+	void PrintResult(const char* pKernel, const char* pMode, float targetHitRate, const Measurement& measurement)
+	{
+		std::cout << std::left
+			<< std::setw(24) << pKernel
+			<< std::setw(26) << pMode
+			<< std::right << std::fixed;
+
+		if (measurement.measuredHitRate < 0.f)
+			std::cout << std::setw(8) << "-" << std::setw(8) << "-";
+		else
+			std::cout << std::setprecision(2) << std::setw(8) << targetHitRate << std::setw(8) << measurement.measuredHitRate;
+
+		std::cout << std::setprecision(2) << std::setw(12) << measurement.nsPerTest
+			<< std::setw(12) << 1e3 / measurement.nsPerTest << std::endl;
+	}
+#pragma endregion
+
+#pragma region Kernels
+	struct CullModeEntry
+	{
+		TriangleCullMode cullMode;
+		const char* pName;
+	};
+
+	constexpr CullModeEntry g_CullModes[]{
+		{ TriangleCullMode::NoCulling, "NoCulling" },
+		{ TriangleCullMode::BackFaceCulling, "BackFaceCulling" },
+		{ TriangleCullMode::FrontFaceCulling, "FrontFaceCulling" }
+	};
+
+	//Closest hit fills in a HitRecord, any hit (shadow rays) only answers yes or no
+	template<typename Primitive, typename HitTest>
+	void RunClosestAndAnyHit(const char* pKernel, const char* pModeSuffix, float hitRate, const std::vector<Primitive>& primitives, const std::vector<Ray>& rays, HitTest hitTest)
+	{
+		const uint32_t count{ static_cast<uint32_t>(rays.size()) };
+
+		const Measurement closest{ Measure(count, [&](uint32_t i) {
+			HitRecord hitRecord{};
+			const bool didHit{ hitTest(primitives[i], rays[i], hitRecord, false) };
+			g_Sink = g_Sink + hitRecord.t;
+			return didHit;
+		}) };
+		PrintResult(pKernel, (std::string("closest") + pModeSuffix).c_str(), hitRate, closest);
+
+		const Measurement any{ Measure(count, [&](uint32_t i) {
+			HitRecord hitRecord{};
+			const bool didHit{ hitTest(primitives[i], rays[i], hitRecord, true) };
+			g_Sink = g_Sink + (didHit ? 1.f : 0.f);
+			return didHit;
+		}) };
+		PrintResult(pKernel, (std::string("any") + pModeSuffix).c_str(), hitRate, any);
+	}
+
+	void RunSphere(RandomGenerator& random, const Settings& settings, float hitRate)
+	{
+		std::vector<Sphere> spheres(settings.count);
+		std::vector<Ray> rays(settings.count);
+		for (uint32_t i = 0; i < settings.count; ++i)
+		{
+			Sphere& sphere{ spheres[i] };
+			sphere.origin = random.InCube(10.f);
+			sphere.radius = random.Range(.5f, 2.f);
+
+			const Vector3 origin{ sphere.origin + random.UnitVector() * (sphere.radius + random.Range(1.f, 20.f)) };
+			const Vector3 target{ random.Chance(hitRate)
+				? sphere.origin + random.UnitVector() * sphere.radius * random.Range(0.f, .9f)
+				: MissTarget(random, origin, sphere.origin, sphere.radius) };
+			rays[i] = MakeRay(origin, target);
+		}
+
+		RunClosestAndAnyHit("HitTest_Sphere", "", hitRate, spheres, rays, [](const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord) {
+			return GeometryUtils::HitTest_Sphere(sphere, ray, hitRecord, ignoreHitRecord);
+		});
+	}
+
+	void RunPlane(RandomGenerator& random, const Settings& settings, float hitRate)
+	{
+		std::vector<Plane> planes(settings.count);
+		std::vector<Ray> rays(settings.count);
+		for (uint32_t i = 0; i < settings.count; ++i)
+		{
+			Plane& plane{ planes[i] };
+			plane.origin = random.InCube(10.f);
+			plane.normal = random.UnitVector();
+
+			//Aimed at the plane or away from it
+			const Vector3 origin{ plane.origin + plane.normal * random.Range(1.f, 10.f) + random.Perpendicular(plane.normal) * random.Range(0.f, 10.f) };
+			const Vector3 onPlane{ plane.origin + random.Perpendicular(plane.normal) * random.Range(0.f, 10.f) };
+			const Vector3 target{ random.Chance(hitRate) ? onPlane : origin + (origin - onPlane) };
+			rays[i] = MakeRay(origin, target);
+		}
+
+		RunClosestAndAnyHit("HitTest_Plane", "", hitRate, planes, rays, [](const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord) {
+			return GeometryUtils::HitTest_Plane(plane, ray, hitRecord, ignoreHitRecord);
+		});
+	}
+
+	void RunTriangle(RandomGenerator& random, const Settings& settings, float hitRate)
+	{
+		std::vector<Triangle> triangles(settings.count);
+		std::vector<Ray> rays(settings.count);
+		for (uint32_t i = 0; i < settings.count; ++i)
+		{
+			const Vector3 center{ random.InCube(10.f) };
+			Vector3 v1{}, v2{};
+			do
+			{
+				v1 = center + random.InCube(1.f);
+				v2 = center + random.InCube(1.f);
+			} while (Vector3::Cross(v1 - center, v2 - center).SqrMagnitude() < .01f);
+			triangles[i] = Triangle{ center, v1, v2 };
+
+			//Inside: barycentrics folded into the triangle, outside: past the v1-v2 edge or before one of the others
+			float u{ random.Range(0.f, 1.f) };
+			float v{ random.Range(0.f, 1.f) };
+			if (random.Chance(hitRate))
+			{
+				if (u + v > 1.f)
+				{
+					u = 1.f - u;
+					v = 1.f - v;
+				}
+			}
+			else if (random.Chance(.5f))
+			{
+				u += 1.05f;
+			}
+			else
+			{
+				u = -random.Range(.05f, 1.f);
+			}
+
+			//Both sides, so back and front face culling each reject about half of the hits
+			const Vector3 target{ center + (v1 - center) * u + (v2 - center) * v };
+			rays[i] = MakeRay(target + random.UnitVector() * random.Range(2.f, 20.f), target);
+		}
+
+		for (const CullModeEntry& cullMode : g_CullModes)
+		{
+			for (Triangle& triangle : triangles)
+				triangle.cullMode = cullMode.cullMode;
+
+			RunClosestAndAnyHit("HitTest_Triangle", (std::string(" ") + cullMode.pName).c_str(), hitRate, triangles, rays, [](const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord) {
+				return GeometryUtils::HitTest_Triangle(triangle, ray, hitRecord, ignoreHitRecord);
+			});
+		}
+	}
+
+	void RunSlabTest(RandomGenerator& random, const Settings& settings, float hitRate)
+	{
+		std::vector<Vector3> minAABBs(settings.count);
+		std::vector<Vector3> maxAABBs(settings.count);
+		std::vector<Ray> rays(settings.count);
+		for (uint32_t i = 0; i < settings.count; ++i)
+		{
+			const Vector3 center{ random.InCube(10.f) };
+			const Vector3 halfExtent{ random.Range(.25f, 2.f), random.Range(.25f, 2.f), random.Range(.25f, 2.f) };
+			minAABBs[i] = center - halfExtent;
+			maxAABBs[i] = center + halfExtent;
+
+			//Outside the bounding sphere of the box
+			const float radius{ halfExtent.Magnitude() };
+			const Vector3 origin{ center + random.UnitVector() * (radius + random.Range(1.f, 20.f)) };
+			const Vector3 target{ random.Chance(hitRate)
+				? center + Vector3{ halfExtent.x * random.Range(-.9f, .9f), halfExtent.y * random.Range(-.9f, .9f), halfExtent.z * random.Range(-.9f, .9f) }
+				: MissTarget(random, origin, center, radius) };
+			rays[i] = MakeRay(origin, target);
+		}
+
+		PrintResult("SlabTest", "", hitRate, Measure(settings.count, [&](uint32_t i) {
+			const bool didHit{ GeometryUtils::SlabTest(minAABBs[i], maxAABBs[i], rays[i]) };
+			g_Sink = g_Sink + (didHit ? 1.f : 0.f);
+			return didHit;
+		}));
+	}
+
+	void RunMesh(RandomGenerator& random, const Settings& settings, float hitRate)
+	{
+		constexpr float halfSize{ 10.f };
+		TriangleMesh mesh{ MakeTriangleSoup(random, settings.nrMeshTriangles, halfSize) };
+
+		//Hits aim at a point on a random triangle, misses pass outside the bounding sphere of the cube
+		const float radius{ halfSize * std::sqrt(3.f) * 1.05f };
+		std::vector<Ray> rays(settings.count);
+		for (uint32_t i = 0; i < settings.count; ++i)
+		{
+			const Vector3 origin{ random.UnitVector() * random.Range(radius, radius * 2.f) };
+			Vector3 target{};
+			if (random.Chance(hitRate))
+			{
+				const int* pIndices{ &mesh.indices[static_cast<size_t>(random.Range(0.f, mesh.trCount - 1.f)) * 3] };
+				const float u{ random.Range(0.f, .5f) };
+				const float v{ random.Range(0.f, .5f) };
+				target = mesh.transformedPositions[pIndices[0]] * (1.f - u - v) + mesh.transformedPositions[pIndices[1]] * u + mesh.transformedPositions[pIndices[2]] * v;
+			}
+			else
+			{
+				target = MissTarget(random, origin, Vector3{}, radius);
+			}
+			rays[i] = MakeRay(origin, target);
+		}
+
+		if (IsSelected(settings, "IntersectBVH"))
+		{
+			std::vector<int> indexes(mesh.nodesUsed);
+			PrintResult("IntersectBVH", "", hitRate, Measure(settings.count, [&](uint32_t i) {
+				uint32_t nrIndexes{ 0 };
+				GeometryUtils::IntersectBVH(rays[i], mesh, mesh.rootNodeIdx, indexes.data(), nrIndexes);
+				g_Sink = g_Sink + static_cast<float>(nrIndexes);
+				return nrIndexes != 0;
+			}));
+		}
+
+		if (!IsSelected(settings, "HitTest_TriangleMesh"))
+			return;
+
+		//The mesh test with the BVH around it, per cull mode like the single triangle
+		const std::vector<const TriangleMesh*> meshes(settings.count, &mesh);
+		for (const CullModeEntry& cullMode : g_CullModes)
+		{
+			mesh.cullMode = cullMode.cullMode;
+			RunClosestAndAnyHit("HitTest_TriangleMesh", (std::string(" ") + cullMode.pName).c_str(), hitRate, meshes, rays, [](const TriangleMesh* pMesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord) {
+				return GeometryUtils::HitTest_TriangleMesh(*pMesh, ray, hitRecord, ignoreHitRecord);
+			});
+		}
+	}
+
+	//Hit rates don't apply, directions are random in the hemisphere of the normal
+	void RunBRDFs(RandomGenerator& random, const Settings& settings)
+	{
+		struct Sample
+		{
+			Vector3 n, l, v, h;
+			ColorRGB color;
+			float roughness;
+		};
+
+		std::vector<Sample> samples(settings.count);
+		for (Sample& sample : samples)
+		{
+			sample.n = random.UnitVector();
+			sample.l = random.InHemisphere(sample.n);
+			sample.v = random.InHemisphere(sample.n);
+			sample.h = (sample.l + sample.v).Normalized();
+			sample.color = ColorRGB{ random.Range(0.f, 1.f), random.Range(0.f, 1.f), random.Range(0.f, 1.f) };
+			sample.roughness = random.Range(.05f, 1.f);
+		}
+
+		const auto run = [&](const char* pKernel, auto&& brdf) {
+			if (!IsSelected(settings, pKernel))
+				return;
+
+			Measurement measurement{ Measure(settings.count, [&](uint32_t i) {
+				g_Sink = g_Sink + brdf(samples[i]);
+				return false;
+			}) };
+			measurement.measuredHitRate = -1.f;
+			PrintResult(pKernel, "", 0.f, measurement);
+		};
+
+		run("BRDF::Lambert", [](const Sample& sample) {
+			return BRDF::Lambert(.7f, sample.color).r;
+		});
+		run("BRDF::Phong", [](const Sample& sample) {
+			return BRDF::Phong(.5f, 60.f, sample.l, sample.v, sample.n).r;
+		});
+		run("BRDF::Fresnel_Schlick", [](const Sample& sample) {
+			return BRDF::FresnelFunction_Schlick(sample.h, sample.v, sample.color).r;
+		});
+		run("BRDF::NormalDist_GGX", [](const Sample& sample) {
+			return BRDF::NormalDistribution_GGX(sample.n, sample.h, sample.roughness);
+		});
+		run("BRDF::Geometry_Smith", [](const Sample& sample) {
+			return BRDF::GeometryFunction_Smith(sample.n, sample.v, sample.l, sample.roughness);
+		});
+	}
+#pragma endregion
+
+	bool ParseCommandLine(int argc, char* args[], Settings& settings)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const bool hasValue{ i + 1 < argc };
+			if (std::strcmp(args[i], "--count") == 0 && hasValue)
+				settings.count = std::max(static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10)), 1u);
+			else if (std::strcmp(args[i], "--triangles") == 0 && hasValue)
+				settings.nrMeshTriangles = std::max(static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10)), 2u);
+			else if (std::strcmp(args[i], "--hitrate") == 0 && hasValue)
+				settings.hitRates.push_back(std::clamp(static_cast<float>(std::atof(args[++i])), 0.f, 1.f));
+			else if (std::strcmp(args[i], "--seed") == 0 && hasValue)
+				settings.seed = static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10));
+			else if (std::strcmp(args[i], "--kernel") == 0 && hasValue)
+				settings.kernelFilter = args[++i];
+			else
+			{
+				std::cout << "Usage: MicroBenchmark [--count n] [--triangles n] [--hitrate p]... [--seed n] [--kernel name]\n";
+				return false;
+			}
+		}
+
+		if (settings.hitRates.empty())
+			settings.hitRates = { 0.f, .5f, 1.f };
+		return true;
+	}
+}
+
+int main(int argc, char* args[])
+{
+	Settings settings{};
+	if (!ParseCommandLine(argc, args, settings))
+		return 1;
+
+	std::cout << settings.count << " rays per set, seed " << settings.seed << "\n\n";
+	PrintHeader();
+
+	//Same seed, same sets: every kernel sees the same rays in every build
+	for (float hitRate : settings.hitRates)
+	{
+		RandomGenerator random{ settings.seed };
+		if (IsSelected(settings, "HitTest_Sphere"))
+			RunSphere(random, settings, hitRate);
+		if (IsSelected(settings, "HitTest_Plane"))
+			RunPlane(random, settings, hitRate);
+		if (IsSelected(settings, "HitTest_Triangle"))
+			RunTriangle(random, settings, hitRate);
+		if (IsSelected(settings, "SlabTest"))
+			RunSlabTest(random, settings, hitRate);
+		if (IsSelected(settings, "IntersectBVH") || IsSelected(settings, "HitTest_TriangleMesh"))
+			RunMesh(random, settings, hitRate);
+	}
+
+	RandomGenerator random{ settings.seed };
+	RunBRDFs(random, settings);
+	return 0;
+}
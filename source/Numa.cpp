@@ -0,0 +1,185 @@
+#include "Numa.h"
+
+//External includes
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+//Standard includes
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+
+namespace dae
+{
+	namespace Numa
+	{
+		namespace
+		{
+			thread_local uint32_t t_CurrentNode{ noNode };
+
+#if defined(_WIN32)
+			std::vector<Node> QueryNodes()
+			{
+				std::vector<Node> nodes{};
+				DWORD length{ 0 };
+				GetLogicalProcessorInformationEx(RelationNumaNode, nullptr, &length);
+				if (length == 0)
+					return nodes;
+
+				std::vector<uint8_t> buffer(length);
+				if (!GetLogicalProcessorInformationEx(RelationNumaNode, reinterpret_cast<SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data()), &length))
+					return nodes;
+
+				//Entries have different sizes
+				for (DWORD offset = 0; offset < length;)
+				{
+					const auto* pInfo{ reinterpret_cast<const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX*>(buffer.data() + offset) };
+					offset += pInfo->Size;
+
+					Node node{ pInfo->NumaNode.NodeNumber, {} };
+					const GROUP_AFFINITY& affinity{ pInfo->NumaNode.GroupMask };
+					for (uint32_t i = 0; i < sizeof(KAFFINITY) * 8; ++i)
+					{
+						if (affinity.Mask & (KAFFINITY{ 1 } << i))
+							node.processors.push_back(Processor{ affinity.Group, i });
+					}
+					if (!node.processors.empty())
+						nodes.push_back(std::move(node));
+				}
+				return nodes;
+			}
+#elif defined(__linux__)
+			//cpulist is "0-3,8-11"
+			std::vector<Node> QueryNodes()
+			{
+				std::vector<Node> nodes{};
+				for (uint32_t id = 0; id < 1024; ++id)
+				{
+					std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+					if (!file)
+					{
+						//Node ids can have gaps, but not this many
+						if (id > nodes.size() + 64)
+							break;
+						continue;
+					}
+
+					Node node{ id, {} };
+					std::string range{};
+					while (std::getline(file, range, ','))
+					{
+						if (range.find_first_of("0123456789") == std::string::npos)
+							continue;
+
+						const uint32_t first{ static_cast<uint32_t>(std::strtoul(range.c_str(), nullptr, 10)) };
+						const size_t dash{ range.find('-') };
+						const uint32_t last{ dash != std::string::npos ? static_cast<uint32_t>(std::strtoul(range.c_str() + dash + 1, nullptr, 10)) : first };
+						for (uint32_t cpu = first; cpu <= last; ++cpu)
+							node.processors.push_back(Processor{ 0, cpu });
+					}
+					if (!node.processors.empty())
+						nodes.push_back(std::move(node));
+				}
+				return nodes;
+			}
+#else
+			std::vector<Node> QueryNodes()
+			{
+				return {};
+			}
+#endif
+		}
+
+		const std::vector<Node>& GetNodes()
+		{
+			static const std::vector<Node> nodes{ [] {
+				std::vector<Node> queried{ QueryNodes() };
+				if (queried.empty())
+				{
+					Node node{ 0, {} };
+					for (uint32_t i = 0; i < std::max(std::thread::hardware_concurrency(), 1u); ++i)
+						node.processors.push_back(Processor{ 0, i });
+					queried.push_back(std::move(node));
+				}
+				std::sort(queried.begin(), queried.end(), [](const Node& a, const Node& b) { return a.id < b.id; });
+				return queried;
+			}() };
+			return nodes;
+		}
+
+		uint32_t GetCurrentNode()
+		{
+			return t_CurrentNode;
+		}
+
+		void SetCurrentNode(uint32_t node)
+		{
+			t_CurrentNode = node;
+		}
+
+#if defined(_WIN32)
+		bool PinCurrentThread(const Processor& processor)
+		{
+			GROUP_AFFINITY affinity{};
+			affinity.Mask = KAFFINITY{ 1 } << processor.number;
+			affinity.Group = processor.group;
+			return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr) != 0;
+		}
+
+		void* AllocatePages(size_t size)
+		{
+			return size > 0 ? VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE) : nullptr;
+		}
+
+		void FreePages(void* pData, size_t)
+		{
+			VirtualFree(pData, 0, MEM_RELEASE);
+		}
+#elif defined(__linux__)
+		bool PinCurrentThread(const Processor& processor)
+		{
+			cpu_set_t set{};
+			CPU_ZERO(&set);
+			CPU_SET(processor.number, &set);
+			return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+		}
+
+		void* AllocatePages(size_t size)
+		{
+			if (size == 0)
+				return nullptr;
+			void* pData{ mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) };
+			return pData != MAP_FAILED ? pData : nullptr;
+		}
+
+		void FreePages(void* pData, size_t size)
+		{
+			munmap(pData, size);
+		}
+#else
+		bool PinCurrentThread(const Processor&)
+		{
+			return false;
+		}
+
+		void* AllocatePages(size_t size)
+		{
+			return size > 0 ? std::calloc(size, 1) : nullptr;
+		}
+
+		void FreePages(void* pData, size_t)
+		{
+			std::free(pData);
+		}
+#endif
+	}
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+//Standard includes
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace dae
+{
+	//NUMA topology, thread pinning and memory that is placed on the node of the thread that touches it first
+	namespace Numa
+	{
+		struct Processor
+		{
+			uint16_t group;		//Processor group (Windows), 0 elsewhere
+			uint32_t number;	//Within the group
+		};
+
+		struct Node
+		{
+			uint32_t id;
+			std::vector<Processor> processors;
+		};
+
+		//Rendering on multiple nodes, see Renderer::SetNuma
+		struct Settings
+		{
+			uint32_t nrNodes{ 0 };			//0 renders with parallel_for, otherwise on the processors of the first nrNodes nodes
+			bool isPinned{ true };			//Every worker stays on one processor, so the first touch places its memory on its node
+			bool isReplicated{ false };		//Every node traces its own copy of the triangle meshes (BVH included)
+		};
+
+		static constexpr uint32_t noNode{ std::numeric_limits<uint32_t>::max() };
+
+		//Nodes with at least one processor, a single node with every hardware thread when the system doesn't tell
+		const std::vector<Node>& GetNodes();
+
+		bool PinCurrentThread(const Processor& processor);
+
+		//Index (into the nodes a WorkerPool uses) of the node the calling thread renders for, noNode outside of a pool
+		uint32_t GetCurrentNode();
+		void SetCurrentNode(uint32_t node);
+
+		//Committed but untouched pages, each one ends up on the node of the thread that first writes it
+		//nullptr when the system is out of memory (or size is 0)
+		void* AllocatePages(size_t size);
+		void FreePages(void* pData, size_t size);
+
+		//Array in its own pages, the elements are zero but physically placed on first touch
+		template<typename T>
+		class PageArray final
+		{
+		public:
+			static_assert(std::is_trivially_copyable_v<T>, "Pages are zero filled, nothing is constructed");
+
+			PageArray() = default;
+			~PageArray() { Free(); }
+
+			PageArray(const PageArray&) = delete;
+			PageArray(PageArray&&) noexcept = delete;
+			PageArray& operator=(const PageArray&) = delete;
+			PageArray& operator=(PageArray&&) noexcept = delete;
+
+			//Drops the old pages, so the new ones can be touched first by other threads
+			//Throws std::bad_alloc when the pages can't be committed, like the std::vector it replaces
+			void Allocate(size_t size)
+			{
+				Free();
+				m_pData = static_cast<T*>(AllocatePages(size * sizeof(T)));
+				if (size > 0 && !m_pData)
+					throw std::bad_alloc{};
+				m_Size = size;
+			}
+
+			T* data() const { return m_pData; }
+			size_t size() const { return m_Size; }
+			T* begin() const { return m_pData; }
+			T* end() const { return m_pData + m_Size; }
+
+		private:
+			T* m_pData{};
+			size_t m_Size{};
+
+			void Free()
+			{
+				if (m_pData)
+					FreePages(m_pData, m_Size * sizeof(T));
+				m_pData = nullptr;
+				m_Size = 0;
+			}
+		};
+	}
+}
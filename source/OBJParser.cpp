@@ -0,0 +1,372 @@
+#include "OBJParser.h"
+
+//Standard includes
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <future>
+#include <thread>
+
+//Project includes
+#include "MappedFile.h"
+
+namespace dae
+{
+	namespace OBJParser
+	{
+		namespace
+		{
+			//A chunk can't resolve negative (relative) indices on its own, it doesn't know how many vertices came before it
+			//Those are stored as (localIndex - relativeIndexBias) and fixed up while merging, localIndex is negative when
+			//the index points into a previous chunk. Missing indices are stored as INT32_MAX
+			constexpr int relativeIndexBias{ 1 << 30 };
+
+			//First destination element of a chunk in every merged array
+			struct ChunkOffsets
+			{
+				size_t positions{};
+				size_t texcoords{};
+				size_t normals{};
+				size_t corners{};
+			};
+
+#pragma region Tokenizing
+			bool IsSpace(char c)
+			{
+				return c == ' ' || c == '\t' || c == '\r';
+			}
+
+			bool IsDigit(char c)
+			{
+				return c >= '0' && c <= '9';
+			}
+
+			const char* SkipSpaces(const char* p, const char* end)
+			{
+				while (p < end && IsSpace(*p))
+					++p;
+				return p;
+			}
+
+			const char* SkipLine(const char* p, const char* end)
+			{
+				while (p < end && *p != '\n')
+					++p;
+				return p < end ? p + 1 : end;
+			}
+
+			double PowerOf10(int exponent)
+			{
+				static const double table[]{
+					1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+					1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+				if (exponent >= 0 && exponent <= 22)
+					return table[exponent];
+				if (exponent < 0 && exponent >= -22)
+					return 1.0 / table[-exponent];
+				return std::pow(10.0, exponent);
+			}
+
+			//Decimal mantissa (up to 19 significant digits) scaled by a power of 10, plenty for geometry
+			const char* ParseFloat(const char* p, const char* end, float& value)
+			{
+				p = SkipSpaces(p, end);
+
+				bool isNegative{ false };
+				if (p < end && (*p == '-' || *p == '+'))
+				{
+					isNegative = *p == '-';
+					++p;
+				}
+
+				uint64_t mantissa{ 0 };
+				int exponent{ 0 };
+				int nrDigits{ 0 };
+
+				for (; p < end && IsDigit(*p); ++p)
+				{
+					if (nrDigits < 19)
+					{
+						mantissa = mantissa * 10 + (*p - '0');
+						if (mantissa != 0)
+							++nrDigits;
+					}
+					else
+					{
+						++exponent;
+					}
+				}
+
+				if (p < end && *p == '.')
+				{
+					for (++p; p < end && IsDigit(*p); ++p)
+					{
+						if (nrDigits < 19)
+						{
+							mantissa = mantissa * 10 + (*p - '0');
+							--exponent;
+							if (mantissa != 0)
+								++nrDigits;
+						}
+					}
+				}
+
+				if (p < end && (*p == 'e' || *p == 'E'))
+				{
+					++p;
+					bool isExponentNegative{ false };
+					if (p < end && (*p == '-' || *p == '+'))
+					{
+						isExponentNegative = *p == '-';
+						++p;
+					}
+
+					int explicitExponent{ 0 };
+					for (; p < end && IsDigit(*p); ++p)
+					{
+						if (explicitExponent < 10000)
+							explicitExponent = explicitExponent * 10 + (*p - '0');
+					}
+					exponent += isExponentNegative ? -explicitExponent : explicitExponent;
+				}
+
+				const double result{ static_cast<double>(mantissa) * PowerOf10(exponent) };
+				value = static_cast<float>(isNegative ? -result : result);
+				return p;
+			}
+
+			const char* ParseInt(const char* p, const char* end, int& value)
+			{
+				bool isNegative{ false };
+				if (p < end && (*p == '-' || *p == '+'))
+				{
+					isNegative = *p == '-';
+					++p;
+				}
+
+				int result{ 0 };
+				for (; p < end && IsDigit(*p); ++p)
+					result = result * 10 + (*p - '0');
+
+				value = isNegative ? -result : result;
+				return p;
+			}
+
+			//OBJ indices are 1-based, negative ones count back from the last element read so far
+			int ToChunkIndex(int objIndex, size_t localCount)
+			{
+				if (objIndex > 0)
+					return objIndex - 1;
+				if (objIndex < 0)
+					return static_cast<int>(localCount) + objIndex - relativeIndexBias;
+				return INT32_MAX;
+			}
+#pragma endregion
+
+#pragma region Parsing
+			void ParseFace(const char* p, const char* end, OBJData& data)
+			{
+				//Corners of the current polygon
+				thread_local std::vector<int> positionCorners{};
+				thread_local std::vector<int> texcoordCorners{};
+				thread_local std::vector<int> normalCorners{};
+				positionCorners.clear();
+				texcoordCorners.clear();
+				normalCorners.clear();
+
+				while (true)
+				{
+					p = SkipSpaces(p, end);
+					if (p >= end || *p == '\n' || *p == '#')
+						break;
+
+					int position{ 0 }, texcoord{ 0 }, normal{ 0 };
+					const char* pStart{ p };
+					p = ParseInt(p, end, position);
+					if (p < end && *p == '/')
+					{
+						++p;
+						if (p < end && *p != '/')
+							p = ParseInt(p, end, texcoord);
+						if (p < end && *p == '/')
+							p = ParseInt(p + 1, end, normal);
+					}
+
+					if (p == pStart || position == 0)
+					{
+						//Not an index, ignore the rest of the line
+						break;
+					}
+
+					positionCorners.push_back(ToChunkIndex(position, data.positions.size()));
+					texcoordCorners.push_back(ToChunkIndex(texcoord, data.texcoords.size()));
+					normalCorners.push_back(ToChunkIndex(normal, data.normals.size()));
+				}
+
+				//Fan triangulation
+				for (size_t i = 2; i < positionCorners.size(); ++i)
+				{
+					for (size_t corner : { size_t(0), i - 1, i })
+					{
+						data.indices.push_back(positionCorners[corner]);
+						data.texcoordIndices.push_back(texcoordCorners[corner]);
+						data.normalIndices.push_back(normalCorners[corner]);
+					}
+				}
+			}
+
+			void ParseChunk(const char* p, const char* end, OBJData& data)
+			{
+				while (p < end)
+				{
+					p = SkipSpaces(p, end);
+					if (p >= end)
+						break;
+
+					const char* pLineEnd{ p };
+					while (pLineEnd < end && *pLineEnd != '\n')
+						++pLineEnd;
+
+					if (p + 1 < pLineEnd && p[0] == 'v')
+					{
+						Vector3 value{};
+						if (IsSpace(p[1]))
+						{
+							const char* pValue{ ParseFloat(p + 1, pLineEnd, value.x) };
+							pValue = ParseFloat(pValue, pLineEnd, value.y);
+							ParseFloat(pValue, pLineEnd, value.z);
+							data.positions.push_back(value);
+						}
+						else if (p[1] == 't')
+						{
+							const char* pValue{ ParseFloat(p + 2, pLineEnd, value.x) };
+							pValue = ParseFloat(pValue, pLineEnd, value.y);
+							ParseFloat(pValue, pLineEnd, value.z);
+							data.texcoords.push_back(value);
+						}
+						else if (p[1] == 'n')
+						{
+							const char* pValue{ ParseFloat(p + 2, pLineEnd, value.x) };
+							pValue = ParseFloat(pValue, pLineEnd, value.y);
+							ParseFloat(pValue, pLineEnd, value.z);
+							data.normals.push_back(value);
+						}
+					}
+					else if (p + 1 < pLineEnd && p[0] == 'f' && IsSpace(p[1]))
+					{
+						ParseFace(p + 1, pLineEnd, data);
+					}
+					//Comments, groups, materials, smoothing groups,... are ignored
+
+					p = SkipLine(pLineEnd, end);
+				}
+			}
+#pragma endregion
+
+#pragma region Merging
+			//fileOffset: elements the caller had before parsing, chunkOffset: fileOffset + elements of the previous chunks
+			void MergeIndices(const std::vector<int>& source, int* pDestination, int fileOffset, int chunkOffset)
+			{
+				for (size_t i = 0; i < source.size(); ++i)
+				{
+					const int index{ source[i] };
+					if (index == INT32_MAX)
+						pDestination[i] = -1;						//Missing
+					else if (index < 0)
+						pDestination[i] = chunkOffset + index + relativeIndexBias;	//Relative to the chunk
+					else
+						pDestination[i] = fileOffset + index;		//Absolute
+				}
+			}
+
+			void MergeChunk(const OBJData& chunk, OBJData& data, const ChunkOffsets& fileOffsets, const ChunkOffsets& chunkOffsets)
+			{
+				std::copy(chunk.positions.begin(), chunk.positions.end(), data.positions.begin() + chunkOffsets.positions);
+				std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), data.texcoords.begin() + chunkOffsets.texcoords);
+				std::copy(chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + chunkOffsets.normals);
+
+				int* pIndices{ data.indices.data() + chunkOffsets.corners };
+				int* pTexcoordIndices{ data.texcoordIndices.data() + chunkOffsets.corners };
+				int* pNormalIndices{ data.normalIndices.data() + chunkOffsets.corners };
+				MergeIndices(chunk.indices, pIndices, static_cast<int>(fileOffsets.positions), static_cast<int>(chunkOffsets.positions));
+				MergeIndices(chunk.texcoordIndices, pTexcoordIndices, static_cast<int>(fileOffsets.texcoords), static_cast<int>(chunkOffsets.texcoords));
+				MergeIndices(chunk.normalIndices, pNormalIndices, static_cast<int>(fileOffsets.normals), static_cast<int>(chunkOffsets.normals));
+			}
+#pragma endregion
+		}
+
+		bool Parse(const std::string& filename, OBJData& data, unsigned int nrThreads)
+		{
+			const MappedFile file{ filename };
+			if (!file.IsOpen())
+				return false;
+
+			const char* pBegin{ file.GetData() };
+			const char* pEnd{ pBegin + file.GetSize() };
+
+			//Small files aren't worth the threads
+			constexpr size_t minChunkSize{ 1 << 16 };
+			if (nrThreads == 0)
+				nrThreads = std::max(std::thread::hardware_concurrency(), 1u);
+			const size_t nrChunks{ std::max<size_t>(1, std::min<size_t>(nrThreads, file.GetSize() / minChunkSize)) };
+
+			//Split at line boundaries
+			std::vector<const char*> chunkStarts{ pBegin };
+			for (size_t i = 1; i < nrChunks; ++i)
+			{
+				const char* p{ std::max(pBegin + file.GetSize() * i / nrChunks, chunkStarts.back()) };
+				while (p < pEnd && *(p - 1) != '\n')
+					++p;
+				chunkStarts.push_back(p);
+			}
+			chunkStarts.push_back(pEnd);
+
+			std::vector<OBJData> chunks(nrChunks);
+			{
+				std::vector<std::future<void>> tasks{};
+				for (size_t i = 0; i < nrChunks; ++i)
+				{
+					tasks.push_back(std::async(std::launch::async, [&, i] { ParseChunk(chunkStarts[i], chunkStarts[i + 1], chunks[i]); }));
+				}
+				for (std::future<void>& task : tasks)
+					task.wait();
+			}
+
+			//Data is appended after what the caller already had
+			const ChunkOffsets fileOffsets{ data.positions.size(), data.texcoords.size(), data.normals.size(), data.indices.size() };
+			data.texcoordIndices.resize(data.indices.size(), -1);
+			data.normalIndices.resize(data.indices.size(), -1);
+
+			std::vector<ChunkOffsets> chunkOffsets(nrChunks);
+			ChunkOffsets total{ fileOffsets };
+			for (size_t i = 0; i < nrChunks; ++i)
+			{
+				chunkOffsets[i] = total;
+				total.positions += chunks[i].positions.size();
+				total.texcoords += chunks[i].texcoords.size();
+				total.normals += chunks[i].normals.size();
+				total.corners += chunks[i].indices.size();
+			}
+
+			data.positions.resize(total.positions);
+			data.texcoords.resize(total.texcoords);
+			data.normals.resize(total.normals);
+			data.indices.resize(total.corners);
+			data.texcoordIndices.resize(total.corners);
+			data.normalIndices.resize(total.corners);
+
+			{
+				std::vector<std::future<void>> tasks{};
+				for (size_t i = 0; i < nrChunks; ++i)
+				{
+					tasks.push_back(std::async(std::launch::async, [&, i] { MergeChunk(chunks[i], data, fileOffsets, chunkOffsets[i]); }));
+				}
+				for (std::future<void>& task : tasks)
+					task.wait();
+			}
+
+			return true;
+		}
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+//Standard includes
+#include <string>
+#include <vector>
+
+//Project includes
+#include "Vector3.h"
+
+namespace dae
+{
+	namespace OBJParser
+	{
+		//Everything a .obj describes about its geometry, polygons are fan-triangulated
+		//The index arrays are per triangle corner and 0-based, missing texcoord/normal indices are -1
+		struct OBJData
+		{
+			std::vector<Vector3> positions{};
+			std::vector<Vector3> texcoords{};	//u, v, w
+			std::vector<Vector3> normals{};		//vn, per vertex (not per triangle like TriangleMesh::normals)
+
+			std::vector<int> indices{};
+			std::vector<int> texcoordIndices{};
+			std::vector<int> normalIndices{};
+		};
+
+		/**
+		 * \brief Memory maps the file and parses line-aligned chunks of it in parallel
+		 * Supports v, vt, vn and f with v, v/vt, v//vn and v/vt/vn corners (negative indices included)
+		 * \param nrThreads 0 uses std::thread::hardware_concurrency
+		 * \return false if the file could not be opened
+		 */
+		bool Parse(const std::string& filename, OBJData& data, unsigned int nrThreads = 0);
+	}
+}
@@ -0,0 +1,420 @@
+#include "OutOfCoreMesh.h"
+
+//Standard includes
+#include <cassert>
+#include <cstring>
+#include <fstream>
+
+//Project includes
+#include "MappedFile.h"
+#include "MeshCache.h"
+#include "ScratchArena.h"
+#include "Utils.h"
+
+namespace dae
+{
+	namespace
+	{
+		constexpr char magic[8]{ 'D', 'A', 'E', 'P', 'A', 'G', 'E', '\0' };
+		constexpr uint32_t version{ 2 };
+		//Pages start on an OS page so paging one in never touches its neighbours
+		constexpr uint64_t pageAlignment{ 4096 };
+
+		struct FileHeader
+		{
+			char magic[8]{};
+			uint32_t version{};
+			uint32_t nrTopNodes{};
+			uint32_t nrPages{};
+			uint32_t maxDepth{};	//Of the top tree and of every page, their roots are at depth 0
+			uint64_t sourceHash{};
+			uint64_t buildHash{};
+			uint64_t topNodesOffset{};
+			uint64_t pageTableOffset{};
+			uint64_t fileSize{};
+		};
+
+		struct FilePageEntry
+		{
+			uint64_t offset{};
+			uint32_t nrNodes{};
+			uint32_t nrTriangles{};
+		};
+
+		struct FileTriangle
+		{
+			Vector3 v0, v1, v2;
+			Vector3 normal;
+		};
+
+		uint64_t AlignUp(uint64_t offset, uint64_t alignment)
+		{
+			return (offset + alignment - 1) & ~(alignment - 1);
+		}
+
+#pragma region Building
+		struct PageBuilder
+		{
+			const TriangleMesh& mesh;
+			std::vector<BVHNode> nodes{};
+			std::vector<FileTriangle> triangles{};
+			uint32_t maxDepth{};
+
+			//Copies the subtree below meshNodeIdx into nodes[localIdx], children are kept next to each other
+			void Emit(uint32_t meshNodeIdx, uint32_t localIdx, uint32_t depth)
+			{
+				maxDepth = std::max(maxDepth, depth);
+				const BVHNode& meshNode{ mesh.bvhNodes[meshNodeIdx] };
+				nodes[localIdx].minAABB = meshNode.minAABB;
+				nodes[localIdx].maxAABB = meshNode.maxAABB;
+
+				if (meshNode.nrPrimitives != 0)
+				{
+					nodes[localIdx].leftFirst = static_cast<uint32_t>(triangles.size());
+					nodes[localIdx].nrPrimitives = meshNode.nrPrimitives;
+
+					for (uint32_t slot = meshNode.leftFirst; slot < meshNode.leftFirst + meshNode.nrPrimitives; ++slot)
+					{
+						const uint32_t t{ mesh.GetLeafTriangle(slot) };
+						triangles.push_back(FileTriangle{
+							mesh.GetTransformedPosition(mesh.indices[t * 3]),
+							mesh.GetTransformedPosition(mesh.indices[t * 3 + 1]),
+							mesh.GetTransformedPosition(mesh.indices[t * 3 + 2]),
+							mesh.GetTransformedNormal(t) });
+					}
+					return;
+				}
+
+				const uint32_t leftIdx{ static_cast<uint32_t>(nodes.size()) };
+				nodes.resize(nodes.size() + 2);
+				nodes[localIdx].leftFirst = leftIdx;
+				nodes[localIdx].nrPrimitives = 0;
+
+				Emit(meshNode.leftFirst, leftIdx, depth + 1);
+				Emit(meshNode.leftFirst + 1, leftIdx + 1, depth + 1);
+			}
+		};
+
+		struct FileBuilder
+		{
+			const TriangleMesh& mesh;
+			uint32_t maxTrianglesPerPage{};
+			std::vector<uint32_t> subtreeTriangles{};
+
+			std::vector<BVHNode> topNodes{};
+			std::vector<PageBuilder> pages{};
+			uint32_t maxDepth{};
+
+			uint32_t CountTriangles(uint32_t nodeIdx)
+			{
+				const BVHNode& node{ mesh.bvhNodes[nodeIdx] };
+				if (node.nrPrimitives != 0)
+					subtreeTriangles[nodeIdx] = node.nrPrimitives;
+				else
+					subtreeTriangles[nodeIdx] = CountTriangles(node.leftFirst) + CountTriangles(node.leftFirst + 1);
+				return subtreeTriangles[nodeIdx];
+			}
+
+			void Emit(uint32_t meshNodeIdx, uint32_t topIdx, uint32_t depth)
+			{
+				maxDepth = std::max(maxDepth, depth);
+				const BVHNode& meshNode{ mesh.bvhNodes[meshNodeIdx] };
+				topNodes[topIdx].minAABB = meshNode.minAABB;
+				topNodes[topIdx].maxAABB = meshNode.maxAABB;
+
+				//Small enough (or a leaf that can't be split), this subtree becomes a page
+				if (meshNode.nrPrimitives != 0 || subtreeTriangles[meshNodeIdx] <= maxTrianglesPerPage)
+				{
+					PageBuilder page{ mesh };
+					page.nodes.resize(1);
+					page.Emit(meshNodeIdx, 0, 0);
+					maxDepth = std::max(maxDepth, page.maxDepth);
+
+					topNodes[topIdx].leftFirst = static_cast<uint32_t>(pages.size());
+					topNodes[topIdx].nrPrimitives = subtreeTriangles[meshNodeIdx];
+					pages.push_back(std::move(page));
+					return;
+				}
+
+				const uint32_t leftIdx{ static_cast<uint32_t>(topNodes.size()) };
+				topNodes.resize(topNodes.size() + 2);
+				topNodes[topIdx].leftFirst = leftIdx;
+				topNodes[topIdx].nrPrimitives = 0;
+
+				Emit(meshNode.leftFirst, leftIdx, depth + 1);
+				Emit(meshNode.leftFirst + 1, leftIdx + 1, depth + 1);
+			}
+		};
+#pragma endregion
+	}
+
+	OutOfCoreMesh::OutOfCoreMesh(const std::string& filename, uint64_t sourceHash, uint64_t buildHash, uint64_t residentBudget, TriangleCullMode cullMode, MaterialHandle materialHandle) :
+		m_pFile(std::make_unique<MappedFile>(filename)),
+		m_CullMode(cullMode),
+		m_MaterialHandle(materialHandle),
+		m_ResidentBudget(residentBudget)
+	{
+		if (!m_pFile->IsOpen() || m_pFile->GetSize() < sizeof(FileHeader))
+			return;
+
+		const char* pFile{ m_pFile->GetData() };
+		FileHeader header{};
+		std::memcpy(&header, pFile, sizeof(FileHeader));
+
+		if (std::memcmp(header.magic, magic, sizeof(magic)) != 0
+			|| header.version != version
+			|| header.sourceHash != sourceHash
+			|| header.buildHash != buildHash
+			|| header.fileSize != m_pFile->GetSize()
+			|| header.topNodesOffset + header.nrTopNodes * sizeof(BVHNode) > header.fileSize
+			|| header.pageTableOffset + header.nrPages * sizeof(FilePageEntry) > header.fileSize)
+			return;
+
+		//The top of the tree and the page table are the only resident parts
+		const FilePageEntry* pEntries{ reinterpret_cast<const FilePageEntry*>(pFile + header.pageTableOffset) };
+		m_PageTable.reserve(header.nrPages);
+		for (uint32_t i = 0; i < header.nrPages; ++i)
+		{
+			if (pEntries[i].offset + pEntries[i].nrNodes * sizeof(BVHNode) + pEntries[i].nrTriangles * sizeof(FileTriangle) > header.fileSize)
+			{
+				m_PageTable.clear();
+				return;
+			}
+			m_PageTable.push_back(PageEntry{ pEntries[i].offset, pEntries[i].nrNodes, pEntries[i].nrTriangles });
+		}
+
+		m_pPageSlots = std::make_unique<PageSlot[]>(header.nrPages);
+		//Every inner node pops one entry and pushes two, so the stack never holds more than the depth + 1
+		m_StackSize = header.maxDepth + 1;
+
+		const BVHNode* pTopNodes{ reinterpret_cast<const BVHNode*>(pFile + header.topNodesOffset) };
+		m_TopNodes.assign(pTopNodes, pTopNodes + header.nrTopNodes);
+	}
+
+	OutOfCoreMesh::~OutOfCoreMesh() = default;
+
+	bool OutOfCoreMesh::Build(const TriangleMesh& mesh, const std::string& filename, uint64_t sourceHash, uint32_t maxTrianglesPerPage)
+	{
+		if (!mesh.shouldUseBVH || mesh.nodesUsed == 0)
+			return false;
+
+		FileBuilder builder{ mesh, std::max(maxTrianglesPerPage, 1u) };
+		builder.subtreeTriangles.resize(mesh.nodesUsed);
+		builder.CountTriangles(mesh.rootNodeIdx);
+		builder.topNodes.resize(1);
+		builder.Emit(mesh.rootNodeIdx, 0, 0);
+
+		FileHeader header{};
+		std::memcpy(header.magic, magic, sizeof(magic));
+		header.version = version;
+		header.maxDepth = builder.maxDepth;
+		header.sourceHash = sourceHash;
+		header.buildHash = HashBuild(mesh, maxTrianglesPerPage);
+		header.nrTopNodes = static_cast<uint32_t>(builder.topNodes.size());
+		header.nrPages = static_cast<uint32_t>(builder.pages.size());
+		header.topNodesOffset = AlignUp(sizeof(FileHeader), 64);
+		header.pageTableOffset = AlignUp(header.topNodesOffset + header.nrTopNodes * sizeof(BVHNode), 64);
+
+		std::vector<FilePageEntry> pageTable(header.nrPages);
+		uint64_t offset{ header.pageTableOffset + header.nrPages * sizeof(FilePageEntry) };
+		for (uint32_t i = 0; i < header.nrPages; ++i)
+		{
+			offset = AlignUp(offset, pageAlignment);
+			pageTable[i].offset = offset;
+			pageTable[i].nrNodes = static_cast<uint32_t>(builder.pages[i].nodes.size());
+			pageTable[i].nrTriangles = static_cast<uint32_t>(builder.pages[i].triangles.size());
+			offset += pageTable[i].nrNodes * sizeof(BVHNode) + pageTable[i].nrTriangles * sizeof(FileTriangle);
+		}
+		header.fileSize = offset;
+
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return false;
+
+		auto padTo = [&file](uint64_t target)
+		{
+			static const char zeros[pageAlignment]{};
+			file.write(zeros, target - static_cast<uint64_t>(file.tellp()));
+		};
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+		padTo(header.topNodesOffset);
+		file.write(reinterpret_cast<const char*>(builder.topNodes.data()), header.nrTopNodes * sizeof(BVHNode));
+		padTo(header.pageTableOffset);
+		file.write(reinterpret_cast<const char*>(pageTable.data()), header.nrPages * sizeof(FilePageEntry));
+
+		for (uint32_t i = 0; i < header.nrPages; ++i)
+		{
+			padTo(pageTable[i].offset);
+			file.write(reinterpret_cast<const char*>(builder.pages[i].nodes.data()), pageTable[i].nrNodes * sizeof(BVHNode));
+			file.write(reinterpret_cast<const char*>(builder.pages[i].triangles.data()), pageTable[i].nrTriangles * sizeof(FileTriangle));
+		}
+
+		return file.good();
+	}
+
+	uint64_t OutOfCoreMesh::HashBuild(const TriangleMesh& mesh, uint32_t maxTrianglesPerPage)
+	{
+		uint64_t hash{ MeshCache::Hash(&version, sizeof(version)) };
+		//The pages are cut from the mesh MeshCache loads, a change in its triangle order changes them too
+		hash = MeshCache::Hash(&MeshCache::version, sizeof(MeshCache::version), hash);
+		hash = MeshCache::Hash(&mesh.rotationTransform, sizeof(Matrix), hash);
+		hash = MeshCache::Hash(&mesh.translationTransform, sizeof(Matrix), hash);
+		hash = MeshCache::Hash(&mesh.scaleTransform, sizeof(Matrix), hash);
+		hash = MeshCache::Hash(&mesh.bvhSettings, sizeof(BVHBuildSettings), hash);
+		hash = MeshCache::Hash(&maxTrianglesPerPage, sizeof(maxTrianglesPerPage), hash);
+		return hash;
+	}
+
+	OutOfCoreMesh::Stats OutOfCoreMesh::GetStats() const
+	{
+		Stats stats{};
+		stats.pageIns = m_PageIns.load(std::memory_order_relaxed);
+		stats.evictions = m_Evictions.load(std::memory_order_relaxed);
+		stats.totalPages = static_cast<uint32_t>(m_PageTable.size());
+
+		std::lock_guard<std::mutex> lock{ m_PagingMutex };
+		stats.residentBytes = m_ResidentBytes;
+		stats.residentPages = static_cast<uint32_t>(m_ResidentPages.size());
+		return stats;
+	}
+
+	std::shared_ptr<const OutOfCoreMesh::Page> OutOfCoreMesh::AcquirePage(uint32_t pageIdx) const
+	{
+		PageSlot& slot{ m_pPageSlots[pageIdx] };
+		slot.lastUsedFrame.store(m_CurrentFrame.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+		//Fast path, already resident
+		std::shared_ptr<const Page> pPage{ slot.pPage.load(std::memory_order_acquire) };
+		if (pPage)
+			return pPage;
+
+		std::lock_guard<std::mutex> lock{ m_PagingMutex };
+
+		//Another thread might have paged it in while we waited
+		pPage = slot.pPage.load(std::memory_order_acquire);
+		if (pPage)
+			return pPage;
+
+		const PageEntry& entry{ m_PageTable[pageIdx] };
+		const char* pData{ m_pFile->GetData() + entry.offset };
+
+		auto pNewPage{ std::make_shared<Page>() };
+		const BVHNode* pNodes{ reinterpret_cast<const BVHNode*>(pData) };
+		pNewPage->nodes.assign(pNodes, pNodes + entry.nrNodes);
+		const PagedTriangle* pTriangles{ reinterpret_cast<const PagedTriangle*>(pData + entry.nrNodes * sizeof(BVHNode)) };
+		pNewPage->triangles.assign(pTriangles, pTriangles + entry.nrTriangles);
+
+		pPage = pNewPage;
+		slot.pPage.store(pPage, std::memory_order_release);
+		m_ResidentPages.push_back(pageIdx);
+		m_ResidentBytes += entry.nrNodes * sizeof(BVHNode) + entry.nrTriangles * sizeof(PagedTriangle);
+		m_PageIns.fetch_add(1, std::memory_order_relaxed);
+
+		//Evict least recently used pages until we are back under budget (never the page we just loaded)
+		//Rays still using an evicted page keep it alive through their shared_ptr
+		while (m_ResidentBytes > m_ResidentBudget && m_ResidentPages.size() > 1)
+		{
+			size_t oldestIdx{ 0 };
+			uint32_t oldestFrame{ UINT32_MAX };
+			for (size_t i = 0; i < m_ResidentPages.size(); ++i)
+			{
+				const uint32_t frame{ m_pPageSlots[m_ResidentPages[i]].lastUsedFrame.load(std::memory_order_relaxed) };
+				if (m_ResidentPages[i] != pageIdx && frame < oldestFrame)
+				{
+					oldestFrame = frame;
+					oldestIdx = i;
+				}
+			}
+
+			const uint32_t evictedPageIdx{ m_ResidentPages[oldestIdx] };
+			const PageEntry& evictedEntry{ m_PageTable[evictedPageIdx] };
+			m_pPageSlots[evictedPageIdx].pPage.store(nullptr, std::memory_order_release);
+			m_ResidentBytes -= evictedEntry.nrNodes * sizeof(BVHNode) + evictedEntry.nrTriangles * sizeof(PagedTriangle);
+			m_ResidentPages[oldestIdx] = m_ResidentPages.back();
+			m_ResidentPages.pop_back();
+			m_Evictions.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		return pPage;
+	}
+
+	bool OutOfCoreMesh::HitTestPage(const Page& page, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord) const
+	{
+		Triangle triangle{};
+		triangle.cullMode = m_CullMode;
+		triangle.materialHandle = m_MaterialHandle;
+
+		//Sized from the depth the file was built with, scratch memory of this thread
+		ScratchArena& arena{ ScratchArena::Get() };
+		ScratchArena::Scope scope{ arena };
+		uint32_t* pStack{ arena.Allocate<uint32_t>(m_StackSize) };
+		uint32_t stackSize{ 0 };
+		pStack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const BVHNode& node{ page.nodes[pStack[--stackSize]] };
+			TraversalStats::Add(TraversalStats::NodesVisited);
+			TraversalStats::Touch(&node);
+			if (!GeometryUtils::SlabTest(node.minAABB, node.maxAABB, ray))
+				continue;
+
+			if (node.nrPrimitives == 0)
+			{
+				assert(stackSize + 2 <= m_StackSize && "Deeper than the file header says");
+				pStack[stackSize++] = node.leftFirst;
+				pStack[stackSize++] = node.leftFirst + 1;
+				continue;
+			}
+
+			for (uint32_t i = node.leftFirst; i < node.leftFirst + node.nrPrimitives; ++i)
+			{
+				const PagedTriangle& pagedTriangle{ page.triangles[i] };
+				TraversalStats::Touch(&pagedTriangle);
+				triangle.v0 = pagedTriangle.v0;
+				triangle.v1 = pagedTriangle.v1;
+				triangle.v2 = pagedTriangle.v2;
+				triangle.normal = pagedTriangle.normal;
+				if (GeometryUtils::HitTest_Triangle(triangle, ray, hitRecord) && ignoreHitRecord)
+					return true;
+			}
+		}
+		return hitRecord.didHit;
+	}
+
+	bool OutOfCoreMesh::HitTest(const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord) const
+	{
+		if (m_TopNodes.empty())
+			return false;
+
+		//Sized from the depth the file was built with, scratch memory of this thread
+		ScratchArena& arena{ ScratchArena::Get() };
+		ScratchArena::Scope scope{ arena };
+		uint32_t* pStack{ arena.Allocate<uint32_t>(m_StackSize) };
+		uint32_t stackSize{ 0 };
+		pStack[stackSize++] = 0;
+
+		while (stackSize > 0)
+		{
+			const BVHNode& node{ m_TopNodes[pStack[--stackSize]] };
+			TraversalStats::Add(TraversalStats::NodesVisited);
+			TraversalStats::Touch(&node);
+			if (!GeometryUtils::SlabTest(node.minAABB, node.maxAABB, ray))
+				continue;
+
+			if (node.nrPrimitives == 0)
+			{
+				assert(stackSize + 2 <= m_StackSize && "Deeper than the file header says");
+				pStack[stackSize++] = node.leftFirst;
+				pStack[stackSize++] = node.leftFirst + 1;
+				continue;
+			}
+
+			const std::shared_ptr<const Page> pPage{ AcquirePage(node.leftFirst) };
+			if (HitTestPage(*pPage, ray, hitRecord, ignoreHitRecord) && ignoreHitRecord)
+				return true;
+		}
+		return hitRecord.didHit;
+	}
+}
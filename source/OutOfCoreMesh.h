@@ -0,0 +1,118 @@
+#pragma once
+
+//Standard includes
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+
+namespace dae
+{
+	class MappedFile;
+
+	//Static triangle mesh that only keeps the top of its BVH in memory
+	//Every subtree below the top is a page (its BVH nodes + triangles) in a memory mapped file,
+	//pages are copied in the first time a ray reaches them and evicted least recently used first once over budget
+	class OutOfCoreMesh final
+	{
+	public:
+		struct Stats
+		{
+			uint64_t pageIns{};
+			uint64_t evictions{};
+			uint64_t residentBytes{};
+			uint32_t residentPages{};
+			uint32_t totalPages{};
+		};
+
+		/**
+		 * \brief Opens a file written by OutOfCoreMesh::Build, IsLoaded stays false when it was built from another source or with another build hash
+		 * \param sourceHash Of the file the mesh is loaded from (MeshCache::HashFile)
+		 * \param buildHash OutOfCoreMesh::HashBuild of the mesh, set up the way it will be for Build
+		 * \param residentBudget Maximum amount of page bytes kept in memory (the top of the BVH is not counted)
+		 */
+		OutOfCoreMesh(const std::string& filename, uint64_t sourceHash, uint64_t buildHash, uint64_t residentBudget, TriangleCullMode cullMode, MaterialHandle materialHandle);
+		~OutOfCoreMesh();
+
+		OutOfCoreMesh(const OutOfCoreMesh&) = delete;
+		OutOfCoreMesh(OutOfCoreMesh&&) noexcept = delete;
+		OutOfCoreMesh& operator=(const OutOfCoreMesh&) = delete;
+		OutOfCoreMesh& operator=(OutOfCoreMesh&&) noexcept = delete;
+
+		/**
+		 * \brief Writes the mesh (in its current, transformed, state) and its BVH as a paged file
+		 * \param sourceHash Of the file the mesh was loaded from (MeshCache::HashFile), stored with HashBuild so a stale file isn't opened
+		 * \param maxTrianglesPerPage Subtrees up to this size become one page
+		 */
+		static bool Build(const TriangleMesh& mesh, const std::string& filename, uint64_t sourceHash, uint32_t maxTrianglesPerPage = 1024);
+
+		//The pages hold transformed triangles, so the transform, the BVH settings and the page size all change the file.
+		//Name the file after it (MeshCache::GetCacheFilename) so meshes built differently from one OBJ don't overwrite each other
+		static uint64_t HashBuild(const TriangleMesh& mesh, uint32_t maxTrianglesPerPage = 1024);
+
+		bool IsLoaded() const { return !m_TopNodes.empty(); }
+		bool HitTest(const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false) const;
+
+		//Pages used in the current frame are the most recently used ones
+		void NextFrame() { ++m_CurrentFrame; }
+		Stats GetStats() const;
+
+		Vector3 GetMinAABB() const { return m_TopNodes.empty() ? Vector3{} : m_TopNodes[0].minAABB; }
+		Vector3 GetMaxAABB() const { return m_TopNodes.empty() ? Vector3{} : m_TopNodes[0].maxAABB; }
+
+	private:
+		struct PagedTriangle
+		{
+			Vector3 v0, v1, v2;
+			Vector3 normal;
+		};
+
+		struct Page
+		{
+			std::vector<BVHNode> nodes{};	//Leaves index into triangles
+			std::vector<PagedTriangle> triangles{};
+		};
+
+		struct PageEntry
+		{
+			uint64_t offset{};
+			uint32_t nrNodes{};
+			uint32_t nrTriangles{};
+		};
+
+		//std::atomic<std::shared_ptr> is not lock free (the standard library guards it with a small internal lock),
+		//but a lookup never waits on m_PagingMutex
+		struct PageSlot
+		{
+			std::atomic<std::shared_ptr<const Page>> pPage{};
+			std::atomic<uint32_t> lastUsedFrame{};
+		};
+
+		std::unique_ptr<MappedFile> m_pFile{};
+		std::vector<BVHNode> m_TopNodes{};	//Leaves reference a page: leftFirst = page index
+		std::vector<PageEntry> m_PageTable{};
+		std::unique_ptr<PageSlot[]> m_pPageSlots{};
+
+		TriangleCullMode m_CullMode{};
+		MaterialHandle m_MaterialHandle{};
+
+		uint64_t m_ResidentBudget{};
+		uint32_t m_StackSize{};	//Traversal stack of the top tree and of every page, the deepest node of the file + 1
+		std::atomic<uint32_t> m_CurrentFrame{ 0 };
+
+		//Guards page-in and eviction, lookups of resident pages don't take it
+		mutable std::mutex m_PagingMutex{};
+		mutable std::vector<uint32_t> m_ResidentPages{};
+		mutable uint64_t m_ResidentBytes{};
+		mutable std::atomic<uint64_t> m_PageIns{ 0 };
+		mutable std::atomic<uint64_t> m_Evictions{ 0 };
+
+		std::shared_ptr<const Page> AcquirePage(uint32_t pageIdx) const;
+		bool HitTestPage(const Page& page, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord) const;
+	};
+}
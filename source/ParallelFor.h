@@ -0,0 +1,24 @@
+#pragma once
+
+//External includes
+#if defined(_WIN32)
+#include <ppl.h> //parallel_for
+#endif
+
+//Standard includes
+#include <cstdint>
+
+namespace dae
+{
+	//Calls function(i) for every i below count. PPL only exists on Windows, elsewhere (the BVHAnalyzer Linux build) the loop runs on the calling thread
+	template<typename Function>
+	void ParallelFor(uint32_t count, const Function& function)
+	{
+#if defined(_WIN32)
+		concurrency::parallel_for(0u, count, function);
+#else
+		for (uint32_t i = 0; i < count; ++i)
+			function(i);
+#endif
+	}
+}
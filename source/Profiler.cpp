@@ -0,0 +1,166 @@
+#include "Profiler.h"
+
+//Standard includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//Project includes
+#include "AllocationCounter.h"
+
+namespace dae
+{
+	namespace Profiler
+	{
+		namespace
+		{
+			//Per thread, the oldest zones are overwritten when a capture runs longer than this
+			constexpr uint32_t ringBufferSize{ 1 << 16 };
+
+			struct Event
+			{
+				const char* pName;
+				uint64_t start;		//ns since the start of the capture
+				uint64_t end;
+			};
+
+			//Only its own thread writes, the count is published after the event so a reader never sees half of one
+			struct ThreadBuffer
+			{
+				std::unique_ptr<Event[]> pEvents{ std::make_unique<Event[]>(ringBufferSize) };
+				std::atomic<uint64_t> count{ 0 };
+				uint32_t threadId{};
+				std::string name{};
+			};
+
+			std::atomic<bool> g_IsCapturing{ false };
+			std::chrono::steady_clock::time_point g_CaptureStart{};
+
+			//Registering a thread locks, recording never does
+			std::mutex g_BuffersMutex{};
+			std::vector<std::unique_ptr<ThreadBuffer>> g_Buffers{};
+
+			uint64_t GetTime()
+			{
+				return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - g_CaptureStart).count());
+			}
+
+			ThreadBuffer& GetThreadBuffer()
+			{
+				thread_local ThreadBuffer* pBuffer{ nullptr };
+				if (!pBuffer)
+				{
+					//Once per thread, not part of the frame
+					AllocationCounter::ScopedIgnore ignoreAllocations{};
+					std::lock_guard<std::mutex> lock{ g_BuffersMutex };
+					g_Buffers.push_back(std::make_unique<ThreadBuffer>());
+					pBuffer = g_Buffers.back().get();
+					pBuffer->threadId = static_cast<uint32_t>(g_Buffers.size());
+				}
+				return *pBuffer;
+			}
+
+			void WriteEscaped(std::ofstream& file, const char* pText)
+			{
+				for (; *pText != '\0'; ++pText)
+				{
+					if (*pText == '"' || *pText == '\\')
+						file << '\\';
+					file << *pText;
+				}
+			}
+		}
+
+		Zone::Zone(const char* pName) :
+			m_pName(g_IsCapturing.load(std::memory_order_acquire) ? pName : nullptr)
+		{
+			if (m_pName)
+				m_Start = GetTime();
+		}
+
+		Zone::~Zone()
+		{
+			if (!m_pName || !g_IsCapturing.load(std::memory_order_relaxed))
+				return;
+
+			ThreadBuffer& buffer{ GetThreadBuffer() };
+			const uint64_t count{ buffer.count.load(std::memory_order_relaxed) };
+			buffer.pEvents[count % ringBufferSize] = Event{ m_pName, m_Start, GetTime() };
+			buffer.count.store(count + 1, std::memory_order_release);
+		}
+
+		void SetThreadName(const char* pName)
+		{
+			ThreadBuffer& buffer{ GetThreadBuffer() };
+			std::lock_guard<std::mutex> lock{ g_BuffersMutex };
+			buffer.name = pName;
+		}
+
+		bool IsCapturing()
+		{
+			return g_IsCapturing.load(std::memory_order_relaxed);
+		}
+
+		void StartCapture()
+		{
+			{
+				std::lock_guard<std::mutex> lock{ g_BuffersMutex };
+				for (const auto& pBuffer : g_Buffers)
+					pBuffer->count.store(0, std::memory_order_relaxed);
+				g_CaptureStart = std::chrono::steady_clock::now();
+			}
+			g_IsCapturing.store(true, std::memory_order_release);
+			std::cout << "Profiler capture started" << std::endl;
+		}
+
+		bool StopCapture(const std::string& filename)
+		{
+			g_IsCapturing.store(false, std::memory_order_relaxed);
+
+			std::ofstream file(filename, std::ios::trunc);
+			if (!file)
+			{
+				std::cout << "Can't write profiler capture " << filename << std::endl;
+				return false;
+			}
+
+			std::lock_guard<std::mutex> lock{ g_BuffersMutex };
+			file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+			bool isFirst{ true };
+			size_t nrEvents{ 0 };
+			for (const auto& pBuffer : g_Buffers)
+			{
+				file << (isFirst ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << pBuffer->threadId << ",\"args\":{\"name\":\"";
+				WriteEscaped(file, pBuffer->name.empty() ? ("Thread " + std::to_string(pBuffer->threadId)).c_str() : pBuffer->name.c_str());
+				file << "\"}}";
+				isFirst = false;
+
+				//A zone that was ending while the capture stopped can still land, only what's published before the copy counts
+				//and anything it may have overwritten (older than a full ring) is dropped
+				const uint64_t count{ pBuffer->count.load(std::memory_order_acquire) };
+				const uint64_t first{ count > ringBufferSize ? count - ringBufferSize + 1 : 0 };
+				for (uint64_t i = first; i < count; ++i)
+				{
+					const Event& event{ pBuffer->pEvents[i % ringBufferSize] };
+					file << ",\n{\"name\":\"";
+					WriteEscaped(file, event.pName);
+					//Microseconds with one decimal
+					file << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << pBuffer->threadId
+						<< ",\"ts\":" << event.start / 1000 << '.' << event.start % 1000 / 100
+						<< ",\"dur\":" << (event.end - event.start) / 1000 << '.' << (event.end - event.start) % 1000 / 100 << '}';
+					++nrEvents;
+				}
+			}
+
+			file << "\n]}\n";
+			std::cout << "Profiler capture written to " << filename << " (" << nrEvents << " zones)" << std::endl;
+			return file.good();
+		}
+	}
+}
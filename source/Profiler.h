@@ -0,0 +1,46 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string>
+
+//Scoped zones recorded into a ring buffer per thread while a capture runs, written as Chrome trace JSON
+//(chrome://tracing or ui.perfetto.dev) when it stops. Outside a capture a zone costs one atomic load
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+//Name has to outlive the capture, use a string literal
+#define PROFILE_ZONE(name) const dae::Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__){ name }
+
+namespace dae
+{
+	namespace Profiler
+	{
+		class Zone final
+		{
+		public:
+			explicit Zone(const char* pName);
+			~Zone();
+
+			Zone(const Zone&) = delete;
+			Zone(Zone&&) noexcept = delete;
+			Zone& operator=(const Zone&) = delete;
+			Zone& operator=(Zone&&) noexcept = delete;
+
+		private:
+			const char* m_pName;	//nullptr when no capture was running at the start
+			uint64_t m_Start{};
+		};
+
+		//Shown instead of the thread's number in the trace, call it once from the thread itself
+		void SetThreadName(const char* pName);
+
+		bool IsCapturing();
+		void StartCapture();
+		/**
+		 * \brief Stops the capture and writes every zone still in the ring buffers
+		 * Threads that are still inside a zone finish it outside the capture, so it's not in the file
+		 * \return false if the file couldn't be written
+		 */
+		bool StopCapture(const std::string& filename);
+	}
+}
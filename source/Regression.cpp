@@ -0,0 +1,344 @@
+#include "Regression.h"
+
+//External includes
+#include "SDL.h"
+#include "SDL_surface.h"
+
+//Standard includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+
+//Project includes
+#include "Benchmark.h"
+#include "Json.h"
+#include "Renderer.h"
+#include "Scene.h"
+#include "Timer.h"
+
+namespace dae
+{
+	namespace Regression
+	{
+		namespace
+		{
+			struct Image
+			{
+				int width{};
+				int height{};
+				std::vector<uint8_t> rgb{};
+			};
+
+			struct Result
+			{
+				std::string name{};		//<scene>_t<time>
+				float time{};
+				double frameMs{};
+				double referenceFrameMs{ -1.0 };	//Negative when the reference doesn't have one
+				bool hasReference{ false };
+				double rmse{};
+				double psnr{};				//Infinite for identical images
+				uint32_t maxDifference{};
+				uint32_t nrMismatches{};	//Pixels with a channel beyond the tolerance
+				bool isMatch{ false };
+			};
+
+#pragma region Images
+			//The same binary P6 layout ImageWriter writes, so references can also come from F7/F8 captures
+			bool ReadPPM(const std::string& filename, Image& image)
+			{
+				std::ifstream file(filename, std::ios::binary);
+				if (!file)
+					return false;
+
+				std::string magic{};
+				int maxValue{};
+				file >> magic >> image.width >> image.height >> maxValue;
+				if (!file || magic != "P6" || maxValue != 255 || image.width <= 0 || image.height <= 0)
+					return false;
+				file.get();	//Single whitespace before the pixels
+
+				image.rgb.resize(static_cast<size_t>(image.width) * image.height * 3);
+				file.read(reinterpret_cast<char*>(image.rgb.data()), image.rgb.size());
+				return file.gcount() == static_cast<std::streamsize>(image.rgb.size());
+			}
+
+			bool WritePPM(const std::string& filename, const Image& image)
+			{
+				std::ofstream file(filename, std::ios::binary);
+				if (!file)
+					return false;
+
+				file << "P6\n" << image.width << ' ' << image.height << "\n255\n";
+				file.write(reinterpret_cast<const char*>(image.rgb.data()), image.rgb.size());
+				return file.good();
+			}
+
+			//The buffer is created as ARGB8888 in Run
+			Image ReadBuffer(const SDL_Surface* pBuffer)
+			{
+				Image image{ pBuffer->w, pBuffer->h };
+				image.rgb.resize(static_cast<size_t>(image.width) * image.height * 3);
+				for (int y = 0; y < image.height; ++y)
+				{
+					const uint32_t* pRow{ reinterpret_cast<const uint32_t*>(static_cast<const uint8_t*>(pBuffer->pixels) + y * pBuffer->pitch) };
+					for (int x = 0; x < image.width; ++x)
+					{
+						uint8_t* pRGB{ &image.rgb[(static_cast<size_t>(y) * image.width + x) * 3] };
+						pRGB[0] = static_cast<uint8_t>(pRow[x] >> 16);
+						pRGB[1] = static_cast<uint8_t>(pRow[x] >> 8);
+						pRGB[2] = static_cast<uint8_t>(pRow[x]);
+					}
+				}
+				return image;
+			}
+
+			/**
+			 * \brief Fills the statistics of result and makes a diff image
+			 * Matching pixels are the difference scaled up in grey, mismatching ones are red
+			 */
+			void Compare(const Image& image, const Image& reference, const Settings& settings, Result& result, Image& diff)
+			{
+				diff = Image{ image.width, image.height, std::vector<uint8_t>(image.rgb.size()) };
+
+				double squaredError{ 0.0 };
+				const size_t nrPixels{ static_cast<size_t>(image.width) * image.height };
+				for (size_t i = 0; i < nrPixels; ++i)
+				{
+					uint32_t pixelDifference{ 0 };
+					for (size_t channel = 0; channel < 3; ++channel)
+					{
+						const int difference{ std::abs(image.rgb[i * 3 + channel] - reference.rgb[i * 3 + channel]) };
+						squaredError += static_cast<double>(difference) * difference;
+						pixelDifference = std::max(pixelDifference, static_cast<uint32_t>(difference));
+					}
+
+					result.maxDifference = std::max(result.maxDifference, pixelDifference);
+					uint8_t* pDiff{ &diff.rgb[i * 3] };
+					if (pixelDifference > settings.tolerance)
+					{
+						++result.nrMismatches;
+						pDiff[0] = 255;
+					}
+					else
+					{
+						pDiff[0] = pDiff[1] = pDiff[2] = static_cast<uint8_t>(std::min(pixelDifference * 32u, 255u));
+					}
+				}
+
+				result.rmse = std::sqrt(squaredError / (nrPixels * 3));
+				result.psnr = result.rmse > 0.0 ? 20.0 * std::log10(255.0 / result.rmse) : std::numeric_limits<double>::infinity();
+				result.isMatch = result.nrMismatches <= settings.maxMismatchRatio * nrPixels;
+			}
+#pragma endregion
+
+			std::string GetImageName(const char* pScene, float time)
+			{
+				std::stringstream name{};
+				name << pScene << "_t" << std::fixed << std::setprecision(2) << time;
+				return name.str();
+			}
+
+			//Frame time of the reference, written next to it with --update
+			double ReadReferenceFrameMs(const std::string& filename)
+			{
+				Json::Value root{};
+				std::string error{};
+				if (!Json::ParseFile(filename, root, error))
+					return -1.0;
+				return root.GetFloat("frameMs", -1.f);
+			}
+
+			bool WriteReferenceFrameMs(const std::string& filename, const Settings& settings, double frameMs)
+			{
+				std::ofstream file(filename, std::ios::trunc);
+				file << "{ \"frameMs\": " << frameMs << ", \"width\": " << settings.width << ", \"height\": " << settings.height << " }\n";
+				return file.good();
+			}
+
+			Result RenderImage(const std::string& name, float time, Scene& scene, Renderer& renderer, SDL_Surface* pBuffer, const Settings& settings)
+			{
+				Result result{};
+				result.name = name;
+				result.time = time;
+
+				Timer timer{};
+				timer.SetFixedTime(time);
+				scene.Update(&timer);
+
+				//Every frame traces the same rays, the first one also warms the caches
+				renderer.Render(&scene);
+				result.frameMs = std::numeric_limits<double>::max();
+				for (uint32_t i = 0; i < settings.nrTimedFrames; ++i)
+				{
+					const auto frameStart{ std::chrono::steady_clock::now() };
+					renderer.Render(&scene);
+					result.frameMs = std::min(result.frameMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+				}
+
+				const std::string basePath{ settings.referenceDirectory + "/" + name };
+				const Image image{ ReadBuffer(pBuffer) };
+				if (settings.isUpdate)
+				{
+					result.isMatch = WritePPM(basePath + ".ppm", image) && WriteReferenceFrameMs(basePath + ".json", settings, result.frameMs);
+					if (!result.isMatch)
+						std::cout << "Can't write " << basePath << ".ppm" << std::endl;
+					return result;
+				}
+
+				Image reference{};
+				result.hasReference = ReadPPM(basePath + ".ppm", reference) && reference.width == image.width && reference.height == image.height;
+				if (!result.hasReference)
+				{
+					std::cout << name << ": no " << settings.width << "x" << settings.height << " reference in " << settings.referenceDirectory << std::endl;
+					return result;
+				}
+				result.referenceFrameMs = ReadReferenceFrameMs(basePath + ".json");
+
+				Image diff{};
+				Compare(image, reference, settings, result, diff);
+				if (result.maxDifference > 0)
+					WritePPM(basePath + "_diff.ppm", diff);
+
+				std::cout << std::left << std::setw(40) << name << (result.isMatch ? "match   " : "MISMATCH")
+					<< " RMSE " << result.rmse << ", PSNR " << result.psnr << " dB, " << result.nrMismatches << " pixels beyond tolerance, "
+					<< result.frameMs << "ms (reference " << result.referenceFrameMs << "ms)" << std::endl;
+				return result;
+			}
+
+			void WriteResult(std::ofstream& file, const Result& result)
+			{
+				file << "\t\t{ "
+					<< "\"name\": \"" << result.name << "\", "
+					<< "\"time\": " << result.time << ", "
+					<< "\"frameMs\": " << result.frameMs << ", "
+					<< "\"referenceFrameMs\": " << (result.referenceFrameMs >= 0.0 ? std::to_string(result.referenceFrameMs) : "null") << ", ";
+
+				if (result.hasReference)
+				{
+					file << "\"rmse\": " << result.rmse << ", "
+						<< "\"psnr\": " << (std::isinf(result.psnr) ? std::string("null") : std::to_string(result.psnr)) << ", "
+						<< "\"maxDifference\": " << result.maxDifference << ", "
+						<< "\"mismatchingPixels\": " << result.nrMismatches << ", ";
+				}
+				file << "\"match\": " << (result.isMatch ? "true" : "false") << " }";
+			}
+		}
+
+		bool ParseCommandLine(int argc, char* args[], Settings& settings)
+		{
+			bool isRegression{ false };
+			for (int i = 1; i < argc; ++i)
+			{
+				const bool hasValue{ i + 1 < argc };
+				const auto readNumber = [&](uint32_t& value) {
+					if (i + 1 < argc)
+						value = static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10));
+				};
+
+				if (std::strcmp(args[i], "--regression") == 0)
+				{
+					isRegression = true;
+					if (hasValue && std::strncmp(args[i + 1], "--", 2) != 0)
+						settings.referenceDirectory = args[++i];
+				}
+				else if (std::strcmp(args[i], "--update") == 0)
+					settings.isUpdate = true;
+				else if (std::strcmp(args[i], "--tolerance") == 0)
+					readNumber(settings.tolerance);
+				else if (std::strcmp(args[i], "--mismatch") == 0 && hasValue)
+					settings.maxMismatchRatio = std::clamp(static_cast<float>(std::atof(args[++i])), 0.f, 1.f);
+				else if (std::strcmp(args[i], "--threads") == 0)
+					readNumber(settings.nrThreads);
+				else if (std::strcmp(args[i], "--resolution") == 0)
+				{
+					readNumber(settings.width);
+					readNumber(settings.height);
+				}
+				else if (std::strcmp(args[i], "--times") == 0 && hasValue)
+				{
+					settings.times.clear();
+					std::stringstream stream{ args[++i] };
+					std::string time{};
+					while (std::getline(stream, time, ','))
+						settings.times.push_back(static_cast<float>(std::atof(time.c_str())));
+				}
+			}
+
+			settings.width = std::max(settings.width, 4u);
+			settings.height = std::max(settings.height, 4u);
+			if (settings.times.empty())
+				settings.times.push_back(0.f);
+			return isRegression;
+		}
+
+		bool Run(const Settings& settings)
+		{
+			const uint32_t nrThreads{ Benchmark::SetThreadCount(settings.nrThreads) };
+
+			if (settings.isUpdate)
+			{
+				std::error_code error{};
+				std::filesystem::create_directories(settings.referenceDirectory, error);
+			}
+
+			SDL_Surface* pBuffer{ SDL_CreateRGBSurfaceWithFormat(0, settings.width, settings.height, 32, SDL_PIXELFORMAT_ARGB8888) };
+			if (!pBuffer)
+			{
+				std::cout << "Can't create a " << settings.width << "x" << settings.height << " buffer: " << SDL_GetError() << std::endl;
+				return false;
+			}
+
+			std::vector<Result> results{};
+			{
+				Renderer renderer{ pBuffer };
+				renderer.SetPipelining(false);
+
+				for (const Benchmark::SceneEntry& entry : Benchmark::GetScenes())
+				{
+					std::unique_ptr<Scene> pScene{ entry.create() };
+					pScene->Initialize();
+					for (float time : settings.times)
+						results.push_back(RenderImage(GetImageName(entry.pName, time), time, *pScene, renderer, pBuffer, settings));
+				}
+			}
+			SDL_FreeSurface(pBuffer);
+
+			const size_t nrMatches{ static_cast<size_t>(std::count_if(results.begin(), results.end(), [](const Result& result) { return result.isMatch; })) };
+			if (settings.isUpdate)
+			{
+				std::cout << nrMatches << " references written to " << settings.referenceDirectory << std::endl;
+				return nrMatches == results.size();
+			}
+
+			std::ofstream file(settings.outputFilename, std::ios::trunc);
+			file << "{\n"
+				<< "\t\"width\": " << settings.width << ",\n"
+				<< "\t\"height\": " << settings.height << ",\n"
+				<< "\t\"threads\": " << nrThreads << ",\n"
+				<< "\t\"tolerance\": " << settings.tolerance << ",\n"
+				<< "\t\"maxMismatchRatio\": " << settings.maxMismatchRatio << ",\n"
+				<< "\t\"images\": [\n";
+			for (size_t i = 0; i < results.size(); ++i)
+			{
+				WriteResult(file, results[i]);
+				file << (i + 1 < results.size() ? ",\n" : "\n");
+			}
+			file << "\t]\n}\n";
+			if (!file)
+				std::cout << "Can't write " << settings.outputFilename << std::endl;
+
+			std::cout << nrMatches << " of " << results.size() << " images match their reference" << std::endl;
+			return nrMatches == results.size() && file.good();
+		}
+	}
+}
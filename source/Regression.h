@@ -0,0 +1,43 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dae
+{
+	namespace Regression
+	{
+		struct Settings
+		{
+			uint32_t width{ 160 };		//Small enough to keep the references in the repository
+			uint32_t height{ 120 };
+			uint32_t nrThreads{ 0 };			//0 uses every hardware thread
+			uint32_t nrTimedFrames{ 3 };		//The fastest one is the recorded frame time
+			std::vector<float> times{ 0.f, 1.f, 2.5f };	//Timer::GetTotal seen by Scene::Update, one image per scene per time
+			uint32_t tolerance{ 2 };			//Largest per channel difference (0-255) a pixel may have and still match
+			float maxMismatchRatio{ 0.f };		//Fraction of the pixels allowed to exceed the tolerance
+			std::string referenceDirectory{ "Resources/Reference" };
+			std::string outputFilename{ "regression.json" };
+			bool isUpdate{ false };				//Overwrites the references instead of comparing against them
+		};
+
+		/**
+		 * \brief Reads --regression [directory] [--update] [--tolerance n] [--mismatch ratio] [--times t,t,...] [--threads n] [--resolution w h]
+		 * \return false if --regression isn't there
+		 */
+		bool ParseCommandLine(int argc, char* args[], Settings& settings);
+
+		/**
+		 * \brief Renders every scene headless at every time and compares each image to <directory>/<scene>_t<time>.ppm
+		 * Mismatching images get a <scene>_t<time>_diff.ppm next to the reference. RMSE, PSNR and the frame time
+		 * (with the one recorded next to the reference) are written as JSON.
+		 * The references in Resources/Reference are written by "--regression --update" with the default settings,
+		 * run that again (and commit the result) after a change that is meant to alter the images.
+		 * Every scene but the out of core bunny is bit for bit what the renderer drew before the HDR buffer and resolve pass
+		 * \return true if every image matched its reference (or every reference was written with --update)
+		 */
+		bool Run(const Settings& settings);
+	}
+}
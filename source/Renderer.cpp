@@ -9,178 +9,669 @@
 #include "Material.h"
 #include "Scene.h"
 #include "Utils.h"
+#include "AllocationCounter.h"
+#include "ScratchArena.h"
+#include "Profiler.h"
+#include "WorkerPool.h"
+#include "LinearBVH.h"
 #include <future> //async
 #include <ppl.h> //parallel_for
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <numeric>
 using namespace dae;
 
 //#define ASYNC
 #define PARALLEL_FOR
 
+namespace
+{
+	//Shadow rays start this far along the normal and ignore hits closer than it, so they don't hit their own surface
+	constexpr float shadowRayOffset{ 0.0001f };
+
+	Ray GetShadowRay(const Light& light, const HitRecord& hit)
+	{
+		Ray lightRay{};
+		lightRay.origin = hit.origin + hit.normal * (shadowRayOffset * 2);
+
+		const Vector3 dirToLight{ LightUtils::GetDirectionToLight(light, lightRay.origin) };
+		lightRay.direction = dirToLight.Normalized();
+		lightRay.min = shadowRayOffset;
+		lightRay.max = dirToLight.Magnitude();
+		lightRay.reciprocalDir = { 1.f / lightRay.direction.x,1.f / lightRay.direction.y,1.f / lightRay.direction.z };
+		return lightRay;
+	}
+
+	struct ShadowRayKey
+	{
+		uint64_t key;
+		uint32_t rayIdx;	//pixel * nrLights + light
+	};
+
+	//Light in the top 16 bits, then the Morton code of the origin (10 bits per axis, in the bounds of the batch)
+	//and of the direction (6 bits per axis): rays next to each other in this order start close together and go the same way
+	uint64_t GetShadowRayKey(uint32_t lightIdx, const Ray& ray, const Vector3& minOrigin, const Vector3& inverseExtent)
+	{
+		const uint64_t originCode{ LinearBVH::MortonCode(
+			(ray.origin.x - minOrigin.x) * inverseExtent.x,
+			(ray.origin.y - minOrigin.y) * inverseExtent.y,
+			(ray.origin.z - minOrigin.z) * inverseExtent.z) };
+		const uint64_t directionCode{ LinearBVH::MortonCode(
+			ray.direction.x * .5f + .5f,
+			ray.direction.y * .5f + .5f,
+			ray.direction.z * .5f + .5f) >> 12 };
+		return uint64_t{ std::min(lightIdx, 0xFFFFu) } << 48 | originCode << 18 | directionCode;
+	}
+}
+
 Renderer::Renderer(SDL_Window * pWindow) :
-	m_pWindow(pWindow),
-	m_pBuffer(SDL_GetWindowSurface(pWindow))
+	Renderer(SDL_GetWindowSurface(pWindow))
+{
+	m_pWindow = pWindow;
+}
+
+Renderer::Renderer(SDL_Surface* pBuffer) :
+	m_pBuffer(pBuffer),
+	m_TileScheduler(pBuffer->w, pBuffer->h, tileSize)
 {
 	//Initialize
-	SDL_GetWindowSize(pWindow, &m_Width, &m_Height);
+	m_Width = m_pBuffer->w;
+	m_Height = m_pBuffer->h;
 	m_pBufferPixels = static_cast<uint32_t*>(m_pBuffer->pixels);
+
+	AllocateFrames();
+
+	//The resolve pass packs 32-bit pixels itself instead of calling SDL_MapRGB per pixel
+	assert(m_pBuffer->format->BytesPerPixel == 4 && m_pBuffer->pitch == m_Width * 4);
+	m_PixelFormat.rShift = m_pBuffer->format->Rshift;
+	m_PixelFormat.gShift = m_pBuffer->format->Gshift;
+	m_PixelFormat.bShift = m_pBuffer->format->Bshift;
+	m_PixelFormat.aMask = m_pBuffer->format->Amask;
+}
+
+Renderer::~Renderer()
+{
+	{
+		std::lock_guard<std::mutex> lock{ m_TraceMutex };
+		m_IsStoppingTrace = true;
+	}
+	m_TraceChanged.notify_all();
+
+	if (m_TraceThread.joinable())
+		m_TraceThread.join();
+}
+
+void Renderer::Render(Scene* pScene)
+{
+	PROFILE_ZONE("Renderer::Render");
+	const uint64_t nrAllocationsBefore{ AllocationCounter::GetCount() };
+
+	if (m_IsPipelined)
+	{
+		RenderPipelined(pScene);
+	}
+	else
+	{
+		TraceFrame(pScene);
+		PresentFrame(m_HDRFrames[m_TraceFrameIdx]);
+	}
+
+	CheckHeapAllocations(nrAllocationsBefore);
+}
+
+void Renderer::RenderPipelined(Scene* pScene)
+{
+	//The scene is not touched by the present, so the previous frame can be resolved, presented and saved
+	//while this one is traced into the other buffer
+	const uint32_t presentFrameIdx{ m_TraceFrameIdx };
+	m_TraceFrameIdx = 1 - m_TraceFrameIdx;
+
+	if (!m_TraceThread.joinable())
+		m_TraceThread = std::thread(&Renderer::RunTraceThread, this);
+
+	{
+		std::lock_guard<std::mutex> lock{ m_TraceMutex };
+		m_pTraceScene = pScene;
+	}
+	m_TraceChanged.notify_all();
+
+	if (m_HasTracedFrame)
+	{
+		PresentFrame(m_HDRFrames[presentFrameIdx]);
+	}
+
+	std::unique_lock<std::mutex> lock{ m_TraceMutex };
+	m_TraceChanged.wait(lock, [this] { return m_pTraceScene == nullptr; });
+	m_HasTracedFrame = true;
+}
+
+void Renderer::RunTraceThread()
+{
+	Profiler::SetThreadName("Trace");
+	std::unique_lock<std::mutex> lock{ m_TraceMutex };
+	while (true)
+	{
+		m_TraceChanged.wait(lock, [this] { return m_pTraceScene != nullptr || m_IsStoppingTrace; });
+		if (m_IsStoppingTrace)
+			return;
+
+		Scene* pScene{ m_pTraceScene };
+		lock.unlock();
+		TraceFrame(pScene);
+		lock.lock();
+
+		m_pTraceScene = nullptr;
+		m_TraceChanged.notify_all();
+	}
+}
+
+void Renderer::CheckHeapAllocations(uint64_t nrAllocationsBefore)
+{
+#ifdef COUNT_HEAP_ALLOCATIONS
+	//Arenas, thread pools and the trace thread are allowed to grow in the first frames
+	if (m_NrWarmupFrames > 0)
+	{
+		--m_NrWarmupFrames;
+		return;
+	}
+
+	//Not an assert, this has to hold in Release
+	const uint64_t nrAllocations{ AllocationCounter::GetCount() - nrAllocationsBefore };
+	if (nrAllocations != 0)
+	{
+		std::cout << "Renderer::Render made " << nrAllocations << " heap allocations" << std::endl;
+		std::abort();
+	}
+#else
+	(void)nrAllocationsBefore;
+#endif
 }
 
-void Renderer::Render(Scene* pScene) const
+void Renderer::TraceFrame(Scene* pScene)
 {
+	PROFILE_ZONE("Renderer::TraceFrame");
 	Camera& camera = pScene->GetCamera();
 	camera.CalculateCameraToWorld();
 
 	auto& materials = pScene->GetMaterials();
 	auto& lights = pScene->GetLights();
 
+	//Scratch memory of the previous frame can be reused
+	ScratchArena::NextFrame();
+
+	HDRFrame& frame{ m_HDRFrames[m_TraceFrameIdx] };
+	frame.lightingMode = m_CurrentLightingMode;
+
 	float aspectRatio{ static_cast<float>(m_Width) / m_Height };
 	float fovRadians{tanf( TO_RADIANS * (camera.fovAngle /2)) };
 	
-	const uint32_t numPixels = m_Width * m_Height;
-	
-#if defined(ASYNC)
-	//Async Logic
-	const uint32_t numCores = std::thread::hardware_concurrency();
-	std::vector<std::future<void>> async_features{};
-	const uint32_t numPixelsPerTask = numPixels / numCores;
-	uint32_t numUnassignedPixels = numPixels % numCores;
-	uint32_t currPixelIndex = 0;
-
-	for (uint32_t coreId{ 0 }; coreId < numCores; ++coreId)
-	{
-		//If there are unissigned tasks we want to distrubute those to the cores
-		uint32_t taskSize = numPixelsPerTask;
-		if (numUnassignedPixels > 0)
+#if defined(ASYNC) || defined(PARALLEL_FOR)
+	//Square tiles instead of single pixels, neighbouring rays traverse the same nodes and a tile is a zone in the profiler
+	//Every worker takes the next tile until none are left, the scheduler orders and splits them by the cost of the last frame
+	m_TileScheduler.BeginFrame();
+	const auto renderTiles = [&](uint32_t node) {
+		uint32_t tileIdx{};
+		while (m_TileScheduler.GetNextTile(node, tileIdx))
 		{
-			++taskSize;
-			--numUnassignedPixels;
+			PROFILE_ZONE("Tile");
+			const auto tileStart{ std::chrono::steady_clock::now() };
+			const TileScheduler::Tile& tile{ m_TileScheduler.GetTile(tileIdx) };
+			if (m_SortShadowRays && m_ShadowsEnabled)
+			{
+				RenderTileSortedShadows(pScene, tile, fovRadians, aspectRatio, camera, lights, materials);
+			}
+			else
+			{
+				for (uint32_t y = tile.beginY; y < tile.endY; ++y)
+					for (uint32_t x = tile.beginX; x < tile.endX; ++x)
+						RenderPixel(pScene, x + y * m_Width, fovRadians, aspectRatio, camera, lights, materials);
+			}
+			m_TileScheduler.SetTileTime(tileIdx, std::chrono::duration<float>(std::chrono::steady_clock::now() - tileStart).count());
 		}
+	};
 
-		async_features.push_back(std::async(std::launch::async, [=, this]
-			{
-				//Render all pixels for this task (currentPixelIndex > currPixIndes + taskSize)
-				const uint32_t pixelIndexEnd = currPixelIndex + taskSize;
-				for (uint32_t pixelIndex{ currPixelIndex }; pixelIndex < pixelIndexEnd; ++pixelIndex)
+	if (m_pWorkerPool)
+	{
+		//NUMA: every node first refreshes its copy of the meshes, then its workers take the tiles of its band first
+		WorkerPool& pool{ *m_pWorkerPool };
+		pScene->PrepareReplicas(m_NumaSettings.isReplicated ? pool.GetNrNodes() : 0);
+		if (m_NumaSettings.isReplicated)
+		{
+			pool.Run([&pool, pScene](uint32_t workerIdx) {
+				const uint32_t node{ pool.GetNode(workerIdx) };
+				if (pool.GetFirstWorker(node) == workerIdx)
+					pScene->UpdateReplica(node);
+				});
+		}
+		pool.Run([&pool, &renderTiles](uint32_t workerIdx) {
+			renderTiles(pool.GetNode(workerIdx));
+			});
+	}
+	else
+	{
+		const uint32_t numCores = std::max(std::thread::hardware_concurrency(), 1u);
+#if defined(ASYNC)
+		//Async Logic
+		std::vector<std::future<void>> async_features{};
+		for (uint32_t coreId{ 0 }; coreId < numCores; ++coreId)
+		{
+			async_features.push_back(std::async(std::launch::async, [&renderTiles]
 				{
-					RenderPixel(pScene, pixelIndex, fovRadians, aspectRatio, camera, lights, materials);
-				}
+					PROFILE_ZONE("Task");
+					renderTiles(0);
+				}));
+		}
 
-			}));
+		//Wait for all tasks before resolving
+		for (const std::future<void>& task : async_features)
+		{
+			task.wait();
+		}
+#else
+		//Parallel-For Logic
 
-		currPixelIndex += taskSize;
+		//One iteration per core, by reference: copying the lights and materials into the functor allocates every frame
+		//With fewer workers (Benchmark::SetThreadCount) the extra iterations find the queue empty
+		concurrency::parallel_for(0u, numCores, [&renderTiles](uint32_t) {
+			renderTiles(0);
+			});
+#endif
 	}
-
-#elif defined(PARALLEL_FOR)
-	//Parallel-For Logic
-
-	concurrency::parallel_for(0u, numPixels, [=, this](int i) {
-		RenderPixel(pScene, i, fovRadians, aspectRatio, camera, lights, materials);
-		});
+	m_TileScheduler.EndFrame();
 #else
 	//Synchronous Logic (no threading)
+	const uint32_t numPixels = m_Width * m_Height;
 	for (uint32_t i = 0; i < numPixels; ++i)
 	{
 		RenderPixel(pScene, i, fovRadians, aspectRatio, camera, lights, materials);
 	}
 #endif
 	//@END
+
+	if (TraversalStats::isEnabled && frame.lightingMode == LightingMode::TraversalHeatmap)
+		WriteTraversalHeatmap(frame);
+}
+
+void Renderer::PresentFrame(const HDRFrame& frame)
+{
+	PROFILE_ZONE("Renderer::PresentFrame");
+	ResolveHDRBuffer(frame);
+
 	//Update SDL Surface
-	SDL_UpdateWindowSurface(m_pWindow);
+	if (m_pWindow)
+		SDL_UpdateWindowSurface(m_pWindow);
+
+	//Copying the frame into the writer's pool may allocate, that isn't part of rendering
+	AllocationCounter::ScopedIgnore ignoreAllocations{};
+	if (m_ScreenshotRequested)
+	{
+		std::cout << "Screenshot " << SaveBufferToImage(frame) << " queued!" << std::endl;
+		m_ScreenshotRequested = false;
+	}
+	else if (m_SaveEveryFrame)
+	{
+		SaveBufferToImage(frame);
+	}
 }
 
-void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials) const
+void Renderer::ResolveHDRBuffer(const HDRFrame& frame) const
 {
-	const int px = pixelIndex % m_Width;
-	const int py = pixelIndex / m_Width;
+	PROFILE_ZONE("Renderer::ResolveHDRBuffer");
+	const uint32_t numPixels = m_Width * m_Height;
 
-	float rx = px + 0.5f;
-	float ry = py + 0.5f;
+	//The heatmap is already in [0, 1] and its colors mean something, tone mapping would shift them
+	const ToneMapping::ResolveSettings settings{ frame.lightingMode == LightingMode::TraversalHeatmap
+		? ToneMapping::ResolveSettings{ 1.f, ToneMapping::ToneMapper::Clamp, false }
+		: m_ResolveSettings };
 
-	float cx = (2 * (rx / float(m_Width)) - 1) * aspectRatio * fov;
-	float cy = (1 - (2 * (ry / float(m_Height)))) * fov;
+#if defined(PARALLEL_FOR)
+	//Blocks are a multiple of 4 pixels so every block (but the last) stays on the aligned SIMD path
+	constexpr uint32_t blockSize{ 4096 };
+	const uint32_t numBlocks{ (numPixels + blockSize - 1) / blockSize };
 
-	ColorRGB finalColor{};
-	HitRecord closestHit{};
+	concurrency::parallel_for(0u, numBlocks, [=, this, &frame, &settings](uint32_t blockIdx) {
+		const uint32_t begin{ blockIdx * blockSize };
+		const uint32_t end{ std::min(begin + blockSize, numPixels) };
+		ToneMapping::Resolve(frame.pRed, frame.pGreen, frame.pBlue, m_pBufferPixels, begin, end, m_PixelFormat, settings);
+		});
+#else
+	ToneMapping::Resolve(frame.pRed, frame.pGreen, frame.pBlue, m_pBufferPixels, 0, numPixels, m_PixelFormat, settings);
+#endif
+}
 
-	Vector3 rayDir{ cx * Vector3::UnitX + cy * Vector3::UnitY + Vector3::UnitZ };
-	//we shoot rays from the camera positioin, not from the world origin
-	rayDir = camera.cameraToWorld.TransformVector(rayDir);
-	rayDir.Normalize();
+void Renderer::WriteTraversalHeatmap(const HDRFrame& frame) const
+{
+	PROFILE_ZONE("Renderer::WriteTraversalHeatmap");
+	const uint32_t numPixels = m_Width * m_Height;
 
-	Ray viewRay{ camera.origin,rayDir,{1.f/rayDir.x, 1.f / rayDir.y, 1.f / rayDir.z} };
+	uint32_t maxCost{ 1 };
+	for (uint32_t i = 0; i < numPixels; ++i)
+		maxCost = std::max(maxCost, frame.pTraversalCounts[i].GetCost());
 
-	finalColor = dae::colors::Black;
+	const ColorRGB ramp[]{ colors::Black, colors::Blue, colors::Cyan, colors::Green, colors::Yellow, colors::Red };
+	constexpr uint32_t nrSegments{ static_cast<uint32_t>(std::size(ramp)) - 1 };
 
-	pScene->GetClosestHit(viewRay, closestHit);
+	for (uint32_t i = 0; i < numPixels; ++i)
+	{
+		const float position{ static_cast<float>(frame.pTraversalCounts[i].GetCost()) / maxCost * nrSegments };
+		const uint32_t segment{ std::min(static_cast<uint32_t>(position), nrSegments - 1) };
+		const ColorRGB color{ ColorRGB::Lerp(ramp[segment], ramp[segment + 1], position - segment) };
+
+		frame.pRed[i] = color.r;
+		frame.pGreen[i] = color.g;
+		frame.pBlue[i] = color.b;
+	}
+}
+
+void Renderer::RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera, const std::vector<Light>& lights, const MaterialTable& materials) const
+{
+	ColorRGB finalColor{ dae::colors::Black };
+	HitRecord closestHit{};
+	TraversalStats::BeginRay();
+
+	const Ray viewRay{ GetViewRay(pixelIndex, fov, aspectRatio, camera) };
+	TraceViewRay(pScene, viewRay, fov, closestHit);
 
 	if (closestHit.didHit)
 	{
-		float offset{ 0.0001f };
-		Ray lightRay{};
-		lightRay.origin = closestHit.origin + closestHit.normal * (offset * 2);
-
 		for (const Light& currentLight : lights)
 		{
-			Vector3 dirToLight{ LightUtils::GetDirectionToLight(currentLight,lightRay.origin) };
-			lightRay.direction = dirToLight.Normalized();
-			lightRay.min = offset;
-			lightRay.max = dirToLight.Magnitude();
-			lightRay.reciprocalDir = { 1.f / lightRay.direction.x,1.f / lightRay.direction.y,1.f / lightRay.direction.z };
-
-			float lambertCosine{ Vector3::Dot(closestHit.normal, lightRay.direction) };
+			const Ray lightRay{ GetShadowRay(currentLight, closestHit) };
 			bool skipCalculations{ false };
 
 			if (m_ShadowsEnabled)
 			{
+				TraversalStats::Add(TraversalStats::ShadowRays);
 				skipCalculations = pScene->DoesHit(lightRay);
 			}
 
 			if (!skipCalculations)
+				finalColor += ShadeLight(currentLight, closestHit, viewRay, lightRay, materials);
+		}
+	}
+
+	const uint16_t nrShadowRays{ closestHit.didHit && m_ShadowsEnabled ? static_cast<uint16_t>(std::min(lights.size(), size_t(UINT16_MAX))) : uint16_t{ 0 } };
+	WritePixel(pixelIndex, finalColor, nrShadowRays, TraversalStats::EndRay());
+}
+
+void Renderer::RenderTileSortedShadows(Scene* pScene, const TileScheduler::Tile& tile, float fov, float aspectRatio, const Camera& camera, const std::vector<Light>& lights, const MaterialTable& materials) const
+{
+	const uint32_t tileWidth{ tile.endX - tile.beginX };
+	const uint32_t nrPixels{ tileWidth * (tile.endY - tile.beginY) };
+	const uint32_t nrLights{ static_cast<uint32_t>(lights.size()) };
+
+	//Scratch memory of this thread, released when the tile is done
+	ScratchArena& arena{ ScratchArena::Get() };
+	ScratchArena::Scope scope{ arena };
+	Ray* pViewRays{ arena.Allocate<Ray>(nrPixels) };
+	HitRecord* pHits{ arena.Allocate<HitRecord>(nrPixels) };
+	Ray* pShadowRays{ arena.Allocate<Ray>(nrPixels * nrLights) };
+	bool* pIsOccluded{ arena.Allocate<bool>(nrPixels * nrLights) };
+	ShadowRayKey* pKeys{ arena.Allocate<ShadowRayKey>(nrPixels * nrLights) };
+	TraversalStats::Counts* pCounts{ TraversalStats::isEnabled ? arena.Allocate<TraversalStats::Counts>(nrPixels) : nullptr };
+
+	const auto getPixelIndex = [&](uint32_t i) { return tile.beginX + i % tileWidth + (tile.beginY + i / tileWidth) * m_Width; };
+
+	//View rays first, every hit adds its shadow rays to the batch
+	uint32_t nrKeys{ 0 };
+	Vector3 minOrigin{ INFINITY, INFINITY, INFINITY };
+	Vector3 maxOrigin{ -INFINITY, -INFINITY, -INFINITY };
+	for (uint32_t i = 0; i < nrPixels; ++i)
+	{
+		TraversalStats::BeginRay();
+		pViewRays[i] = GetViewRay(getPixelIndex(i), fov, aspectRatio, camera);
+		pHits[i] = HitRecord{};
+		TraceViewRay(pScene, pViewRays[i], fov, pHits[i]);
+		if constexpr (TraversalStats::isEnabled)
+			pCounts[i] = TraversalStats::EndRay();
+
+		if (!pHits[i].didHit)
+			continue;
+
+		for (uint32_t lightIdx = 0; lightIdx < nrLights; ++lightIdx)
+		{
+			const uint32_t rayIdx{ i * nrLights + lightIdx };
+			pShadowRays[rayIdx] = GetShadowRay(lights[lightIdx], pHits[i]);
+			pKeys[nrKeys++].rayIdx = rayIdx;
+			minOrigin = Vector3::Min(minOrigin, pShadowRays[rayIdx].origin);
+			maxOrigin = Vector3::Max(maxOrigin, pShadowRays[rayIdx].origin);
+		}
+	}
+
+	//Traced in key order, so consecutive rays mostly visit the nodes and triangles the previous one left in the cache
+	const Vector3 extent{ maxOrigin - minOrigin };
+	const Vector3 inverseExtent{
+		extent.x > 0.f ? 1.f / extent.x : 0.f,
+		extent.y > 0.f ? 1.f / extent.y : 0.f,
+		extent.z > 0.f ? 1.f / extent.z : 0.f };
+	for (uint32_t i = 0; i < nrKeys; ++i)
+	{
+		const uint32_t rayIdx{ pKeys[i].rayIdx };
+		pKeys[i].key = GetShadowRayKey(rayIdx % nrLights, pShadowRays[rayIdx], minOrigin, inverseExtent);
+	}
+	std::sort(pKeys, pKeys + nrKeys, [](const ShadowRayKey& a, const ShadowRayKey& b) { return a.key < b.key; });
+
+	for (uint32_t i = 0; i < nrKeys; ++i)
+	{
+		const uint32_t rayIdx{ pKeys[i].rayIdx };
+		TraversalStats::BeginShadowRay();
+		TraversalStats::Add(TraversalStats::ShadowRays);
+		pIsOccluded[rayIdx] = pScene->DoesHit(pShadowRays[rayIdx]);
+		if constexpr (TraversalStats::isEnabled)
+			pCounts[rayIdx / nrLights].Add(TraversalStats::EndRay());
+	}
+
+	//Shaded in the light order of RenderPixel, so both modes give the same image
+	const uint16_t nrShadowRays{ static_cast<uint16_t>(std::min(lights.size(), size_t(UINT16_MAX))) };
+	for (uint32_t i = 0; i < nrPixels; ++i)
+	{
+		ColorRGB finalColor{ dae::colors::Black };
+		if (pHits[i].didHit)
+		{
+			for (uint32_t lightIdx = 0; lightIdx < nrLights; ++lightIdx)
 			{
-				switch (m_CurrentLightingMode)
-				{
-				case dae::Renderer::LightingMode::ObservedArea:
-					if (lambertCosine > 0.f)
-					{
-						finalColor += ColorRGB{ lambertCosine,lambertCosine,lambertCosine };
-					}
-					break;
-				case dae::Renderer::LightingMode::Radiance:
-					finalColor += LightUtils::GetRadiance(currentLight, closestHit.origin);
-					break;
-				case dae::Renderer::LightingMode::BRDF:
-					finalColor += materials[closestHit.materialIndex]->Shade(closestHit, lightRay.direction, -viewRay.direction);
-					break;
-				case dae::Renderer::LightingMode::Combined:
-					if (lambertCosine > 0.f)
-					{
-						finalColor += LightUtils::GetRadiance(currentLight, closestHit.origin) * materials[closestHit.materialIndex]->Shade(closestHit, lightRay.direction, -viewRay.direction) * lambertCosine;
-					}
-					break;
-				}
+				const uint32_t rayIdx{ i * nrLights + lightIdx };
+				if (!pIsOccluded[rayIdx])
+					finalColor += ShadeLight(lights[lightIdx], pHits[i], pViewRays[i], pShadowRays[rayIdx], materials);
 			}
+		}
+		WritePixel(getPixelIndex(i), finalColor, pHits[i].didHit ? nrShadowRays : uint16_t{ 0 }, TraversalStats::isEnabled ? pCounts[i] : TraversalStats::Counts{});
+	}
+}
+
+Ray Renderer::GetViewRay(uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera) const
+{
+	const int px = pixelIndex % m_Width;
+	const int py = pixelIndex / m_Width;
+
+	float rx = px + 0.5f;
+	float ry = py + 0.5f;
+
+	float cx = (2 * (rx / float(m_Width)) - 1) * aspectRatio * fov;
+	float cy = (1 - (2 * (ry / float(m_Height)))) * fov;
+
+	Vector3 rayDir{ cx * Vector3::UnitX + cy * Vector3::UnitY + Vector3::UnitZ };
+	//we shoot rays from the camera positioin, not from the world origin
+	rayDir = camera.cameraToWorld.TransformVector(rayDir);
+	rayDir.Normalize();
 
+	return Ray{ camera.origin,rayDir,{1.f/rayDir.x, 1.f / rayDir.y, 1.f / rayDir.z} };
+}
 
+void Renderer::TraceViewRay(Scene* pScene, const Ray& viewRay, float fov, HitRecord& closestHit) const
+{
+	pScene->GetClosestHit(viewRay, closestHit);
+	if (!closestHit.didHit)
+		return;
+
+	//Ray cone, the pixel's spread angle times the distance, wider where the surface is seen at a grazing angle
+	const float pixelSpread{ 2.f * fov / m_Height };
+	const float cosine{ std::max(std::abs(Vector3::Dot(closestHit.normal, viewRay.direction)), 0.01f) };
+	closestHit.footprint = closestHit.t * pixelSpread / cosine;
+}
+
+ColorRGB Renderer::ShadeLight(const Light& light, const HitRecord& closestHit, const Ray& viewRay, const Ray& lightRay, const MaterialTable& materials) const
+{
+	const float lambertCosine{ Vector3::Dot(closestHit.normal, lightRay.direction) };
+	switch (m_CurrentLightingMode)
+	{
+	case dae::Renderer::LightingMode::ObservedArea:
+		if (lambertCosine > 0.f)
+		{
+			return ColorRGB{ lambertCosine,lambertCosine,lambertCosine };
+		}
+		break;
+	case dae::Renderer::LightingMode::Radiance:
+		return LightUtils::GetRadiance(light, closestHit.origin);
+	case dae::Renderer::LightingMode::BRDF:
+		return materials.Shade(closestHit.materialHandle, closestHit, lightRay.direction, -viewRay.direction);
+	case dae::Renderer::LightingMode::Combined:
+		if (lambertCosine > 0.f)
+		{
+			return LightUtils::GetRadiance(light, closestHit.origin) * materials.Shade(closestHit.materialHandle, closestHit, lightRay.direction, -viewRay.direction) * lambertCosine;
+		}
+		break;
+	case dae::Renderer::LightingMode::TraversalHeatmap:
+		break;	//Written over the whole frame in WriteTraversalHeatmap
+	}
+	return dae::colors::Black;
+}
+
+void Renderer::WritePixel(uint32_t pixelIndex, const ColorRGB& color, uint16_t nrShadowRays, const TraversalStats::Counts& counts) const
+{
+	//Update Color in HDR Buffer (tonemapping and packing happen in ResolveHDRBuffer)
+	const HDRFrame& frame{ m_HDRFrames[m_TraceFrameIdx] };
+	frame.pRed[pixelIndex] = color.r;
+	frame.pGreen[pixelIndex] = color.g;
+	frame.pBlue[pixelIndex] = color.b;
+	frame.pShadowRays[pixelIndex] = nrShadowRays;
+	if constexpr (TraversalStats::isEnabled)
+		frame.pTraversalCounts[pixelIndex] = counts;
+}
+
+uint32_t Renderer::SaveBufferToImage(const HDRFrame& frame)
+{
+	PROFILE_ZONE("Renderer::SaveBufferToImage");
+	return m_ImageWriter.Enqueue(m_Width, m_Height, m_pBufferPixels, m_PixelFormat, frame.pRed, frame.pGreen, frame.pBlue);
+}
+
+void dae::Renderer::ToggleSaveEveryFrame()
+{
+	m_SaveEveryFrame = !m_SaveEveryFrame;
+	std::cout << (m_SaveEveryFrame ? "Saving every frame" : "Stopped saving every frame") << std::endl;
+}
+
+void dae::Renderer::ToggleShadowRaySorting()
+{
+	m_SortShadowRays = !m_SortShadowRays;
+	std::cout << (m_SortShadowRays ? "Sorted shadow rays per tile" : "Shadow rays traced per pixel") << std::endl;
+}
+
+void dae::Renderer::TogglePipelining()
+{
+	SetPipelining(!m_IsPipelined);
+	std::cout << (m_IsPipelined ? "Pipelined presentation" : "Sequential presentation") << std::endl;
+}
+
+void dae::Renderer::SetPipelining(bool isPipelined)
+{
+	if (m_IsPipelined == isPipelined)
+		return;
+
+	m_IsPipelined = isPipelined;
+	m_HasTracedFrame = false;
+	m_NrWarmupFrames = nrWarmupFrames;
+}
+
+void dae::Renderer::SetNuma(const Numa::Settings& settings)
+{
+#if defined(ASYNC) || defined(PARALLEL_FOR)
+	m_NumaSettings = settings;
+	m_pWorkerPool.reset();
+	if (settings.nrNodes > 0)
+		m_pWorkerPool = std::make_unique<WorkerPool>(settings.nrNodes, settings.isPinned);
+	m_TileScheduler.SetNrNodes(m_pWorkerPool ? m_pWorkerPool->GetNrNodes() : 1);
+
+	//The frame that wasn't presented yet is in the old pages
+	m_HasTracedFrame = false;
+	m_NrWarmupFrames = nrWarmupFrames;
+	AllocateFrames();
+	if (m_pWorkerPool)
+		FirstTouchFrames();
+#else
+	(void)settings;
+	std::cout << "NUMA rendering needs ASYNC or PARALLEL_FOR" << std::endl;
+#endif
+}
+
+uint32_t dae::Renderer::GetNrNumaWorkers() const
+{
+	return m_pWorkerPool ? m_pWorkerPool->GetNrWorkers() : 0;
+}
+
+void dae::Renderer::AllocateFrames()
+{
+	//Fresh pages, the first thread writing one decides its NUMA node
+	const size_t numPixels{ static_cast<size_t>(m_Width) * m_Height };
+	for (HDRFrame& frame : m_HDRFrames)
+	{
+		frame.buffer.Allocate(numPixels * 3);
+		frame.pRed = frame.buffer.data();
+		frame.pGreen = frame.pRed + numPixels;
+		frame.pBlue = frame.pGreen + numPixels;
+
+		frame.shadowRayBuffer.Allocate(numPixels);
+		frame.pShadowRays = frame.shadowRayBuffer.data();
+
+		if (TraversalStats::isEnabled)
+		{
+			frame.traversalBuffer.resize(numPixels);
+			frame.pTraversalCounts = frame.traversalBuffer.data();
 		}
 	}
+}
 
-	//Update Color in Buffer
-	finalColor.MaxToOne();
+void dae::Renderer::FirstTouchFrames()
+{
+	//Every band is cleared by the workers of the node that renders it, so its pages are placed on that node
+	WorkerPool& pool{ *m_pWorkerPool };
+	pool.Run([this, &pool](uint32_t workerIdx) {
+		const uint32_t node{ pool.GetNode(workerIdx) };
+		const uint32_t nodeWorkerIdx{ workerIdx - pool.GetFirstWorker(node) };
+		const uint32_t nrNodeWorkers{ pool.GetNrWorkers(node) };
 
-	m_pBufferPixels[px + (py * m_Width)] = SDL_MapRGB(m_pBuffer->format,
-		static_cast<uint8_t>(finalColor.r * 255),
-		static_cast<uint8_t>(finalColor.g * 255),
-		static_cast<uint8_t>(finalColor.b * 255));
+		uint32_t nodeRow{ 0 };
+		for (uint32_t y = 0; y < static_cast<uint32_t>(m_Height); ++y)
+		{
+			if (m_TileScheduler.GetNode(y) != node || nodeRow++ % nrNodeWorkers != nodeWorkerIdx)
+				continue;
+
+			const size_t rowBegin{ static_cast<size_t>(y) * m_Width };
+			for (HDRFrame& frame : m_HDRFrames)
+			{
+				std::fill_n(frame.pRed + rowBegin, m_Width, 0.f);
+				std::fill_n(frame.pGreen + rowBegin, m_Width, 0.f);
+				std::fill_n(frame.pBlue + rowBegin, m_Width, 0.f);
+				std::fill_n(frame.pShadowRays + rowBegin, m_Width, uint16_t{ 0 });
+			}
+		}
+		});
 }
 
-bool Renderer::SaveBufferToImage() const
+uint64_t dae::Renderer::GetNrShadowRays() const
 {
-	return SDL_SaveBMP(m_pBuffer, "RayTracing_Buffer.bmp");
+	const HDRFrame& frame{ m_HDRFrames[m_TraceFrameIdx] };
+	return std::accumulate(frame.shadowRayBuffer.begin(), frame.shadowRayBuffer.end(), uint64_t{ 0 });
 }
 
 void dae::Renderer::CycleLightingMode()
 {
-	if (m_CurrentLightingMode == LightingMode::Combined)
+	//Without the counters the heatmap would be black, it's skipped
+	const LightingMode lastMode{ TraversalStats::isEnabled ? LightingMode::TraversalHeatmap : LightingMode::Combined };
+	if (m_CurrentLightingMode == lastMode)
 	{
 		m_CurrentLightingMode = LightingMode::ObservedArea;
 	}
@@ -189,3 +680,23 @@ void dae::Renderer::CycleLightingMode()
 		m_CurrentLightingMode = static_cast<LightingMode>(static_cast<int>(m_CurrentLightingMode) + 1);
 	}
 }
+
+void dae::Renderer::CycleToneMapper()
+{
+	if (m_ResolveSettings.toneMapper == ToneMapping::ToneMapper::ACES)
+	{
+		m_ResolveSettings.toneMapper = ToneMapping::ToneMapper::MaxToOne;
+	}
+	else
+	{
+		m_ResolveSettings.toneMapper = static_cast<ToneMapping::ToneMapper>(static_cast<int>(m_ResolveSettings.toneMapper) + 1);
+	}
+
+	std::cout << "Tonemapper: " << ToneMapping::GetToneMapperName(m_ResolveSettings.toneMapper) << std::endl;
+}
+
+void dae::Renderer::ChangeExposure(float stops)
+{
+	m_ResolveSettings.exposure *= exp2f(stops);
+	std::cout << "Exposure: " << m_ResolveSettings.exposure << std::endl;
+}
@@ -1,7 +1,16 @@
 #pragma once
 
+#include <condition_variable>
 #include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
+#include "ToneMapping.h"
+#include "ImageWriter.h"
+#include "Numa.h"
+#include "TileScheduler.h"
+#include "TraversalStats.h"
 struct SDL_Window;
 struct SDL_Surface;
 
@@ -12,27 +21,56 @@ namespace dae
 	class Scene;
 	struct Camera;
 	struct Light;
-	class Material;
+	struct Ray;
+	struct HitRecord;
+	struct ColorRGB;
+	class MaterialTable;
+	class WorkerPool;
 
 	class Renderer final
 	{
 	public:
 		Renderer(SDL_Window* pWindow);
-		~Renderer() = default;
+		//Headless, renders into pBuffer (a 32-bit surface the caller owns) and never presents to a window
+		explicit Renderer(SDL_Surface* pBuffer);
+		~Renderer();
 
 		Renderer(const Renderer&) = delete;
 		Renderer(Renderer&&) noexcept = delete;
 		Renderer& operator=(const Renderer&) = delete;
 		Renderer& operator=(Renderer&&) noexcept = delete;
 
-		void Render(Scene* pScene) const;
+		//Pipelined: traces this frame while the previous one is resolved, presented and saved (one frame of latency)
+		//Otherwise: traces, resolves and presents this frame in sequence
+		void Render(Scene* pScene);
 
-		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera, const std::vector<Light>& lights, const std::vector<Material*>& materials) const;
+		void RenderPixel(Scene* pScene, uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera, const std::vector<Light>& lights, const MaterialTable& materials) const;
 
-		bool SaveBufferToImage() const;
+		//Saved right after the next present
+		void RequestScreenshot() { m_ScreenshotRequested = true; }
+		void ToggleSaveEveryFrame();
+		void CycleImageFormat() { m_ImageWriter.CycleFormat(); }
+		void TogglePipelining();
+		void ToggleAdaptiveTiles() { m_TileScheduler.ToggleAdaptive(); }
+		//Renders on pinned workers per NUMA node instead of parallel_for (ASYNC and PARALLEL_FOR only), nrNodes 0 turns it off
+		void SetNuma(const Numa::Settings& settings);
+		//0 without NUMA
+		uint32_t GetNrNumaWorkers() const;
+		void SetPipelining(bool isPipelined);
+
+		uint32_t GetNrPrimaryRays() const { return static_cast<uint32_t>(m_Width * m_Height); }
+		//Of the last traced frame
+		uint64_t GetNrShadowRays() const;
 
 		void ToggleShadows() { m_ShadowsEnabled = !m_ShadowsEnabled; }
+		//Traces the shadow rays of a tile as one batch, sorted by light and Morton code of origin and direction (ASYNC and PARALLEL_FOR only)
+		//Same image, the rays share more of the nodes in the cache, TraversalStats::CacheMisses shows how much
+		void ToggleShadowRaySorting();
+		void SetShadowRaySorting(bool isSorted) { m_SortShadowRays = isSorted; }
 		void CycleLightingMode();
+		void CycleToneMapper();
+		void ToggleSRGB() { m_ResolveSettings.encodeSRGB = !m_ResolveSettings.encodeSRGB; }
+		void ChangeExposure(float stops);
 
 	private:
 		enum class LightingMode
@@ -40,16 +78,91 @@ namespace dae
 			ObservedArea,	//Lambert Cosine Law
 			Radiance,		//Incident Radiance
 			BRDF,			//Scattering of the light
-			Combined		
+			Combined,
+			TraversalHeatmap	//Nodes visited + primitives tested per pixel, only with TRAVERSAL_STATS
 		};
 
 		LightingMode m_CurrentLightingMode{ LightingMode::Combined };
 		bool m_ShadowsEnabled{ true };
+		bool m_SortShadowRays{ false };
 
 		SDL_Window* m_pWindow{};
 		SDL_Surface* m_pBuffer{};
 		uint32_t* m_pBufferPixels{};
 		int m_Width{};
 		int m_Height{};
+
+		//Linear HDR radiance, one plane per channel so the resolve pass can load 4 pixels per channel at once
+		struct HDRFrame
+		{
+			Numa::PageArray<float> buffer{};
+			float* pRed{};
+			float* pGreen{};
+			float* pBlue{};
+
+			//Shadow rays cast per pixel, for statistics
+			Numa::PageArray<uint16_t> shadowRayBuffer{};
+			uint16_t* pShadowRays{};
+
+			//Per pixel traversal counts, empty without TRAVERSAL_STATS
+			std::vector<TraversalStats::Counts> traversalBuffer{};
+			TraversalStats::Counts* pTraversalCounts{};
+
+			//Mode the frame was traced with, pipelined frames are resolved after the next toggle may have changed m_CurrentLightingMode
+			LightingMode lightingMode{ LightingMode::Combined };
+		};
+
+		//Edge of the square tiles TraceFrame hands out to the workers (ASYNC and PARALLEL_FOR), before the scheduler splits them
+		static constexpr uint32_t tileSize{ 16 };
+		TileScheduler m_TileScheduler;
+
+		//Only with SetNuma, every node renders its band of tiles first
+		Numa::Settings m_NumaSettings{};
+		std::unique_ptr<WorkerPool> m_pWorkerPool{};
+
+		//One frame is traced while the other one is presented
+		HDRFrame m_HDRFrames[2]{};
+		uint32_t m_TraceFrameIdx{ 0 };
+		bool m_IsPipelined{ true };
+		bool m_HasTracedFrame{ false };
+
+		//Pipelined frames are traced on this thread, started with the first one and kept alive so a frame doesn't create threads
+		std::thread m_TraceThread{};
+		std::mutex m_TraceMutex{};
+		std::condition_variable m_TraceChanged{};
+		Scene* m_pTraceScene{};	//Set while a frame is being traced
+		bool m_IsStoppingTrace{ false };
+
+		//Frames rendered since the last change that allocates once (COUNT_HEAP_ALLOCATIONS only checks after these)
+		static constexpr uint32_t nrWarmupFrames{ 3 };
+		uint32_t m_NrWarmupFrames{ nrWarmupFrames };
+
+		ToneMapping::PixelFormat m_PixelFormat{};
+		ToneMapping::ResolveSettings m_ResolveSettings{};
+
+		ImageWriter m_ImageWriter{ "RayTracing_Buffer" };
+		bool m_ScreenshotRequested{ false };
+		bool m_SaveEveryFrame{ false };
+
+		void AllocateFrames();
+		void FirstTouchFrames();
+		void RenderPipelined(Scene* pScene);
+		void RunTraceThread();
+		void CheckHeapAllocations(uint64_t nrAllocationsBefore);
+		void TraceFrame(Scene* pScene);
+		void PresentFrame(const HDRFrame& frame);
+		void ResolveHDRBuffer(const HDRFrame& frame) const;
+		//View rays of the whole tile first, then every shadow ray in sorted order, then the shading
+		void RenderTileSortedShadows(Scene* pScene, const TileScheduler::Tile& tile, float fov, float aspectRatio, const Camera& camera, const std::vector<Light>& lights, const MaterialTable& materials) const;
+		Ray GetViewRay(uint32_t pixelIndex, float fov, float aspectRatio, const Camera& camera) const;
+		//Closest hit and its ray cone footprint
+		void TraceViewRay(Scene* pScene, const Ray& viewRay, float fov, HitRecord& closestHit) const;
+		//Contribution of one unoccluded light in the current lighting mode
+		ColorRGB ShadeLight(const Light& light, const HitRecord& closestHit, const Ray& viewRay, const Ray& lightRay, const MaterialTable& materials) const;
+		void WritePixel(uint32_t pixelIndex, const ColorRGB& color, uint16_t nrShadowRays, const TraversalStats::Counts& counts) const;
+		//Replaces the radiance of the frame by its traversal cost, black (nothing) over blue and green to red (the most expensive pixel)
+		void WriteTraversalHeatmap(const HDRFrame& frame) const;
+		//Queues the frame on the background image writer, returns the sequence number of the file
+		uint32_t SaveBufferToImage(const HDRFrame& frame);
 	};
 }
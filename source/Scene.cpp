@@ -1,30 +1,36 @@
 #include "Scene.h"
 #include "Utils.h"
 #include "Material.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "OutOfCoreMesh.h"
+#include "Json.h"
+#include "Numa.h"
+
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <map>
+
+//Also times the same rays against meshes before and after they are compacted ("compact": true in a scene file)
+//#define REPORT_COMPACT_STORAGE
 
 namespace dae {
 
 #pragma region Base Scene
 	//Initialize Scene with Default Solid Color Material (RED)
-	Scene::Scene():
-		m_Materials({ new Material_SolidColor({1,0,0})})
+	Scene::Scene()
 	{
+		AddMaterial(Material_SolidColor({1,0,0}));
+
 		m_SphereGeometries.reserve(32);
 		m_PlaneGeometries.reserve(32);
 		m_TriangleMeshGeometries.reserve(32);
 		m_Lights.reserve(32);
 	}
 
-	Scene::~Scene()
-	{
-		for(auto& pMaterial : m_Materials)
-		{
-			delete pMaterial;
-			pMaterial = nullptr;
-		}
-
-		m_Materials.clear();
-	}
+	//Out of line, OutOfCoreMesh is only forward declared in the header
+	Scene::~Scene() = default;
 
 	void dae::Scene::GetClosestHit(const Ray& ray, HitRecord& closestHit) const
 	{
@@ -43,12 +49,18 @@ namespace dae {
 
 		if (GeometryUtils::SlabTest(m_aabbTriangles.min,m_aabbTriangles.max,ray))
 		{
-			for (size_t i = 0; i < m_TriangleMeshGeometries.size(); i++)
+			const std::vector<TriangleMesh>& triangleMeshes{ GetLocalTriangleMeshes() };
+			for (size_t i = 0; i < triangleMeshes.size(); i++)
 			{
-				GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[i], ray, closestHit);
+				GeometryUtils::HitTest_TriangleMesh(triangleMeshes[i], ray, closestHit);
 
 			}
 		}
+
+		for (const auto& pMesh : m_OutOfCoreMeshes)
+		{
+			pMesh->HitTest(ray, closestHit);
+		}
 		
 	}
 
@@ -73,48 +85,94 @@ namespace dae {
 
 		if (GeometryUtils::SlabTest(m_aabbTriangles.min, m_aabbTriangles.max, ray))
 		{
-			for (size_t i = 0; i < m_TriangleMeshGeometries.size(); i++)
+			const std::vector<TriangleMesh>& triangleMeshes{ GetLocalTriangleMeshes() };
+			for (size_t i = 0; i < triangleMeshes.size(); i++)
 			{
-				if (GeometryUtils::HitTest_TriangleMesh(m_TriangleMeshGeometries[i], ray))
+				if (GeometryUtils::HitTest_TriangleMesh(triangleMeshes[i], ray))
 					return true;
 			}
 		}
+
+		for (const auto& pMesh : m_OutOfCoreMeshes)
+		{
+			HitRecord temp{};
+			if (pMesh->HitTest(ray, temp, true))
+				return true;
+		}
 		return false;
 	}
 
+	void Scene::PrepareReplicas(uint32_t nrNodes)
+	{
+		if (m_TriangleMeshReplicas.size() != nrNodes)
+		{
+			m_TriangleMeshReplicas.clear();
+			m_TriangleMeshReplicas.resize(nrNodes);
+		}
+	}
+
+	void Scene::UpdateReplica(uint32_t node)
+	{
+		std::vector<TriangleMesh>& replica{ m_TriangleMeshReplicas[node] };
+		if (replica.size() != m_TriangleMeshGeometries.size())
+		{
+			replica = m_TriangleMeshGeometries;
+			return;
+		}
+
+		//Static meshes are copied once, animated ones every frame (into the same memory)
+		for (size_t i = 0; i < replica.size(); ++i)
+		{
+			if (replica[i].transformVersion != m_TriangleMeshGeometries[i].transformVersion)
+				replica[i] = m_TriangleMeshGeometries[i];
+		}
+	}
+
+	const std::vector<TriangleMesh>& Scene::GetLocalTriangleMeshes() const
+	{
+		const uint32_t node{ Numa::GetCurrentNode() };
+		return node < m_TriangleMeshReplicas.size() ? m_TriangleMeshReplicas[node] : m_TriangleMeshGeometries;
+	}
+
 #pragma region Scene Helpers
-	Sphere* Scene::AddSphere(const Vector3& origin, float radius, unsigned char materialIndex)
+	Sphere* Scene::AddSphere(const Vector3& origin, float radius, MaterialHandle materialHandle)
 	{
 		Sphere s;
 		s.origin = origin;
 		s.radius = radius;
-		s.materialIndex = materialIndex;
+		s.materialHandle = materialHandle;
 
 		m_SphereGeometries.emplace_back(s);
 		return &m_SphereGeometries.back();
 	}
 
-	Plane* Scene::AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex)
+	Plane* Scene::AddPlane(const Vector3& origin, const Vector3& normal, MaterialHandle materialHandle)
 	{
 		Plane p;
 		p.origin = origin;
 		p.normal = normal;
-		p.materialIndex = materialIndex;
+		p.materialHandle = materialHandle;
 
 		m_PlaneGeometries.emplace_back(p);
 		return &m_PlaneGeometries.back();
 	}
 
-	TriangleMesh* Scene::AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex)
+	TriangleMesh* Scene::AddTriangleMesh(TriangleCullMode cullMode, MaterialHandle materialHandle)
 	{
 		TriangleMesh m{};
 		m.cullMode = cullMode;
-		m.materialIndex = materialIndex;
+		m.materialHandle = materialHandle;
 
 		m_TriangleMeshGeometries.emplace_back(m);
 		return &m_TriangleMeshGeometries.back();
 	}
 
+	OutOfCoreMesh* Scene::AddOutOfCoreMesh(const std::string& filename, uint64_t sourceHash, uint64_t buildHash, uint64_t residentBudget, TriangleCullMode cullMode, MaterialHandle materialHandle)
+	{
+		m_OutOfCoreMeshes.push_back(std::make_unique<OutOfCoreMesh>(filename, sourceHash, buildHash, residentBudget, cullMode, materialHandle));
+		return m_OutOfCoreMeshes.back().get();
+	}
+
 	Light* Scene::AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color)
 	{
 		Light l;
@@ -139,10 +197,14 @@ namespace dae {
 		return &m_Lights.back();
 	}
 
-	unsigned char Scene::AddMaterial(Material* pMaterial)
+	const Texture* Scene::AddTexture(const std::string& filename)
 	{
-		m_Materials.push_back(pMaterial);
-		return static_cast<unsigned char>(m_Materials.size() - 1);
+		std::unique_ptr<Texture> pTexture{ Texture::LoadFromFile(filename) };
+		if (!pTexture)
+			return nullptr;
+
+		m_Textures.push_back(std::move(pTexture));
+		return m_Textures.back().get();
 	}
 #pragma endregion
 #pragma endregion
@@ -152,11 +214,11 @@ namespace dae {
 	{
 				//default: Material id0 >> SolidColor Material (RED)
 		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
+		const MaterialHandle matId_Solid_Blue = AddMaterial(Material_SolidColor{ colors::Blue });
 
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		const MaterialHandle matId_Solid_Yellow = AddMaterial(Material_SolidColor{ colors::Yellow });
+		const MaterialHandle matId_Solid_Green = AddMaterial(Material_SolidColor{ colors::Green });
+		const MaterialHandle matId_Solid_Magenta = AddMaterial(Material_SolidColor{ colors::Magenta });
 
 		//Spheres
 		AddSphere({ -25.f, 0.f, 100.f }, 50.f, matId_Solid_Red);
@@ -179,11 +241,11 @@ namespace dae {
 
 		//default: Material id0 >> SolidColor Material (RED)
 		constexpr unsigned char matId_Solid_Red = 0;
-		const unsigned char matId_Solid_Blue = AddMaterial(new Material_SolidColor{ colors::Blue });
+		const MaterialHandle matId_Solid_Blue = AddMaterial(Material_SolidColor{ colors::Blue });
 
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_SolidColor{ colors::Yellow });
-		const unsigned char matId_Solid_Green = AddMaterial(new Material_SolidColor{ colors::Green });
-		const unsigned char matId_Solid_Magenta = AddMaterial(new Material_SolidColor{ colors::Magenta });
+		const MaterialHandle matId_Solid_Yellow = AddMaterial(Material_SolidColor{ colors::Yellow });
+		const MaterialHandle matId_Solid_Green = AddMaterial(Material_SolidColor{ colors::Green });
+		const MaterialHandle matId_Solid_Magenta = AddMaterial(Material_SolidColor{ colors::Magenta });
 
 		//Plane
 		AddPlane({ -5.f,0.f,0.f }, { 1.f,0.f,0.f }, matId_Solid_Green);
@@ -209,9 +271,9 @@ namespace dae {
 		m_Camera.origin = { 0.f,1.f,-5.f };
 		m_Camera.fovAngle = 45.f;
 
-		const unsigned char matId_Solid_Red = AddMaterial(new Material_Lambert(colors::Red,1.f));
-		const unsigned char matLambertPhong_Blue = AddMaterial(new Material_LambertPhong(colors::Blue,1.f,1.f,60.f));
-		const unsigned char matId_Solid_Yellow = AddMaterial(new Material_Lambert(colors::Yellow, 1.f));
+		const MaterialHandle matId_Solid_Red = AddMaterial(Material_Lambert(colors::Red,1.f));
+		const MaterialHandle matLambertPhong_Blue = AddMaterial(Material_LambertPhong(colors::Blue,1.f,1.f,60.f));
+		const MaterialHandle matId_Solid_Yellow = AddMaterial(Material_Lambert(colors::Yellow, 1.f));
 
 		AddSphere({ -.75f, 1.f,.0f }, 1.f, matId_Solid_Red);
 		AddSphere({ .75f, 1.f,.0f }, 1.f, matLambertPhong_Blue);
@@ -226,14 +288,14 @@ namespace dae {
 		m_Camera.origin = { 0.f,3.f,-9.f };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({.972f,.960f,.915f},1.f,1.f));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ .972f,.960f,.915f }, 1.f, .6f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ .972f,.960f,.915f }, 1.f, .1f));
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({.75f,.75f,.75f},.0f,1.f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ .75f,.75f,.75f }, .0f, .6f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ .75f,.75f,.75f }, .0f, .1f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material_CookTorrence({.972f,.960f,.915f},1.f,1.f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material_CookTorrence({ .972f,.960f,.915f }, 1.f, .6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material_CookTorrence({ .972f,.960f,.915f }, 1.f, .1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material_CookTorrence({.75f,.75f,.75f},.0f,1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material_CookTorrence({ .75f,.75f,.75f }, .0f, .6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material_CookTorrence({ .75f,.75f,.75f }, .0f, .1f));
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f,.57f,.57f }, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert({ .49f,.57f,.57f }, 1.f));
 
 		AddPlane(Vector3{ 0.f,0.f,10.f }, Vector3{ 0.f,0.f,-1.f }, matLambert_GrayBlue); //BACK
 		AddPlane(Vector3{ 0.f,0.f,0.f }, Vector3{ 0.f,1.f,0.f }, matLambert_GrayBlue); //BOTTOM
@@ -242,9 +304,9 @@ namespace dae {
 		AddPlane(Vector3{ -5.f,0.f,0.f }, Vector3{ 1.f,0.f,0.f }, matLambert_GrayBlue); //LEFT
 
 		//Temp Phong
-		//const auto matLambertPhong1 = AddMaterial(new Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 3.f));
-		//const auto matLambertPhong2 = AddMaterial(new Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 15.f));
-		//const auto matLambertPhong3 = AddMaterial(new Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 50.f));
+		//const auto matLambertPhong1 = AddMaterial(Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 3.f));
+		//const auto matLambertPhong2 = AddMaterial(Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 15.f));
+		//const auto matLambertPhong3 = AddMaterial(Material_LambertPhong(colors::Blue, 0.5f, 0.5f, 50.f));
 
 		//AddSphere(Vector3{ -1.75f,1.f,0.f }, .75f, matLambertPhong1);
 		//AddSphere(Vector3{ 0.f,1.f,0.f }, .75f, matLambertPhong2);
@@ -268,8 +330,8 @@ namespace dae {
 		m_Camera.origin = { 0.f, 1.f, -5.f };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ .49f,.57f,.57f }, 1.f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert({ .49f,.57f,.57f }, 1.f));
+		const auto matLambert_White = AddMaterial(Material_Lambert(colors::White, 1.f));
 
 		AddPlane(Vector3{ 0.f,0.f,10.f }, Vector3{ 0.f,0.f,-1.f }, matLambert_GrayBlue); //BACK
 		AddPlane(Vector3{ 0.f,0.f,0.f }, Vector3{ 0.f,1.f,0.f }, matLambert_GrayBlue); //BOTTOM
@@ -279,6 +341,7 @@ namespace dae {
 
 		pMesh = AddTriangleMesh(dae::TriangleCullMode::BackFaceCulling, matLambert_White);
 		Utils::ParseOBJ("Resources/simple_cube.obj",pMesh->positions,pMesh->normals,pMesh->indices);
+		MeshOptimizer::Optimize(*pMesh);
 
 
 
@@ -311,15 +374,15 @@ namespace dae {
 		m_Camera.origin = { 0.f, 3.0f, -9.0f };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matCT_GrayRoughMetal = AddMaterial(new Material_CookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 1.0f));
-		const auto matCT_GrayMediumMetal = AddMaterial(new Material_CookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 0.6f));
-		const auto matCT_GraySmoothMetal = AddMaterial(new Material_CookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 0.1f));
-		const auto matCT_GrayRoughPlastic = AddMaterial(new Material_CookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 1.f));
-		const auto matCT_GrayMediumPlastic = AddMaterial(new Material_CookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 0.6f));
-		const auto matCT_GraySmoothPlastic = AddMaterial(new Material_CookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 0.1f));
+		const auto matCT_GrayRoughMetal = AddMaterial(Material_CookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 1.0f));
+		const auto matCT_GrayMediumMetal = AddMaterial(Material_CookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 0.6f));
+		const auto matCT_GraySmoothMetal = AddMaterial(Material_CookTorrence({ 0.972f, 0.960f, 0.915f }, 1.0f, 0.1f));
+		const auto matCT_GrayRoughPlastic = AddMaterial(Material_CookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 1.f));
+		const auto matCT_GrayMediumPlastic = AddMaterial(Material_CookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 0.6f));
+		const auto matCT_GraySmoothPlastic = AddMaterial(Material_CookTorrence({ 0.75f, 0.75f, 0.75f }, 0.0f, 0.1f));
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.0f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.0f));
+		const auto matLambert_White = AddMaterial(Material_Lambert(colors::White, 1.f));
 
 		//Plane
 		AddPlane(Vector3{ 0.0f, 0.0f, 10.0f }, Vector3{ 0.0f, 0.0f, -1.0f }, matLambert_GrayBlue);; //Back
@@ -390,9 +453,9 @@ namespace dae {
 			
 			for (uint32_t i = 0; i < m->trCount; i++)
 			{
-				m_aabbTriangles.Grow(m->transformedPositions[m->indices[i * 3]]);
-				m_aabbTriangles.Grow(m->transformedPositions[m->indices[i * 3 + 1]]);
-				m_aabbTriangles.Grow(m->transformedPositions[m->indices[i * 3 + 2]]);
+				m_aabbTriangles.Grow(m->GetTransformedPosition(m->indices[i * 3]));
+				m_aabbTriangles.Grow(m->GetTransformedPosition(m->indices[i * 3 + 1]));
+				m_aabbTriangles.Grow(m->GetTransformedPosition(m->indices[i * 3 + 2]));
 			}
 
 		}
@@ -412,8 +475,8 @@ namespace dae {
 		m_Camera.origin = { 0.f, 3.0f, -9.0f };
 		m_Camera.fovAngle = 45.f;
 
-		const auto matLambert_GrayBlue = AddMaterial(new Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.0f));
-		const auto matLambert_White = AddMaterial(new Material_Lambert(colors::White, 1.f));
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.0f));
+		const auto matLambert_White = AddMaterial(Material_Lambert(colors::White, 1.f));
 
 		//Plane
 		AddPlane(Vector3{ 0.0f, 0.0f, 10.0f }, Vector3{ 0.0f, 0.0f, -1.0f }, matLambert_GrayBlue);; //Back
@@ -424,17 +487,11 @@ namespace dae {
 
 
 		m_pBunny = AddTriangleMesh(dae::TriangleCullMode::BackFaceCulling, matLambert_White);
-		Utils::ParseOBJ("Resources/lowpoly_bunny.obj", m_pBunny->positions, m_pBunny->normals, m_pBunny->indices);
-		//m_pBunny->CalculateNormals();	
 		m_pBunny->shouldUseBVH = true;
 		m_pBunny->Scale({ 2.f,2.f,2.f });
-	
-		m_pBunny->CalculateCentroids();
-		
-		m_pBunny->UpdateTransforms();
-	
-		m_pBunny->InitBVH();
-		m_pBunny->BuildBVH();
+
+		//Parses the OBJ and builds the BVH only when its Resources/lowpoly_bunny.obj.<build hash>.bvhcache is missing or outdated
+		MeshCache::LoadOBJ("Resources/lowpoly_bunny.obj", *m_pBunny);
 
 		
 
@@ -453,4 +510,295 @@ namespace dae {
 
 	}
 	
+
+	void Scene_W4_OutOfCoreBunnyScene::Initialize()
+	{
+		sceneName = "Out Of Core Bunny Scene";
+		m_Camera.origin = { 0.f, 3.0f, -9.0f };
+		m_Camera.fovAngle = 45.f;
+
+		const auto matLambert_GrayBlue = AddMaterial(Material_Lambert({ 0.49f, 0.57f, 0.57f }, 1.0f));
+		const auto matLambert_White = AddMaterial(Material_Lambert(colors::White, 1.f));
+
+		//Plane
+		AddPlane(Vector3{ 0.0f, 0.0f, 10.0f }, Vector3{ 0.0f, 0.0f, -1.0f }, matLambert_GrayBlue); //Back
+		AddPlane(Vector3{ 0.0f, 0.0f, 0.0f }, Vector3{ 0.0f, 1.0f, 0.0f }, matLambert_GrayBlue); //Bottom
+		AddPlane(Vector3{ 0.0f, 10.0f, 0.0f }, Vector3{ 0.0f, -1.0f, 0.0f }, matLambert_GrayBlue); //Top
+		AddPlane(Vector3{ 5.0f, 0.f, 0.0f }, Vector3{ -1.0f, 0.0f, 0.0f }, matLambert_GrayBlue); //Right
+		AddPlane(Vector3{ -5.0f, 0.0f, 0.0f }, Vector3{ 1.0f, 0.0f, 0.0f }, matLambert_GrayBlue); //Left
+
+		//Small pages and a budget of a few pages so paging actually happens with the low poly bunny
+		//The paged file is static world space data, it is rebuilt when the OBJ, the transform below or the page size changes
+		const std::string sourceFilename{ "Resources/lowpoly_bunny.obj" };
+		constexpr uint32_t trianglesPerPage{ 64 };
+		constexpr uint64_t residentBudget{ 8 * 1024 };
+
+		TriangleMesh source{};
+		source.shouldUseBVH = true;
+		source.Scale({ 2.f,2.f,2.f });
+		uint64_t sourceHash{};
+		MeshCache::HashFile(sourceFilename, sourceHash);
+		const uint64_t buildHash{ OutOfCoreMesh::HashBuild(source, trianglesPerPage) };
+		const std::string pagedFilename{ MeshCache::GetCacheFilename(sourceFilename, buildHash, ".paged") };
+
+		m_pBunny = AddOutOfCoreMesh(pagedFilename, sourceHash, buildHash, residentBudget, TriangleCullMode::BackFaceCulling, matLambert_White);
+		if (!m_pBunny->IsLoaded())
+		{
+			m_OutOfCoreMeshes.pop_back();
+
+			if (!MeshCache::LoadOBJ(sourceFilename, source) || !OutOfCoreMesh::Build(source, pagedFilename, sourceHash, trianglesPerPage))
+				std::cout << "Failed to build " << pagedFilename << std::endl;
+
+			m_pBunny = AddOutOfCoreMesh(pagedFilename, sourceHash, buildHash, residentBudget, TriangleCullMode::BackFaceCulling, matLambert_White);
+		}
+
+		//Light
+		AddPointLight(Vector3{ 0.0f, 5.0f, 5.0f }, 50.f, ColorRGB{ 1.0f, 0.61f, 0.45f }); // Backlight
+		AddPointLight(Vector3{ -2.5f, 5.0f, -5.0f }, 70.f, ColorRGB{ 1.0f, 0.8f, 0.45f }); // Frontlight left
+		AddPointLight(Vector3{ 2.5f, 2.5f, -5.0f }, 50.f, ColorRGB{ 0.34f, 0.47f, 0.68f });
+	}
+
+	void Scene_W4_OutOfCoreBunnyScene::Update(Timer* pTimer)
+	{
+		Scene::Update(pTimer);
+		m_pBunny->NextFrame();
+
+		m_StatsTimer += pTimer->GetElapsed();
+		if (m_StatsTimer >= 1.f)
+		{
+			const OutOfCoreMesh::Stats stats{ m_pBunny->GetStats() };
+			std::cout << "Paging: " << (stats.pageIns - m_LastPageIns) / m_StatsTimer << " page-ins/s, "
+				<< stats.residentPages << "/" << stats.totalPages << " pages resident ("
+				<< stats.residentBytes / 1024 << " KB), " << stats.evictions << " evictions" << std::endl;
+
+			m_LastPageIns = stats.pageIns;
+			m_StatsTimer = 0.f;
+		}
+	}
+
+#pragma region SCENE FILE
+	namespace
+	{
+		Vector3 ReadVector3(const Json::Value& value, const std::string& key, const Vector3& defaultValue)
+		{
+			const Json::Value* pArray{ value.Find(key) };
+			if (!pArray || pArray->type != Json::Type::Array || pArray->array.size() != 3)
+				return defaultValue;
+
+			Vector3 result{};
+			for (int i = 0; i < 3; ++i)
+			{
+				if (pArray->array[i].type != Json::Type::Number)
+					return defaultValue;
+				result[i] = static_cast<float>(pArray->array[i].number);
+			}
+			return result;
+		}
+
+		ColorRGB ReadColor(const Json::Value& value, const std::string& key, const ColorRGB& defaultValue)
+		{
+			const Vector3 color{ ReadVector3(value, key, Vector3{ defaultValue.r, defaultValue.g, defaultValue.b }) };
+			return ColorRGB{ color.x, color.y, color.z };
+		}
+
+		TriangleCullMode ReadCullMode(const Json::Value& value)
+		{
+			const std::string cullMode{ value.GetString("cullMode", "back") };
+			if (cullMode == "front")
+				return TriangleCullMode::FrontFaceCulling;
+			if (cullMode == "none")
+				return TriangleCullMode::NoCulling;
+			return TriangleCullMode::BackFaceCulling;
+		}
+
+		const std::vector<Json::Value>& ReadArray(const Json::Value& value, const std::string& key)
+		{
+			static const std::vector<Json::Value> empty{};
+			const Json::Value* pArray{ value.Find(key) };
+			return pArray && pArray->type == Json::Type::Array ? pArray->array : empty;
+		}
+
+		//pTexture modulates the diffuse color or albedo, nullptr for none
+		bool CreateMaterial(const Json::Value& value, const Texture* pTexture, MaterialTable& materials, MaterialHandle& handle)
+		{
+			const std::string type{ value.GetString("type", "") };
+			if (type == "solidColor")
+				handle = materials.Add(Material_SolidColor{ ReadColor(value, "color", colors::White) });
+			else if (type == "lambert")
+				handle = materials.Add(Material_Lambert{ ReadColor(value, "color", colors::White), value.GetFloat("reflectance", 1.f), pTexture });
+			else if (type == "lambertPhong")
+				handle = materials.Add(Material_LambertPhong{ ReadColor(value, "color", colors::White), value.GetFloat("kd", 1.f), value.GetFloat("ks", 1.f), value.GetFloat("exponent", 60.f), pTexture });
+			else if (type == "cookTorrence")
+				handle = materials.Add(Material_CookTorrence{ ReadColor(value, "albedo", colors::White), value.GetFloat("metalness", 0.f), value.GetFloat("roughness", 1.f), pTexture });
+			else
+			{
+				std::cout << "Unknown material type \"" << type << "\"" << std::endl;
+				return false;
+			}
+			return true;
+		}
+
+		void CompactMesh(const std::string& filename, TriangleMesh& mesh)
+		{
+			const size_t fullBytes{ mesh.GetMemoryUsage() };
+#ifdef REPORT_COMPACT_STORAGE
+			constexpr uint32_t nrRays{ 20000 };
+			const double fullTime{ MeshOptimizer::MeasureTraversal(mesh, nrRays) };
+#endif
+			mesh.Compact();
+
+			std::cout << "Compacted " << filename << ": " << fullBytes / 1024 << " KB -> " << mesh.GetMemoryUsage() / 1024 << " KB";
+#ifdef REPORT_COMPACT_STORAGE
+			const double compactTime{ MeshOptimizer::MeasureTraversal(mesh, nrRays) };
+			std::cout << ", traversal " << fullTime * 1000.0 << "ms -> " << compactTime * 1000.0 << "ms for " << nrRays << " rays";
+#endif
+			std::cout << std::endl;
+		}
+	}
+
+	void Scene_File::Initialize()
+	{
+		const auto startTime{ std::chrono::steady_clock::now() };
+
+		Json::Value root{};
+		std::string error{};
+		if (!Json::ParseFile(m_Filename, root, error))
+		{
+			std::cout << "Failed to load scene " << m_Filename << ": " << error << std::endl;
+			return;
+		}
+
+		sceneName = root.GetString("name", m_Filename);
+
+		if (const Json::Value* pCamera{ root.Find("camera") })
+		{
+			m_Camera.origin = ReadVector3(*pCamera, "origin", m_Camera.origin);
+			m_Camera.fovAngle = pCamera->GetFloat("fov", m_Camera.fovAngle);
+			m_Camera.totalPitch = pCamera->GetFloat("pitch", 0.f) * TO_RADIANS;
+			m_Camera.totalYaw = pCamera->GetFloat("yaw", 0.f) * TO_RADIANS;
+		}
+
+		//Materials are referenced by name or by index, index 0 is the default (red) material
+		std::vector<MaterialHandle> materialHandles{ 0 };
+		std::map<std::string, MaterialHandle> materialNames{};
+		for (const Json::Value& material : ReadArray(root, "materials"))
+		{
+			//Textures are BMPs relative to the working directory, meshes need texcoords to use them
+			const Texture* pTexture{ nullptr };
+			const std::string textureFilename{ material.GetString("texture", "") };
+			if (!textureFilename.empty())
+				pTexture = AddTexture(textureFilename);
+
+			MaterialHandle materialHandle{};
+			if (!CreateMaterial(material, pTexture, m_Materials, materialHandle))
+				continue;
+
+			materialHandles.push_back(materialHandle);
+			const std::string name{ material.GetString("name", "") };
+			if (!name.empty())
+				materialNames[name] = materialHandle;
+		}
+
+		auto readMaterial = [&](const Json::Value& value) -> MaterialHandle
+		{
+			const Json::Value* pMaterial{ value.Find("material") };
+			if (!pMaterial)
+				return 0;
+			if (pMaterial->type == Json::Type::Number && pMaterial->number >= 0 && pMaterial->number < materialHandles.size())
+				return materialHandles[static_cast<size_t>(pMaterial->number)];
+			if (pMaterial->type == Json::Type::String && materialNames.contains(pMaterial->string))
+				return materialNames[pMaterial->string];
+
+			std::cout << "Unknown material in " << m_Filename << ", using the default one" << std::endl;
+			return 0;
+		};
+
+		for (const Json::Value& plane : ReadArray(root, "planes"))
+		{
+			AddPlane(ReadVector3(plane, "origin", Vector3::Zero), ReadVector3(plane, "normal", Vector3::UnitY).Normalized(), readMaterial(plane));
+		}
+
+		for (const Json::Value& sphere : ReadArray(root, "spheres"))
+		{
+			AddSphere(ReadVector3(sphere, "origin", Vector3::Zero), sphere.GetFloat("radius", 1.f), readMaterial(sphere));
+		}
+
+		for (const Json::Value& light : ReadArray(root, "lights"))
+		{
+			const ColorRGB color{ ReadColor(light, "color", colors::White) };
+			const float intensity{ light.GetFloat("intensity", 1.f) };
+			if (light.GetString("type", "point") == "directional")
+				AddDirectionalLight(ReadVector3(light, "direction", -Vector3::UnitY).Normalized(), intensity, color);
+			else
+				AddPointLight(ReadVector3(light, "origin", Vector3::Zero), intensity, color);
+		}
+
+		//All meshes are added first, pointers into m_TriangleMeshGeometries are only stable once it stopped growing
+		const std::vector<Json::Value>& meshes{ ReadArray(root, "meshes") };
+		std::vector<std::string> meshFilenames{};
+		std::vector<bool> shouldCompactMeshes{};
+		for (const Json::Value& mesh : meshes)
+		{
+			meshFilenames.push_back(mesh.GetString("file", ""));
+			shouldCompactMeshes.push_back(mesh.GetBool("compact", false));
+
+			TriangleMesh* pMesh{ AddTriangleMesh(ReadCullMode(mesh), readMaterial(mesh)) };
+			pMesh->shouldUseBVH = mesh.GetBool("bvh", true);
+			const std::string bvhBuilder{ mesh.GetString("bvhBuilder", "sah") };
+			if (bvhBuilder == "linear")
+				pMesh->bvhSettings.builder = BVHBuilder::Linear;
+			else if (bvhBuilder == "spatial")
+				pMesh->bvhSettings.builder = BVHBuilder::SpatialSAH;
+			pMesh->bvhSettings.sahLevels = static_cast<uint32_t>(mesh.GetFloat("sahLevels", 0.f));
+			pMesh->bvhSettings.spatialSplitBudget = mesh.GetFloat("spatialSplitBudget", pMesh->bvhSettings.spatialSplitBudget);
+			pMesh->bvhSettings.treeletSize = static_cast<uint32_t>(mesh.GetFloat("treeletSize", 0.f));
+			pMesh->shouldRebuildBVH = mesh.GetBool("rebuildBVH", false);
+			const std::string accelerationStructure{ mesh.GetString("acceleration", "bvh") };
+			if (accelerationStructure == "grid")
+				pMesh->accelerationStructure = AccelerationStructure::Grid;
+			else if (accelerationStructure == "kdtree")
+				pMesh->accelerationStructure = AccelerationStructure::KdTree;
+			else if (accelerationStructure == "auto")
+				pMesh->accelerationStructure = AccelerationStructure::Automatic;
+			pMesh->Scale(ReadVector3(mesh, "scale", Vector3{ 1.f, 1.f, 1.f }));
+			pMesh->RotateY(mesh.GetFloat("rotationY", 0.f) * TO_RADIANS);
+			pMesh->Translate(ReadVector3(mesh, "translation", Vector3::Zero));
+		}
+
+		//One task per file, meshes sharing a file load one after the other so identical ones don't race on their cache file
+		std::map<std::string, std::vector<std::pair<TriangleMesh*, bool>>> meshesPerFile{};
+		const size_t firstMeshIdx{ m_TriangleMeshGeometries.size() - meshes.size() };
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			meshesPerFile[meshFilenames[i]].emplace_back(&m_TriangleMeshGeometries[firstMeshIdx + i], shouldCompactMeshes[i]);
+		}
+
+		std::vector<std::future<void>> tasks{};
+		for (const auto& [filename, fileMeshes] : meshesPerFile)
+		{
+			tasks.push_back(std::async(std::launch::async, [&filename, &fileMeshes]
+				{
+					for (const auto& [pMesh, shouldCompact] : fileMeshes)
+					{
+						if (MeshCache::LoadOBJ(filename, *pMesh))
+						{
+							if (shouldCompact)
+								CompactMesh(filename, *pMesh);
+							continue;
+						}
+
+						//Stays in the scene as an empty mesh, which has no BVH to traverse
+						std::cout << "Failed to load mesh " << filename << std::endl;
+						pMesh->shouldUseBVH = false;
+					}
+				}));
+		}
+		for (std::future<void>& task : tasks)
+			task.wait();
+
+		const auto duration{ std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime) };
+		std::cout << "Loaded scene " << sceneName << " (" << meshes.size() << " meshes) in " << duration.count() << "ms" << std::endl;
+	}
+#pragma endregion
+
 }
@@ -1,19 +1,21 @@
 #pragma once
+#include <memory>
 #include <string>
 #include <vector>
 
 #include "Math.h"
 #include "DataTypes.h"
 #include "Camera.h"
+#include "Material.h"
 
 namespace dae
 {
 	//Forward Declarations
 	class Timer;
-	class Material;
 	struct Plane;
 	struct Sphere;
 	struct Light;
+	class OutOfCoreMesh;
 
 	//Scene Base Class
 	class Scene
@@ -39,8 +41,14 @@ namespace dae
 
 		const std::vector<Plane>& GetPlaneGeometries() const { return m_PlaneGeometries; }
 		const std::vector<Sphere>& GetSphereGeometries() const { return m_SphereGeometries; }
+		const std::vector<TriangleMesh>& GetTriangleMeshGeometries() const { return m_TriangleMeshGeometries; }
 		const std::vector<Light>& GetLights() const { return m_Lights; }
-		const std::vector<Material*> GetMaterials() const { return m_Materials; }
+		const MaterialTable& GetMaterials() const { return m_Materials; }
+
+		//Copies of the triangle meshes per NUMA node, 0 drops them. Called before the workers of the frame start (Renderer::SetNuma)
+		void PrepareReplicas(uint32_t nrNodes);
+		//Called by one worker on the node, so the copy is placed there. Only meshes that changed since the last call are copied
+		void UpdateReplica(uint32_t node);
 
 	protected:
 		std::string	sceneName;
@@ -48,21 +56,31 @@ namespace dae
 		std::vector<Plane> m_PlaneGeometries{};
 		std::vector<Sphere> m_SphereGeometries{};
 		std::vector<TriangleMesh> m_TriangleMeshGeometries{};
+		std::vector<std::vector<TriangleMesh>> m_TriangleMeshReplicas{};	//Per NUMA node, empty without replication
+		std::vector<std::unique_ptr<OutOfCoreMesh>> m_OutOfCoreMeshes{};
+		std::vector<std::unique_ptr<Texture>> m_Textures{};
 		std::vector<Light> m_Lights{};
-		std::vector<Material*> m_Materials{};
+		MaterialTable m_Materials{};
 		//temp
 		std::vector<Triangle> m_Triangles{};
 		AABB m_aabbTriangles;
 		AABB m_aabbCircles;
 		Camera m_Camera{};
 
-		Sphere* AddSphere(const Vector3& origin, float radius, unsigned char materialIndex = 0);
-		Plane* AddPlane(const Vector3& origin, const Vector3& normal, unsigned char materialIndex = 0);
-		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, unsigned char materialIndex = 0);
+		Sphere* AddSphere(const Vector3& origin, float radius, MaterialHandle materialHandle = 0);
+		Plane* AddPlane(const Vector3& origin, const Vector3& normal, MaterialHandle materialHandle = 0);
+		TriangleMesh* AddTriangleMesh(TriangleCullMode cullMode, MaterialHandle materialHandle = 0);
+		OutOfCoreMesh* AddOutOfCoreMesh(const std::string& filename, uint64_t sourceHash, uint64_t buildHash, uint64_t residentBudget, TriangleCullMode cullMode, MaterialHandle materialHandle = 0);
+
+		//The replica of the node the calling thread renders for, the meshes themselves outside of a WorkerPool
+		const std::vector<TriangleMesh>& GetLocalTriangleMeshes() const;
 
 		Light* AddPointLight(const Vector3& origin, float intensity, const ColorRGB& color);
 		Light* AddDirectionalLight(const Vector3& direction, float intensity, const ColorRGB& color);
-		unsigned char AddMaterial(Material* pMaterial);
+		template<typename T>
+		MaterialHandle AddMaterial(const T& material) { return m_Materials.Add(material); }
+		//Owned by the scene, nullptr when the file can't be loaded
+		const Texture* AddTexture(const std::string& filename);
 	};
 
 	//+++++++++++++++++++++++++++++++++++++++++
@@ -176,4 +194,41 @@ namespace dae
 		TriangleMesh* m_pBunny{nullptr};
 	};
 
+	//Bunny traced from a paged file with a resident budget far below its size
+	class Scene_W4_OutOfCoreBunnyScene final : public Scene
+	{
+	public:
+		Scene_W4_OutOfCoreBunnyScene() = default;
+		~Scene_W4_OutOfCoreBunnyScene() override = default;
+
+		Scene_W4_OutOfCoreBunnyScene(const Scene_W4_OutOfCoreBunnyScene&) = delete;
+		Scene_W4_OutOfCoreBunnyScene(Scene_W4_OutOfCoreBunnyScene&&) noexcept = delete;
+		Scene_W4_OutOfCoreBunnyScene& operator=(const Scene_W4_OutOfCoreBunnyScene&) = delete;
+		Scene_W4_OutOfCoreBunnyScene& operator=(Scene_W4_OutOfCoreBunnyScene&&) noexcept = delete;
+
+		void Initialize() override;
+		void Update(Timer* pTimer) override;
+	private:
+		OutOfCoreMesh* m_pBunny{ nullptr };
+		float m_StatsTimer{ 0.f };
+		uint64_t m_LastPageIns{ 0 };
+	};
+
+	//Scene described by a JSON scene file (see Resources/Scenes), meshes are loaded in parallel
+	class Scene_File final : public Scene
+	{
+	public:
+		Scene_File(const std::string& filename) : m_Filename(filename) {}
+		~Scene_File() override = default;
+
+		Scene_File(const Scene_File&) = delete;
+		Scene_File(Scene_File&&) noexcept = delete;
+		Scene_File& operator=(const Scene_File&) = delete;
+		Scene_File& operator=(Scene_File&&) noexcept = delete;
+
+		void Initialize() override;
+	private:
+		std::string m_Filename;
+	};
+
 }
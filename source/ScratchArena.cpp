@@ -0,0 +1,80 @@
+#include "ScratchArena.h"
+
+//Standard includes
+#include <algorithm>
+#include <atomic>
+
+namespace dae
+{
+	namespace
+	{
+		std::atomic<uint32_t> g_CurrentFrame{ 0 };
+	}
+
+	ScratchArena& ScratchArena::Get()
+	{
+		thread_local ScratchArena arena{};
+		return arena;
+	}
+
+	void ScratchArena::NextFrame()
+	{
+		g_CurrentFrame.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void* ScratchArena::Allocate(size_t size, size_t alignment)
+	{
+		const uint32_t currentFrame{ g_CurrentFrame.load(std::memory_order_relaxed) };
+		if (m_Frame != currentFrame && m_BlockIdx == 0 && m_Offset == 0)
+		{
+			//Only at the bottom, an open Scope still points into the blocks
+			m_Frame = currentFrame;
+			Reset();
+		}
+
+		//Current block first, then the blocks grown in earlier frames, then a new one
+		while (m_BlockIdx < m_Blocks.size())
+		{
+			Block& block{ m_Blocks[m_BlockIdx] };
+			const uintptr_t base{ reinterpret_cast<uintptr_t>(block.pData.get()) };
+			const uintptr_t aligned{ (base + m_Offset + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1) };
+			const size_t offset{ aligned - base };
+
+			if (offset + size <= block.size)
+			{
+				m_Offset = offset + size;
+				return block.pData.get() + offset;
+			}
+
+			++m_BlockIdx;
+			m_Offset = 0;
+		}
+
+		const size_t blockSize{ std::max({ initialBlockSize, size + alignment, m_Blocks.empty() ? size_t(0) : m_Blocks.back().size * 2 }) };
+		m_Blocks.push_back(Block{ std::make_unique<std::byte[]>(blockSize), blockSize });
+		m_BlockIdx = m_Blocks.size() - 1;
+		m_Offset = 0;
+		return Allocate(size, alignment);
+	}
+
+	size_t ScratchArena::GetCapacity() const
+	{
+		size_t capacity{ 0 };
+		for (const Block& block : m_Blocks)
+			capacity += block.size;
+		return capacity;
+	}
+
+	void ScratchArena::Reset()
+	{
+		m_BlockIdx = 0;
+		m_Offset = 0;
+		if (m_Blocks.size() <= 1)
+			return;
+
+		//Grew last frame: one block as large as all of them, so the next frame fits in a single block
+		const size_t capacity{ GetCapacity() };
+		m_Blocks.clear();
+		m_Blocks.push_back(Block{ std::make_unique<std::byte[]>(capacity), capacity });
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+//Standard includes
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace dae
+{
+	//Per thread bump allocator for scratch memory on the hot path (BVH traversal lists, ...)
+	//Allocations are released by rewinding a Scope, nothing is destructed so only trivially destructible types fit.
+	//Blocks are kept across frames, once every thread saw its largest frame nothing is allocated from the heap anymore
+	class ScratchArena final
+	{
+	public:
+		//Everything allocated while the scope lives is released when it ends
+		class Scope final
+		{
+		public:
+			explicit Scope(ScratchArena& arena) :
+				m_Arena(arena),
+				m_BlockIdx(arena.m_BlockIdx),
+				m_Offset(arena.m_Offset)
+			{
+			}
+
+			~Scope()
+			{
+				m_Arena.m_BlockIdx = m_BlockIdx;
+				m_Arena.m_Offset = m_Offset;
+			}
+
+			Scope(const Scope&) = delete;
+			Scope(Scope&&) noexcept = delete;
+			Scope& operator=(const Scope&) = delete;
+			Scope& operator=(Scope&&) noexcept = delete;
+
+		private:
+			ScratchArena& m_Arena;
+			size_t m_BlockIdx;
+			size_t m_Offset;
+		};
+
+		ScratchArena() = default;
+		~ScratchArena() = default;
+
+		ScratchArena(const ScratchArena&) = delete;
+		ScratchArena(ScratchArena&&) noexcept = delete;
+		ScratchArena& operator=(const ScratchArena&) = delete;
+		ScratchArena& operator=(ScratchArena&&) noexcept = delete;
+
+		//Arena of the calling thread
+		static ScratchArena& Get();
+
+		//Every arena resets the first time it is used in the new frame (and merges its blocks if it had to grow)
+		static void NextFrame();
+
+		void* Allocate(size_t size, size_t alignment);
+
+		template<typename T>
+		T* Allocate(size_t count)
+		{
+			static_assert(std::is_trivially_destructible_v<T>, "Scratch memory is never destructed");
+			return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+		}
+
+		size_t GetCapacity() const;
+
+	private:
+		struct Block
+		{
+			std::unique_ptr<std::byte[]> pData{};
+			size_t size{};
+		};
+
+		static constexpr size_t initialBlockSize{ 64 * 1024 };
+
+		std::vector<Block> m_Blocks{};
+		size_t m_BlockIdx{ 0 };
+		size_t m_Offset{ 0 };
+		uint32_t m_Frame{ 0 };
+
+		void Reset();
+	};
+}
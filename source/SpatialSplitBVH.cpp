@@ -0,0 +1,413 @@
+#include "SpatialSplitBVH.h"
+
+//Standard includes
+#include <algorithm>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+
+namespace dae
+{
+	namespace SpatialSplitBVH
+	{
+		namespace
+		{
+			//Spatial splits are only tried when the children of the best object split overlap by more than this part of the root's area
+			constexpr float minOverlap{ 1e-5f };
+			//Clipped references can keep a node's cost from ever getting worse than a leaf, deeper nodes always become one
+			constexpr uint32_t maxDepth{ 64 };
+			constexpr uint32_t invalidIdx{ ~0u };
+
+			//The part of a triangle that is inside a node
+			struct Reference
+			{
+				AABB bounds;
+				uint32_t triangleIdx;
+			};
+
+			struct Split
+			{
+				float cost{ INFINITY };
+				int axis{ -1 };
+				bool isSpatial{ false };
+				uint32_t bin{};			//Object split: bins up to this one go left
+				float position{};		//Spatial split: the plane
+				AABB leftBounds{};
+				AABB rightBounds{};
+			};
+
+			Vector3 GetCenter(const AABB& bounds)
+			{
+				return (bounds.min + bounds.max) * .5f;
+			}
+
+			struct Builder
+			{
+				TriangleMesh& mesh;
+				uint32_t binCount;
+				uint32_t leafSize;
+				uint32_t maxReferences;
+				uint32_t nrReferences;
+				float rootArea{};
+
+				//Bounds of the part of the triangle between the planes at min and max on axis, inside the bounds of the reference
+				AABB Clip(const Reference& reference, int axis, float min, float max) const
+				{
+					const int* pIndices{ &mesh.indices[reference.triangleIdx * 3] };
+					const Vector3 vertices[3]{
+						mesh.GetTransformedPosition(pIndices[0]),
+						mesh.GetTransformedPosition(pIndices[1]),
+						mesh.GetTransformedPosition(pIndices[2]) };
+
+					AABB bounds{};
+					for (int i = 0; i < 3; ++i)
+					{
+						const Vector3& v0{ vertices[i] };
+						const Vector3& v1{ vertices[(i + 1) % 3] };
+						if (v0[axis] >= min && v0[axis] <= max)
+							bounds.Grow(v0);
+
+						//Where the edge crosses either plane
+						for (const float plane : { min, max })
+						{
+							if ((v0[axis] - plane) * (v1[axis] - plane) < 0.f)
+							{
+								Vector3 crossing{ v0 + (v1 - v0) * ((plane - v0[axis]) / (v1[axis] - v0[axis])) };
+								crossing[axis] = plane;
+								bounds.Grow(crossing);
+							}
+						}
+					}
+					return bounds.Intersection(reference.bounds);
+				}
+
+				void FindObjectSplit(const std::vector<Reference>& references, const AABB& centroidBounds, Split& split) const
+				{
+					constexpr uint32_t maxBinCount{ BVHBuildSettings::maxBinCount };
+					for (int a = 0; a < 3; ++a)
+					{
+						const float extent{ centroidBounds.max[a] - centroidBounds.min[a] };
+						if (extent <= 0.f)
+							continue;
+
+						Bin bins[maxBinCount];
+						const float scale{ binCount / extent };
+						for (const Reference& reference : references)
+						{
+							const uint32_t binIdx{ std::min(binCount - 1, static_cast<uint32_t>((GetCenter(reference.bounds)[a] - centroidBounds.min[a]) * scale)) };
+							++bins[binIdx].nrPrimitives;
+							bins[binIdx].bounds = bins[binIdx].bounds.Union(reference.bounds);
+						}
+
+						//Right sides first, then every plane is evaluated while the left side grows
+						AABB rightBounds[maxBinCount];
+						uint32_t rightCounts[maxBinCount]{};
+						AABB bounds{};
+						uint32_t count{ 0 };
+						for (uint32_t i = binCount - 1; i > 0; --i)
+						{
+							bounds = bounds.Union(bins[i].bounds);
+							count += bins[i].nrPrimitives;
+							rightBounds[i] = bounds;
+							rightCounts[i] = count;
+						}
+
+						bounds = AABB{};
+						count = 0;
+						for (uint32_t i = 0; i < binCount - 1; ++i)
+						{
+							bounds = bounds.Union(bins[i].bounds);
+							count += bins[i].nrPrimitives;
+							const float cost{ count * bounds.Area() + rightCounts[i + 1] * rightBounds[i + 1].Area() };
+							if (cost < split.cost)
+							{
+								split = Split{ cost, a, false, i, 0.f, bounds, rightBounds[i + 1] };
+							}
+						}
+					}
+				}
+
+				void FindSpatialSplit(const std::vector<Reference>& references, const AABB& nodeBounds, Split& split) const
+				{
+					constexpr uint32_t maxBinCount{ BVHBuildSettings::maxBinCount };
+					for (int a = 0; a < 3; ++a)
+					{
+						const float extent{ nodeBounds.max[a] - nodeBounds.min[a] };
+						if (extent <= 0.f)
+							continue;
+
+						//Every reference enters the bin of its min and exits the bin of its max, the bins in between get the clipped parts
+						AABB bins[maxBinCount];
+						uint32_t entries[maxBinCount]{};
+						uint32_t exits[maxBinCount]{};
+						const float binSize{ extent / binCount };
+						auto getBin = [&](float position)
+						{
+							return std::min(binCount - 1, static_cast<uint32_t>(std::max((position - nodeBounds.min[a]) / binSize, 0.f)));
+						};
+
+						for (const Reference& reference : references)
+						{
+							const uint32_t first{ getBin(reference.bounds.min[a]) };
+							const uint32_t last{ getBin(reference.bounds.max[a]) };
+							++entries[first];
+							++exits[last];
+
+							if (first == last)
+							{
+								bins[first] = bins[first].Union(reference.bounds);
+								continue;
+							}
+							for (uint32_t i = first; i <= last; ++i)
+							{
+								const float binMin{ nodeBounds.min[a] + i * binSize };
+								bins[i] = bins[i].Union(Clip(reference, a, binMin, binMin + binSize));
+							}
+						}
+
+						AABB rightBounds[maxBinCount];
+						uint32_t rightCounts[maxBinCount]{};
+						AABB bounds{};
+						uint32_t count{ 0 };
+						for (uint32_t i = binCount - 1; i > 0; --i)
+						{
+							bounds = bounds.Union(bins[i]);
+							count += exits[i];
+							rightBounds[i] = bounds;
+							rightCounts[i] = count;
+						}
+
+						bounds = AABB{};
+						count = 0;
+						for (uint32_t i = 0; i < binCount - 1; ++i)
+						{
+							bounds = bounds.Union(bins[i]);
+							count += entries[i];
+
+							//Only when the triangles it duplicates still fit in the budget
+							const uint32_t nrDuplicates{ count + rightCounts[i + 1] - static_cast<uint32_t>(references.size()) };
+							if (nrReferences + nrDuplicates > maxReferences)
+								continue;
+
+							const float cost{ count * bounds.Area() + rightCounts[i + 1] * rightBounds[i + 1].Area() };
+							if (cost < split.cost)
+							{
+								const float position{ nodeBounds.min[a] + (i + 1) * binSize };
+								split = Split{ cost, a, true, 0, position, bounds, rightBounds[i + 1] };
+							}
+						}
+					}
+				}
+
+				//Straddling references are split over both sides, or kept whole on one side when that's cheaper (reference unsplitting)
+				void PartitionSpatial(const std::vector<Reference>& references, const Split& split, std::vector<Reference>& left, std::vector<Reference>& right)
+				{
+					const int axis{ split.axis };
+					AABB leftBounds{};
+					AABB rightBounds{};
+					std::vector<const Reference*> straddling{};
+					for (const Reference& reference : references)
+					{
+						if (reference.bounds.max[axis] <= split.position)
+						{
+							left.push_back(reference);
+							leftBounds = leftBounds.Union(reference.bounds);
+						}
+						else if (reference.bounds.min[axis] >= split.position)
+						{
+							right.push_back(reference);
+							rightBounds = rightBounds.Union(reference.bounds);
+						}
+						else
+						{
+							straddling.push_back(&reference);
+						}
+					}
+
+					for (const Reference* pReference : straddling)
+					{
+						const Reference leftPart{ Clip(*pReference, axis, -INFINITY, split.position), pReference->triangleIdx };
+						const Reference rightPart{ Clip(*pReference, axis, split.position, INFINITY), pReference->triangleIdx };
+						const float leftCount{ static_cast<float>(left.size()) };
+						const float rightCount{ static_cast<float>(right.size()) };
+
+						const float wholeLeftCost{ leftBounds.Union(pReference->bounds).Area() * (leftCount + 1) + rightBounds.Area() * rightCount };
+						const float wholeRightCost{ leftBounds.Area() * leftCount + rightBounds.Union(pReference->bounds).Area() * (rightCount + 1) };
+						float splitCost{ leftBounds.Union(leftPart.bounds).Area() * (leftCount + 1) + rightBounds.Union(rightPart.bounds).Area() * (rightCount + 1) };
+						//A part can be empty when the triangle only touches the plane
+						if (nrReferences >= maxReferences || leftPart.bounds.IsEmpty() || rightPart.bounds.IsEmpty())
+							splitCost = INFINITY;
+
+						if (splitCost < wholeLeftCost && splitCost < wholeRightCost)
+						{
+							left.push_back(leftPart);
+							right.push_back(rightPart);
+							leftBounds = leftBounds.Union(leftPart.bounds);
+							rightBounds = rightBounds.Union(rightPart.bounds);
+							++nrReferences;
+						}
+						else if (wholeLeftCost <= wholeRightCost)
+						{
+							left.push_back(*pReference);
+							leftBounds = leftBounds.Union(pReference->bounds);
+						}
+						else
+						{
+							right.push_back(*pReference);
+							rightBounds = rightBounds.Union(pReference->bounds);
+						}
+					}
+				}
+
+				void MakeLeaf(BVHNode& node, const std::vector<Reference>& references)
+				{
+					node.leftFirst = static_cast<uint32_t>(mesh.bvhReferences.size());
+					node.nrPrimitives = static_cast<uint32_t>(references.size());
+					for (const Reference& reference : references)
+						mesh.bvhReferences.push_back(reference.triangleIdx);
+				}
+
+				void Subdivide(uint32_t nodeIdx, std::vector<Reference>& references, uint32_t depth)
+				{
+					AABB nodeBounds{};
+					AABB centroidBounds{};
+					for (const Reference& reference : references)
+					{
+						nodeBounds = nodeBounds.Union(reference.bounds);
+						centroidBounds.Grow(GetCenter(reference.bounds));
+					}
+
+					BVHNode& node{ mesh.bvhNodes[nodeIdx] };
+					node.minAABB = nodeBounds.min;
+					node.maxAABB = nodeBounds.max;
+					if (references.size() <= leafSize || depth >= maxDepth)
+					{
+						MakeLeaf(node, references);
+						return;
+					}
+
+					Split split{};
+					FindObjectSplit(references, centroidBounds, split);
+					if (split.axis == -1 || split.leftBounds.Intersection(split.rightBounds).Area() > minOverlap * rootArea)
+						FindSpatialSplit(references, nodeBounds, split);
+
+					//Terminate Recursion, same cost as TriangleMesh::CalculateNodeCost
+					if (split.axis == -1 || split.cost >= references.size() * nodeBounds.Area())
+					{
+						MakeLeaf(node, references);
+						return;
+					}
+
+					std::vector<Reference> left{};
+					std::vector<Reference> right{};
+					if (split.isSpatial)
+					{
+						PartitionSpatial(references, split, left, right);
+					}
+					else
+					{
+						const float minBound{ centroidBounds.min[split.axis] };
+						const float scale{ binCount / (centroidBounds.max[split.axis] - minBound) };
+						for (const Reference& reference : references)
+						{
+							const uint32_t binIdx{ std::min(binCount - 1, static_cast<uint32_t>((GetCenter(reference.bounds)[split.axis] - minBound) * scale)) };
+							(binIdx <= split.bin ? left : right).push_back(reference);
+						}
+					}
+
+					if (left.empty() || right.empty())
+					{
+						MakeLeaf(node, references);
+						return;
+					}
+
+					//Only the references of the path being built are alive
+					std::vector<Reference>{}.swap(references);
+
+					const uint32_t leftChildIdx{ mesh.nodesUsed };
+					mesh.nodesUsed += 2;
+					node.nrPrimitives = 0; //Is not leaf
+					node.leftFirst = leftChildIdx;
+
+					Subdivide(leftChildIdx, left, depth + 1);
+					Subdivide(leftChildIdx + 1, right, depth + 1); //rightChild
+				}
+			};
+
+			//Puts the per triangle values in the order of the references
+			template<typename T>
+			void Reorder(const std::vector<uint32_t>& order, uint32_t stride, std::vector<T>& values)
+			{
+				if (values.size() != order.size() * stride)
+					return;
+
+				std::vector<T> reordered(values.size());
+				for (size_t i = 0; i < order.size(); ++i)
+					std::copy_n(values.begin() + size_t{ order[i] } * stride, stride, reordered.begin() + i * stride);
+				values = std::move(reordered);
+			}
+		}
+
+		void Build(TriangleMesh& mesh)
+		{
+			PROFILE_ZONE("SpatialSplitBVH::Build");
+			const uint32_t count{ mesh.trCount };
+			const float budget{ std::max(mesh.bvhSettings.spatialSplitBudget, 0.f) };
+
+			Builder builder{
+				mesh,
+				std::clamp(mesh.bvhSettings.binCount, 2u, BVHBuildSettings::maxBinCount),
+				std::max(mesh.bvhSettings.leafSize, 1u),
+				count + static_cast<uint32_t>(count * budget),
+				count };
+
+			std::vector<Reference> references(count);
+			AABB rootBounds{};
+			for (uint32_t triangleIdx = 0; triangleIdx < count; ++triangleIdx)
+			{
+				Reference& reference{ references[triangleIdx] };
+				reference.triangleIdx = triangleIdx;
+				for (int i = 0; i < 3; ++i)
+					reference.bounds.Grow(mesh.GetTransformedPosition(mesh.indices[triangleIdx * 3 + i]));
+				rootBounds = rootBounds.Union(reference.bounds);
+			}
+			builder.rootArea = rootBounds.Area();
+
+			//Every reference can end up in its own leaf
+			const size_t maxNodes{ size_t{ builder.maxReferences } * 2 - 1 };
+			if (mesh.bvhNodes.size() < maxNodes)
+				mesh.bvhNodes.resize(maxNodes);
+
+			mesh.bvhReferences.clear();
+			mesh.bvhReferences.reserve(builder.maxReferences);
+			mesh.rootNodeIdx = 0;
+			mesh.nodesUsed = 1;
+			builder.Subdivide(mesh.rootNodeIdx, references, 0);
+
+			//Triangles in the order the leaves first reference them, so leaves still read consecutive triangles
+			std::vector<uint32_t> newIndices(count, invalidIdx);
+			std::vector<uint32_t> order{};
+			order.reserve(count);
+			for (uint32_t& triangleIdx : mesh.bvhReferences)
+			{
+				if (newIndices[triangleIdx] == invalidIdx)
+				{
+					newIndices[triangleIdx] = static_cast<uint32_t>(order.size());
+					order.push_back(triangleIdx);
+				}
+				triangleIdx = newIndices[triangleIdx];
+			}
+
+			Reorder(order, 3, mesh.indices);
+			Reorder(order, 1, mesh.normals);
+			Reorder(order, 1, mesh.transformedNormals);
+			Reorder(order, 1, mesh.centroids);
+			Reorder(order, 1, mesh.transformedCentroids);
+
+			//Nothing was duplicated, every leaf slot is its own triangle again
+			if (mesh.bvhReferences.size() == count)
+				std::vector<uint32_t>{}.swap(mesh.bvhReferences);
+		}
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+namespace dae
+{
+	struct TriangleMesh;
+
+	//Binned SAH BVH with spatial splits (SBVH, Stich et al. 2009) for meshes whose long thin triangles make object splits overlap
+	//Selected with BVHBuildSettings::builder, TriangleMesh::BuildBVH calls it
+	namespace SpatialSplitBVH
+	{
+		/**
+		 * \brief Builds the BVH of the mesh, splitting triangles over both children where the overlap of the best object split is worth it
+		 * Split triangles are referenced by a leaf of each side, through TriangleMesh::bvhReferences,
+		 * which grows by at most BVHBuildSettings::spatialSplitBudget times the number of triangles.
+		 * Triangles are reordered in the order the leaves first reference them, without duplicates the references are dropped again.
+		 * Slower than the other builders and it allocates, build it once at asset time (MeshCache stores the result).
+		 */
+		void Build(TriangleMesh& mesh);
+	}
+}
@@ -0,0 +1,214 @@
+#include "Texture.h"
+
+//External includes
+#include "SDL.h"
+#include "SDL_surface.h"
+
+//Standard includes
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+
+//Project includes
+#include "DataTypes.h"
+
+namespace dae
+{
+	namespace
+	{
+		float DecodeSRGB(float c)
+		{
+			return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+		}
+
+		uint32_t EncodeSRGB(float c)
+		{
+			c = std::clamp(c, 0.f, 1.f);
+			c = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.f / 2.4f) - 0.055f;
+			return static_cast<uint32_t>(c * 255.f + 0.5f);
+		}
+
+		//Fetches decode through a table instead of calling powf
+		const std::array<float, 256>& GetDecodeTable()
+		{
+			static const std::array<float, 256> table{ [] {
+				std::array<float, 256> values{};
+				for (uint32_t i = 0; i < values.size(); ++i)
+					values[i] = DecodeSRGB(i / 255.f);
+				return values;
+			}() };
+			return table;
+		}
+
+		//Interleaves the bits of x and y inside a tile (3 bits each)
+		uint32_t MortonIndex(uint32_t x, uint32_t y)
+		{
+			x = (x | (x << 2)) & 0x33;
+			x = (x | (x << 1)) & 0x55;
+			y = (y | (y << 2)) & 0x33;
+			y = (y | (y << 1)) & 0x55;
+			return x | (y << 1);
+		}
+
+		uint32_t Wrap(int coordinate, uint32_t size)
+		{
+			const int wrapped{ coordinate % static_cast<int>(size) };
+			return static_cast<uint32_t>(wrapped < 0 ? wrapped + static_cast<int>(size) : wrapped);
+		}
+	}
+
+	Texture::Texture(uint32_t width, uint32_t height, const std::vector<ColorRGB>& linearTexels)
+	{
+		assert(width > 0 && height > 0 && linearTexels.size() == static_cast<size_t>(width) * height);
+
+		//Layout of the whole chain first, so the texels are one allocation
+		size_t nrTexels{ 0 };
+		for (uint32_t levelWidth = width, levelHeight = height; ; levelWidth = std::max(levelWidth / 2, 1u), levelHeight = std::max(levelHeight / 2, 1u))
+		{
+			Level level{};
+			level.width = levelWidth;
+			level.height = levelHeight;
+			level.tilesPerRow = (levelWidth + tileSize - 1) >> tileSizeBits;
+			level.offset = nrTexels;
+			m_Levels.push_back(level);
+
+			const uint32_t tileRows{ (levelHeight + tileSize - 1) >> tileSizeBits };
+			nrTexels += static_cast<size_t>(level.tilesPerRow) * tileRows * tileSize * tileSize;
+
+			if (levelWidth == 1 && levelHeight == 1)
+				break;
+		}
+		m_Texels.resize(nrTexels);
+
+		//Every level is a 2x2 box filter of the previous one (in linear space), odd sizes clamp at the edge
+		std::vector<ColorRGB> current{ linearTexels };
+		std::vector<ColorRGB> next{};
+		StoreLevel(m_Levels[0], current);
+		for (size_t levelIdx = 1; levelIdx < m_Levels.size(); ++levelIdx)
+		{
+			const Level& previous{ m_Levels[levelIdx - 1] };
+			const Level& level{ m_Levels[levelIdx] };
+			next.resize(static_cast<size_t>(level.width) * level.height);
+
+			for (uint32_t y = 0; y < level.height; ++y)
+			{
+				const uint32_t y0{ std::min(y * 2, previous.height - 1) };
+				const uint32_t y1{ std::min(y * 2 + 1, previous.height - 1) };
+				for (uint32_t x = 0; x < level.width; ++x)
+				{
+					const uint32_t x0{ std::min(x * 2, previous.width - 1) };
+					const uint32_t x1{ std::min(x * 2 + 1, previous.width - 1) };
+					const ColorRGB& topLeft{ current[static_cast<size_t>(y0) * previous.width + x0] };
+					const ColorRGB& topRight{ current[static_cast<size_t>(y0) * previous.width + x1] };
+					const ColorRGB& bottomLeft{ current[static_cast<size_t>(y1) * previous.width + x0] };
+					const ColorRGB& bottomRight{ current[static_cast<size_t>(y1) * previous.width + x1] };
+					next[static_cast<size_t>(y) * level.width + x] = (topLeft + topRight + bottomLeft + bottomRight) * 0.25f;
+				}
+			}
+
+			StoreLevel(level, next);
+			std::swap(current, next);
+		}
+	}
+
+	std::unique_ptr<Texture> Texture::LoadFromFile(const std::string& path)
+	{
+		SDL_Surface* pLoaded{ SDL_LoadBMP(path.c_str()) };
+		if (!pLoaded)
+		{
+			std::cout << "Can't load texture " << path << ": " << SDL_GetError() << std::endl;
+			return nullptr;
+		}
+
+		//Byte order R, G, B, A whatever the file had
+		SDL_Surface* pSurface{ SDL_ConvertSurfaceFormat(pLoaded, SDL_PIXELFORMAT_RGBA32, 0) };
+		SDL_FreeSurface(pLoaded);
+		if (!pSurface)
+			return nullptr;
+
+		const std::array<float, 256>& decode{ GetDecodeTable() };
+		const uint32_t width{ static_cast<uint32_t>(pSurface->w) };
+		const uint32_t height{ static_cast<uint32_t>(pSurface->h) };
+		std::vector<ColorRGB> texels(static_cast<size_t>(width) * height);
+
+		SDL_LockSurface(pSurface);
+		for (uint32_t y = 0; y < height; ++y)
+		{
+			const uint8_t* pRow{ static_cast<const uint8_t*>(pSurface->pixels) + static_cast<size_t>(y) * pSurface->pitch };
+			for (uint32_t x = 0; x < width; ++x)
+			{
+				texels[static_cast<size_t>(y) * width + x] = { decode[pRow[x * 4]], decode[pRow[x * 4 + 1]], decode[pRow[x * 4 + 2]] };
+			}
+		}
+		SDL_UnlockSurface(pSurface);
+		SDL_FreeSurface(pSurface);
+
+		return std::make_unique<Texture>(width, height, texels);
+	}
+
+	ColorRGB Texture::Sample(const Vector2& uv, float footprint) const
+	{
+		//Level where one texel covers the footprint
+		const float lod{ std::log2(std::max(footprint * std::max(GetWidth(), GetHeight()), FLT_MIN)) };
+		const float maxLod{ static_cast<float>(m_Levels.size() - 1) };
+		if (lod <= 0.f)
+			return SampleBilinear(m_Levels[0], uv);
+		if (lod >= maxLod)
+			return SampleBilinear(m_Levels.back(), uv);
+
+		const uint32_t levelIdx{ static_cast<uint32_t>(lod) };
+		const float weight{ lod - levelIdx };
+		return SampleBilinear(m_Levels[levelIdx], uv) * (1.f - weight) + SampleBilinear(m_Levels[levelIdx + 1], uv) * weight;
+	}
+
+	ColorRGB Texture::Sample(const HitRecord& hitRecord) const
+	{
+		return Sample(hitRecord.uv, hitRecord.uvScale * hitRecord.footprint);
+	}
+
+	size_t Texture::GetTexelIndex(const Level& level, uint32_t x, uint32_t y) const
+	{
+		const size_t tileIdx{ static_cast<size_t>(y >> tileSizeBits) * level.tilesPerRow + (x >> tileSizeBits) };
+		return level.offset + (tileIdx << (tileSizeBits * 2)) + MortonIndex(x & (tileSize - 1), y & (tileSize - 1));
+	}
+
+	ColorRGB Texture::Fetch(const Level& level, uint32_t x, uint32_t y) const
+	{
+		const std::array<float, 256>& decode{ GetDecodeTable() };
+		const uint32_t texel{ m_Texels[GetTexelIndex(level, x, y)] };
+		return { decode[texel & 0xff], decode[(texel >> 8) & 0xff], decode[(texel >> 16) & 0xff] };
+	}
+
+	ColorRGB Texture::SampleBilinear(const Level& level, const Vector2& uv) const
+	{
+		//Texel centers are at .5
+		const float x{ uv.x * level.width - 0.5f };
+		const float y{ uv.y * level.height - 0.5f };
+		const float floorX{ std::floor(x) };
+		const float floorY{ std::floor(y) };
+		const float weightX{ x - floorX };
+		const float weightY{ y - floorY };
+
+		const uint32_t x0{ Wrap(static_cast<int>(floorX), level.width) };
+		const uint32_t y0{ Wrap(static_cast<int>(floorY), level.height) };
+		const uint32_t x1{ x0 + 1 < level.width ? x0 + 1 : 0 };
+		const uint32_t y1{ y0 + 1 < level.height ? y0 + 1 : 0 };
+
+		const ColorRGB top{ Fetch(level, x0, y0) * (1.f - weightX) + Fetch(level, x1, y0) * weightX };
+		const ColorRGB bottom{ Fetch(level, x0, y1) * (1.f - weightX) + Fetch(level, x1, y1) * weightX };
+		return top * (1.f - weightY) + bottom * weightY;
+	}
+
+	void Texture::StoreLevel(const Level& level, const std::vector<ColorRGB>& linearTexels)
+	{
+		for (uint32_t y = 0; y < level.height; ++y)
+		{
+			for (uint32_t x = 0; x < level.width; ++x)
+			{
+				const ColorRGB& texel{ linearTexels[static_cast<size_t>(y) * level.width + x] };
+				m_Texels[GetTexelIndex(level, x, y)] = EncodeSRGB(texel.r) | (EncodeSRGB(texel.g) << 8) | (EncodeSRGB(texel.b) << 16);
+			}
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+//Project includes
+#include "Math.h"
+
+namespace dae
+{
+	struct HitRecord;
+
+	//RGB texture with a full mip chain, texels are 8-bit sRGB and filtered in linear space
+	//Every level is split in 8x8 tiles (256 bytes) with the texels of a tile in Morton order,
+	//so the 2x2 texels of a bilinear sample and the ones next to them are almost always in the same few cache lines
+	class Texture final
+	{
+	public:
+		//linearTexels is row-major, top row first
+		Texture(uint32_t width, uint32_t height, const std::vector<ColorRGB>& linearTexels);
+		~Texture() = default;
+
+		Texture(const Texture&) = delete;
+		Texture(Texture&&) noexcept = delete;
+		Texture& operator=(const Texture&) = delete;
+		Texture& operator=(Texture&&) noexcept = delete;
+
+		//Any BMP SDL can read, nullptr when it can't
+		static std::unique_ptr<Texture> LoadFromFile(const std::string& path);
+
+		/**
+		 * \brief Trilinear sample, uv repeats outside [0, 1]
+		 * \param footprint Width of the sample in uv units, picks the mip level (0 samples the full resolution)
+		 */
+		ColorRGB Sample(const Vector2& uv, float footprint) const;
+
+		//Footprint of the ray cone at the hit, projected on the triangle's uv mapping
+		ColorRGB Sample(const HitRecord& hitRecord) const;
+
+		uint32_t GetWidth() const { return m_Levels[0].width; }
+		uint32_t GetHeight() const { return m_Levels[0].height; }
+		uint32_t GetNrLevels() const { return static_cast<uint32_t>(m_Levels.size()); }
+
+	private:
+		static constexpr uint32_t tileSizeBits{ 3 };
+		static constexpr uint32_t tileSize{ 1 << tileSizeBits };
+
+		struct Level
+		{
+			uint32_t width{};
+			uint32_t height{};
+			uint32_t tilesPerRow{};
+			size_t offset{};	//First texel in m_Texels
+		};
+
+		std::vector<Level> m_Levels{};
+		std::vector<uint32_t> m_Texels{};	//R | G << 8 | B << 16, sRGB encoded
+
+		size_t GetTexelIndex(const Level& level, uint32_t x, uint32_t y) const;
+		ColorRGB Fetch(const Level& level, uint32_t x, uint32_t y) const;
+		ColorRGB SampleBilinear(const Level& level, const Vector2& uv) const;
+		void StoreLevel(const Level& level, const std::vector<ColorRGB>& linearTexels);
+	};
+}
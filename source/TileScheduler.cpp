@@ -0,0 +1,129 @@
+#include "TileScheduler.h"
+
+//Standard includes
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+
+namespace dae
+{
+	TileScheduler::TileScheduler(uint32_t width, uint32_t height, uint32_t tileSize) :
+		m_Width(width),
+		m_Height(height),
+		m_TileSize(tileSize),
+		m_NrTilesX((width + tileSize - 1) / tileSize),
+		m_NrTilesY((height + tileSize - 1) / tileSize)
+	{
+		const uint32_t nrGridTiles{ m_NrTilesX * m_NrTilesY };
+		const uint32_t maxSplits{ std::max(tileSize / minTileSize, 1u) };
+		m_GridCosts.resize(nrGridTiles);
+		m_Tiles.reserve(nrGridTiles * maxSplits * maxSplits);
+		m_TileTimes.resize(m_Tiles.capacity());
+	}
+
+	void TileScheduler::BeginFrame()
+	{
+		m_Tiles.clear();
+
+		const uint32_t nrGridTiles{ m_NrTilesX * m_NrTilesY };
+		const float averageCost{ std::accumulate(m_GridCosts.begin(), m_GridCosts.end(), 0.f) / nrGridTiles };
+		const bool isAdaptive{ m_IsAdaptive && averageCost > 0.f };
+
+		//Bands are whole rows of grid tiles, so every node's tiles are a range of m_Tiles
+		const uint32_t maxSplits{ std::max(m_TileSize / minTileSize, 1u) };
+		for (uint32_t node = 0; node < m_NrNodes; ++node)
+		{
+			NodeQueue& queue{ m_NodeQueues[node] };
+			queue.begin = static_cast<uint32_t>(m_Tiles.size());
+			queue.next.store(queue.begin, std::memory_order_relaxed);
+
+			for (uint32_t gridIdx = 0; gridIdx < nrGridTiles; ++gridIdx)
+			{
+				if (GetNode(gridIdx / m_NrTilesX * m_TileSize) != node)
+					continue;
+
+				//A tile that cost n times the average becomes about n tiles
+				uint32_t nrSplits{ 1 };
+				const float relativeCost{ isAdaptive ? m_GridCosts[gridIdx] / averageCost : 0.f };
+				if (relativeCost > splitThreshold)
+					nrSplits = std::clamp(static_cast<uint32_t>(std::ceil(std::sqrt(relativeCost))), 2u, maxSplits);
+				AddTiles(gridIdx, nrSplits);
+			}
+			queue.end = static_cast<uint32_t>(m_Tiles.size());
+
+			if (!isAdaptive)
+				continue;
+
+			//Largest first, the cheap tiles fill the gaps at the end of the frame. Ties stay in grid order so neighbours run together
+			std::sort(m_Tiles.begin() + queue.begin, m_Tiles.end(), [](const Tile& a, const Tile& b) {
+				if (a.estimatedCost != b.estimatedCost)
+					return a.estimatedCost > b.estimatedCost;
+				if (a.gridIdx != b.gridIdx)
+					return a.gridIdx < b.gridIdx;
+				return a.beginY != b.beginY ? a.beginY < b.beginY : a.beginX < b.beginX;
+			});
+		}
+	}
+
+	bool TileScheduler::GetNextTile(uint32_t node, uint32_t& tileIdx)
+	{
+		//Own band first, then help the other nodes with what they have left
+		for (uint32_t i = 0; i < m_NrNodes; ++i)
+		{
+			NodeQueue& queue{ m_NodeQueues[(node + i) % m_NrNodes] };
+			if (queue.next.load(std::memory_order_relaxed) >= queue.end)
+				continue;
+
+			tileIdx = queue.next.fetch_add(1, std::memory_order_relaxed);
+			if (tileIdx < queue.end)
+				return true;
+		}
+		return false;
+	}
+
+	void TileScheduler::SetNrNodes(uint32_t nrNodes)
+	{
+		m_NrNodes = std::clamp(nrNodes, 1u, std::min(maxNrNodes, m_NrTilesY));
+	}
+
+	void TileScheduler::EndFrame()
+	{
+		std::fill(m_GridCosts.begin(), m_GridCosts.end(), 0.f);
+		for (size_t tileIdx = 0; tileIdx < m_Tiles.size(); ++tileIdx)
+			m_GridCosts[m_Tiles[tileIdx].gridIdx] += m_TileTimes[tileIdx];
+	}
+
+	void TileScheduler::ToggleAdaptive()
+	{
+		m_IsAdaptive = !m_IsAdaptive;
+		std::cout << (m_IsAdaptive ? "Cost adaptive tiles" : "Fixed tiles") << std::endl;
+	}
+
+	void TileScheduler::AddTiles(uint32_t gridIdx, uint32_t nrSplits)
+	{
+		const uint32_t beginX{ gridIdx % m_NrTilesX * m_TileSize };
+		const uint32_t beginY{ gridIdx / m_NrTilesX * m_TileSize };
+		const uint32_t width{ std::min(m_TileSize, m_Width - beginX) };
+		const uint32_t height{ std::min(m_TileSize, m_Height - beginY) };
+
+		//Edge tiles can be too small to split as often
+		const uint32_t nrSplitsX{ std::clamp(width / minTileSize, 1u, nrSplits) };
+		const uint32_t nrSplitsY{ std::clamp(height / minTileSize, 1u, nrSplits) };
+		const float estimatedCost{ m_GridCosts[gridIdx] / (nrSplitsX * nrSplitsY) };
+
+		for (uint32_t y = 0; y < nrSplitsY; ++y)
+		{
+			for (uint32_t x = 0; x < nrSplitsX; ++x)
+			{
+				m_Tiles.push_back(Tile{
+					beginX + x * width / nrSplitsX,
+					beginY + y * height / nrSplitsY,
+					beginX + (x + 1) * width / nrSplitsX,
+					beginY + (y + 1) * height / nrSplitsY,
+					gridIdx,
+					estimatedCost });
+			}
+		}
+	}
+}
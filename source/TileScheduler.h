@@ -0,0 +1,86 @@
+#pragma once
+
+//Standard includes
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace dae
+{
+	//Hands out the tiles of a frame to the render workers, most expensive first
+	//Tiles that took longer than average last frame are split, so the frame doesn't end with one worker finishing a slow tile.
+	//Everything is allocated up front, a frame doesn't touch the heap
+	class TileScheduler final
+	{
+	public:
+		struct Tile
+		{
+			uint32_t beginX, beginY, endX, endY;
+			uint32_t gridIdx;		//Tile of the regular grid it was split from
+			float estimatedCost;	//Seconds, from the previous frame
+		};
+
+		TileScheduler(uint32_t width, uint32_t height, uint32_t tileSize);
+		~TileScheduler() = default;
+
+		TileScheduler(const TileScheduler&) = delete;
+		TileScheduler(TileScheduler&&) noexcept = delete;
+		TileScheduler& operator=(const TileScheduler&) = delete;
+		TileScheduler& operator=(TileScheduler&&) noexcept = delete;
+
+		//Builds the tiles of this frame from the timings of the previous one, or the plain grid when it isn't adaptive
+		void BeginFrame();
+		//Adds the recorded times up per grid tile for the next frame
+		void EndFrame();
+
+		/**
+		 * \brief Index of the next tile to render, called by every worker until it returns false
+		 * \param node Tiles of this node are handed out first, then the ones left on the other nodes
+		 * \return false when the frame is done
+		 */
+		bool GetNextTile(uint32_t node, uint32_t& tileIdx);
+
+		const Tile& GetTile(uint32_t tileIdx) const { return m_Tiles[tileIdx]; }
+		//Only written by the worker that rendered the tile
+		void SetTileTime(uint32_t tileIdx, float seconds) { m_TileTimes[tileIdx] = seconds; }
+
+		void ToggleAdaptive();
+		bool IsAdaptive() const { return m_IsAdaptive; }
+
+		//Splits the frame in horizontal bands, one per NUMA node (see Renderer::SetNuma)
+		void SetNrNodes(uint32_t nrNodes);
+		uint32_t GetNrNodes() const { return m_NrNodes; }
+		//Node whose band has this row of pixels
+		uint32_t GetNode(uint32_t y) const { return y / m_TileSize * m_NrNodes / m_NrTilesY; }
+
+	private:
+		//Splits stop at this edge, smaller tiles cost more in scheduling than they save
+		static constexpr uint32_t minTileSize{ 4 };
+		//Grid tiles costing more than this times the average are split
+		static constexpr float splitThreshold{ 1.5f };
+		static constexpr uint32_t maxNrNodes{ 64 };
+
+		//Workers of every node take from their own band, a cache line each so they don't contend
+		struct alignas(64) NodeQueue
+		{
+			std::atomic<uint32_t> next{ 0 };
+			uint32_t begin{ 0 };
+			uint32_t end{ 0 };
+		};
+
+		uint32_t m_Width;
+		uint32_t m_Height;
+		uint32_t m_TileSize;
+		uint32_t m_NrTilesX;
+		uint32_t m_NrTilesY;
+		bool m_IsAdaptive{ true };
+
+		std::vector<float> m_GridCosts{};	//Per grid tile, 0 until a frame was timed
+		std::vector<Tile> m_Tiles{};		//Of this frame, in the order they are handed out
+		std::vector<float> m_TileTimes{};
+		NodeQueue m_NodeQueues[maxNrNodes]{};
+		uint32_t m_NrNodes{ 1 };
+
+		void AddTiles(uint32_t gridIdx, uint32_t nrSplits);
+	};
+}
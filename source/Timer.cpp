@@ -66,6 +66,9 @@ void Timer::StartBenchmark(int numFrames)
 
 void Timer::Update()
 {
+	if (m_IsFixed)
+		return;
+
 	if (m_IsStopped)
 	{
 		m_FPS = 0;
@@ -141,3 +144,13 @@ void Timer::Stop()
 		m_IsStopped = true;
 	}
 }
+
+void Timer::SetFixedTime(float totalTime)
+{
+	Stop();
+	m_IsFixed = true;
+	m_TotalTime = totalTime;
+	m_ElapsedTime = 0.f;
+	m_FPS = 0;
+	m_dFPS = 0.f;
+}
@@ -23,6 +23,8 @@ namespace dae
 		void Start();
 		void Update();
 		void Stop();
+		//Freezes GetTotal at totalTime and GetElapsed at 0 (Update leaves them alone), for reproducible runs
+		void SetFixedTime(float totalTime);
 
 		uint32_t GetFPS() const { return m_FPS; };
 		float GetdFPS() const { return m_dFPS; };
@@ -49,6 +51,7 @@ namespace dae
 
 		bool m_IsStopped = true;
 		bool m_ForceElapsedUpperBound = false;
+		bool m_IsFixed = false;
 
 		bool m_BenchmarkActive = false;
 		float m_BenchmarkHigh{ 0.f };
@@ -0,0 +1,162 @@
+//External includes
+#include <emmintrin.h> //SSE2
+
+//Standard includes
+#include <algorithm>
+
+//Project includes
+#include "ToneMapping.h"
+
+namespace dae
+{
+	namespace ToneMapping
+	{
+		namespace
+		{
+			__m128 ToneMap(__m128 c, __m128 maxChannel, ToneMapper toneMapper)
+			{
+				const __m128 one{ _mm_set1_ps(1.f) };
+
+				switch (toneMapper)
+				{
+				case ToneMapper::MaxToOne:
+					//Same as ColorRGB::MaxToOne, scale only when the brightest channel exceeds 1
+					return _mm_div_ps(c, _mm_max_ps(maxChannel, one));
+				case ToneMapper::Reinhard:
+					return _mm_div_ps(c, _mm_add_ps(c, one));
+				case ToneMapper::ACES:
+				{
+					//https://knarkowicz.wordpress.com/2016/01/06/aces-filmic-tone-mapping-curve/
+					const __m128 numerator{ _mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(2.51f)), _mm_set1_ps(0.03f))) };
+					const __m128 denominator{ _mm_add_ps(_mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(2.43f)), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f)) };
+					return _mm_div_ps(numerator, denominator);
+				}
+				case ToneMapper::Clamp:
+				default:
+					return c;
+				}
+			}
+
+			__m128 EncodeSRGB(__m128 c)
+			{
+				//x^(1/2.4) approximated with a sqrt chain (max error well below one 8-bit step)
+				const __m128 s1{ _mm_sqrt_ps(c) };
+				const __m128 s2{ _mm_sqrt_ps(s1) };
+				const __m128 s3{ _mm_sqrt_ps(s2) };
+				__m128 curve{ _mm_mul_ps(_mm_set1_ps(0.662002687f), s1) };
+				curve = _mm_add_ps(curve, _mm_mul_ps(_mm_set1_ps(0.684122060f), s2));
+				curve = _mm_sub_ps(curve, _mm_mul_ps(_mm_set1_ps(0.323583601f), s3));
+				curve = _mm_sub_ps(curve, _mm_mul_ps(_mm_set1_ps(0.0225411470f), c));
+
+				const __m128 linear{ _mm_mul_ps(c, _mm_set1_ps(12.92f)) };
+				const __m128 isLinear{ _mm_cmple_ps(c, _mm_set1_ps(0.0031308f)) };
+				return _mm_or_ps(_mm_and_ps(isLinear, linear), _mm_andnot_ps(isLinear, curve));
+			}
+
+			__m128i Quantize(__m128 c)
+			{
+				//Truncates like the old static_cast<uint8_t>(c * 255) did, c is already saturated
+				return _mm_cvttps_epi32(_mm_mul_ps(c, _mm_set1_ps(255.f)));
+			}
+
+			//Resolves 4 pixels at once
+			__m128i ResolveQuad(__m128 r, __m128 g, __m128 b, const PixelFormat& format, const ResolveSettings& settings)
+			{
+				const __m128 zero{ _mm_setzero_ps() };
+				const __m128 one{ _mm_set1_ps(1.f) };
+				const __m128 exposure{ _mm_set1_ps(settings.exposure) };
+
+				r = _mm_max_ps(_mm_mul_ps(r, exposure), zero);
+				g = _mm_max_ps(_mm_mul_ps(g, exposure), zero);
+				b = _mm_max_ps(_mm_mul_ps(b, exposure), zero);
+
+				const __m128 maxChannel{ _mm_max_ps(r, _mm_max_ps(g, b)) };
+				r = _mm_min_ps(ToneMap(r, maxChannel, settings.toneMapper), one);
+				g = _mm_min_ps(ToneMap(g, maxChannel, settings.toneMapper), one);
+				b = _mm_min_ps(ToneMap(b, maxChannel, settings.toneMapper), one);
+
+				if (settings.encodeSRGB)
+				{
+					r = EncodeSRGB(r);
+					g = EncodeSRGB(g);
+					b = EncodeSRGB(b);
+				}
+
+				__m128i packed{ _mm_set1_epi32(static_cast<int>(format.aMask)) };
+				packed = _mm_or_si128(packed, _mm_sll_epi32(Quantize(r), _mm_cvtsi32_si128(static_cast<int>(format.rShift))));
+				packed = _mm_or_si128(packed, _mm_sll_epi32(Quantize(g), _mm_cvtsi32_si128(static_cast<int>(format.gShift))));
+				packed = _mm_or_si128(packed, _mm_sll_epi32(Quantize(b), _mm_cvtsi32_si128(static_cast<int>(format.bShift))));
+				return packed;
+			}
+
+			//Resolves less than 4 pixels through the SIMD path, used for unaligned heads and tails
+			void ResolvePartial(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pDest,
+				uint32_t count, const PixelFormat& format, const ResolveSettings& settings)
+			{
+				alignas(16) float r[4]{};
+				alignas(16) float g[4]{};
+				alignas(16) float b[4]{};
+				alignas(16) uint32_t packed[4]{};
+
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					r[i] = pRed[i];
+					g[i] = pGreen[i];
+					b[i] = pBlue[i];
+				}
+
+				_mm_store_si128(reinterpret_cast<__m128i*>(packed), ResolveQuad(_mm_load_ps(r), _mm_load_ps(g), _mm_load_ps(b), format, settings));
+
+				for (uint32_t i = 0; i < count; ++i)
+				{
+					pDest[i] = packed[i];
+				}
+			}
+		}
+
+		void Resolve(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pDest,
+			uint32_t begin, uint32_t end, const PixelFormat& format, const ResolveSettings& settings)
+		{
+			uint32_t i{ begin };
+
+			//Streaming stores need a 16 byte aligned destination
+			const uint32_t misalignment{ static_cast<uint32_t>((reinterpret_cast<uintptr_t>(pDest + i) & 15) / sizeof(uint32_t)) };
+			if (misalignment != 0)
+			{
+				const uint32_t headCount{ std::min(4 - misalignment, end - i) };
+				ResolvePartial(pRed + i, pGreen + i, pBlue + i, pDest + i, headCount, format, settings);
+				i += headCount;
+			}
+
+			for (; i + 4 <= end; i += 4)
+			{
+				const __m128i packed{ ResolveQuad(_mm_loadu_ps(pRed + i), _mm_loadu_ps(pGreen + i), _mm_loadu_ps(pBlue + i), format, settings) };
+				_mm_stream_si128(reinterpret_cast<__m128i*>(pDest + i), packed);
+			}
+
+			if (i < end)
+			{
+				ResolvePartial(pRed + i, pGreen + i, pBlue + i, pDest + i, end - i, format, settings);
+			}
+
+			//Make the non-temporal stores visible before the surface is presented
+			_mm_sfence();
+		}
+
+		const char* GetToneMapperName(ToneMapper toneMapper)
+		{
+			switch (toneMapper)
+			{
+			case ToneMapper::MaxToOne:
+				return "MaxToOne";
+			case ToneMapper::Clamp:
+				return "Clamp";
+			case ToneMapper::Reinhard:
+				return "Reinhard";
+			case ToneMapper::ACES:
+				return "ACES";
+			}
+			return "Unknown";
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+
+namespace dae
+{
+	namespace ToneMapping
+	{
+		enum class ToneMapper
+		{
+			MaxToOne,	//Divide by the largest channel (original look)
+			Clamp,		//Saturate every channel separately
+			Reinhard,	//c / (1 + c)
+			ACES		//Narkowicz fit of the ACES filmic curve
+		};
+
+		//Bit layout of the 32-bit target surface (taken from the SDL_PixelFormat)
+		struct PixelFormat
+		{
+			uint32_t rShift{ 16 };
+			uint32_t gShift{ 8 };
+			uint32_t bShift{ 0 };
+			uint32_t aMask{ 0 };
+		};
+
+		struct ResolveSettings
+		{
+			float exposure{ 1.f };
+			ToneMapper toneMapper{ ToneMapper::MaxToOne };
+			bool encodeSRGB{ false };
+		};
+
+		/**
+		 * \brief Exposes, tonemaps, (optionally) sRGB encodes and packs the pixels [begin, end) of a planar HDR buffer.
+		 * Works on 4 pixels at a time (SSE2) and writes the result with non-temporal stores.
+		 * \param pRed Red plane of the HDR buffer
+		 * \param pGreen Green plane of the HDR buffer
+		 * \param pBlue Blue plane of the HDR buffer
+		 * \param pDest 32-bit destination pixels, indexed like the planes
+		 */
+		void Resolve(const float* pRed, const float* pGreen, const float* pBlue, uint32_t* pDest,
+			uint32_t begin, uint32_t end, const PixelFormat& format, const ResolveSettings& settings);
+
+		const char* GetToneMapperName(ToneMapper toneMapper);
+	}
+}
@@ -0,0 +1,102 @@
+#include "TraversalStats.h"
+
+//Standard includes
+#include <algorithm>
+#include <atomic>
+
+namespace dae
+{
+	namespace TraversalStats
+	{
+		const char* GetName(Counter counter)
+		{
+			switch (counter)
+			{
+			case PrimaryRays: return "primaryRays";
+			case NodesVisited: return "nodesVisited";
+			case SlabTests: return "slabTests";
+			case TriangleTests: return "triangleTests";
+			case SphereTests: return "sphereTests";
+			case PlaneTests: return "planeTests";
+			case ShadowRays: return "shadowRays";
+			case CacheMisses: return "cacheMisses";
+			default: return "";
+			}
+		}
+
+#ifdef TRAVERSAL_STATS
+		namespace
+		{
+			//More threads than this share slots, still correct because every add is atomic
+			constexpr uint32_t maxThreads{ 256 };
+
+			struct alignas(64) ThreadTotals
+			{
+				std::atomic<uint64_t> values[NrCounters]{};
+			};
+
+			ThreadTotals g_ThreadTotals[maxThreads]{};
+			std::atomic<uint32_t> g_NrThreads{ 0 };
+
+			ThreadTotals& GetThreadTotals()
+			{
+				thread_local ThreadTotals& totals{ g_ThreadTotals[g_NrThreads.fetch_add(1, std::memory_order_relaxed) % maxThreads] };
+				return totals;
+			}
+
+			constexpr uint32_t cacheLineSize{ 64 };
+			constexpr uint32_t nrCacheWays{ 8 };
+			constexpr uint32_t nrCacheSets{ 32 * 1024 / (cacheLineSize * nrCacheWays) };
+
+			//Every set keeps its lines most recently used first
+			struct SimulatedCache
+			{
+				uintptr_t lines[nrCacheSets][nrCacheWays]{};
+			};
+
+			SimulatedCache& GetThreadCache()
+			{
+				thread_local SimulatedCache cache{};
+				return cache;
+			}
+		}
+
+		void Touch(const void* pAddress)
+		{
+			//Line 0 is never touched, so an empty way can't match
+			const uintptr_t line{ reinterpret_cast<uintptr_t>(pAddress) / cacheLineSize };
+			uintptr_t* pSet{ GetThreadCache().lines[line % nrCacheSets] };
+
+			uint32_t way{ 0 };
+			while (way < nrCacheWays - 1 && pSet[way] != line)
+				++way;
+			if (pSet[way] != line)
+				Add(CacheMisses);
+
+			//Moves the line to the front, the least recently used one falls out on a miss
+			std::copy_backward(pSet, pSet + way, pSet + way + 1);
+			pSet[0] = line;
+		}
+
+		Counts EndRay()
+		{
+			ThreadTotals& totals{ GetThreadTotals() };
+			for (uint32_t i = 0; i < NrCounters; ++i)
+				totals.values[i].fetch_add(t_RayCounts.values[i], std::memory_order_relaxed);
+			return t_RayCounts;
+		}
+
+		Totals ExchangeTotals()
+		{
+			Totals totals{};
+			const uint32_t nrSlots{ std::min(g_NrThreads.load(std::memory_order_relaxed), maxThreads) };
+			for (uint32_t slot = 0; slot < nrSlots; ++slot)
+			{
+				for (uint32_t i = 0; i < NrCounters; ++i)
+					totals.values[i] += g_ThreadTotals[slot].values[i].exchange(0, std::memory_order_relaxed);
+			}
+			return totals;
+		}
+#endif
+	}
+}
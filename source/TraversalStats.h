@@ -0,0 +1,96 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+
+//Counts BVH nodes, slab tests, primitive tests and shadow rays per pixel and per thread, Renderer's heatmap mode shows them
+//Also runs every node and triangle the traversal reads through a simulated L1 cache per thread (CacheMisses)
+//Every counter compiles to nothing without this, so it costs nothing in a normal build
+//#define TRAVERSAL_STATS
+
+namespace dae
+{
+	namespace TraversalStats
+	{
+		enum Counter : uint32_t
+		{
+			PrimaryRays,
+			NodesVisited,
+			SlabTests,
+			TriangleTests,
+			SphereTests,
+			PlaneTests,
+			ShadowRays,
+			CacheMisses,	//Of the simulated cache, Touch
+			NrCounters
+		};
+
+		struct Counts
+		{
+			uint32_t values[NrCounters]{};
+
+			void Add(const Counts& other)
+			{
+				for (uint32_t i = 0; i < NrCounters; ++i)
+					values[i] += other.values[i];
+			}
+
+			//Everything a ray paid for, what the heatmap shows
+			uint32_t GetCost() const { return values[NodesVisited] + values[TriangleTests] + values[SphereTests] + values[PlaneTests]; }
+		};
+
+		struct Totals
+		{
+			uint64_t values[NrCounters]{};
+		};
+
+		//camelCase, also used as JSON key
+		const char* GetName(Counter counter);
+
+#ifdef TRAVERSAL_STATS
+		constexpr bool isEnabled{ true };
+
+		//Counts of the pixel this thread is tracing, its shadow rays included
+		inline thread_local Counts t_RayCounts{};
+
+		inline void Add(Counter counter)
+		{
+			++t_RayCounts.values[counter];
+		}
+
+		inline void BeginRay()
+		{
+			t_RayCounts = Counts{};
+			t_RayCounts.values[PrimaryRays] = 1;
+		}
+
+		//Shadow rays traced apart from their pixel (Renderer's sorted shadow rays), EndRay returns what to add to the pixel
+		inline void BeginShadowRay()
+		{
+			t_RayCounts = Counts{};
+		}
+
+		/**
+		 * \brief Reads the cache line of pAddress through the simulated cache of this thread, counts a CacheMiss when it wasn't in it
+		 * 32 KiB, 8 way set associative with 64 byte lines and LRU replacement, the L1 data cache of most desktop cores.
+		 * The cache lives as long as the thread, so it measures how much consecutive rays share, not only one ray.
+		 */
+		void Touch(const void* pAddress);
+
+		//Adds the ray to the totals of this thread (its own cache line, no locks) and returns its counts
+		Counts EndRay();
+
+		//Sum over every thread since the previous call, threads can keep tracing while this runs
+		Totals ExchangeTotals();
+#else
+		constexpr bool isEnabled{ false };
+
+		inline void Add(Counter) {}
+		inline void BeginRay() {}
+		inline void BeginShadowRay() {}
+		inline void Touch(const void*) {}
+		inline Counts EndRay() { return {}; }
+		inline Totals ExchangeTotals() { return {}; }
+#endif
+	}
+}
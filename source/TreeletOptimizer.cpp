@@ -0,0 +1,260 @@
+#include "TreeletOptimizer.h"
+
+//Standard includes
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <iostream>
+#include <vector>
+
+//Project includes
+#include "DataTypes.h"
+#include "ParallelFor.h"
+
+namespace dae
+{
+	namespace TreeletOptimizer
+	{
+		namespace
+		{
+			//Karras and Aila found 7 the best trade off, every extra leaf triples the work per treelet
+			constexpr uint32_t maxTreeletSize{ 8 };
+			constexpr uint32_t maxNrSubsets{ 1u << maxTreeletSize };
+			constexpr uint32_t nrIterations{ 3 };
+			//Costs of the SAH, relative to one slab test
+			constexpr float traversalCost{ 1.f };
+			constexpr float intersectionCost{ 1.f };
+
+			AABB GetBounds(const BVHNode& node)
+			{
+				return AABB{ node.minAABB, node.maxAABB };
+			}
+
+			struct Optimizer
+			{
+				TriangleMesh& mesh;
+				uint32_t treeletSize;
+				std::vector<float> costs{};			//SAH cost of the subtree below every node
+				std::vector<uint32_t> order{};		//Breadth first, so every depth is a range
+				std::vector<uint32_t> levelBegins{};
+				std::atomic<uint32_t> nrRestructured{ 0 };
+
+				void UpdateOrder()
+				{
+					order.assign(1, mesh.rootNodeIdx);
+					levelBegins.assign(1, 0);
+					for (uint32_t begin = 0; begin < order.size();)
+					{
+						const uint32_t end{ static_cast<uint32_t>(order.size()) };
+						for (uint32_t i = begin; i < end; ++i)
+						{
+							const BVHNode& node{ mesh.bvhNodes[order[i]] };
+							if (node.nrPrimitives != 0)
+								continue;
+							order.push_back(node.leftFirst);
+							order.push_back(node.leftFirst + 1);
+						}
+
+						begin = end;
+						if (begin < order.size())
+							levelBegins.push_back(begin);
+					}
+				}
+
+				void UpdateCost(uint32_t nodeIdx)
+				{
+					const BVHNode& node{ mesh.bvhNodes[nodeIdx] };
+					if (node.nrPrimitives != 0)
+						costs[nodeIdx] = intersectionCost * node.nrPrimitives * GetBounds(node).Area();
+					else
+						costs[nodeIdx] = traversalCost * GetBounds(node).Area() + costs[node.leftFirst] + costs[node.leftFirst + 1];
+				}
+
+				//Treelet below rootIdx, grown by opening the leaf with the largest area until it has treeletSize leaves
+				void OptimizeTreelet(uint32_t rootIdx)
+				{
+					if (mesh.bvhNodes[rootIdx].nrPrimitives != 0)
+						return;
+
+					uint32_t leaves[maxTreeletSize]{ mesh.bvhNodes[rootIdx].leftFirst, mesh.bvhNodes[rootIdx].leftFirst + 1 };
+					uint32_t nrLeaves{ 2 };
+					uint32_t pairs[maxTreeletSize - 1]{ mesh.bvhNodes[rootIdx].leftFirst };	//Children of every internal node of the treelet
+					uint32_t nrPairs{ 1 };
+					while (nrLeaves < treeletSize)
+					{
+						int bestLeaf{ -1 };
+						float bestArea{ -1.f };
+						for (uint32_t i = 0; i < nrLeaves; ++i)
+						{
+							const BVHNode& leaf{ mesh.bvhNodes[leaves[i]] };
+							if (leaf.nrPrimitives == 0 && GetBounds(leaf).Area() > bestArea)
+							{
+								bestLeaf = static_cast<int>(i);
+								bestArea = GetBounds(leaf).Area();
+							}
+						}
+						if (bestLeaf == -1)
+							break;
+
+						const uint32_t childIdx{ mesh.bvhNodes[leaves[bestLeaf]].leftFirst };
+						pairs[nrPairs++] = childIdx;
+						leaves[bestLeaf] = childIdx;
+						leaves[nrLeaves++] = childIdx + 1;
+					}
+
+					//Two or three leaves have no other topology worth a search
+					if (nrLeaves < 4)
+						return;
+
+				//Best subtree for every subset of the leaves, smaller subsets first
+					BVHNode leafNodes[maxTreeletSize];
+					float leafCosts[maxTreeletSize];
+					for (uint32_t i = 0; i < nrLeaves; ++i)
+					{
+						leafNodes[i] = mesh.bvhNodes[leaves[i]];
+						leafCosts[i] = costs[leaves[i]];
+					}
+
+					const uint32_t nrSubsets{ 1u << nrLeaves };
+					AABB bounds[maxNrSubsets];
+					float subsetCosts[maxNrSubsets];
+					uint32_t partitions[maxNrSubsets];
+					for (uint32_t subset = 1; subset < nrSubsets; ++subset)
+					{
+						const uint32_t lowestBit{ subset & (~subset + 1) };
+						if (subset == lowestBit)
+						{
+							const uint32_t leafIdx{ static_cast<uint32_t>(std::countr_zero(subset)) };
+							bounds[subset] = GetBounds(leafNodes[leafIdx]);
+							subsetCosts[subset] = leafCosts[leafIdx];
+							continue;
+						}
+
+						bounds[subset] = bounds[subset ^ lowestBit].Union(bounds[lowestBit]);
+
+						//Every split in two once: the side with the lowest leaf is the left one
+						float bestCost{ INFINITY };
+						for (uint32_t left = (subset - 1) & subset; left != 0; left = (left - 1) & subset)
+						{
+							if ((left & lowestBit) == 0)
+								continue;
+
+							const float cost{ subsetCosts[left] + subsetCosts[subset ^ left] };
+							if (cost < bestCost)
+							{
+								bestCost = cost;
+								partitions[subset] = left;
+							}
+						}
+						subsetCosts[subset] = traversalCost * bounds[subset].Area() + bestCost;
+					}
+
+					const uint32_t allLeaves{ nrSubsets - 1 };
+					if (subsetCosts[allLeaves] >= costs[rootIdx] * (1.f - 1e-5f))
+						return;
+
+				//Rewrite the treelet into the same slots, every internal node takes one of the pairs
+					uint32_t nextPair{ 0 };
+					auto emit = [&](auto& self, uint32_t nodeIdx, uint32_t subset) -> void
+					{
+						if (std::has_single_bit(subset))
+						{
+							const uint32_t leafIdx{ static_cast<uint32_t>(std::countr_zero(subset)) };
+							mesh.bvhNodes[nodeIdx] = leafNodes[leafIdx];
+							costs[nodeIdx] = leafCosts[leafIdx];
+							return;
+						}
+
+						const uint32_t childIdx{ pairs[nextPair++] };
+						BVHNode& node{ mesh.bvhNodes[nodeIdx] };
+						node.minAABB = bounds[subset].min;
+						node.maxAABB = bounds[subset].max;
+						node.leftFirst = childIdx;
+						node.nrPrimitives = 0; //Is not leaf
+						costs[nodeIdx] = subsetCosts[subset];
+
+						self(self, childIdx, partitions[subset]);
+						self(self, childIdx + 1, subset ^ partitions[subset]);
+					};
+					emit(emit, rootIdx, allLeaves);
+					++nrRestructured;
+				}
+
+				//Bottom up, one depth at a time: the treelets of a depth are disjoint and their subtrees are already done
+				void Iterate()
+				{
+					UpdateOrder();
+					for (uint32_t level = static_cast<uint32_t>(levelBegins.size()); level-- > 0;)
+					{
+						const uint32_t begin{ levelBegins[level] };
+						const uint32_t end{ level + 1 < levelBegins.size() ? levelBegins[level + 1] : static_cast<uint32_t>(order.size()) };
+						ParallelFor(end - begin, [&](uint32_t i) {
+							const uint32_t nodeIdx{ order[begin + i] };
+							UpdateCost(nodeIdx);
+							OptimizeTreelet(nodeIdx);
+						});
+					}
+				}
+
+				//Depth first again, so children come after their parent (RefitBVH) and the pairs of a treelet are no longer scattered
+				void Relayout()
+				{
+					std::vector<BVHNode> nodes(mesh.bvhNodes.size());
+					nodes[0] = mesh.bvhNodes[mesh.rootNodeIdx];
+					uint32_t nodesUsed{ 1 };
+
+					std::vector<uint32_t> stack{ 0 };
+					while (!stack.empty())
+					{
+						const uint32_t nodeIdx{ stack.back() };
+						stack.pop_back();
+
+						BVHNode& node{ nodes[nodeIdx] };
+						if (node.nrPrimitives != 0)
+							continue;
+
+						nodes[nodesUsed] = mesh.bvhNodes[node.leftFirst];
+						nodes[nodesUsed + 1] = mesh.bvhNodes[node.leftFirst + 1];
+						node.leftFirst = nodesUsed;
+						stack.push_back(nodesUsed + 1);
+						stack.push_back(nodesUsed);
+						nodesUsed += 2;
+					}
+
+					std::copy(nodes.begin(), nodes.begin() + nodesUsed, mesh.bvhNodes.begin());
+					mesh.rootNodeIdx = 0;
+					mesh.nodesUsed = nodesUsed;
+				}
+			};
+		}
+
+		Result Optimize(TriangleMesh& mesh)
+		{
+			PROFILE_ZONE("TreeletOptimizer::Optimize");
+			Optimizer optimizer{ mesh, std::min(mesh.bvhSettings.treeletSize, maxTreeletSize) };
+			optimizer.costs.resize(mesh.bvhNodes.size());
+
+			optimizer.UpdateOrder();
+			for (auto it = optimizer.order.rbegin(); it != optimizer.order.rend(); ++it)
+				optimizer.UpdateCost(*it);
+
+			Result result{ optimizer.costs[mesh.rootNodeIdx], optimizer.costs[mesh.rootNodeIdx], 0 };
+			if (optimizer.treeletSize < 4 || mesh.nodesUsed == 0)
+				return result;
+
+			for (uint32_t iteration = 0; iteration < nrIterations; ++iteration)
+				optimizer.Iterate();
+			result.costAfter = optimizer.costs[mesh.rootNodeIdx];
+			optimizer.Relayout();
+
+			result.nrRestructured = optimizer.nrRestructured.load();
+			return result;
+		}
+
+		void PrintStats(const Result& result)
+		{
+			std::cout << "Treelet optimization: SAH cost " << result.costBefore << " -> " << result.costAfter
+				<< " (" << result.nrRestructured << " treelets restructured)" << std::endl;
+		}
+	}
+}
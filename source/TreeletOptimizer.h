@@ -0,0 +1,31 @@
+#pragma once
+
+//Standard includes
+#include <cstdint>
+
+namespace dae
+{
+	struct TriangleMesh;
+
+	//Treelet restructuring (TRBVH, Karras and Aila 2013): improves a built BVH by finding the best topology for small treelets
+	//Slow enough to only run it when the mesh cache is written (MeshCache::LoadOBJ), the cache stores the result
+	namespace TreeletOptimizer
+	{
+		struct Result
+		{
+			float costBefore;	//SAH cost of the whole tree, traversal and intersection cost 1
+			float costAfter;
+			uint32_t nrRestructured;
+		};
+
+		/**
+		 * \brief Restructures treelets of BVHBuildSettings::treeletSize leaves, a few times over the whole tree from the bottom up
+		 * Treelets with the same depth don't overlap and are optimized in parallel.
+		 * Leaves keep their triangles, only the nodes above them are rearranged and stored depth first again afterwards.
+		 * Works on the tree of every builder, a treeletSize of 0 leaves the tree alone.
+		 */
+		Result Optimize(TriangleMesh& mesh);
+
+		void PrintStats(const Result& result);
+	}
+}
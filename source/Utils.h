@@ -1,8 +1,13 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
 #include <fstream>
+#include <unordered_map>
 #include "Math.h"
 #include "DataTypes.h"
+#include "OBJParser.h"
+#include "ScratchArena.h"
+#include "TraversalStats.h"
 
 
 
@@ -14,7 +19,8 @@ namespace dae
 		//SPHERE HIT-TESTS
 		inline bool HitTest_Sphere(const Sphere& sphere, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
-		
+			TraversalStats::Add(TraversalStats::SphereTests);
+
 			Vector3 raySphere{ sphere.origin - ray.origin };
 			Vector3 rayNormalized{ ray.direction.Normalized() };
 
@@ -48,7 +54,7 @@ namespace dae
 				if (t < hitRecord.t)
 				{
 					hitRecord.t = t;
-					hitRecord.materialIndex = sphere.materialIndex;
+					hitRecord.materialHandle = sphere.materialHandle;
 					hitRecord.didHit = true;
 					hitRecord.origin = ray.origin + ray.direction * hitRecord.t;
 					hitRecord.normal = hitRecord.origin - sphere.origin;
@@ -69,6 +75,8 @@ namespace dae
 		//PLANE HIT-TESTS
 		inline bool HitTest_Plane(const Plane& plane, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
+			TraversalStats::Add(TraversalStats::PlaneTests);
+
 			Vector3 planeNormal{ plane.normal };
 			float t{ Vector3::Dot(plane.origin - ray.origin,planeNormal) / Vector3::Dot(ray.direction,planeNormal) };
 		
@@ -84,7 +92,7 @@ namespace dae
 					
 					hitRecord.t = t;
 					hitRecord.didHit = true;
-					hitRecord.materialIndex = plane.materialIndex;
+					hitRecord.materialHandle = plane.materialHandle;
 					hitRecord.origin = ray.origin + ray.direction* hitRecord.t;
 					hitRecord.normal = plane.normal;
 					hitRecord.normal.Normalize();
@@ -105,7 +113,9 @@ namespace dae
 #pragma region Triangle HitTest
 		//TRIANGLE HIT-TESTS
 		inline bool HitTest_Triangle(const Triangle& triangle, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
-		{	
+		{
+			TraversalStats::Add(TraversalStats::TriangleTests);
+
 			Vector3 v0 = triangle.v0;
 			Vector3 v1 = triangle.v1;
 			Vector3 v2 = triangle.v2;
@@ -170,10 +180,11 @@ namespace dae
 			if (t < hitRecord.t)
 			{
 				hitRecord.t = t;
-				hitRecord.materialIndex = triangle.materialIndex;
+				hitRecord.materialHandle = triangle.materialHandle;
 				hitRecord.origin = ray.origin + ray.direction * hitRecord.t;
 				hitRecord.didHit = true;
 				hitRecord.normal = triangle.normal;
+				hitRecord.barycentrics = { u, v };
 			}
 
 			return true;
@@ -188,6 +199,8 @@ namespace dae
 #pragma region SlabTest
 		inline bool SlabTest(const Vector3& minAABB,const Vector3& maxAABB, const Ray& ray)
 		{
+			TraversalStats::Add(TraversalStats::SlabTests);
+
 			float tx1 = (minAABB.x - ray.origin.x) * ray.reciprocalDir.x;
 			float tx2 = (maxAABB.x - ray.origin.x) * ray.reciprocalDir.x;
 
@@ -209,56 +222,266 @@ namespace dae
 			return tmax > 0 && tmax >= tmin;
 		}
 
-		 inline void IntersectBVH(const Ray& ray, const TriangleMesh& mesh,const uint32_t nodeIdx,std::vector<int>& indexes)
+		//Collects the leaves the ray passes through, pIndexes needs room for every node of the mesh
+		inline void IntersectBVH(const Ray& ray, const TriangleMesh& mesh, const uint32_t nodeIdx, int* pIndexes, uint32_t& nrIndexes)
 		{
+			TraversalStats::Add(TraversalStats::NodesVisited);
 			const BVHNode& node = mesh.bvhNodes[nodeIdx];
+			TraversalStats::Touch(&node);
 
 			if (!SlabTest(node.minAABB, node.maxAABB, ray))
 				return;
 
 			if (node.nrPrimitives !=0) //Leaf
 			{		
-				indexes.push_back(nodeIdx);
+				pIndexes[nrIndexes++] = nodeIdx;
 				return;
 			}
 			else
 			{
-				IntersectBVH(ray, mesh, node.leftFirst, indexes);
-				IntersectBVH(ray, mesh, node.leftFirst + 1, indexes);
+				IntersectBVH(ray, mesh, node.leftFirst, pIndexes, nrIndexes);
+				IntersectBVH(ray, mesh, node.leftFirst + 1, pIndexes, nrIndexes);
 			}
 		}
 #pragma endregion
 #pragma region TriangeMesh HitTest
+		//Compact meshes are decoded here, right before the intersection test
+		//Their normal is only decoded for the closest hit (the test itself doesn't need it)
+		inline void LoadTriangle(const TriangleMesh& mesh, uint32_t triangleIdx, Triangle& triangle)
+		{
+			const int* pIndices{ &mesh.indices[triangleIdx * 3] };
+			TraversalStats::Touch(pIndices);
+			if (mesh.isCompact)
+			{
+				TraversalStats::Touch(&mesh.transformedQuantizedPositions[pIndices[0]]);
+				TraversalStats::Touch(&mesh.transformedQuantizedPositions[pIndices[1]]);
+				TraversalStats::Touch(&mesh.transformedQuantizedPositions[pIndices[2]]);
+				triangle.v0 = mesh.transformedPositionRange.Decode(mesh.transformedQuantizedPositions[pIndices[0]]);
+				triangle.v1 = mesh.transformedPositionRange.Decode(mesh.transformedQuantizedPositions[pIndices[1]]);
+				triangle.v2 = mesh.transformedPositionRange.Decode(mesh.transformedQuantizedPositions[pIndices[2]]);
+				return;
+			}
+
+			TraversalStats::Touch(&mesh.transformedPositions[pIndices[0]]);
+			TraversalStats::Touch(&mesh.transformedPositions[pIndices[1]]);
+			TraversalStats::Touch(&mesh.transformedPositions[pIndices[2]]);
+			triangle.v0 = mesh.transformedPositions[pIndices[0]];
+			triangle.v1 = mesh.transformedPositions[pIndices[1]];
+			triangle.v2 = mesh.transformedPositions[pIndices[2]];
+			triangle.normal = mesh.transformedNormals[triangleIdx];
+		}
+
+		//Only done for the closest hit of a textured mesh
+		inline void InterpolateTexcoords(const TriangleMesh& mesh, uint32_t triangleIdx, HitRecord& hitRecord)
+		{
+			const int* pIndices{ &mesh.indices[triangleIdx * 3] };
+			const Vector2& uv0{ mesh.texcoords[pIndices[0]] };
+			const Vector2& uv1{ mesh.texcoords[pIndices[1]] };
+			const Vector2& uv2{ mesh.texcoords[pIndices[2]] };
+
+			const float w1{ hitRecord.barycentrics.x };
+			const float w2{ hitRecord.barycentrics.y };
+			hitRecord.uv = uv0 * (1.f - w1 - w2) + uv1 * w1 + uv2 * w2;
+
+			Triangle triangle{};
+			LoadTriangle(mesh, triangleIdx, triangle);
+			const float uvArea{ std::abs(Vector2::Cross(uv1 - uv0, uv2 - uv0)) };
+			const float worldArea{ Vector3::Cross(triangle.v1 - triangle.v0, triangle.v2 - triangle.v0).Magnitude() };
+			hitRecord.uvScale = worldArea > 0.f ? std::sqrt(uvArea / worldArea) : 0.f;
+		}
+
+		//One triangle of a leaf or cell, remembers it when it is the closest hit so far
+		inline bool HitTest_MeshTriangle(const TriangleMesh& mesh, uint32_t triangleIdx, const Ray& ray, Triangle& triangle, HitRecord& hitRecord, uint32_t& closestTriangle)
+		{
+			LoadTriangle(mesh, triangleIdx, triangle);
+			const float closestT{ hitRecord.t };
+			if (!HitTest_Triangle(triangle, ray, hitRecord))
+				return false;
+
+			if (hitRecord.t < closestT)
+				closestTriangle = triangleIdx;
+			return true;
+		}
+
+		//Entry and exit distance of the ray in the box, clamped to the ray's own range
+		inline bool ClipRay(const Vector3& minAABB, const Vector3& maxAABB, const Ray& ray, float& tMin, float& tMax)
+		{
+			tMin = ray.min;
+			tMax = ray.max;
+			for (int a = 0; a < 3; ++a)
+			{
+				const float t1{ (minAABB[a] - ray.origin[a]) * ray.reciprocalDir[a] };
+				const float t2{ (maxAABB[a] - ray.origin[a]) * ray.reciprocalDir[a] };
+				tMin = std::max(tMin, std::min(t1, t2));
+				tMax = std::min(tMax, std::max(t1, t2));
+			}
+			return tMin <= tMax;
+		}
+
+		//3D-DDA through the cells (Amanatides and Woo), stops after the first cell that holds a hit closer than its exit
+		inline bool IntersectGrid(const TriangleMesh& mesh, const Ray& ray, Triangle& triangle, HitRecord& hitRecord, bool ignoreHitRecord, uint32_t& closestTriangle)
+		{
+			const UniformGrid& grid{ mesh.grid };
+			float tMin{}, tMax{};
+			if (!ClipRay(grid.minAABB, grid.maxAABB, ray, tMin, tMax))
+				return false;
+
+			int cell[3]{};
+			int step[3]{};
+			float tNext[3]{};
+			float tDelta[3]{};
+			const Vector3 entry{ ray.origin + ray.direction * tMin };
+			for (int a = 0; a < 3; ++a)
+			{
+				cell[a] = std::clamp(static_cast<int>((entry[a] - grid.minAABB[a]) * grid.reciprocalCellSize[a]), 0, grid.resolution[a] - 1);
+				if (ray.direction[a] == 0.f)
+				{
+					tNext[a] = INFINITY;
+					continue;
+				}
+
+				step[a] = ray.direction[a] > 0.f ? 1 : -1;
+				const float boundary{ grid.minAABB[a] + (cell[a] + (step[a] > 0 ? 1 : 0)) * grid.cellSize[a] };
+				tNext[a] = (boundary - ray.origin[a]) * ray.reciprocalDir[a];
+				tDelta[a] = grid.cellSize[a] * std::abs(ray.reciprocalDir[a]);
+			}
+
+			bool didHit{ false };
+			while (true)
+			{
+				TraversalStats::Add(TraversalStats::NodesVisited);
+				const uint32_t cellIdx{ static_cast<uint32_t>(cell[0] + grid.resolution[0] * (cell[1] + grid.resolution[1] * cell[2])) };
+				TraversalStats::Touch(&grid.cellStarts[cellIdx]);
+				for (uint32_t slot = grid.cellStarts[cellIdx]; slot < grid.cellStarts[cellIdx + 1]; ++slot)
+				{
+					if (HitTest_MeshTriangle(mesh, grid.triangles[slot], ray, triangle, hitRecord, closestTriangle))
+					{
+						if (ignoreHitRecord)
+							return true;
+						didHit = true;
+					}
+				}
+
+				const int axis{ tNext[0] < tNext[1] ? (tNext[0] < tNext[2] ? 0 : 2) : (tNext[1] < tNext[2] ? 1 : 2) };
+				//Triangles span cells, so a hit only ends the walk once no later cell can hold a closer one
+				if (hitRecord.t <= tNext[axis] || tNext[axis] > tMax)
+					break;
+
+				cell[axis] += step[axis];
+				if (cell[axis] < 0 || cell[axis] >= grid.resolution[axis])
+					break;
+				tNext[axis] += tDelta[axis];
+			}
+			return didHit;
+		}
+
+		//Front to back with a stack of the far children (pbrt's KdTreeAccel), stops at the first leaf that holds a hit closer than its exit
+		inline bool IntersectKdTree(const TriangleMesh& mesh, const Ray& ray, Triangle& triangle, HitRecord& hitRecord, bool ignoreHitRecord, uint32_t& closestTriangle)
+		{
+			const KdTree& tree{ mesh.kdTree };
+			float tMin{}, tMax{};
+			if (!ClipRay(tree.minAABB, tree.maxAABB, ray, tMin, tMax))
+				return false;
+
+			struct Entry
+			{
+				uint32_t nodeIdx;
+				float tMin, tMax;
+			};
+			Entry stack[KdTree::maxDepth];
+			uint32_t stackSize{ 0 };
+
+			bool didHit{ false };
+			uint32_t nodeIdx{ 0 };
+			while (true)
+			{
+				TraversalStats::Add(TraversalStats::NodesVisited);
+				const KdNode& node{ tree.nodes[nodeIdx] };
+				TraversalStats::Touch(&node);
+				if (node.axis != KdNode::leafAxis)
+				{
+					const uint32_t a{ node.axis };
+					const bool isBelowFirst{ ray.origin[a] < node.splitPos || (ray.origin[a] == node.splitPos && ray.direction[a] <= 0.f) };
+					const uint32_t firstIdx{ isBelowFirst ? node.leftFirst : node.leftFirst + 1 };
+					const uint32_t secondIdx{ isBelowFirst ? node.leftFirst + 1 : node.leftFirst };
+					const float tSplit{ (node.splitPos - ray.origin[a]) * ray.reciprocalDir[a] };
+
+					if (ray.direction[a] == 0.f || tSplit > tMax || tSplit <= 0.f)
+						nodeIdx = firstIdx;
+					else if (tSplit < tMin)
+						nodeIdx = secondIdx;
+					else
+					{
+						stack[stackSize++] = Entry{ secondIdx, tSplit, tMax };
+						nodeIdx = firstIdx;
+						tMax = tSplit;
+					}
+					continue;
+				}
+
+				for (uint32_t slot = node.leftFirst; slot < node.leftFirst + node.nrPrimitives; ++slot)
+				{
+					if (HitTest_MeshTriangle(mesh, tree.triangles[slot], ray, triangle, hitRecord, closestTriangle))
+					{
+						if (ignoreHitRecord)
+							return true;
+						didHit = true;
+					}
+				}
+
+				if (hitRecord.t <= tMax || stackSize == 0)
+					break;
+
+				--stackSize;
+				nodeIdx = stack[stackSize].nodeIdx;
+				tMin = stack[stackSize].tMin;
+				tMax = stack[stackSize].tMax;
+			}
+			return didHit;
+		}
+
 		inline bool HitTest_TriangleMesh(const TriangleMesh& mesh, const Ray& ray, HitRecord& hitRecord, bool ignoreHitRecord = false)
 		{
 
 			Triangle triangle{};
 			triangle.cullMode = mesh.cullMode;
-			triangle.materialIndex = mesh.materialIndex;
-			int nrVertices{ 3 };	
+			triangle.materialHandle = mesh.materialHandle;
 
-			if (mesh.shouldUseBVH)
-			{
-				std::vector<int> indexes{};
-				IntersectBVH(ray, mesh, mesh.rootNodeIdx, indexes);
+			const float previousT{ hitRecord.t };
+			uint32_t closestTriangle{ 0 };
 
-				if (indexes.empty())
+			if (mesh.shouldUseBVH && mesh.accelerationStructure == AccelerationStructure::Grid)
+			{
+				if (IntersectGrid(mesh, ray, triangle, hitRecord, ignoreHitRecord, closestTriangle) && ignoreHitRecord)
+					return true;
+			}
+			else if (mesh.shouldUseBVH && mesh.accelerationStructure == AccelerationStructure::KdTree)
+			{
+				if (IntersectKdTree(mesh, ray, triangle, hitRecord, ignoreHitRecord, closestTriangle) && ignoreHitRecord)
+					return true;
+			}
+			else if (mesh.shouldUseBVH)
+			{
+				//Scratch memory of this thread, released when the test returns
+				ScratchArena& arena{ ScratchArena::Get() };
+				ScratchArena::Scope scope{ arena };
+				int* pIndexes{ arena.Allocate<int>(mesh.nodesUsed) };
+				uint32_t nrIndexes{ 0 };
+				IntersectBVH(ray, mesh, mesh.rootNodeIdx, pIndexes, nrIndexes);
+
+				if (nrIndexes == 0)
 					return hitRecord.didHit;
 
 
-				for (size_t i = 0; i < indexes.size(); i++)
+				for (uint32_t i = 0; i < nrIndexes; i++)
 				{
 
-					uint32_t start = mesh.bvhNodes[indexes[i]].leftFirst;
-					uint32_t end = start + mesh.bvhNodes[indexes[i]].nrPrimitives;
+					uint32_t start = mesh.bvhNodes[pIndexes[i]].leftFirst;
+					uint32_t end = start + mesh.bvhNodes[pIndexes[i]].nrPrimitives;
 
-					for (uint32_t currentTriangle = start; currentTriangle < end; ++currentTriangle)
+					for (uint32_t slot = start; slot < end; ++slot)
 					{
-						triangle.v0 = mesh.transformedPositions[mesh.indices[currentTriangle * nrVertices]];
-						triangle.v1 = mesh.transformedPositions[mesh.indices[currentTriangle * nrVertices + 1]];
-						triangle.v2 = mesh.transformedPositions[mesh.indices[currentTriangle * nrVertices + 2]];
-						triangle.normal = mesh.transformedNormals[currentTriangle];
-						if (HitTest_Triangle(triangle, ray, hitRecord) && ignoreHitRecord)
+						if (HitTest_MeshTriangle(mesh, mesh.GetLeafTriangle(slot), ray, triangle, hitRecord, closestTriangle) && ignoreHitRecord)
 							return true;
 					}
 				}
@@ -270,14 +493,25 @@ namespace dae
 
 				for (uint32_t currentTriangle = 0; currentTriangle < mesh.indices.size() / 3; ++currentTriangle)
 				{
-					triangle.v0 = mesh.transformedPositions[mesh.indices[currentTriangle * nrVertices]];
-					triangle.v1 = mesh.transformedPositions[mesh.indices[currentTriangle * nrVertices + 1]];
-					triangle.v2 = mesh.transformedPositions[mesh.indices[currentTriangle * nrVertices + 2]];
-					triangle.normal = mesh.transformedNormals[currentTriangle];
-					if (HitTest_Triangle(triangle, ray, hitRecord,ignoreHitRecord) && ignoreHitRecord)
-						return true;
+					LoadTriangle(mesh, currentTriangle, triangle);
+					const float closestT{ hitRecord.t };
+					if (HitTest_Triangle(triangle, ray, hitRecord,ignoreHitRecord))
+					{
+						if (ignoreHitRecord)
+							return true;
+						if (hitRecord.t < closestT)
+							closestTriangle = currentTriangle;
+					}
 				}
 			}
+
+			if (hitRecord.t < previousT)
+			{
+				if (mesh.isCompact)
+					hitRecord.normal = mesh.GetTransformedNormal(closestTriangle);
+				if (!mesh.texcoords.empty())
+					InterpolateTexcoords(mesh, closestTriangle, hitRecord);
+			}
 			return hitRecord.didHit;
 		}
 
@@ -321,50 +555,53 @@ namespace dae
 
 	namespace Utils
 	{
-		//Just parses vertices and indices
+		//Parses vertices and (triangulated) indices, precomputes a normal per triangle
 #pragma warning(push)
 #pragma warning(disable : 4505) //Warning unreferenced local function
-		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		//A vertex is a position/texcoord pair, positions used with different texcoords are duplicated
+		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices, std::vector<Vector2>& texcoords)
 		{
-			std::ifstream file(filename);
-			if (!file)
+			//Memory mapped, multithreaded parse, vertex normals aren't used by TriangleMesh (yet)
+			OBJParser::OBJData data{};
+			if (!OBJParser::Parse(filename, data))
 				return false;
 
-			std::string sCommand;
-			// start a while iteration ending when the end of file is reached (ios::eof)
-			while (!file.eof())
+			texcoords.clear();
+			if (data.texcoords.empty())
 			{
-				//read the first word of the string, use the >> operator (istream::operator>>) 
-				file >> sCommand;
-				//use conditional statements to process the different commands	
-				if (sCommand == "#")
-				{
-					// Ignore Comment
-				}
-				else if (sCommand == "v")
-				{
-					//Vertex
-					float x, y, z;
-					file >> x >> y >> z;
-					positions.push_back({ x, y, z });
-				}
-				else if (sCommand == "f")
+				positions = std::move(data.positions);
+				indices = std::move(data.indices);
+			}
+			else
+			{
+				std::unordered_map<uint64_t, int> vertices{};
+				vertices.reserve(data.positions.size());
+				positions.clear();
+				positions.reserve(data.positions.size());
+				texcoords.reserve(data.positions.size());
+				indices.resize(data.indices.size());
+
+				for (size_t corner = 0; corner < data.indices.size(); ++corner)
 				{
-					float i0, i1, i2;
-					file >> i0 >> i1 >> i2;
+					const int positionIdx{ data.indices[corner] };
+					const int texcoordIdx{ data.texcoordIndices[corner] };
+					const uint64_t key{ (static_cast<uint64_t>(static_cast<uint32_t>(positionIdx)) << 32) | static_cast<uint32_t>(texcoordIdx) };
 
-					indices.push_back((int)i0 - 1);
-					indices.push_back((int)i1 - 1);
-					indices.push_back((int)i2 - 1);
-				}
-				//read till end of line and ignore all remaining chars
-				file.ignore(1000, '\n');
+					const auto [vertex, isNew] { vertices.try_emplace(key, static_cast<int>(positions.size())) };
+					if (isNew)
+					{
+						const bool isValid{ positionIdx >= 0 && static_cast<size_t>(positionIdx) < data.positions.size() };
+						positions.push_back(isValid ? data.positions[positionIdx] : Vector3{ NAN, NAN, NAN });
 
-				if (file.eof()) 
-					break;
+						const bool hasTexcoord{ texcoordIdx >= 0 && static_cast<size_t>(texcoordIdx) < data.texcoords.size() };
+						texcoords.push_back(hasTexcoord ? Vector2{ data.texcoords[texcoordIdx].x, data.texcoords[texcoordIdx].y } : Vector2{});
+					}
+					indices[corner] = vertex->second;
+				}
 			}
 
 			//Precompute normals
+			//Degenerate triangles get a NaN normal, MeshOptimizer::Optimize removes them
 			for (uint64_t index = 0; index < indices.size(); index += 3)
 			{
 				uint32_t i0 = indices[index];
@@ -375,22 +612,18 @@ namespace dae
 				Vector3 edgeV0V2 = positions[i2] - positions[i0];
 				Vector3 normal = Vector3::Cross(edgeV0V1, edgeV0V2);
 
-				if(isnan(normal.x))
-				{
-					int k = 0;
-				}
-
 				normal.Normalize();
-				if (isnan(normal.x))
-				{
-					int k = 0;
-				}
-
 				normals.push_back(normal);
 			}
 
 			return true;
 		}
+
+		static bool ParseOBJ(const std::string& filename, std::vector<Vector3>& positions, std::vector<Vector3>& normals, std::vector<int>& indices)
+		{
+			std::vector<Vector2> texcoords{};
+			return ParseOBJ(filename, positions, normals, indices, texcoords);
+		}
 #pragma warning(pop)
 	}
 }
\ No newline at end of file
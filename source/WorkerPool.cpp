@@ -0,0 +1,91 @@
+#include "WorkerPool.h"
+
+//Standard includes
+#include <algorithm>
+#include <iostream>
+
+//Project includes
+#include "Profiler.h"
+
+namespace dae
+{
+	WorkerPool::WorkerPool(uint32_t nrNodes, bool isPinned) :
+		m_IsPinned(isPinned)
+	{
+		const std::vector<Numa::Node>& nodes{ Numa::GetNodes() };
+		nrNodes = std::clamp(nrNodes, 1u, static_cast<uint32_t>(nodes.size()));
+
+		for (uint32_t node = 0; node < nrNodes; ++node)
+		{
+			m_FirstWorkers.push_back(static_cast<uint32_t>(m_Workers.size()));
+			for (const Numa::Processor& processor : nodes[node].processors)
+				m_Workers.push_back(Worker{ node, processor, {} });
+		}
+
+		//Started once the vector stopped growing, workers read their own entry
+		for (uint32_t workerIdx = 0; workerIdx < m_Workers.size(); ++workerIdx)
+			m_Workers[workerIdx].thread = std::thread(&WorkerPool::RunWorker, this, workerIdx);
+
+		std::cout << "Rendering on " << m_Workers.size() << (isPinned ? " pinned" : "") << " workers over " << nrNodes << " NUMA node(s)" << std::endl;
+	}
+
+	WorkerPool::~WorkerPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ m_Mutex };
+			m_IsStopping = true;
+		}
+		m_TaskChanged.notify_all();
+
+		for (Worker& worker : m_Workers)
+		{
+			if (worker.thread.joinable())
+				worker.thread.join();
+		}
+	}
+
+	void WorkerPool::Run(const std::function<void(uint32_t)>& task)
+	{
+		std::unique_lock<std::mutex> lock{ m_Mutex };
+		m_pTask = &task;
+		m_NrBusy = GetNrWorkers();
+		++m_Generation;
+		m_TaskChanged.notify_all();
+
+		m_TaskDone.wait(lock, [this] { return m_NrBusy == 0; });
+		m_pTask = nullptr;
+	}
+
+	uint32_t WorkerPool::GetNrWorkers(uint32_t node) const
+	{
+		const uint32_t end{ node + 1 < GetNrNodes() ? m_FirstWorkers[node + 1] : GetNrWorkers() };
+		return end - m_FirstWorkers[node];
+	}
+
+	void WorkerPool::RunWorker(uint32_t workerIdx)
+	{
+		const Worker& worker{ m_Workers[workerIdx] };
+		if (m_IsPinned && !Numa::PinCurrentThread(worker.processor))
+			std::cout << "Can't pin worker " << workerIdx << " to processor " << worker.processor.group << ":" << worker.processor.number << std::endl;
+		Numa::SetCurrentNode(worker.node);
+		Profiler::SetThreadName("Worker");
+
+		uint64_t generation{ 0 };
+		std::unique_lock<std::mutex> lock{ m_Mutex };
+		while (true)
+		{
+			m_TaskChanged.wait(lock, [&] { return m_IsStopping || m_Generation != generation; });
+			if (m_IsStopping)
+				return;
+
+			generation = m_Generation;
+			const std::function<void(uint32_t)>& task{ *m_pTask };
+			lock.unlock();
+			task(workerIdx);
+			lock.lock();
+
+			if (--m_NrBusy == 0)
+				m_TaskDone.notify_one();
+		}
+	}
+}
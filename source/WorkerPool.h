@@ -0,0 +1,60 @@
+#pragma once
+
+//Standard includes
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Project includes
+#include "Numa.h"
+
+namespace dae
+{
+	//One thread per processor of the first nrNodes NUMA nodes, kept alive between frames
+	//Workers know their node (Numa::GetCurrentNode), so they can work on memory that was placed there
+	class WorkerPool final
+	{
+	public:
+		WorkerPool(uint32_t nrNodes, bool isPinned);
+		~WorkerPool();
+
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool(WorkerPool&&) noexcept = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+		WorkerPool& operator=(WorkerPool&&) noexcept = delete;
+
+		//Calls task(workerIdx) on every worker and blocks until all of them returned
+		void Run(const std::function<void(uint32_t)>& task);
+
+		uint32_t GetNrWorkers() const { return static_cast<uint32_t>(m_Workers.size()); }
+		uint32_t GetNrNodes() const { return static_cast<uint32_t>(m_FirstWorkers.size()); }
+		uint32_t GetNode(uint32_t workerIdx) const { return m_Workers[workerIdx].node; }
+		uint32_t GetFirstWorker(uint32_t node) const { return m_FirstWorkers[node]; }
+		uint32_t GetNrWorkers(uint32_t node) const;
+
+	private:
+		struct Worker
+		{
+			uint32_t node;	//Index into the nodes the pool uses, not the system id
+			Numa::Processor processor;
+			std::thread thread;
+		};
+
+		std::vector<Worker> m_Workers{};
+		std::vector<uint32_t> m_FirstWorkers{};	//Per node
+		bool m_IsPinned;
+
+		std::mutex m_Mutex{};
+		std::condition_variable m_TaskChanged{};
+		std::condition_variable m_TaskDone{};
+		const std::function<void(uint32_t)>* m_pTask{};
+		uint64_t m_Generation{ 0 };
+		uint32_t m_NrBusy{ 0 };
+		bool m_IsStopping{ false };
+
+		void RunWorker(uint32_t workerIdx);
+	};
+}
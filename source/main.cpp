@@ -5,14 +5,34 @@
 #undef main
 
 //Standard includes
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 //Project includes
+#include "Benchmark.h"
+#include "Numa.h"
+#include "Profiler.h"
+#include "Regression.h"
 #include "Timer.h"
 #include "Renderer.h"
 #include "Scene.h"
+#include "TraversalStats.h"
 using namespace dae;
 
+//Averages per primary ray since the previous print, only with TRAVERSAL_STATS
+void PrintTraversalStats()
+{
+	const TraversalStats::Totals totals{ TraversalStats::ExchangeTotals() };
+	const double nrRays{ static_cast<double>(std::max(totals.values[TraversalStats::PrimaryRays], uint64_t{ 1 })) };
+
+	std::cout << "Per ray:";
+	for (uint32_t i = TraversalStats::NodesVisited; i < TraversalStats::NrCounters; ++i)
+		std::cout << ' ' << TraversalStats::GetName(static_cast<TraversalStats::Counter>(i)) << ' ' << totals.values[i] / nrRays;
+	std::cout << std::endl;
+}
+
 void ShutDown(SDL_Window* pWindow)
 {
 	SDL_DestroyWindow(pWindow);
@@ -21,9 +41,25 @@ void ShutDown(SDL_Window* pWindow)
 
 int main(int argc, char* args[])
 {
-	//Unreferenced parameters
-	(void)argc;
-	(void)args;
+	//--benchmark renders every scene headless and exits, see Benchmark.h
+	Benchmark::Settings benchmarkSettings{};
+	if (Benchmark::ParseCommandLine(argc, args, benchmarkSettings))
+	{
+		SDL_Init(0);
+		const bool isWritten{ Benchmark::Run(benchmarkSettings) };
+		SDL_Quit();
+		return isWritten ? 0 : 1;
+	}
+
+	//--regression compares every scene against its reference images and exits, see Regression.h
+	Regression::Settings regressionSettings{};
+	if (Regression::ParseCommandLine(argc, args, regressionSettings))
+	{
+		SDL_Init(0);
+		const bool isMatch{ Regression::Run(regressionSettings) };
+		SDL_Quit();
+		return isMatch ? 0 : 1;
+	}
 
 	//Create window + surfaces
 	SDL_Init(SDL_INIT_VIDEO);
@@ -44,20 +80,49 @@ int main(int argc, char* args[])
 	const auto pTimer = new Timer();
 	const auto pRenderer = new Renderer(pWindow);
 
-	//const auto pScene = new Scene_W1();
-	//const auto pScene = new Scene_W2();
-	//const auto pScene = new Scene_W3_TestScene();
-	//const auto pScene = new Scene_W3();
-	//const auto pScene = new Scene_W4_TestScene();
-	const auto pScene = new Scene_W4_ReferenceScene();
-	//const auto pScene = new Scene_W4_BunnyScene();
+	//--numa [nodes] renders on pinned workers per NUMA node, --replicate gives every node its own copy of the meshes
+	Numa::Settings numaSettings{};
+	const char* pSceneFilename = nullptr;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (std::strcmp(args[i], "--numa") == 0)
+		{
+			const bool hasCount{ i + 1 < argc && std::isdigit(static_cast<unsigned char>(args[i + 1][0])) };
+			numaSettings.nrNodes = hasCount ? static_cast<uint32_t>(std::strtoul(args[++i], nullptr, 10)) : static_cast<uint32_t>(Numa::GetNodes().size());
+		}
+		else if (std::strcmp(args[i], "--replicate") == 0)
+			numaSettings.isReplicated = true;
+		else if (!pSceneFilename)
+			pSceneFilename = args[i];
+	}
+	if (numaSettings.nrNodes > 0)
+		pRenderer->SetNuma(numaSettings);
+
+	//A scene file on the command line (e.g. Resources/Scenes/bunny.json) replaces the compiled in scene
+	Scene* pScene = nullptr;
+	if (pSceneFilename)
+	{
+		pScene = new Scene_File(pSceneFilename);
+	}
+	else
+	{
+		//pScene = new Scene_W1();
+		//pScene = new Scene_W2();
+		//pScene = new Scene_W3_TestScene();
+		//pScene = new Scene_W3();
+		//pScene = new Scene_W4_TestScene();
+		pScene = new Scene_W4_ReferenceScene();
+		//pScene = new Scene_W4_BunnyScene();
+		//pScene = new Scene_W4_OutOfCoreBunnyScene();
+	}
 	pScene->Initialize();
 
 	//Start loop
+	Profiler::SetThreadName("Main");
+	uint32_t nrProfilerCaptures = 0;
 	pTimer->Start();
 	float printTimer = 0.f;
 	bool isLooping = true;
-	bool takeScreenshot = false;
 	while (isLooping)
 	{
 		//--------- Get input events ---------
@@ -71,19 +136,47 @@ int main(int argc, char* args[])
 				break;
 			case SDL_KEYUP:
 				if(e.key.keysym.scancode == SDL_SCANCODE_X)
-					takeScreenshot = true;
+					pRenderer->RequestScreenshot();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F1)
+					pRenderer->ToggleShadowRaySorting();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F2)
 					pRenderer->ToggleShadows();
 				if (e.key.keysym.scancode == SDL_SCANCODE_F3)
 					pRenderer->CycleLightingMode();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F4)
+					pRenderer->CycleToneMapper();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F5)
+					pRenderer->ToggleSRGB();
+				if (e.key.keysym.scancode == SDL_SCANCODE_KP_PLUS)
+					pRenderer->ChangeExposure(.5f);
+				if (e.key.keysym.scancode == SDL_SCANCODE_KP_MINUS)
+					pRenderer->ChangeExposure(-.5f);
 				if (e.key.keysym.scancode == SDL_SCANCODE_F6)
 					pTimer->StartBenchmark();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F7)
+					pRenderer->CycleImageFormat();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F8)
+					pRenderer->ToggleSaveEveryFrame();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F9)
+					pRenderer->TogglePipelining();
+				if (e.key.keysym.scancode == SDL_SCANCODE_F10)
+				{
+					if (Profiler::IsCapturing())
+						Profiler::StopCapture("Profile_" + std::to_string(nrProfilerCaptures++) + ".json");
+					else
+						Profiler::StartCapture();
+				}
+				if (e.key.keysym.scancode == SDL_SCANCODE_F11)
+					pRenderer->ToggleAdaptiveTiles();
 				break;
 			}
 		}
 
 		//--------- Update ---------
-		pScene->Update(pTimer);
+		{
+			PROFILE_ZONE("Scene::Update");
+			pScene->Update(pTimer);
+		}
 
 		//--------- Render ---------
 		pRenderer->Render(pScene);
@@ -95,16 +188,8 @@ int main(int argc, char* args[])
 		{
 			printTimer = 0.f;
 			std::cout << "dFPS: " << pTimer->GetdFPS() << std::endl;
-		}
-
-		//Save screenshot after full render
-		if (takeScreenshot)
-		{
-			if (!pRenderer->SaveBufferToImage())
-				std::cout << "Screenshot saved!" << std::endl;
-			else
-				std::cout << "Something went wrong. Screenshot not saved!" << std::endl;
-			takeScreenshot = false;
+			if (TraversalStats::isEnabled)
+				PrintTraversalStats();
 		}
 	}
 	pTimer->Stop();